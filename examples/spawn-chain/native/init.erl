@@ -0,0 +1,29 @@
+%% The spawn chain benchmark, compiled natively
+%%
+%% This is the same chain as `Chain.create_processes/1` in the browser demo:
+%% each process waits for a number, and sends it on to the next process
+%% incremented by one, so the result is the length of the chain.
+-module(init).
+
+-export([start/0, counter/1]).
+
+-define(PROCESSES, 10000).
+
+start() ->
+    Last = create_processes(?PROCESSES, self()),
+    erlang:send(Last, 0),
+    receive
+        Result when is_integer(Result) ->
+            Result
+    end.
+
+create_processes(0, SendTo) ->
+    SendTo;
+create_processes(N, SendTo) ->
+    create_processes(N - 1, spawn(init, counter, [SendTo])).
+
+counter(NextPid) ->
+    receive
+        N ->
+            erlang:send(NextPid, N + 1)
+    end.
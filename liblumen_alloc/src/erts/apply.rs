@@ -2,25 +2,26 @@ use core::ffi::c_void;
 use core::mem;
 use core::slice;
 
-use hashbrown::HashMap;
+use alloc::boxed::Box;
+use alloc::vec::Vec;
 
 use once_cell::sync::OnceCell;
 
-use liblumen_arena::DroplessArena;
-use liblumen_core::symbols::FunctionSymbol;
+use liblumen_core::symbols::{FunctionSymbol, StaticSymbolTable};
 use liblumen_core::sys::dynamic_call::{self, DynamicCallee};
 
-use crate::erts::term::prelude::{Atom, Encoded, Term};
+use crate::erts::process::Process;
+use crate::erts::term::prelude::{Atom, Encode, Encoded, Term, TypedTerm};
 use crate::erts::ModuleFunctionArity;
 
-/// Dynamically invokes the function mapped to the given symbol.
+/// Dynamically invokes the function mapped to the given symbol in `process`.
 ///
 /// - The caller is responsible for making sure that the given symbol
 /// belongs to a function compiled into the executable.
 /// - The caller must ensure that the target function adheres to the ABI
 /// requirements of the destination function:
 ///   - C calling convention
-///   - Accepts only immediate-sized terms as arguments
+///   - Accepts the process it runs in, followed by immediate-sized terms as arguments
 ///   - Returns an immediate-sized term as a result
 ///
 /// This function returns `Err` if the called function returns the NONE value,
@@ -28,11 +29,16 @@ use crate::erts::ModuleFunctionArity;
 ///
 /// This function will panic if the symbol table has not been initialized.
 #[cfg(all(unix, target_arch = "x86_64"))]
-pub unsafe fn apply(symbol: &ModuleFunctionArity, args: &[Term]) -> Result<Term, ()> {
+pub unsafe fn apply(
+    process: &Process,
+    symbol: &ModuleFunctionArity,
+    args: &[Term],
+) -> Result<Term, ()> {
     if let Some(f) = find_symbol(symbol) {
-        let argv = args.as_ptr() as *const usize;
-        let argc = args.len();
-        let result = mem::transmute::<usize, Term>(dynamic_call::apply(f, argv, argc));
+        let process = process as *const Process as *const c_void;
+        let args = slice::from_raw_parts(args.as_ptr() as *const usize, args.len());
+        let result =
+            mem::transmute::<usize, Term>(dynamic_call::apply_with_process(f, process, args));
         if result.is_none() {
             Err(())
         } else {
@@ -43,122 +49,163 @@ pub unsafe fn apply(symbol: &ModuleFunctionArity, args: &[Term]) -> Result<Term,
     }
 }
 
+/// Returns the function bound to the given symbol, if it exists
+///
+/// This is a constant-time lookup in the static dispatch table, and does not allocate.
+///
+/// This function will panic if the symbol table has not been initialized.
 #[inline]
 pub fn find_symbol(mfa: &ModuleFunctionArity) -> Option<DynamicCallee> {
     let symbols = unsafe { SYMBOLS.get_unchecked() };
-    if let Some(f) = symbols.get_function(mfa) {
-        Some(unsafe { mem::transmute::<*const c_void, DynamicCallee>(f) })
-    } else {
-        None
+    symbols
+        .get(mfa.module.id(), mfa.function.id(), mfa.arity)
+        .map(|symbol| unsafe { mem::transmute::<*const c_void, DynamicCallee>(symbol.ptr) })
+}
+
+/// Returns the dispatch table of the given module, if it defines any functions
+///
+/// This is useful when many functions of the same module are called dynamically,
+/// as is the case for `apply/3` with a fixed module, as the module lookup is done once.
+///
+/// This function will panic if the symbol table has not been initialized.
+#[inline]
+pub fn find_module(module: Atom) -> Option<ModuleFunctions> {
+    let symbols = unsafe { SYMBOLS.get_unchecked() };
+    symbols
+        .get_module(module.id())
+        .map(|symbols| ModuleFunctions { module, symbols })
+}
+
+/// A resolved target of a dynamic call, as cached at dynamic call sites by compiled code
+///
+/// NOTE: The lowering of `eir.call.dynamic` relies on this layout
+#[repr(C)]
+pub struct CallTarget {
+    /// The encoded module atom
+    pub module: Term,
+    /// The encoded function atom
+    pub function: Term,
+    /// An opaque pointer to the function
+    pub callee: *const c_void,
+}
+
+// These are safe to implement because call targets are immutable, and refer to static data
+unsafe impl Sync for CallTarget {}
+unsafe impl Send for CallTarget {}
+
+/// The call target of each symbol in the symbol table, in the same order
+///
+/// This is built the first time a dynamic call site misses its cache, so that
+/// programs which make no dynamic calls do no work for it at startup.
+static CALL_TARGETS: OnceCell<Box<[CallTarget]>> = OnceCell::new();
+
+/// Resolves the target of a dynamic call, returning `None` if the function is undefined
+///
+/// The returned target is immutable and lives for the life of the program, so that it
+/// can be cached by the call site, see `__lumen_builtin_apply_resolve`.
+///
+/// This function will panic if the symbol table has not been initialized.
+pub fn resolve_call_target(module: Term, function: Term, arity: u8) -> Option<&'static CallTarget> {
+    let module = decode_atom(module)?;
+    let function = decode_atom(function)?;
+    let symbols = unsafe { SYMBOLS.get_unchecked() };
+    let index = symbols.get_index(module.id(), function.id(), arity)?;
+    let targets = CALL_TARGETS.get_or_init(|| {
+        symbols
+            .symbols()
+            .iter()
+            .map(|symbol| {
+                let mfa = to_mfa(symbol);
+                CallTarget {
+                    module: mfa.module.encode().unwrap(),
+                    function: mfa.function.encode().unwrap(),
+                    callee: symbol.ptr,
+                }
+            })
+            .collect::<Vec<_>>()
+            .into_boxed_slice()
+    });
+    Some(&targets[index])
+}
+
+#[inline]
+fn decode_atom(term: Term) -> Option<Atom> {
+    match term.decode() {
+        Ok(TypedTerm::Atom(atom)) => Some(atom),
+        _ => None,
     }
 }
 
 pub fn dump_symbols() {
     let symbols = unsafe { SYMBOLS.get_unchecked() };
-    symbols.dump();
+    for symbol in symbols.symbols() {
+        println!("{:?}", to_mfa(symbol));
+    }
 }
 
 /// The symbol table used by the runtime system
-static SYMBOLS: OnceCell<SymbolTable> = OnceCell::new();
+static SYMBOLS: OnceCell<&'static StaticSymbolTable> = OnceCell::new();
 
-/// Performs one-time initialization of the atom table at program start, using the
-/// array of constant atom values present in the compiled program.
+/// Performs one-time initialization of the symbol table at program start, using the
+/// dispatch table present in the compiled program.
+///
+/// The table is used in place, so this does not do any work proportional to the number
+/// of symbols.
 ///
 /// It is expected that this will be called by code generated by the compiler, during the
-/// earliest phase of startup, to ensure that nothing has tried to use the atom table yet.
+/// earliest phase of startup, to ensure that nothing has tried to use the symbol table yet.
 #[no_mangle]
-pub unsafe extern "C" fn InitializeLumenDispatchTable(
-    table: *const FunctionSymbol,
-    len: usize,
-) -> bool {
-    let len = len as usize;
-    if len == 0 {
-        return true;
-    }
+pub unsafe extern "C" fn InitializeLumenDispatchTable(table: *const StaticSymbolTable) -> bool {
     if table.is_null() {
         return false;
     }
-    let raw_table = slice::from_raw_parts::<'static>(table, len);
-    match SymbolTable::from_raw(raw_table) {
-        Err(err) => {
-            panic!("{}", err);
-        }
-        Ok(sym_table) => {
-            if let Err(_) = SYMBOLS.set(sym_table) {
-                panic!("tried to initialize symbol table more than once!");
-            } else {
-                true
-            }
-        }
+    if let Err(_) = SYMBOLS.set(&*table) {
+        panic!("tried to initialize symbol table more than once!");
+    } else {
+        true
     }
 }
 
-struct SymbolTable {
-    functions: HashMap<&'static ModuleFunctionArity, *const c_void>,
-    idents: HashMap<*const c_void, &'static ModuleFunctionArity>,
-    arena: DroplessArena,
+/// The functions of a single module in the dispatch table
+#[derive(Clone, Copy)]
+pub struct ModuleFunctions {
+    module: Atom,
+    // Sorted by (function, arity)
+    symbols: &'static [FunctionSymbol],
 }
-impl SymbolTable {
-    fn new(size: usize) -> Self {
-        Self {
-            functions: HashMap::with_capacity(size),
-            idents: HashMap::with_capacity(size),
-            arena: DroplessArena::default(),
-        }
+impl ModuleFunctions {
+    /// Returns the module these functions belong to
+    #[inline]
+    pub fn module(&self) -> Atom {
+        self.module
     }
 
-    fn dump(&self) {
-        for mfa in self.functions.keys() {
-            println!("{:?}", mfa);
-        }
-    }
-
-    /// Used to initialize the atom table from an array of null-terminated strings with static
-    /// lifetime, such as generated by codegen in order to initialize the atom table with
-    /// constant atom values in the compiled program. It is expected that this will be called
-    /// via `InitializeLumenAtomTable`
-    unsafe fn from_raw(raw_table: &'static [FunctionSymbol]) -> anyhow::Result<Self> {
-        let mut table = Self::new(raw_table.len());
-
-        for FunctionSymbol {
-            module,
-            function,
-            arity,
-            ptr,
-        } in raw_table.iter()
-        {
-            // This is safe because the underlying data is static
-            let module = Atom::from_id(*module);
-            let function = Atom::from_id(*function);
-            let callee = *ptr;
-            let size = mem::size_of::<ModuleFunctionArity>();
-            let ptr = table
-                .arena
-                .alloc_raw(size, mem::align_of::<ModuleFunctionArity>())
-                as *mut ModuleFunctionArity;
-            ptr.write(ModuleFunctionArity {
-                module,
-                function,
-                arity: *arity,
-            });
-            let sym = mem::transmute::<&ModuleFunctionArity, &'static ModuleFunctionArity>(&*ptr);
-            assert_eq!(None, table.idents.insert(callee, sym));
-            assert_eq!(None, table.functions.insert(sym, callee));
-        }
-
-        Ok(table)
+    /// Returns the function bound to the given function name and arity in this module
+    #[inline]
+    pub fn find_symbol(&self, function: Atom, arity: u8) -> Option<DynamicCallee> {
+        let key = (function.id(), arity);
+        self.symbols
+            .binary_search_by_key(&key, |symbol| (symbol.function, symbol.arity))
+            .ok()
+            .map(|index| unsafe {
+                mem::transmute::<*const c_void, DynamicCallee>(self.symbols[index].ptr)
+            })
     }
 
-    #[allow(unused)]
-    fn get_ident(&self, function: *const c_void) -> Option<&'static ModuleFunctionArity> {
-        self.idents.get(&function).copied()
+    /// Returns an iterator over the functions in this module
+    pub fn iter(&self) -> impl Iterator<Item = ModuleFunctionArity> {
+        self.symbols.iter().map(to_mfa)
     }
+}
 
-    fn get_function(&self, ident: &ModuleFunctionArity) -> Option<*const c_void> {
-        self.functions.get(ident).copied()
+#[inline]
+fn to_mfa(symbol: &FunctionSymbol) -> ModuleFunctionArity {
+    // This is safe because the symbol table only refers to atoms in the static atom table
+    unsafe {
+        ModuleFunctionArity {
+            module: Atom::from_id(symbol.module),
+            function: Atom::from_id(symbol.function),
+            arity: symbol.arity,
+        }
     }
 }
-
-// These are safe to implement because the items in the symbol table are static
-unsafe impl Sync for SymbolTable {}
-unsafe impl Send for SymbolTable {}
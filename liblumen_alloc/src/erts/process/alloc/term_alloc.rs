@@ -604,7 +604,7 @@ where
 }
 
 fn str_from_binary_bytes<'heap>(bytes: &'heap [u8]) -> Result<&'heap str, StrFromBinaryError> {
-    match core::str::from_utf8(bytes) {
+    match liblumen_core::util::bytes::to_str(bytes) {
         Ok(s) => Ok(unsafe { inherit_str_lifetime(s) }),
         Err(utf8_error) => Err(StrFromBinaryError::Utf8Error(utf8_error)),
     }
@@ -34,10 +34,6 @@ pub enum ProcessSignal {
 }
 
 extern "C" {
-    #[link_name = "__lumen_proc"]
-    #[thread_local]
-    static mut CURRENT_PROCESS: *mut ();
-
     #[link_name = "__lumen_proc_reductions"]
     #[thread_local]
     static mut PROCESS_REDUCTIONS: u32;
@@ -102,8 +98,7 @@ pub fn process_error() -> Option<Term> {
 
 /// Used to allocate memory on the process stack, rather than the native stack
 #[link_name = "__lumen_builtin_alloca"]
-extern "C" fn alloca(size: usize, align: usize) -> Option<*mut u8> {
-    let proc = unsafe { current_process() };
+extern "C" fn alloca(process: &Process, size: usize, align: usize) -> Option<*mut u8> {
     let layout = Layout::from_size_align(size, align).unwrap_or_else(|_| {
         abort_with_message!(
             "__lumen_builtin_alloca got invalid layout (size={}, align={})",
@@ -112,7 +107,8 @@ extern "C" fn alloca(size: usize, align: usize) -> Option<*mut u8> {
         )
     });
     unsafe {
-        proc.alloca_layout(layout)
+        process
+            .alloca_layout(layout)
             .ok()
             .map(|nn| nn.as_ptr() as *mut u8)
     }
@@ -127,8 +123,7 @@ extern "C" fn alloc_frame(_size: usize, _align: usize) -> Option<*mut u8> {
 
 /// Used to allocate space on the process heap directly from native code
 #[link_name = "__lumen_builtin_malloc"]
-extern "C" fn malloc(size: usize, align: usize) -> Option<*mut u8> {
-    let proc = unsafe { current_process() };
+extern "C" fn malloc(process: &Process, size: usize, align: usize) -> Option<*mut u8> {
     let layout = Layout::from_size_align(size, align).unwrap_or_else(|_| {
         abort_with_message!(
             "__lumen_builtin_alloca got invalid layout (size={}, align={})",
@@ -137,18 +132,9 @@ extern "C" fn malloc(size: usize, align: usize) -> Option<*mut u8> {
         )
     });
     unsafe {
-        proc.alloc_nofrag_layout(layout)
+        process
+            .alloc_nofrag_layout(layout)
             .ok()
             .map(|nn| nn.as_ptr() as *mut u8)
     }
 }
-
-#[inline]
-unsafe fn current_process<'a>() -> &'a Process {
-    let proc = CURRENT_PROCESS as *mut Process;
-    if proc.is_null() {
-        abort_with_message!("__lumen_builtin_alloca called with no process!");
-    } else {
-        &*proc
-    }
-}
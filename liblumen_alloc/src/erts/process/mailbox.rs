@@ -7,7 +7,8 @@ use crate::borrow::CloneToProcess;
 use crate::erts::exception::AllocResult;
 use crate::erts::message::{self, Message};
 use crate::erts::process::Process;
-use crate::erts::term::prelude::Term;
+use crate::erts::scheduler;
+use crate::erts::term::prelude::{ReferenceNumber, Term};
 
 #[derive(Debug)]
 pub struct Mailbox {
@@ -15,6 +16,25 @@ pub struct Mailbox {
     seen: isize,
 
     cursor: usize,
+    marker: Option<Marker>,
+    deadline: Option<u64>,
+    timer: Option<ReceiveTimer>,
+}
+
+/// The timer which wakes the process when the deadline of the current receive expires,
+/// numbered `reference` on the scheduler with `scheduler_id`
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct ReceiveTimer {
+    pub scheduler_id: scheduler::ID,
+    pub reference: ReferenceNumber,
+}
+
+/// The length of the mailbox when the reference numbered `reference` was made, as no
+/// message before that position can contain it
+#[derive(Clone, Copy, Debug)]
+struct Marker {
+    reference: ReferenceNumber,
+    position: usize,
 }
 
 impl Mailbox {
@@ -47,6 +67,79 @@ impl Mailbox {
     }
     // End receive implementation for the eir interpreter
 
+    // Start receive implementation for compiled code
+    //
+    // Compiled code drives the same cursor as the interpreter, but the scan and the
+    // matching of each message are inline, and a receive which matches on a freshly made
+    // reference can skip every message which was already in the mailbox when it was made.
+    /// Starts a receive scanning from the oldest message, which times out at `deadline`,
+    /// in monotonic milliseconds, if given
+    pub fn recv_start_with_deadline(&mut self, deadline: Option<u64>) {
+        self.cursor = 0;
+        self.deadline = deadline;
+    }
+    /// Saves the current end of the mailbox as the position a receive matching on the
+    /// reference numbered `reference` may start scanning from. Only the last reference
+    /// made is remembered.
+    pub fn recv_mark(&mut self, reference: ReferenceNumber) {
+        self.marker = Some(Marker {
+            reference,
+            position: self.len(),
+        });
+    }
+    /// Moves the cursor of the current receive to the position saved for `reference`, if
+    /// it is still the one remembered, otherwise it stays at the oldest message
+    pub fn recv_set(&mut self, reference: ReferenceNumber) {
+        match self.marker {
+            Some(Marker {
+                reference: marked,
+                position,
+            }) if marked == reference => self.cursor = position,
+            _ => (),
+        }
+    }
+    /// Returns `true` if there are messages after the cursor which have not been scanned
+    pub fn recv_pending(&self) -> bool {
+        self.cursor < self.len()
+    }
+    pub fn recv_deadline(&self) -> Option<u64> {
+        self.deadline
+    }
+    /// Records the timer started to wake the process at the deadline of the current
+    /// receive, so that it is only started once however often the process waits
+    pub fn recv_set_timer(&mut self, timer: ReceiveTimer) {
+        self.timer = Some(timer);
+    }
+    pub fn recv_has_timer(&self) -> bool {
+        self.timer.is_some()
+    }
+    /// Takes the timer of the receive, which is kept when it ends so that the runtime can
+    /// cancel it
+    pub fn recv_take_timer(&mut self) -> Option<ReceiveTimer> {
+        self.timer.take()
+    }
+    /// Removes the message last peeked from the queue, ending the receive.
+    ///
+    /// Unlike `recv_finish`, a heap fragment holding the message is left on the process's
+    /// off-heap list, as the terms bound by the match may point into it.
+    pub fn recv_remove(&mut self) {
+        let index = self.cursor - 1;
+        self.messages.remove(index).unwrap();
+
+        if (index as isize) <= self.seen {
+            self.seen -= 1;
+        }
+        self.shift_marker(index);
+
+        self.recv_end();
+    }
+    /// Ends the current receive without removing a message, i.e. when it times out
+    pub fn recv_end(&mut self) {
+        self.cursor = 0;
+        self.deadline = None;
+    }
+    // End receive implementation for compiled code
+
     pub fn flush<F>(&mut self, predicate: F, process: &Process) -> bool
     where
         F: Fn(&Message) -> bool,
@@ -78,6 +171,7 @@ impl Mailbox {
         match self.messages.pop_front() {
             option_message @ Some(_) => {
                 self.decrement_seen();
+                self.shift_marker(0);
 
                 option_message
             }
@@ -96,6 +190,7 @@ impl Mailbox {
         self.messages.pop_front().map(|message| match message {
             Message::Process(message::Process { data }) => {
                 self.decrement_seen();
+                self.shift_marker(0);
 
                 Ok(data)
             }
@@ -115,6 +210,7 @@ impl Mailbox {
                     }
 
                     self.decrement_seen();
+                    self.shift_marker(0);
 
                     Ok(heap_data)
                 }
@@ -148,6 +244,7 @@ impl Mailbox {
         if (index as isize) <= self.seen {
             self.seen -= 1;
         }
+        self.shift_marker(index);
     }
 
     pub fn seen(&self) -> isize {
@@ -165,6 +262,14 @@ impl Mailbox {
             self.seen -= 1;
         }
     }
+
+    fn shift_marker(&mut self, removed_index: usize) {
+        if let Some(marker) = self.marker.as_mut() {
+            if removed_index < marker.position {
+                marker.position -= 1;
+            }
+        }
+    }
 }
 
 impl Default for Mailbox {
@@ -173,6 +278,144 @@ impl Default for Mailbox {
             messages: Default::default(),
             seen: -1,
             cursor: 0,
+            marker: None,
+            deadline: None,
+            timer: None,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn recv_set_after_mark_skips_older_messages() {
+        let mut mailbox = mailbox(&[0, 1]);
+        mailbox.recv_mark(7);
+        mailbox.push(message(2));
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(2)));
+    }
+
+    #[test]
+    fn recv_set_after_another_mark_scans_from_oldest_message() {
+        let mut mailbox = mailbox(&[0]);
+        mailbox.recv_mark(7);
+        mailbox.recv_mark(8);
+        mailbox.push(message(1));
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(0)));
+    }
+
+    #[test]
+    fn removing_message_before_marker_shifts_it() {
+        let mut mailbox = mailbox(&[0, 1]);
+        mailbox.recv_mark(7);
+        mailbox.push(message(2));
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_increment();
+        mailbox.recv_remove();
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(2)));
+    }
+
+    #[test]
+    fn popping_message_before_marker_shifts_it() {
+        let mut mailbox = mailbox(&[0, 1]);
+        mailbox.recv_mark(7);
+        mailbox.push(message(2));
+
+        assert!(mailbox.pop().is_some());
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(2)));
+    }
+
+    #[test]
+    fn removing_message_after_marker_keeps_it() {
+        let mut mailbox = mailbox(&[0]);
+        mailbox.recv_mark(7);
+        mailbox.push(message(1));
+        mailbox.push(message(2));
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+        mailbox.recv_increment();
+        mailbox.recv_increment();
+        mailbox.recv_remove();
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_set(7);
+
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(1)));
+        mailbox.recv_increment();
+        assert!(!mailbox.recv_pending());
+    }
+
+    #[test]
+    fn recv_pending_once_message_pushed_after_scan() {
+        let mut mailbox = mailbox(&[0]);
+
+        mailbox.recv_start_with_deadline(None);
+        mailbox.recv_increment();
+        assert!(!mailbox.recv_pending());
+
+        mailbox.push(message(1));
+
+        assert!(mailbox.recv_pending());
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(1)));
+    }
+
+    #[test]
+    fn recv_end_at_expired_deadline_rescans_from_oldest_message() {
+        let mut mailbox = mailbox(&[0, 1]);
+        let timer = ReceiveTimer {
+            scheduler_id: scheduler::id::next(),
+            reference: 3,
+        };
+
+        mailbox.recv_start_with_deadline(Some(0));
+        mailbox.recv_set_timer(timer);
+        mailbox.recv_increment();
+        mailbox.recv_increment();
+        assert_eq!(mailbox.recv_deadline(), Some(0));
+
+        mailbox.recv_end();
+
+        assert_eq!(mailbox.recv_deadline(), None);
+        assert_eq!(mailbox.recv_peek(), Some(fixnum!(0)));
+        assert_eq!(mailbox.len(), 2);
+        // The timer is left for the runtime to cancel
+        assert_eq!(mailbox.recv_take_timer(), Some(timer));
+        assert!(!mailbox.recv_has_timer());
+    }
+
+    fn mailbox(values: &[isize]) -> Mailbox {
+        let mut mailbox = Mailbox::default();
+
+        for value in values {
+            mailbox.push(message(*value));
         }
+
+        mailbox
+    }
+
+    fn message(value: isize) -> Message {
+        Message::Process(message::Process {
+            data: fixnum!(value),
+        })
     }
 }
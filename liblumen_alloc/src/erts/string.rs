@@ -1,11 +1,12 @@
 use core::convert::{TryFrom, TryInto};
 use core::fmt;
-use core::str;
 
 use alloc::string::String;
 
 use thiserror::Error;
 
+use liblumen_core::util::bytes;
+
 use super::term::prelude::{Atom, Encoded, Term, TypedTerm};
 
 // The largest value as an integer of a latin-1 ASCII character
@@ -154,7 +155,7 @@ pub fn to_latin1_bytes(s: &str) -> Result<Vec<u8>, InvalidEncodingError> {
 ///
 /// Returns `Ok(str)` if successful, otherwise `Err(InvalidEncodingError)`
 pub fn as_utf8_str(bytes: &[u8]) -> Result<&str, InvalidEncodingError> {
-    str::from_utf8(bytes).map_err(|err| {
+    bytes::to_str(bytes).map_err(|err| {
         let index = err.valid_up_to();
         let code = bytes[index] as u16;
         InvalidEncodingError::new(code, index, Encoding::Utf8, Direction::ToString)
@@ -6,8 +6,7 @@ use core::mem;
 use core::ptr;
 use core::slice;
 use core::str::{self, Utf8Error};
-
-use std::os::raw::c_uint;
+use core::sync::atomic::{AtomicPtr, Ordering};
 
 use hashbrown::HashMap;
 use lazy_static::lazy_static;
@@ -15,7 +14,7 @@ use thiserror::Error;
 
 use liblumen_arena::DroplessArena;
 
-use liblumen_core::atoms::ConstantAtom;
+use liblumen_core::atoms::StaticAtomTable;
 use liblumen_core::locks::RwLock;
 
 use super::prelude::{Term, TypeError, TypedTerm};
@@ -27,38 +26,76 @@ pub const MAX_ATOMS: usize = super::arch::MAX_ATOM_ID - 1;
 pub const MAX_ATOM_LENGTH: usize = u16::max_value() as usize;
 
 lazy_static! {
-    /// The atom table used by the runtime system
+    /// The table of atoms created at runtime, i.e. those not present in `STATIC_ATOMS`
     static ref ATOMS: RwLock<AtomTable> = Default::default();
 }
 
+/// The atom table generated by the compiler, if the program was compiled with one
+///
+/// This table is immutable, so lookups in it require no locking.
+static STATIC_ATOMS: AtomicPtr<StaticAtomTable> = AtomicPtr::new(ptr::null_mut());
+
 /// Performs one-time initialization of the atom table at program start, using the
-/// array of constant atom values present in the compiled program.
+/// table of constant atom values present in the compiled program.
+///
+/// The table is used in place, so this does not do any work proportional to the number
+/// of atoms; atoms created after this point are stored in the overflow table.
 ///
 /// It is expected that this will be called by code generated by the compiler, during the
 /// earliest phase of startup, to ensure that nothing has tried to use the atom table yet.
 #[no_mangle]
-pub unsafe extern "C" fn InitializeLumenAtomTable(table: *const ConstantAtom, len: c_uint) -> bool {
-    let len = len as usize;
-    if len == 0 {
-        return true;
-    }
+pub unsafe extern "C" fn InitializeLumenAtomTable(table: *const StaticAtomTable) -> bool {
     if table.is_null() {
         return false;
     }
-    let raw_table = slice::from_raw_parts::<'static>(table, len);
-    let mut default_table = ATOMS.write();
-    if let Err(err) = default_table.from_raw(raw_table) {
+    let static_table = &*table;
+    if let Err(err) = AtomTable::validate_static(static_table) {
         panic!("{}", err);
-    } else {
-        true
     }
+    // The overflow table assigns ids starting after those of the static table,
+    // and no longer needs to contain the default atoms, as they are static now
+    ATOMS.write().reset(static_table.id_limit);
+    STATIC_ATOMS.store(table as *mut StaticAtomTable, Ordering::Release);
+    true
 }
 
 pub fn dump_atoms() {
+    if let Some(table) = static_atoms() {
+        for (id, name) in table.iter() {
+            let name = unsafe { str::from_utf8_unchecked(name) };
+            println!("atom(id = {}, value = '{}')", id, name);
+        }
+    }
     let table = ATOMS.read();
     table.dump();
 }
 
+#[inline]
+fn static_atoms() -> Option<&'static StaticAtomTable> {
+    let table = STATIC_ATOMS.load(Ordering::Acquire);
+    if table.is_null() {
+        None
+    } else {
+        Some(unsafe { &*table })
+    }
+}
+
+#[inline]
+fn get_static_id(name: &str) -> Option<usize> {
+    static_atoms().and_then(|table| table.get_id(name.as_bytes()))
+}
+
+#[inline]
+fn get_name(id: usize) -> Option<&'static str> {
+    if let Some(table) = static_atoms() {
+        if let Some(name) = table.get_name(id) {
+            // This is safe because the compiler only emits valid utf-8 strings
+            return Some(unsafe { str::from_utf8_unchecked(name) });
+        }
+    }
+    ATOMS.read().get_name(id)
+}
+
 /// An interned string, represented in memory as a integer ID.
 ///
 /// This struct is simply a transparent wrapper around the ID.
@@ -77,7 +114,7 @@ impl Atom {
     /// Returns the string representation of this atom
     #[inline]
     pub fn name(&self) -> &'static str {
-        ATOMS.read().get_name(self.0).unwrap()
+        get_name(self.0).unwrap()
     }
 
     /// Returns true if this atom is a boolean value
@@ -130,6 +167,9 @@ impl Atom {
     pub fn try_from_str<S: AsRef<str>>(s: S) -> Result<Self, AtomError> {
         let name = s.as_ref();
         Self::validate(name)?;
+        if let Some(id) = get_static_id(name) {
+            return Ok(Atom(id));
+        }
         if let Some(id) = ATOMS.read().get_id(name) {
             return Ok(Atom(id));
         }
@@ -144,6 +184,9 @@ impl Atom {
     pub fn try_from_str_existing<S: AsRef<str>>(s: S) -> Result<Self, AtomError> {
         let name = s.as_ref();
         Self::validate(name)?;
+        if let Some(id) = get_static_id(name) {
+            return Ok(Atom(id));
+        }
         if let Some(id) = ATOMS.read().get_id(name) {
             return Ok(Atom(id));
         }
@@ -212,7 +255,7 @@ impl Display for Atom {
 
 impl Debug for Atom {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        if let Some(name) = ATOMS.read().get_name(self.0) {
+        if let Some(name) = get_name(self.0) {
             f.write_str(":\"")?;
             name.chars()
                 .flat_map(char::escape_default)
@@ -302,37 +345,31 @@ impl AtomTable {
         table
     }
 
-    /// Used to initialize the atom table from an array of null-terminated strings with static
-    /// lifetime, such as generated by codegen in order to initialize the atom table with
-    /// constant atom values in the compiled program. It is expected that this will be called
-    /// via `InitializeLumenAtomTable`
-    unsafe fn from_raw(&mut self, raw_table: &'static [ConstantAtom]) -> anyhow::Result<()> {
-        use std::ffi::CStr;
-
-        let len = raw_table.len();
-
-        self.next_id = 0;
+    /// Clears this table, so that it only holds atoms created after the static atom
+    /// table was installed, whose ids start at `next_id`. It is expected that this
+    /// will be called via `InitializeLumenAtomTable`
+    fn reset(&mut self, next_id: usize) {
+        self.next_id = next_id;
         self.ids.clear();
         self.names.clear();
+    }
 
-        self.ids.reserve(len);
-        self.names.reserve(len);
-
-        for ConstantAtom { id, value } in raw_table.iter() {
-            let id = *id;
-            // Ensure the 'next_id' is always one higher than the highest id we've seen
-            if id >= self.next_id {
-                self.next_id = id + 1;
+    /// Checks that the static atom table generated by the compiler is consistent
+    /// with the assumptions made by the runtime
+    fn validate_static(table: &'static StaticAtomTable) -> anyhow::Result<()> {
+        if table.id_limit >= MAX_ATOMS {
+            anyhow::bail!(
+                "invalid atom table: contains ids up to {}, maximum is {}",
+                table.id_limit,
+                MAX_ATOMS
+            );
+        }
+        // See `Atom::is_boolean`
+        for (id, name) in Self::DEFAULT_ATOMS.iter().enumerate() {
+            if table.get_name(id) != Some(name.as_bytes()) {
+                anyhow::bail!("invalid atom table: expected '{}' to have id {}", name, id);
             }
-            // This is safe because the underlying data is static
-            let cs = CStr::from_ptr::<'static>(*value);
-            let name = cs.to_str().expect("invalid utf-8 in atom table!");
-            assert_eq!(None, self.names.insert(id, name));
-            assert_eq!(None, self.ids.insert(name, id));
         }
-
-        assert!(self.next_id < MAX_ATOMS);
-
         Ok(())
     }
 
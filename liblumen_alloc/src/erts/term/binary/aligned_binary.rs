@@ -5,6 +5,8 @@ use core::str;
 
 use anyhow::*;
 
+use liblumen_core::util::bytes;
+
 use crate::erts::term::prelude::Boxed;
 
 use super::prelude::{Binary, BinaryLiteral, HeapBin, IndexByte, MaybePartialByte, ProcBin};
@@ -98,7 +100,7 @@ macro_rules! impl_aligned_binary {
             /// > * Bitstrings are compared byte by byte, incomplete bytes are compared bit by bit.
             /// > -- https://hexdocs.pm/elixir/operators.html#term-ordering
             fn cmp(&self, other: &Self) -> core::cmp::Ordering {
-                self.as_bytes().cmp(other.as_bytes())
+                bytes::compare(self.as_bytes(), other.as_bytes())
             }
         }
 
@@ -116,7 +118,7 @@ macro_rules! impl_aligned_binary {
             /// > * Bitstrings are compared byte by byte, incomplete bytes are compared bit by bit.
             /// > -- https://hexdocs.pm/elixir/operators.html#term-ordering
             fn eq(&self, other: &$t) -> bool {
-                self.as_bytes().eq(other.as_bytes())
+                bytes::eq(self.as_bytes(), other.as_bytes())
             }
         }
 
@@ -126,7 +128,7 @@ macro_rules! impl_aligned_binary {
         {
             #[inline]
             default fn eq(&self, other: &T) -> bool {
-                self.as_bytes().eq(other.as_bytes())
+                bytes::eq(self.as_bytes(), other.as_bytes())
             }
         }
 
@@ -136,7 +138,7 @@ macro_rules! impl_aligned_binary {
         {
             #[inline]
             default fn partial_cmp(&self, other: &T) -> Option<core::cmp::Ordering> {
-                self.as_bytes().partial_cmp(other.as_bytes())
+                Some(bytes::compare(self.as_bytes(), other.as_bytes()))
             }
         }
 
@@ -144,7 +146,7 @@ macro_rules! impl_aligned_binary {
             type Error = anyhow::Error;
 
             fn try_into(self) -> Result<String, Self::Error> {
-                let s = str::from_utf8(self.as_bytes())
+                let s = bytes::to_str(self.as_bytes())
                     .with_context(|| format!("binary ({}) cannot be converted to String", self))?;
 
                 Ok(s.to_owned())
@@ -192,7 +194,7 @@ macro_rules! impl_aligned_try_into {
             type Error = anyhow::Error;
 
             fn try_into(self) -> Result<String, Self::Error> {
-                let s = str::from_utf8(self.as_bytes())
+                let s = bytes::to_str(self.as_bytes())
                     .with_context(|| format!("binary ({}) cannot be converted to String", self))?;
 
                 Ok(s.to_owned())
@@ -215,7 +217,7 @@ impl_aligned_try_into!(BinaryLiteral);
 
 /// Displays a binary using Erlang-style formatting
 pub(super) fn display(bytes: &[u8], f: &mut fmt::Formatter) -> fmt::Result {
-    match str::from_utf8(bytes) {
+    match bytes::to_str(bytes) {
         Ok(s) => write!(f, "\"{}\"", s.escape_default().to_string()),
         Err(_) => {
             f.write_str("<<")?;
@@ -242,7 +244,7 @@ macro_rules! partial_eq_aligned_binary_aligned_binary {
             /// > * Bitstrings are compared byte by byte, incomplete bytes are compared bit by bit.
             /// > -- https://hexdocs.pm/elixir/operators.html#term-ordering
             fn eq(&self, other: &$o) -> bool {
-                self.as_bytes().eq(other.as_bytes())
+                bytes::eq(self.as_bytes(), other.as_bytes())
             }
         }
     };
@@ -1,5 +1,7 @@
 use core::cmp;
 
+use liblumen_core::util::bytes;
+
 use super::prelude::*;
 use crate::erts::term::prelude::Boxed;
 
@@ -12,7 +14,7 @@ macro_rules! partial_eq_aligned_binary_maybe_aligned_maybe_binary {
             fn eq(&self, other: &$o) -> bool {
                 if self.is_binary() {
                     if self.is_aligned() {
-                        unsafe { self.as_bytes_unchecked() }.eq(other.as_bytes())
+                        bytes::eq(unsafe { self.as_bytes_unchecked() }, other.as_bytes())
                     } else {
                         self.full_byte_iter().eq(other.full_byte_iter())
                     }
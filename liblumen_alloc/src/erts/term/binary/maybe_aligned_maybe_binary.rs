@@ -1,7 +1,6 @@
 use core::convert::TryInto;
 use core::fmt::{self, Display};
 use core::hash::{Hash, Hasher};
-use core::str;
 
 use alloc::string::String;
 use alloc::vec::Vec;
@@ -9,6 +8,8 @@ use alloc::vec::Vec;
 use anyhow::*;
 use thiserror::Error;
 
+use liblumen_core::util::bytes;
+
 use crate::erts::term::prelude::Boxed;
 
 use super::aligned_binary;
@@ -105,13 +106,13 @@ macro_rules! partial_eq {
             fn eq(&self, other: &$o) -> bool {
                 if self.is_binary() && other.is_binary() {
                     if self.is_aligned() && other.is_aligned() {
-                        unsafe { self.as_bytes_unchecked().eq(other.as_bytes_unchecked()) }
+                        unsafe { bytes::eq(self.as_bytes_unchecked(), other.as_bytes_unchecked()) }
                     } else {
                         self.full_byte_iter().eq(other.full_byte_iter())
                     }
                 } else {
                     let bytes_equal = if self.is_aligned() && other.is_aligned() {
-                        unsafe { self.as_bytes_unchecked().eq(other.as_bytes_unchecked()) }
+                        unsafe { bytes::eq(self.as_bytes_unchecked(), other.as_bytes_unchecked()) }
                     } else {
                         self.full_byte_iter().eq(other.full_byte_iter())
                     };
@@ -144,13 +145,17 @@ macro_rules! ord {
             fn cmp(&self, other: &Self) -> core::cmp::Ordering {
                 if self.is_binary() && other.is_binary() {
                     if self.is_aligned() && other.is_aligned() {
-                        unsafe { self.as_bytes_unchecked().cmp(other.as_bytes_unchecked()) }
+                        unsafe {
+                            bytes::compare(self.as_bytes_unchecked(), other.as_bytes_unchecked())
+                        }
                     } else {
                         self.full_byte_iter().cmp(other.full_byte_iter())
                     }
                 } else {
                     let bytes_ordering = if self.is_aligned() && other.is_aligned() {
-                        unsafe { self.as_bytes_unchecked().cmp(other.as_bytes_unchecked()) }
+                        unsafe {
+                            bytes::compare(self.as_bytes_unchecked(), other.as_bytes_unchecked())
+                        }
                     } else {
                         self.full_byte_iter().cmp(other.full_byte_iter())
                     };
@@ -191,7 +196,7 @@ macro_rules! impl_maybe_aligned_try_into {
             fn try_into(self) -> Result<String, Self::Error> {
                 if self.is_binary() {
                     if self.is_aligned() {
-                        match str::from_utf8(unsafe { self.as_bytes_unchecked() }) {
+                        match bytes::to_str(unsafe { self.as_bytes_unchecked() }) {
                             Ok(s) => Ok(s.to_owned()),
                             Err(utf8_error) => Err(utf8_error.into()),
                         }
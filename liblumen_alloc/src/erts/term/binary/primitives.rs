@@ -1,4 +1,7 @@
 use core::ptr;
+use core::slice;
+
+use liblumen_core::util::bytes;
 
 /// Creates a mask which can be used to extract bits from a byte
 ///
@@ -196,11 +199,17 @@ pub unsafe fn copy_bits(
             src = src.offset(src_di);
         }
 
-        while count > 0 {
-            count -= 1;
-            ptr::write(dst, *src);
-            dst = dst.offset(dst_di);
-            src = src.offset(src_di);
+        if src_d == CopyDirection::Forward && dst_d == CopyDirection::Forward {
+            ptr::copy_nonoverlapping(src, dst, count);
+            dst = dst.add(count);
+            src = src.add(count);
+        } else {
+            while count > 0 {
+                count -= 1;
+                ptr::write(dst, *src);
+                dst = dst.offset(dst_di);
+                src = src.offset(src_di);
+            }
         }
 
         if rmask > 0 {
@@ -235,13 +244,23 @@ pub unsafe fn copy_bits(
             dst = dst.offset(dst_di);
         }
 
-        while count > 0 {
-            count -= 1;
-            src_bits1 = src_bits << lshift;
-            src_bits = *src;
-            src = src.offset(src_di);
-            ptr::write(dst, src_bits1 | (src_bits >> rshift));
-            dst = dst.offset(dst_di);
+        if src_d == CopyDirection::Forward && dst_d == CopyDirection::Forward {
+            // This is the bulk of the work for large bitstrings, so use the vectorized
+            // implementation, which is equivalent to the loop below
+            let src_bytes = slice::from_raw_parts(src, count);
+            let dst_bytes = slice::from_raw_parts_mut(dst, count);
+            src_bits = bytes::shift_copy(dst_bytes, src_bytes, src_bits, lshift as u32);
+            src = src.add(count);
+            dst = dst.add(count);
+        } else {
+            while count > 0 {
+                count -= 1;
+                src_bits1 = src_bits << lshift;
+                src_bits = *src;
+                src = src.offset(src_di);
+                ptr::write(dst, src_bits1 | (src_bits >> rshift));
+                dst = dst.offset(dst_di);
+            }
         }
 
         if rmask > 0 {
@@ -18,6 +18,8 @@ use crate::erts::{self, Arity, ModuleFunctionArity};
 
 use super::prelude::*;
 
+/// Closures are also constructed by compiled code, which relies on this layout, and those of
+/// `Definition` and `Creator`, being `repr(C)`, see `getClosureType` in `ConvertEIRToLLVM.cpp`
 #[repr(C)]
 pub struct Closure {
     header: Header<Closure>,
@@ -25,6 +27,9 @@ pub struct Closure {
     definition: Definition,
     arity: u8,
     /// Pointer to function entry.  When a closure is received over ETF, `code` may be `None`.
+    ///
+    /// For closures constructed by compiled code, this is not a `Code`, but the thunk which
+    /// `eir.call.indirect` calls with the process, the arguments, and the closure.
     code: Option<Code>,
     env: [Term],
 }
@@ -501,6 +506,7 @@ impl TryFrom<TypedTerm> for Boxed<Closure> {
 }
 
 #[derive(Clone)]
+#[repr(C, u32)]
 pub enum Creator {
     Local(Pid),
     External(ExternalPid),
@@ -528,8 +534,12 @@ impl From<ExternalPid> for Creator {
 }
 
 #[derive(Clone, Debug)]
+#[repr(C, u32)]
 pub enum Definition {
     /// External functions captured with `fun M:F/A` in Erlang or `&M.f/a` in Elixir.
+    ///
+    /// Funs constructed by compiled code are also exports, of the function they were lifted
+    /// into, as they have no index or unique.
     Export { function: Atom },
     /// Anonymous functions declared with `fun` in Erlang or `fn` in Elixir.
     Anonymous {
@@ -676,3 +686,90 @@ pub type OldUnique = u32;
 
 /// 16 byte MD5 of the significant parts of the BEAM file.
 pub type Unique = [u8; 16];
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use core::mem;
+
+    use crate::erts::term::arch::Repr;
+    use crate::erts::testing::RegionHeap;
+
+    /// The layout `getClosureType` in `ConvertEIRToLLVM.cpp` gives a closure over two terms
+    #[repr(C)]
+    struct CompiledClosure {
+        header: Header<Closure>,
+        module: Atom,
+        definition: CompiledDefinition,
+        arity: u8,
+        code: *const (),
+        env: [Term; 2],
+    }
+
+    /// A `Definition` is its tag followed by its largest variant, `Anonymous`
+    #[repr(C)]
+    struct CompiledDefinition {
+        tag: u32,
+        anonymous: CompiledAnonymous,
+    }
+
+    #[repr(C)]
+    struct CompiledAnonymous {
+        index: u32,
+        unique: [u8; 16],
+        old_unique: u32,
+        creator: CompiledCreator,
+    }
+
+    /// A `Creator` is its tag followed by its largest variant, an `ExternalPid`
+    #[repr(C)]
+    struct CompiledCreator {
+        tag: u32,
+        external_pid: [usize; 3],
+    }
+
+    extern "C" fn thunk() {}
+
+    #[test]
+    fn compiled_closure_decodes_as_closure() {
+        let mut heap = RegionHeap::default();
+        let module = Atom::from_str("compiled");
+        let function = Atom::from_str("outer-fun-0-2");
+        let env = [fixnum!(1), fixnum!(2)];
+
+        let layout = Layout::new::<CompiledClosure>();
+        assert_eq!(layout.size(), ClosureLayout::for_env(&env).layout.size());
+
+        // Written as compiled code writes it: an export definition is its tag, zero, and the
+        // function, which is stored in the first word following the tag
+        let ptr = unsafe {
+            let ptr = heap.alloc_layout(layout).unwrap().as_ptr() as *mut CompiledClosure;
+            ptr.write(CompiledClosure {
+                header: Header::from_arity(env.len()),
+                module,
+                definition: CompiledDefinition {
+                    tag: 0,
+                    anonymous: mem::zeroed(),
+                },
+                arity: 1,
+                code: thunk as *const (),
+                env,
+            });
+            let anonymous = &mut (*ptr).definition.anonymous as *mut CompiledAnonymous;
+            (anonymous as *mut Atom).write(function);
+            ptr
+        };
+
+        match Term::encode_box(ptr).decode().unwrap() {
+            TypedTerm::Closure(closure) => {
+                assert_eq!(closure.module(), module);
+                assert_eq!(closure.definition(), &Definition::Export { function });
+                assert_eq!(closure.arity(), 1);
+                assert_eq!(closure.code_address(), Some(thunk as usize));
+                assert_eq!(closure.env_slice(), &env[..]);
+            }
+            typed_term => panic!("{:?} is not a closure", typed_term),
+        }
+    }
+}
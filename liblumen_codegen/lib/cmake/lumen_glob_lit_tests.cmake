@@ -7,7 +7,7 @@ function(lumen_glob_lit_tests)
 
   lumen_package_name(_PACKAGE_NAME)
   file(GLOB_RECURSE _TEST_FILES *.mlir)
-  set(_TOOL_DEPS lumen_tool_lumen-opt LumenFileCheck)
+  set(_TOOL_DEPS lumen-opt lumen-translate LumenFileCheck)
 
   foreach(_TEST_FILE ${_TEST_FILES})
     get_filename_component(_TEST_FILE_LOCATION ${_TEST_FILE} DIRECTORY)
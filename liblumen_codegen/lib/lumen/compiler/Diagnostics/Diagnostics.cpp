@@ -9,6 +9,7 @@
 #include "lumen/compiler/Support/MLIR.h"
 #include "lumen/compiler/Support/RustString.h"
 #include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Location.h"
 
 using namespace lumen;
 
@@ -116,8 +117,16 @@ extern "C" void MLIRRegisterDiagnosticHandler(MLIRContextRef ctx, void *handler,
       });
 }
 
+extern "C" mlir::DiagnosticSeverity MLIRGetDiagnosticSeverity(
+    MLIRDiagnosticRef d) {
+  return unwrap(d)->getSeverity();
+}
+
 extern "C" void MLIRWriteDiagnosticInfoToString(MLIRDiagnosticRef d,
                                                 RustStringRef str) {
   RawRustStringOstream OS(str);
-  unwrap(d)->print(OS);
+  mlir::Diagnostic *diag = unwrap(d);
+  mlir::Location loc = diag->getLocation();
+  if (!loc.isa<mlir::UnknownLoc>()) OS << loc << ": ";
+  diag->print(OS);
 }
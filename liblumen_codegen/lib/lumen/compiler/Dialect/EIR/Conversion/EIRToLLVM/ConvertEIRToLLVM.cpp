@@ -1,9 +1,12 @@
 #include "lumen/compiler/Dialect/EIR/Conversion/EIRToLLVM/ConvertEIRToLLVM.h"
 
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Target/TargetMachine.h"
 #include "lumen/compiler/Dialect/EIR/IR/EIRAttributes.h"
 #include "lumen/compiler/Dialect/EIR/IR/EIROps.h"
 #include "lumen/compiler/Dialect/EIR/IR/EIRTypes.h"
+#include "lumen/compiler/Support/Statistics.h"
+#include "lumen/compiler/Target/DispatchCache.h"
 #include "lumen/compiler/Target/TargetInfo.h"
 #include "mlir/Conversion/StandardToLLVM/ConvertStandardToLLVM.h"
 #include "mlir/Conversion/StandardToLLVM/ConvertStandardToLLVMPass.h"
@@ -53,6 +56,10 @@ using llvm_inttoptr = ValueBuilder<LLVM::IntToPtrOp>;
 using llvm_sub = ValueBuilder<LLVM::SubOp>;
 using llvm_undef = ValueBuilder<LLVM::UndefOp>;
 using llvm_urem = ValueBuilder<LLVM::URemOp>;
+using llvm_ashr = ValueBuilder<LLVM::AShrOp>;
+using llvm_lshr = ValueBuilder<LLVM::LShrOp>;
+using llvm_sdiv = ValueBuilder<LLVM::SDivOp>;
+using llvm_srem = ValueBuilder<LLVM::SRemOp>;
 using llvm_alloca = ValueBuilder<LLVM::AllocaOp>;
 using llvm_return = OperationBuilder<LLVM::ReturnOp>;
 
@@ -139,7 +146,8 @@ static FlatSymbolRefAttr createOrInsertFunction(
   if (mod.lookupSymbol<LLVM::LLVMFuncOp>(symbol))
     return SymbolRefAttr::get(symbol, context);
 
-  // Create a function declaration for the symbol
+  // Create a function declaration for the symbol; if it is a runtime builtin,
+  // its attributes are added after translation to LLVM IR, see Builtins.h
   auto fnTy = LLVMType::getFunctionTy(resultType, argTypes, /*isVarArg=*/false);
 
   // Insert the function into the body of the parent module.
@@ -291,6 +299,29 @@ class EIROpConversion : public mlir::OpConversionPattern<Op> {
     return targetInfo.makeTupleType(dialect, elementTypes);
   }
 
+  // The layout of `Closure` in liblumen_alloc/src/erts/term/closure.rs:
+  //
+  //   { header, atom module, definition, i8 arity, i8* code, term env[] }
+  //
+  // The runtime types are `repr(C)`, so the layout follows from their fields.
+  // A `Definition` is its tag followed by its largest variant, `Anonymous`,
+  // which ends with a `Creator`, itself a tag followed by its largest variant,
+  // an `ExternalPid` of three words. Atoms are stored as their ids, untagged.
+  LLVMType getClosureType(unsigned envSize) const {
+    auto termTy = getUsizeType();
+    auto i8Ty = LLVMType::getInt8Ty(dialect);
+    auto i32Ty = getI32Type();
+    auto creatorTy = LLVMType::getStructTy(
+        dialect, {i32Ty, LLVMType::getArrayTy(termTy, 3)});
+    auto anonymousTy = LLVMType::getStructTy(
+        dialect, {i32Ty, LLVMType::getArrayTy(i8Ty, 16), i32Ty, creatorTy});
+    auto definitionTy = LLVMType::getStructTy(dialect, {i32Ty, anonymousTy});
+    return LLVMType::getStructTy(
+        dialect, {termTy, termTy, definitionTy, i8Ty,
+                  LLVMType::getInt8PtrTy(dialect),
+                  LLVMType::getArrayTy(termTy, envSize)});
+  }
+
   Type getIntegerType(OpBuilder &builder) const {
     return builder.getIntegerType(targetInfo.pointerSizeInBits);
   }
@@ -307,25 +338,76 @@ class EIROpConversion : public mlir::OpConversionPattern<Op> {
     return builder.getIntegerAttr(builder.getIntegerType(32), i);
   }
 
+  // The process context is passed to every Erlang function as an implicit
+  // first argument, an opaque pointer to the running process
+  LLVMType getProcessContextType() const {
+    return LLVMType::getInt8PtrTy(dialect);
+  }
+
+  // Returns the process context of the function containing `op`, or null if
+  // that function has not yet been given one
+  Value getProcessContext(Operation *op) const {
+    mlir::Region *body = nullptr;
+    if (auto func = op->getParentOfType<mlir::FuncOp>())
+      body = &func.getBody();
+    else if (auto func = op->getParentOfType<LLVM::LLVMFuncOp>())
+      body = &func.getBody();
+    if (!body || body->empty()) return nullptr;
+
+    Block &entry = body->front();
+    if (entry.getNumArguments() == 0 ||
+        entry.getArgument(0).getType() != getProcessContextType())
+      return nullptr;
+    return entry.getArgument(0);
+  }
+
+  // Shadows `Pattern::matchSuccess` so that successful rewrites are counted
+  // per operation when statistics are enabled
+  PatternMatchResult matchSuccess(
+      std::unique_ptr<mlir::PatternState> state = {}) const {
+    if (stats::isCountingEnabled())
+      stats::recordRewrite(Op::getOperationName());
+    return mlir::OpConversionPattern<Op>::matchSuccess(std::move(state));
+  }
+
   FlatSymbolRefAttr getOrInsertFunction(
       PatternRewriter &builder, ModuleOp mod, StringRef name, LLVMType retTy,
       ArrayRef<LLVMType> argTypes = {}) const {
+    // Calls into the runtime are counted, so that we can see which operations
+    // are not being lowered to inline code
+    if (stats::isCountingEnabled() && name.startswith("__lumen_"))
+      stats::recordRuntimeCall(Op::getOperationName(), name);
     return createOrInsertFunction(builder, mod, dialect, targetInfo, name,
                                   retTy, argTypes);
   }
 
   Value processAlloc(PatternRewriter &builder, edsc::ScopedContext &context,
-                     ModuleOp parentModule, Location loc, LLVMType ty,
-                     Value allocBytes) const {
+                     ModuleOp parentModule, Location loc, Value process,
+                     LLVMType ty, Value allocBytes) const {
     auto ptrTy = ty.getPointerTo();
     auto usizeTy = getUsizeType();
-    auto callee = getOrInsertFunction(
-        builder, parentModule, "__lumen_builtin_malloc", ptrTy, {usizeTy});
-    auto call = builder.create<mlir::CallOp>(loc, callee, ArrayRef<Type>{ptrTy},
-                                             ArrayRef<Value>{allocBytes});
+    auto callee = getOrInsertFunction(builder, parentModule,
+                                      "__lumen_builtin_malloc", ptrTy,
+                                      {getProcessContextType(), usizeTy});
+    auto call = builder.create<mlir::CallOp>(
+        loc, callee, ArrayRef<Type>{ptrTy},
+        ArrayRef<Value>{process, allocBytes});
     return call.getResult(0);
   }
 
+  // Returns the size of `ty` in bytes, as the address one past a null pointer
+  // to it, which LLVM folds to a constant for the target
+  Value sizeOf(OpBuilder &builder, LLVMType ty) const {
+    auto termTy = getUsizeType();
+    auto int32Ty = getI32Type();
+    auto ptrTy = ty.getPointerTo();
+    Value zero = llvm_constant(termTy, getIntegerAttr(builder, 0));
+    Value one = llvm_constant(int32Ty, getI32Attr(builder, 1));
+    Value end = llvm_gep(ptrTy, llvm_inttoptr(ptrTy, zero),
+                         ArrayRef<Value>({one}));
+    return llvm_ptrtoint(termTy, end);
+  }
+
   Value make_list(OpBuilder &builder, edsc::ScopedContext &context,
                   Value cons) const {
     return do_make_list(builder, context, typeConverter, targetInfo, cons);
@@ -346,6 +428,75 @@ class EIROpConversion : public mlir::OpConversionPattern<Op> {
     return do_unbox_list(builder, context, typeConverter, targetInfo, innerTy,
                          box);
   }
+
+  // Returns true if the given term is a fixnum
+  Value isFixnum(OpBuilder &builder, Value term) const {
+    auto termTy = getUsizeType();
+    Value fixnumMask = llvm_constant(
+        termTy, getIntegerAttr(builder, targetInfo.fixnumMask()));
+    Value fixnumTag =
+        llvm_constant(termTy, getIntegerAttr(builder, targetInfo.fixnumTag()));
+    return llvm_icmp(getI1Type(), LLVM::ICmpPredicate::eq,
+                     llvm_and(term, fixnumMask), fixnumTag);
+  }
+
+  // Returns the signed value of the given fixnum
+  Value untagFixnum(OpBuilder &builder, Value fixnum) const {
+    auto termTy = getUsizeType();
+    // With a shifted immediate, the tag is in the low bits, otherwise it is
+    // in the high bits, which must be shifted out to sign-extend the value
+    auto &immediateMask = targetInfo.immediateMask();
+    unsigned highBits = 0;
+    if (!immediateMask.requiresShift())
+      highBits = targetInfo.pointerSizeInBits -
+                 llvm::countPopulation(immediateMask.mask);
+    Value value = fixnum;
+    if (highBits > 0) {
+      Value highShift =
+          llvm_constant(termTy, getIntegerAttr(builder, highBits));
+      value = llvm_shl(value, highShift);
+    }
+    Value lowShift = llvm_constant(
+        termTy, getIntegerAttr(builder, highBits + immediateMask.shift));
+    return llvm_ashr(value, lowShift);
+  }
+
+  // Returns the fixnum for the given value, which must be in range
+  Value tagFixnum(OpBuilder &builder, Value value) const {
+    auto termTy = getUsizeType();
+    auto &immediateMask = targetInfo.immediateMask();
+    Value fixnumTag =
+        llvm_constant(termTy, getIntegerAttr(builder, targetInfo.fixnumTag()));
+    if (immediateMask.requiresShift()) {
+      Value shift =
+          llvm_constant(termTy, getIntegerAttr(builder, immediateMask.shift));
+      return llvm_or(llvm_shl(value, shift), fixnumTag);
+    }
+    Value valueMask =
+        llvm_constant(termTy, getIntegerAttr(builder, immediateMask.mask));
+    return llvm_or(llvm_and(value, valueMask), fixnumTag);
+  }
+
+  // Marks the given condition as likely, so that the slow path is laid out
+  // away from the fast path
+  Value expectTrue(PatternRewriter &builder, ModuleOp parentModule,
+                   Location loc, Value cond) const {
+    return expect(builder, parentModule, loc, cond, true);
+  }
+
+  // Marks the given condition as likely to have the value `expected`
+  Value expect(PatternRewriter &builder, ModuleOp parentModule, Location loc,
+               Value cond, bool expected) const {
+    auto i1Ty = getI1Type();
+    auto callee = getOrInsertFunction(builder, parentModule, "llvm.expect.i1",
+                                      i1Ty, {i1Ty, i1Ty});
+    Value expectedConst = llvm_constant(
+        i1Ty, builder.getIntegerAttr(builder.getIntegerType(1), expected));
+    auto callOp =
+        builder.create<mlir::CallOp>(loc, callee, ArrayRef<Type>{i1Ty},
+                                     ArrayRef<Value>({cond, expectedConst}));
+    return callOp.getResult(0);
+  }
 };
 
 struct TraceConstructOpConversion : public EIROpConversion<TraceConstructOp> {
@@ -458,6 +609,21 @@ struct IsTypeOpConversion : public EIROpConversion<IsTypeOp> {
     auto isType = rewriter.create<mlir::CallOp>(
         op.getLoc(), callee, int1Ty,
         ArrayRef<Value>{matchConst, adaptor.value()});
+
+    // Numbers other than fixnums may be boxed, i.e. bigints, and floats on
+    // targets which don't use nanboxing, so those are checked for too
+    if (matchType.isNumber() && !matchType.isa<FixnumType>()) {
+      auto boxedCallee = getOrInsertFunction(
+          rewriter, parentModule, "__lumen_builtin_is_boxed_type", int1Ty,
+          {int32Ty, termTy});
+      auto isBoxedType = rewriter.create<mlir::CallOp>(
+          op.getLoc(), boxedCallee, int1Ty,
+          ArrayRef<Value>{matchConst, adaptor.value()});
+      Value isNumber =
+          llvm_or(isType.getResult(0), isBoxedType.getResult(0));
+      rewriter.replaceOp(op, isNumber);
+      return matchSuccess();
+    }
     rewriter.replaceOp(op, isType.getResults());
 
     return matchSuccess();
@@ -480,6 +646,105 @@ struct YieldOpConversion : public EIROpConversion<YieldOp> {
   }
 };
 
+// The receive ops only move the cursor of the mailbox of the current process,
+// so each is lowered to a call to the corresponding builtin, which is given the
+// process context; the matching of each message is inline, see EIROps.td
+template <typename Op>
+class ReceiveOpConversion : public EIROpConversion<Op> {
+ public:
+  using EIROpConversion<Op>::EIROpConversion;
+
+ protected:
+  // Replaces `op` with a call to `builtin`, which returns `resultTy`, if any.
+  // Fails if the enclosing function has no process context
+  PatternMatchResult lowerToCall(Op op, ArrayRef<Value> operands,
+                                 ConversionPatternRewriter &rewriter,
+                                 StringRef builtin,
+                                 Optional<LLVMType> resultTy = {}) const {
+    Value process = this->getProcessContext(op);
+    if (!process) return this->matchFailure();
+
+    ModuleOp parentModule = op.template getParentOfType<ModuleOp>();
+    SmallVector<LLVMType, 2> argTypes{this->getProcessContextType()};
+    argTypes.append(operands.size(), this->getUsizeType());
+    SmallVector<Value, 2> args{process};
+    args.append(operands.begin(), operands.end());
+    auto retTy = resultTy ? *resultTy : LLVMType::getVoidTy(this->dialect);
+    auto callee = this->getOrInsertFunction(rewriter, parentModule, builtin,
+                                            retTy, argTypes);
+
+    SmallVector<Type, 1> resultTypes;
+    if (resultTy) resultTypes.push_back(*resultTy);
+    auto call = rewriter.create<mlir::CallOp>(op.getLoc(), callee,
+                                              resultTypes, args);
+    rewriter.replaceOp(op, call.getResults());
+    return this->matchSuccess();
+  }
+};
+
+struct ReceiveStartOpConversion : public ReceiveOpConversion<ReceiveStartOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceiveStartOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_start",
+                       getUsizeType());
+  }
+};
+
+struct ReceivePeekOpConversion : public ReceiveOpConversion<ReceivePeekOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceivePeekOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_peek",
+                       getUsizeType());
+  }
+};
+
+struct ReceiveWaitOpConversion : public ReceiveOpConversion<ReceiveWaitOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceiveWaitOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_wait",
+                       getI1Type());
+  }
+};
+
+struct ReceiveDoneOpConversion : public ReceiveOpConversion<ReceiveDoneOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceiveDoneOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_done");
+  }
+};
+
+struct ReceiveMarkOpConversion : public ReceiveOpConversion<ReceiveMarkOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceiveMarkOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_mark");
+  }
+};
+
+struct ReceiveSetOpConversion : public ReceiveOpConversion<ReceiveSetOp> {
+  using ReceiveOpConversion::ReceiveOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ReceiveSetOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_receive_set");
+  }
+};
+
 struct ReturnOpConversion : public EIROpConversion<ReturnOp> {
   using EIROpConversion::EIROpConversion;
 
@@ -561,7 +826,18 @@ struct CondBranchOpConversion : public EIROpConversion<eir::CondBranchOp> {
       }
     }
 
-    auto attrs = op.getAttrs();
+    // Branches to error handling carry the expected value of their condition,
+    // which is passed on to LLVM as branch weights
+    if (auto expected = op.getExpectedCondition()) {
+      ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+      finalCond =
+          expect(rewriter, parentModule, op.getLoc(), finalCond, *expected);
+    }
+
+    SmallVector<NamedAttribute, 1> attrs;
+    for (auto attr : op.getAttrs())
+      if (attr.first != eir::CondBranchOp::getExpectAttrName())
+        attrs.push_back(attr);
     ArrayRef<Block *> dests({trueDest, falseDest});
     ArrayRef<ValueRange> destsArgs({trueArgs, falseArgs});
     rewriter.replaceOpWithNewOp<LLVM::CondBrOp>(op, finalCond, dests, destsArgs,
@@ -580,6 +856,12 @@ struct CondBranchOpConversion : public EIROpConversion<eir::CondBranchOp> {
 //
 // TODO: Need to actually perform the above, right now we just handle
 // the translation to mlir::FuncOp
+//
+// Every Erlang function takes the process it runs in as an implicit first
+// argument, see `getProcessContext`. Passing it in a register, rather than
+// reading it from the scheduler's thread-local state, keeps it live in a
+// callee-saved register across calls, and remains correct when a process
+// resumes on a different scheduler thread after yielding.
 struct FuncOpConversion : public EIROpConversion<eir::FuncOp> {
   using EIROpConversion::EIROpConversion;
 
@@ -593,14 +875,23 @@ struct FuncOpConversion : public EIROpConversion<eir::FuncOp> {
         continue;
       }
     }
+    auto fnTy = op.getType();
+    mlir::TypeConverter::SignatureConversion signature(fnTy.getNumInputs());
+    signature.addInputs(getProcessContextType());
     SmallVector<NamedAttributeList, 4> argAttrs;
+    argAttrs.push_back(NamedAttributeList());
     for (unsigned i = 0, e = op.getNumArguments(); i < e; ++i) {
+      signature.addInputs(i, fnTy.getInput(i));
       auto aa = ::mlir::impl::getArgAttrs(op, i);
       argAttrs.push_back(NamedAttributeList(aa));
     }
+    auto newFnTy = rewriter.getFunctionType(signature.getConvertedTypes(),
+                                            fnTy.getResults());
     auto newFunc = rewriter.create<mlir::FuncOp>(op.getLoc(), op.getName(),
-                                                 op.getType(), attrs, argAttrs);
+                                                 newFnTy, attrs, argAttrs);
     rewriter.inlineRegionBefore(op.getBody(), newFunc.getBody(), newFunc.end());
+    if (!newFunc.getBody().empty())
+      rewriter.applySignatureConversion(&newFunc.getBody(), signature);
     rewriter.eraseOp(op);
     return matchSuccess();
   }
@@ -649,32 +940,205 @@ struct CallOpConversion : public EIROpConversion<CallOp> {
     CallOpOperandAdaptor adaptor(operands);
 
     ModuleOp parentModule = op.getParentOfType<ModuleOp>();
-    SmallVector<LLVMType, 2> argTypes;
-    for (auto operand : operands) {
+    Value process = getProcessContext(op);
+    if (!process) return matchFailure();
+
+    SmallVector<Value, 4> args;
+    SmallVector<LLVMType, 4> argTypes;
+    args.push_back(process);
+    argTypes.push_back(getProcessContextType());
+    for (auto operand : adaptor.operands()) {
+      args.push_back(operand);
       argTypes.push_back(operand.getType().cast<LLVMType>());
     }
-    auto opResultTypes = op.getResultTypes();
     SmallVector<Type, 2> resultTypes;
-    LLVMType resultType;
-    if (opResultTypes.size() == 1) {
-      resultType =
-          typeConverter.convertType(opResultTypes.front()).cast<LLVMType>();
+    SmallVector<LLVMType, 2> llvmResultTypes;
+    for (auto opResultType : op.getResultTypes()) {
+      auto resultType =
+          typeConverter.convertType(opResultType).dyn_cast_or_null<LLVMType>();
       if (!resultType) {
         return matchFailure();
       }
       resultTypes.push_back(resultType);
-    } else if (opResultTypes.size() > 1) {
-      return matchFailure();
+      llvmResultTypes.push_back(resultType);
+    }
+    // Multiple results are returned as a struct, as by the lowering of the
+    // standard dialect, see `createMultiValueReturnPass`
+    LLVMType resultType;
+    if (llvmResultTypes.size() == 1) {
+      resultType = llvmResultTypes.front();
+    } else if (llvmResultTypes.size() > 1) {
+      resultType = LLVMType::getStructTy(dialect, llvmResultTypes);
     }
 
     auto calleeName = op.getCallee();
     auto callee = getOrInsertFunction(rewriter, parentModule, calleeName,
                                       resultType, argTypes);
 
-    rewriter.replaceOpWithNewOp<mlir::CallOp>(op, callee, resultTypes,
-                                              adaptor.operands());
+    rewriter.replaceOpWithNewOp<mlir::CallOp>(op, callee, resultTypes, args);
+    return matchSuccess();
+  }
+};
+
+// Lowers a dynamic call to a call through a monomorphic inline cache.
+//
+// Each call site gets a private global which points to the call target it
+// last resolved, a `{ term module, term function, i8* callee }` entry owned by
+// the runtime. The entries are immutable, and the cache is a single pointer,
+// which every scheduler running the call site may read and update; the load is
+// made an acquire load, and the store a release store, once translated to LLVM
+// IR, see `addDispatchCacheOrdering`, so a thread which sees a new target also
+// sees its fields:
+//
+//   %target = load atomic acquire @cache
+//   if %target != null && %target.module == module && %target.function == fun:
+//     %result = %target.callee(process, args...)
+//   else:
+//     %target = __lumen_builtin_apply_resolve(process, module, fun, arity)
+//     if %target == null: %result = NONE  (the resolver raised undef)
+//     else:
+//       store atomic release %target, @cache
+//       %result = %target.callee(process, args...)
+struct DynamicCallOpConversion : public EIROpConversion<DynamicCallOp> {
+  using EIROpConversion::EIROpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      DynamicCallOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    DynamicCallOpOperandAdaptor adaptor(operands);
+
+    auto loc = op.getLoc();
+    ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+    auto termTy = getUsizeType();
+    auto i1Ty = getI1Type();
+    auto i8PtrTy = LLVMType::getInt8PtrTy(dialect);
+    auto arity = op.getArity();
+
+    Value module = adaptor.module();
+    Value function = adaptor.function();
+    SmallVector<Value, 4> args(adaptor.args().begin(), adaptor.args().end());
+    Value process = getProcessContext(op);
+    if (!process) return matchFailure();
+
+    SmallVector<LLVMType, 4> argTypes(arity, termTy);
+    argTypes.insert(argTypes.begin(), getProcessContextType());
+    auto calleeTy =
+        LLVMType::getFunctionTy(termTy, argTypes, /*isVarArg=*/false);
+    auto targetTy = LLVMType::createStructTy(
+        dialect, {termTy, termTy, i8PtrTy}, llvm::None);
+    auto targetPtrTy = targetTy.getPointerTo();
+
+    auto resolve = getOrInsertFunction(
+        rewriter, parentModule, "__lumen_builtin_apply_resolve", targetPtrTy,
+        {getProcessContextType(), termTy, termTy, termTy});
+    auto cache = getOrInsertCache(rewriter, parentModule, loc, targetPtrTy);
+
+    Value zero = llvm_constant(termTy, getIntegerAttr(rewriter, 0));
+    Value one = llvm_constant(getI32Type(), getI32Attr(rewriter, 1));
+    Value i32Zero = llvm_constant(getI32Type(), getI32Attr(rewriter, 0));
+    Value noneVal = llvm_constant(
+        termTy, getIntegerAttr(rewriter, targetInfo.getNoneValue()));
+
+    // Split the block at the call, the continuation receives the result
+    Block *currentBlock = rewriter.getInsertionBlock();
+    Block *contBlock =
+        rewriter.splitBlock(currentBlock, rewriter.getInsertionPoint());
+    Value result = contBlock->addArgument(termTy);
+
+    Block *checkBlock = rewriter.createBlock(contBlock);
+    Block *missBlock = rewriter.createBlock(contBlock);
+    Block *storeBlock = rewriter.createBlock(contBlock);
+    Block *callBlock = rewriter.createBlock(contBlock, {targetPtrTy});
+
+    // Load the cached target, if any
+    rewriter.setInsertionPointToEnd(currentBlock);
+    Value cachePtr = llvm_addressof(cache);
+    Value cached = llvm_load(cachePtr);
+    Value isEmpty = llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq,
+                              llvm_ptrtoint(termTy, cached), zero);
+    rewriter.create<LLVM::CondBrOp>(
+        loc, isEmpty, ArrayRef<Block *>({missBlock, checkBlock}),
+        ArrayRef<ValueRange>({ValueRange(), ValueRange()}));
+
+    // Check that the cached target is the one being called
+    rewriter.setInsertionPointToEnd(checkBlock);
+    Value cachedModule =
+        llvm_load(llvm_gep(termTy.getPointerTo(), cached,
+                           ArrayRef<Value>({i32Zero, i32Zero})));
+    Value cachedFunction = llvm_load(llvm_gep(
+        termTy.getPointerTo(), cached, ArrayRef<Value>({i32Zero, one})));
+    Value isHit = llvm_and(
+        llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq, cachedModule, module),
+        llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq, cachedFunction, function));
+    rewriter.create<LLVM::CondBrOp>(
+        loc, isHit, ArrayRef<Block *>({callBlock, missBlock}),
+        ArrayRef<ValueRange>({ValueRange(cached), ValueRange()}));
+
+    // Resolve the target via the dispatch table
+    rewriter.setInsertionPointToEnd(missBlock);
+    Value arityConst = llvm_constant(termTy, getIntegerAttr(rewriter, arity));
+    auto resolveOp = rewriter.create<mlir::CallOp>(
+        loc, resolve, ArrayRef<Type>{targetPtrTy},
+        ArrayRef<Value>({process, module, function, arityConst}));
+    Value resolved = resolveOp.getResult(0);
+    Value isUndef = llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq,
+                              llvm_ptrtoint(termTy, resolved), zero);
+    rewriter.create<LLVM::CondBrOp>(
+        loc, isUndef, ArrayRef<Block *>({contBlock, storeBlock}),
+        ArrayRef<ValueRange>({ValueRange(noneVal), ValueRange()}));
+
+    rewriter.setInsertionPointToEnd(storeBlock);
+    llvm_store(resolved, cachePtr);
+    rewriter.create<LLVM::BrOp>(loc, ArrayRef<Value>(),
+                                ArrayRef<Block *>(callBlock),
+                                ArrayRef<ValueRange>(ValueRange(resolved)));
+
+    // Call the target
+    rewriter.setInsertionPointToEnd(callBlock);
+    Value target = callBlock->getArgument(0);
+    Value two = llvm_constant(getI32Type(), getI32Attr(rewriter, 2));
+    Value calleePtr = llvm_load(llvm_gep(i8PtrTy.getPointerTo(), target,
+                                         ArrayRef<Value>({i32Zero, two})));
+    Value callee = llvm_bitcast(calleeTy.getPointerTo(), calleePtr);
+    SmallVector<Value, 5> callOperands;
+    callOperands.push_back(callee);
+    callOperands.push_back(process);
+    callOperands.append(args.begin(), args.end());
+    auto callOp = rewriter.create<LLVM::CallOp>(
+        loc, ArrayRef<Type>{termTy}, callOperands, ArrayRef<NamedAttribute>{});
+    rewriter.create<LLVM::BrOp>(
+        loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+        ArrayRef<ValueRange>(ValueRange(callOp.getResult(0))));
+
+    rewriter.replaceOp(op, {result});
     return matchSuccess();
   }
+
+ private:
+  // Creates the cache global for a call site, initialized to null
+  LLVM::GlobalOp getOrInsertCache(PatternRewriter &rewriter, ModuleOp mod,
+                                  Location loc, LLVMType targetPtrTy) const {
+    std::string name;
+    for (unsigned i = 0;; i++) {
+      name = (llvm::Twine(dispatchCachePrefix) + llvm::Twine(i)).str();
+      if (!mod.lookupSymbol(name)) break;
+    }
+
+    PatternRewriter::InsertionGuard insertGuard(rewriter);
+    rewriter.setInsertionPointToStart(mod.getBody());
+    auto global = rewriter.create<LLVM::GlobalOp>(
+        loc, targetPtrTy, /*isConstant=*/false, LLVM::Linkage::Internal, name,
+        Attribute());
+    auto &initRegion = global.getInitializerRegion();
+    rewriter.createBlock(&initRegion);
+    auto termTy = getUsizeType();
+    Value zero = rewriter.create<LLVM::ConstantOp>(
+        loc, termTy, getIntegerAttr(rewriter, 0));
+    Value null = rewriter.create<LLVM::IntToPtrOp>(loc, targetPtrTy, zero);
+    rewriter.create<LLVM::ReturnOp>(loc, null);
+    return global;
+  }
 };
 
 struct CmpEqOpConversion : public EIROpConversion<CmpEqOp> {
@@ -689,9 +1153,11 @@ struct CmpEqOpConversion : public EIROpConversion<CmpEqOp> {
     ModuleOp parentModule = op.getParentOfType<ModuleOp>();
     auto termTy = getUsizeType();
     auto int1ty = getI1Type();
-    auto callee =
-        getOrInsertFunction(rewriter, parentModule, "__lumen_builtin_cmpeq",
-                            int1ty, {termTy, termTy});
+    // Use the variant specialised for the target CPU, if there is one
+    auto suffix = targetInfo.getBuiltinSuffix();
+    auto symbol = ("__lumen_builtin_cmpeq" + suffix).str();
+    auto callee = getOrInsertFunction(rewriter, parentModule, symbol, int1ty,
+                                      {termTy, termTy});
 
     auto lhs = adaptor.lhs();
     auto rhs = adaptor.rhs();
@@ -705,6 +1171,796 @@ struct CmpEqOpConversion : public EIROpConversion<CmpEqOp> {
   }
 };
 
+struct CmpNeqOpConversion : public EIROpConversion<CmpNeqOp> {
+  using EIROpConversion::EIROpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      CmpNeqOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    CmpNeqOpOperandAdaptor adaptor(operands);
+
+    ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+    auto termTy = getUsizeType();
+    auto int1ty = getI1Type();
+    // This is the negation of equality, see CmpEqOpConversion
+    auto suffix = targetInfo.getBuiltinSuffix();
+    auto symbol = ("__lumen_builtin_cmpeq" + suffix).str();
+    auto callee = getOrInsertFunction(rewriter, parentModule, symbol, int1ty,
+                                      {termTy, termTy});
+
+    ArrayRef<Value> args({adaptor.lhs(), adaptor.rhs()});
+    auto callOp = rewriter.create<mlir::CallOp>(op.getLoc(), callee,
+                                                ArrayRef<Type>{int1ty}, args);
+    Value one = llvm_constant(
+        int1ty, rewriter.getIntegerAttr(rewriter.getIntegerType(1), 1));
+    Value result = llvm_xor(callOp.getResult(0), one);
+
+    rewriter.replaceOp(op, result);
+    return matchSuccess();
+  }
+};
+
+// Arithmetic operations are lowered inline when all of their operands are
+// fixnums, and their result fits in a fixnum. For example, addition becomes:
+//
+//   %fast = is_fixnum(%lhs) && is_fixnum(%rhs)
+//   cond_br llvm.expect(%fast, true), ^fast, ^slow
+// ^fast:
+//   %sum, %overflow = llvm.sadd.with.overflow(untag(%lhs), untag(%rhs))
+//   %ok = !%overflow && MIN_FIXNUM <= %sum && %sum <= MAX_FIXNUM
+//   cond_br llvm.expect(%ok, true), ^cont(tag(%sum)), ^slow
+// ^slow:
+//   %result = __lumen_builtin_math.add(%process, %lhs, %rhs)
+//   br ^cont(%result)
+//
+// The builtins handle bigints and floats, promote results which don't fit in
+// a fixnum to bigints, and raise badarith, in which case the result is NONE.
+//
+// Bitwise operations of fixnums always produce fixnums, and are performed on
+// the tagged values, as the tag bits of both operands are the same.
+template <typename Op>
+class ArithmeticOpConversion : public EIROpConversion<Op> {
+ public:
+  using EIROpConversion<Op>::EIROpConversion;
+
+ protected:
+  // Builds the fast path from the operands, returning the result, and setting
+  // `failed` if the slow path must be taken instead
+  using FastPathBuilder =
+      llvm::function_ref<Value(ArrayRef<Value> operands, Value &failed)>;
+
+  // Lowers an operation whose fast path operates on the untagged values of
+  // fixnum operands, producing an untagged result which is range checked
+  PatternMatchResult lowerArithmetic(Op op, ArrayRef<Value> operands,
+                                     ConversionPatternRewriter &rewriter,
+                                     StringRef builtin,
+                                     FastPathBuilder buildFastPath) const {
+    auto &targetInfo = this->targetInfo;
+    auto termTy = this->getUsizeType();
+    auto i1Ty = this->getI1Type();
+
+    auto buildUntagged = [&](ArrayRef<Value> tagged, Value &failed) {
+      SmallVector<Value, 2> untagged;
+      for (auto operand : tagged)
+        untagged.push_back(this->untagFixnum(rewriter, operand));
+
+      Value value = buildFastPath(untagged, failed);
+      Value minFixnum = llvm_constant(
+          termTy, this->getIntegerAttr(rewriter, targetInfo.minFixnum()));
+      Value maxFixnum = llvm_constant(
+          termTy, this->getIntegerAttr(rewriter, targetInfo.maxFixnum()));
+      Value outOfRange = llvm_or(
+          llvm_icmp(i1Ty, LLVM::ICmpPredicate::slt, value, minFixnum),
+          llvm_icmp(i1Ty, LLVM::ICmpPredicate::sgt, value, maxFixnum));
+      if (failed)
+        failed = llvm_or(failed, outOfRange);
+      else
+        failed = outOfRange;
+
+      return this->tagFixnum(rewriter, value);
+    };
+
+    return lowerWithFastPath(op, operands, rewriter, builtin, buildUntagged);
+  }
+
+  // Lowers an operation whose fast path operates on fixnum operands directly,
+  // i.e. without untagging them, producing a tagged result. If the fast path
+  // does not set `failed`, it is taken whenever the operands are fixnums.
+  // Fails if the enclosing function has no process context, which the builtin
+  // allocates its result on, and stores the exception it raises on
+  PatternMatchResult lowerWithFastPath(Op op, ArrayRef<Value> operands,
+                                       ConversionPatternRewriter &rewriter,
+                                       StringRef builtin,
+                                       FastPathBuilder buildFastPath) const {
+    Value process = this->getProcessContext(op);
+    if (!process) return this->matchFailure();
+
+    edsc::ScopedContext context(rewriter, op.getLoc());
+
+    auto loc = op.getLoc();
+    ModuleOp parentModule = op.template getParentOfType<ModuleOp>();
+    auto termTy = this->getUsizeType();
+    auto i1Ty = this->getI1Type();
+
+    SmallVector<LLVMType, 3> argTypes{this->getProcessContextType()};
+    argTypes.append(operands.size(), termTy);
+    auto callee = this->getOrInsertFunction(rewriter, parentModule, builtin,
+                                            termTy, argTypes);
+
+    // Split the block at the operation, the continuation receives the result
+    Block *currentBlock = rewriter.getInsertionBlock();
+    Block *contBlock =
+        rewriter.splitBlock(currentBlock, rewriter.getInsertionPoint());
+    Value result = contBlock->addArgument(termTy);
+
+    Block *fastBlock = rewriter.createBlock(contBlock);
+    Block *slowBlock = rewriter.createBlock(contBlock);
+
+    // Check that all of the operands are fixnums
+    rewriter.setInsertionPointToEnd(currentBlock);
+    Value isFast;
+    for (auto operand : operands) {
+      Value isFixnum = this->isFixnum(rewriter, operand);
+      if (isFast)
+        isFast = llvm_and(isFast, isFixnum);
+      else
+        isFast = isFixnum;
+    }
+    rewriter.create<LLVM::CondBrOp>(
+        loc, this->expectTrue(rewriter, parentModule, loc, isFast),
+        ArrayRef<Block *>({fastBlock, slowBlock}),
+        ArrayRef<ValueRange>({ValueRange(), ValueRange()}));
+
+    rewriter.setInsertionPointToEnd(fastBlock);
+    Value failed;
+    Value fastResult = buildFastPath(operands, failed);
+    if (failed) {
+      Value isOk = llvm_xor(
+          failed, llvm_constant(i1Ty, rewriter.getIntegerAttr(
+                                          rewriter.getIntegerType(1), 1)));
+      rewriter.create<LLVM::CondBrOp>(
+          loc, this->expectTrue(rewriter, parentModule, loc, isOk),
+          ArrayRef<Block *>({contBlock, slowBlock}),
+          ArrayRef<ValueRange>({ValueRange(fastResult), ValueRange()}));
+    } else {
+      rewriter.create<LLVM::BrOp>(
+          loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+          ArrayRef<ValueRange>(ValueRange(fastResult)));
+    }
+
+    // Call the runtime for everything else
+    rewriter.setInsertionPointToEnd(slowBlock);
+    SmallVector<Value, 3> args{process};
+    args.append(operands.begin(), operands.end());
+    auto callOp = rewriter.create<mlir::CallOp>(
+        loc, callee, ArrayRef<Type>{termTy}, args);
+    rewriter.create<LLVM::BrOp>(
+        loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+        ArrayRef<ValueRange>(ValueRange(callOp.getResult(0))));
+
+    rewriter.replaceOp(op, {result});
+    return this->matchSuccess();
+  }
+
+  // Calls `llvm.<name>.with.overflow`, returning the result, and setting
+  // `overflowed` to whether the operation overflowed
+  Value withOverflow(ConversionPatternRewriter &rewriter, Op op,
+                     StringRef name, Value lhs, Value rhs,
+                     Value &overflowed) const {
+    ModuleOp parentModule = op.template getParentOfType<ModuleOp>();
+    auto termTy = this->getUsizeType();
+    auto i1Ty = this->getI1Type();
+    auto resultTy = LLVMType::getStructTy(this->dialect, {termTy, i1Ty});
+    auto intrinsic = llvm::formatv("llvm.{0}.with.overflow.i{1}", name,
+                                   this->targetInfo.pointerSizeInBits)
+                         .str();
+    auto callee = this->getOrInsertFunction(rewriter, parentModule, intrinsic,
+                                            resultTy, {termTy, termTy});
+    auto callOp = rewriter.create<mlir::CallOp>(
+        op.getLoc(), callee, ArrayRef<Type>{resultTy},
+        ArrayRef<Value>({lhs, rhs}));
+    Value pair = callOp.getResult(0);
+    overflowed = llvm_extractvalue(i1Ty, pair, rewriter.getI64ArrayAttr(1));
+    return llvm_extractvalue(termTy, pair, rewriter.getI64ArrayAttr(0));
+  }
+
+  // Returns the divisor, or one if it is zero, in which case `failed` is set
+  Value nonZeroDivisor(ConversionPatternRewriter &rewriter, Value divisor,
+                       Value &failed) const {
+    auto termTy = this->getUsizeType();
+    Value zero = llvm_constant(termTy, this->getIntegerAttr(rewriter, 0));
+    Value one = llvm_constant(termTy, this->getIntegerAttr(rewriter, 1));
+    failed = llvm_icmp(this->getI1Type(), LLVM::ICmpPredicate::eq, divisor,
+                       zero);
+    return llvm_select(failed, one, divisor);
+  }
+};
+
+struct AddOpConversion : public ArithmeticOpConversion<AddOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      AddOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.add",
+        [&](ArrayRef<Value> args, Value &failed) {
+          return withOverflow(rewriter, op, "sadd", args[0], args[1],
+                              failed);
+        });
+  }
+};
+
+struct SubOpConversion : public ArithmeticOpConversion<SubOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      SubOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.sub",
+        [&](ArrayRef<Value> args, Value &failed) {
+          return withOverflow(rewriter, op, "ssub", args[0], args[1],
+                              failed);
+        });
+  }
+};
+
+struct MulOpConversion : public ArithmeticOpConversion<MulOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      MulOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.mul",
+        [&](ArrayRef<Value> args, Value &failed) {
+          return withOverflow(rewriter, op, "smul", args[0], args[1],
+                              failed);
+        });
+  }
+};
+
+// Division by zero takes the slow path, which raises. The divisor is replaced
+// so that the division itself never traps; it cannot overflow either, as the
+// quotient of the smallest fixnum and -1 still fits in a word.
+struct DivOpConversion : public ArithmeticOpConversion<DivOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      DivOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.div",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value divisor = nonZeroDivisor(rewriter, args[1], failed);
+          return llvm_sdiv(args[0], divisor);
+        });
+  }
+};
+
+struct RemOpConversion : public ArithmeticOpConversion<RemOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      RemOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.rem",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value divisor = nonZeroDivisor(rewriter, args[1], failed);
+          return llvm_srem(args[0], divisor);
+        });
+  }
+};
+
+struct NegOpConversion : public ArithmeticOpConversion<NegOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      NegOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    auto termTy = getUsizeType();
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.neg",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value zero = llvm_constant(termTy, getIntegerAttr(rewriter, 0));
+          return withOverflow(rewriter, op, "ssub", zero, args[0], failed);
+        });
+  }
+};
+
+struct BandOpConversion : public ArithmeticOpConversion<BandOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BandOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerWithFastPath(
+        op, operands, rewriter, "__lumen_builtin_math.band",
+        [&](ArrayRef<Value> args, Value &failed) {
+          return llvm_and(args[0], args[1]);
+        });
+  }
+};
+
+struct BorOpConversion : public ArithmeticOpConversion<BorOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BorOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerWithFastPath(
+        op, operands, rewriter, "__lumen_builtin_math.bor",
+        [&](ArrayRef<Value> args, Value &failed) {
+          return llvm_or(args[0], args[1]);
+        });
+  }
+};
+
+// The tags cancel each other out, so they are put back afterwards
+struct BxorOpConversion : public ArithmeticOpConversion<BxorOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BxorOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    auto termTy = getUsizeType();
+    return lowerWithFastPath(
+        op, operands, rewriter, "__lumen_builtin_math.bxor",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value fixnumTag = llvm_constant(
+              termTy, getIntegerAttr(rewriter, targetInfo.fixnumTag()));
+          return llvm_or(llvm_xor(args[0], args[1]), fixnumTag);
+        });
+  }
+};
+
+// Flips all of the bits, then flips the tag bits back
+struct BnotOpConversion : public ArithmeticOpConversion<BnotOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BnotOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    auto termTy = getUsizeType();
+    return lowerWithFastPath(
+        op, operands, rewriter, "__lumen_builtin_math.bnot",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value allOnes = llvm_constant(termTy, getIntegerAttr(rewriter, -1));
+          Value fixnumMask = llvm_constant(
+              termTy, getIntegerAttr(rewriter, targetInfo.fixnumMask()));
+          return llvm_xor(llvm_xor(args[0], allOnes), fixnumMask);
+        });
+  }
+};
+
+// Shifts by a negative amount, or by at least the width of a word, take the
+// slow path, as do shifts which overflow.
+struct BslOpConversion : public ArithmeticOpConversion<BslOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BslOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    auto termTy = getUsizeType();
+    auto i1Ty = getI1Type();
+    auto bits = targetInfo.pointerSizeInBits;
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.bsl",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value value = args[0];
+          Value zero = llvm_constant(termTy, getIntegerAttr(rewriter, 0));
+          Value width = llvm_constant(termTy, getIntegerAttr(rewriter, bits));
+          // Negative shifts are out of range when compared as unsigned
+          failed = llvm_icmp(i1Ty, LLVM::ICmpPredicate::uge, args[1], width);
+          Value shift = llvm_select(failed, zero, args[1]);
+          Value shifted = llvm_shl(value, shift);
+          Value overflowed = llvm_icmp(i1Ty, LLVM::ICmpPredicate::ne,
+                                       llvm_ashr(shifted, shift), value);
+          failed = llvm_or(failed, overflowed);
+          return shifted;
+        });
+  }
+};
+
+// Shifts by a negative amount take the slow path, shifts by at least the width
+// of a word produce either 0 or -1, depending on the sign of the value.
+struct BsrOpConversion : public ArithmeticOpConversion<BsrOp> {
+  using ArithmeticOpConversion::ArithmeticOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      BsrOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    auto termTy = getUsizeType();
+    auto i1Ty = getI1Type();
+    auto bits = targetInfo.pointerSizeInBits;
+    return lowerArithmetic(
+        op, operands, rewriter, "__lumen_builtin_math.bsr",
+        [&](ArrayRef<Value> args, Value &failed) {
+          Value zero = llvm_constant(termTy, getIntegerAttr(rewriter, 0));
+          Value maxShift =
+              llvm_constant(termTy, getIntegerAttr(rewriter, bits - 1));
+          failed = llvm_icmp(i1Ty, LLVM::ICmpPredicate::slt, args[1], zero);
+          Value isWide =
+              llvm_icmp(i1Ty, LLVM::ICmpPredicate::sgt, args[1], maxShift);
+          Value shift = llvm_select(isWide, maxShift, args[1]);
+          shift = llvm_select(failed, zero, shift);
+          return Value(llvm_ashr(args[0], shift));
+        });
+  }
+};
+
+// Built-in functions are lowered inline for the common case, guarded by a
+// sequence of checks, each of which may use values computed by the previous
+// ones. For example, `erlang:element/2` becomes:
+//
+//   %ok = is_fixnum(%index) && is_boxed(%tuple)
+//   cond_br llvm.expect(%ok, true), ^bounds, ^slow
+// ^bounds:
+//   %header = load(unbox(%tuple))
+//   %ok = is_tuple(%header) && (untag(%index) - 1) <u arity(%header)
+//   cond_br llvm.expect(%ok, true), ^fast, ^slow
+// ^fast:
+//   %element = load(unbox(%tuple)[untag(%index)])
+//   br ^cont(%element)
+// ^slow:
+//   %result = __lumen_builtin_tuple.element(%process, %index, %tuple)
+//   br ^cont(%result)
+//
+// The builtins implement the full semantics of the BIF, including raising
+// badarg, in which case the result is NONE. Literals, and anything else which
+// is not cheap to check for inline, are left to the runtime.
+template <typename Op>
+class BuiltinOpConversion : public EIROpConversion<Op> {
+ public:
+  using EIROpConversion<Op>::EIROpConversion;
+
+ protected:
+  // Builds one of the checks guarding the fast path, returning true if the
+  // fast path may be taken
+  using CheckBuilder = llvm::function_ref<Value()>;
+  // Builds the fast path, returning the result
+  using FastPathBuilder = llvm::function_ref<Value()>;
+
+  // Lowers an operation to its fast path, guarded by the given checks, and a
+  // call to the builtin if any of them fail. Fails if the enclosing function
+  // has no process context, see `callBuiltin`
+  PatternMatchResult lowerWithChecks(Op op, ArrayRef<Value> operands,
+                                     ConversionPatternRewriter &rewriter,
+                                     StringRef builtin,
+                                     ArrayRef<CheckBuilder> checks,
+                                     FastPathBuilder buildFastPath) const {
+    Value process = this->getProcessContext(op);
+    if (!process) return this->matchFailure();
+
+    auto loc = op.getLoc();
+    ModuleOp parentModule = op.template getParentOfType<ModuleOp>();
+    auto termTy = this->getUsizeType();
+
+    // Split the block at the operation, the continuation receives the result
+    Block *currentBlock = rewriter.getInsertionBlock();
+    Block *contBlock =
+        rewriter.splitBlock(currentBlock, rewriter.getInsertionPoint());
+    Value result = contBlock->addArgument(termTy);
+    Block *slowBlock = rewriter.createBlock(contBlock);
+
+    // Each check branches to the next one, or to the slow path
+    rewriter.setInsertionPointToEnd(currentBlock);
+    for (auto buildCheck : checks) {
+      Value isOk = buildCheck();
+      Block *checkBlock = rewriter.getInsertionBlock();
+      Block *nextBlock = rewriter.createBlock(slowBlock);
+      rewriter.setInsertionPointToEnd(checkBlock);
+      rewriter.create<LLVM::CondBrOp>(
+          loc, this->expectTrue(rewriter, parentModule, loc, isOk),
+          ArrayRef<Block *>({nextBlock, slowBlock}),
+          ArrayRef<ValueRange>({ValueRange(), ValueRange()}));
+      rewriter.setInsertionPointToEnd(nextBlock);
+    }
+
+    Value fastResult = buildFastPath();
+    rewriter.create<LLVM::BrOp>(loc, ArrayRef<Value>(),
+                                ArrayRef<Block *>(contBlock),
+                                ArrayRef<ValueRange>(ValueRange(fastResult)));
+
+    // Call the runtime for everything else
+    rewriter.setInsertionPointToEnd(slowBlock);
+    Value slowResult = callBuiltin(op, process, operands, rewriter, builtin);
+    rewriter.create<LLVM::BrOp>(loc, ArrayRef<Value>(),
+                                ArrayRef<Block *>(contBlock),
+                                ArrayRef<ValueRange>(ValueRange(slowResult)));
+
+    rewriter.replaceOp(op, {result});
+    return this->matchSuccess();
+  }
+
+  // Lowers an operation to a call to the builtin, for those with no fast path.
+  // Fails if the enclosing function has no process context, unless the
+  // builtin does not take one
+  PatternMatchResult lowerToCall(Op op, ArrayRef<Value> operands,
+                                 ConversionPatternRewriter &rewriter,
+                                 StringRef builtin,
+                                 bool takesProcess = true) const {
+    Value process;
+    if (takesProcess) {
+      process = this->getProcessContext(op);
+      if (!process) return this->matchFailure();
+    }
+
+    rewriter.replaceOp(op,
+                       callBuiltin(op, process, operands, rewriter, builtin));
+    return this->matchSuccess();
+  }
+
+  // Calls `builtin` with the operands, preceded by the process, if given, which
+  // the builtin allocates its result on, and stores the exception it raises on
+  Value callBuiltin(Op op, Value process, ArrayRef<Value> operands,
+                    ConversionPatternRewriter &rewriter,
+                    StringRef builtin) const {
+    ModuleOp parentModule = op.template getParentOfType<ModuleOp>();
+    auto termTy = this->getUsizeType();
+    SmallVector<LLVMType, 4> argTypes;
+    SmallVector<Value, 4> args;
+    if (process) {
+      argTypes.push_back(this->getProcessContextType());
+      args.push_back(process);
+    }
+    argTypes.append(operands.size(), termTy);
+    args.append(operands.begin(), operands.end());
+    auto callee = this->getOrInsertFunction(rewriter, parentModule, builtin,
+                                            termTy, argTypes);
+    auto callOp = rewriter.create<mlir::CallOp>(
+        op.getLoc(), callee, ArrayRef<Type>{termTy}, args);
+    return callOp.getResult(0);
+  }
+
+  // Returns true if the given term is a box pointing into the process heap,
+  // i.e. it is neither a literal nor a list
+  Value isBoxed(OpBuilder &builder, Value term) const {
+    auto &targetInfo = this->targetInfo;
+    auto termTy = this->getUsizeType();
+    auto i1Ty = this->getI1Type();
+    Value primaryMask = llvm_constant(
+        termTy, this->getIntegerAttr(builder, targetInfo.listMask()));
+    Value boxTag = llvm_constant(
+        termTy, this->getIntegerAttr(builder, targetInfo.boxTag()));
+    Value isBox = llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq,
+                            llvm_and(term, primaryMask), boxTag);
+    if (targetInfo.boxTag() != 0) return isBox;
+
+    // Pointers are untagged, so literals are distinguished by their low bits,
+    // and the null pointer is NONE
+    Value literalTag = llvm_constant(
+        termTy, this->getIntegerAttr(builder, targetInfo.literalTag()));
+    Value zero = llvm_constant(termTy, this->getIntegerAttr(builder, 0));
+    Value isLiteral = llvm_icmp(i1Ty, LLVM::ICmpPredicate::ne,
+                                llvm_and(term, literalTag), zero);
+    Value isNull = llvm_icmp(i1Ty, LLVM::ICmpPredicate::eq, term, zero);
+    Value one = llvm_constant(
+        i1Ty, builder.getIntegerAttr(builder.getIntegerType(1), 1));
+    return llvm_and(isBox, llvm_xor(llvm_or(isLiteral, isNull), one));
+  }
+
+  // Returns true if the given header is that of a tuple, setting `arity`
+  Value isTupleHeader(OpBuilder &builder, Value header, Value &arity) const {
+    return isHeader(builder, header, TypeKind::Tuple, arity);
+  }
+
+  // Returns true if the given header is of the given kind, setting `arity`
+  Value isHeader(OpBuilder &builder, Value header, unsigned kind,
+                 Value &arity) const {
+    auto &targetInfo = this->targetInfo;
+    auto termTy = this->getUsizeType();
+    auto &headerMask = targetInfo.headerMask();
+    auto tag = targetInfo.encodeHeader(kind, 0).getLimitedValue();
+    // The arity is either shifted above the tag, or masked below it
+    uint64_t tagMask;
+    if (headerMask.requiresShift()) {
+      tagMask = (uint64_t(1) << headerMask.shift) - 1;
+      Value shift = llvm_constant(
+          termTy, this->getIntegerAttr(builder, headerMask.shift));
+      arity = llvm_lshr(header, shift);
+    } else {
+      tagMask = ~headerMask.mask;
+      Value valueMask = llvm_constant(
+          termTy, this->getIntegerAttr(builder, headerMask.mask));
+      arity = llvm_and(header, valueMask);
+    }
+    Value tagMaskConst =
+        llvm_constant(termTy, this->getIntegerAttr(builder, tagMask));
+    Value tagConst = llvm_constant(termTy, this->getIntegerAttr(builder, tag));
+    return llvm_icmp(this->getI1Type(), LLVM::ICmpPredicate::eq,
+                     llvm_and(header, tagMaskConst), tagConst);
+  }
+
+  // Lowers `hd/1` or `tl/1`, which load the given field of a cons cell
+  PatternMatchResult lowerListAccessor(Op op, ArrayRef<Value> operands,
+                                       ConversionPatternRewriter &rewriter,
+                                       StringRef builtin,
+                                       unsigned field) const {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    auto &targetInfo = this->targetInfo;
+    auto termTy = this->getUsizeType();
+    auto int32Ty = this->getI32Type();
+    Value list = operands[0];
+
+    auto checkList = [&]() -> Value {
+      Value listTag = llvm_constant(
+          termTy, this->getIntegerAttr(rewriter, targetInfo.listTag()));
+      Value listMask = llvm_constant(
+          termTy, this->getIntegerAttr(rewriter, targetInfo.listMask()));
+      return llvm_icmp(this->getI1Type(), LLVM::ICmpPredicate::eq,
+                       llvm_and(list, listMask), listTag);
+    };
+    auto buildFastPath = [&]() -> Value {
+      auto consPtrTy = targetInfo.getConsType().getPointerTo();
+      Value cons = this->unbox_list(rewriter, context, consPtrTy, list);
+      Value cns0 = llvm_constant(int32Ty, this->getI32Attr(rewriter, 0));
+      Value index =
+          llvm_constant(int32Ty, this->getI32Attr(rewriter, field));
+      Value ptr = llvm_gep(termTy.getPointerTo(), cons,
+                           ArrayRef<Value>({cns0, index}));
+      return llvm_load(ptr);
+    };
+    return lowerWithChecks(op, operands, rewriter, builtin, {checkList},
+                           buildFastPath);
+  }
+};
+
+struct TupleSizeOpConversion : public BuiltinOpConversion<TupleSizeOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      TupleSizeOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    TupleSizeOpOperandAdaptor adaptor(operands);
+    auto termPtrTy = getUsizeType().getPointerTo();
+    Value tuple = adaptor.tuple();
+
+    Value arity;
+    auto checkBoxed = [&]() { return isBoxed(rewriter, tuple); };
+    auto checkTuple = [&]() {
+      Value ptr = unbox(rewriter, context, termPtrTy, tuple);
+      return isTupleHeader(rewriter, llvm_load(ptr), arity);
+    };
+    auto buildFastPath = [&]() { return tagFixnum(rewriter, arity); };
+    return lowerWithChecks(op, operands, rewriter, "__lumen_builtin_tuple.size",
+                           {checkBoxed, checkTuple}, buildFastPath);
+  }
+};
+
+struct TupleElementOpConversion : public BuiltinOpConversion<TupleElementOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      TupleElementOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    TupleElementOpOperandAdaptor adaptor(operands);
+    auto termTy = getUsizeType();
+    auto termPtrTy = termTy.getPointerTo();
+    Value index = adaptor.index();
+    Value tuple = adaptor.tuple();
+
+    Value ptr, position;
+    auto checkTypes = [&]() -> Value {
+      return llvm_and(isFixnum(rewriter, index), isBoxed(rewriter, tuple));
+    };
+    auto checkBounds = [&]() -> Value {
+      ptr = unbox(rewriter, context, termPtrTy, tuple);
+      Value arity;
+      Value isTuple = isTupleHeader(rewriter, llvm_load(ptr), arity);
+      // The elements follow the header, so the one-based index is also the
+      // position of the element, and it is in bounds if 1 <= index <= arity
+      position = untagFixnum(rewriter, index);
+      Value one = llvm_constant(termTy, getIntegerAttr(rewriter, 1));
+      Value inBounds = llvm_icmp(getI1Type(), LLVM::ICmpPredicate::ult,
+                                 llvm_sub(position, one), arity);
+      return llvm_and(isTuple, inBounds);
+    };
+    auto buildFastPath = [&]() -> Value {
+      return llvm_load(llvm_gep(termPtrTy, ptr, ArrayRef<Value>({position})));
+    };
+    return lowerWithChecks(op, operands, rewriter,
+                           "__lumen_builtin_tuple.element",
+                           {checkTypes, checkBounds}, buildFastPath);
+  }
+};
+
+// The copy is allocated on the process heap, which dominates the cost of the
+// operation, so this is left to the runtime
+struct TupleSetElementOpConversion
+    : public BuiltinOpConversion<TupleSetElementOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      TupleSetElementOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter,
+                       "__lumen_builtin_tuple.setelement");
+  }
+};
+
+struct HdOpConversion : public BuiltinOpConversion<HdOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      HdOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerListAccessor(op, operands, rewriter, "__lumen_builtin_list.hd",
+                             0);
+  }
+};
+
+struct TlOpConversion : public BuiltinOpConversion<TlOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      TlOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerListAccessor(op, operands, rewriter, "__lumen_builtin_list.tl",
+                             1);
+  }
+};
+
+// Binaries have several representations (heap, reference-counted, sub and
+// literal binaries), so their size is always computed by the runtime
+struct ByteSizeOpConversion : public BuiltinOpConversion<ByteSizeOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ByteSizeOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter,
+                       "__lumen_builtin_binary.byte_size");
+  }
+};
+
+// The layout of maps is private to the runtime
+struct MapSizeOpConversion : public BuiltinOpConversion<MapSizeOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      MapSizeOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_map.size");
+  }
+};
+
+struct SelfOpConversion : public BuiltinOpConversion<SelfOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      SelfOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_self");
+  }
+};
+
+struct NodeOpConversion : public BuiltinOpConversion<NodeOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      NodeOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_node",
+                       /*takesProcess=*/false);
+  }
+};
+
+struct MakeRefOpConversion : public BuiltinOpConversion<MakeRefOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      MakeRefOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    return lowerToCall(op, operands, rewriter, "__lumen_builtin_make_ref");
+  }
+};
+
 struct GetElementPtrOpConversion : public EIROpConversion<GetElementPtrOp> {
   using EIROpConversion::EIROpConversion;
 
@@ -739,6 +1995,8 @@ struct LoadOpConversion : public EIROpConversion<LoadOp> {
     edsc::ScopedContext context(rewriter, op.getLoc());
     LoadOpOperandAdaptor adaptor(operands);
 
+    // If this loads from a boxed term, it is marked invariant after
+    // translation to LLVM IR, see TermMetadata.h
     Value ptr = adaptor.ref();
     Value load = llvm_load(ptr);
 
@@ -770,6 +2028,19 @@ struct CastOpConversion : public EIROpConversion<CastOp> {
     }
 
     auto termTy = targetInfo.getTermType();
+    if (inTy == getI1Type() && outTy == termTy) {
+      // This is a cast from boolean to term, i.e. to the atoms true/false
+      auto trueAtom = targetInfo.encodeImmediate(TypeKind::Atom, 1);
+      auto falseAtom = targetInfo.encodeImmediate(TypeKind::Atom, 0);
+      Value trueConst = llvm_constant(
+          termTy, getIntegerAttr(rewriter, trueAtom.getLimitedValue()));
+      Value falseConst = llvm_constant(
+          termTy, getIntegerAttr(rewriter, falseAtom.getLimitedValue()));
+      Value atom = llvm_select(in, trueConst, falseConst);
+      rewriter.replaceOp(op, atom);
+      return matchSuccess();
+    }
+
     Value ptr;
     if (inTy == termTy && outTy.isPointerTy()) {
       // This is a cast from opaque term to pointer type, i.e. unboxing
@@ -1131,8 +2402,10 @@ struct TupleOpConversion : public EIROpConversion<TupleOp> {
     // Value tupleAlloc =
     //    llvm_alloca(ptrTy, allocN, rewriter.getI64IntegerAttr(8));
     ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+    Value process = getProcessContext(op);
+    if (!process) return matchFailure();
     Value tupleAlloc = processAlloc(rewriter, context, parentModule,
-                                    op.getLoc(), ty, allocBytes);
+                                    op.getLoc(), process, ty, allocBytes);
     Value tuple = llvm_undef(ty);
     tuple = llvm_insertvalue(ty, tuple, header, rewriter.getI64ArrayAttr(0));
     for (auto i = 0; i < numElements; i++) {
@@ -1149,6 +2422,288 @@ struct TupleOpConversion : public EIROpConversion<TupleOp> {
   }
 };
 
+// Lowers a closure to a boxed term on the process heap, laid out as the
+// runtime's `Closure`, see `getClosureType`. As there, the arity of the header
+// is the size of the environment. The fun is an export of the function named
+// by the op, as compiled funs have no index or unique to make them anonymous.
+// The code is a thunk which takes the process, the arguments, and the closure
+// itself, and calls the callee with the environment loaded from the closure
+// ahead of the arguments, so that the callee is the same function which is
+// called directly when the fun is known.
+struct ClosureOpConversion : public EIROpConversion<ClosureOp> {
+  using EIROpConversion::EIROpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      ClosureOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    ClosureOpOperandAdaptor adaptor(operands);
+
+    auto loc = op.getLoc();
+    ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+    Value process = getProcessContext(op);
+    if (!process) return matchFailure();
+
+    auto termTy = getUsizeType();
+    auto termPtrTy = termTy.getPointerTo();
+    auto i8Ty = LLVMType::getInt8Ty(dialect);
+    auto i8PtrTy = LLVMType::getInt8PtrTy(dialect);
+    auto int32Ty = getI32Type();
+    auto env = adaptor.env();
+    unsigned envSize = env.size();
+    unsigned arity = op.getArity();
+    auto ty = getClosureType(envSize);
+
+    auto thunk = getOrInsertThunk(rewriter, context, parentModule, loc,
+                                  op.getCallee(), arity, envSize);
+    Value code = llvm_bitcast(
+        i8PtrTy, llvm_constant(thunk.getType().getPointerTo(),
+                               rewriter.getSymbolRefAttr(thunk)));
+    auto headerRaw = targetInfo.encodeHeader(TypeKind::Closure, envSize);
+    Value header = llvm_constant(
+        termTy, getIntegerAttr(rewriter, headerRaw.getLimitedValue()));
+    Value module =
+        llvm_constant(termTy, getIntegerAttr(rewriter, op.getModuleId()));
+    Value function =
+        llvm_constant(termTy, getIntegerAttr(rewriter, op.getFunctionId()));
+    // `Definition::Export` is the first variant
+    Value exportTag = llvm_constant(int32Ty, getI32Attr(rewriter, 0));
+    Value arityConst =
+        llvm_constant(i8Ty, rewriter.getIntegerAttr(rewriter.getIntegerType(8),
+                                                    arity));
+
+    Value closureAlloc = processAlloc(rewriter, context, parentModule, loc,
+                                      process, ty, sizeOf(rewriter, ty));
+    Value closure = llvm_undef(ty);
+    closure =
+        llvm_insertvalue(ty, closure, header, rewriter.getI64ArrayAttr(0));
+    closure =
+        llvm_insertvalue(ty, closure, module, rewriter.getI64ArrayAttr(1));
+    closure = llvm_insertvalue(ty, closure, exportTag,
+                               rewriter.getI64ArrayAttr({2, 0}));
+    closure =
+        llvm_insertvalue(ty, closure, arityConst, rewriter.getI64ArrayAttr(3));
+    closure = llvm_insertvalue(ty, closure, code, rewriter.getI64ArrayAttr(4));
+    for (unsigned i = 0; i < envSize; i++) {
+      closure = llvm_insertvalue(ty, closure, env[i],
+                                 rewriter.getI64ArrayAttr({5, i}));
+    }
+    llvm_store(closure, closureAlloc);
+
+    // The function of an export is the first word following the tag, which
+    // overlaps the fields of `Anonymous`, so it is stored separately
+    Value cns0 = llvm_constant(int32Ty, getI32Attr(rewriter, 0));
+    Value cns1 = llvm_constant(int32Ty, getI32Attr(rewriter, 1));
+    Value cns2 = llvm_constant(int32Ty, getI32Attr(rewriter, 2));
+    Value variant = llvm_gep(int32Ty.getPointerTo(), closureAlloc,
+                             ArrayRef<Value>({cns0, cns2, cns1, cns0}));
+    llvm_store(function, llvm_bitcast(termPtrTy, variant));
+
+    // Box the allocated closure
+    auto boxed = make_box(rewriter, context, closureAlloc);
+
+    rewriter.replaceOp(op, boxed);
+    return matchSuccess();
+  }
+
+ private:
+  // Returns the thunk called through closures over `callee`, creating it if
+  // it does not yet exist in this module
+  LLVM::LLVMFuncOp getOrInsertThunk(PatternRewriter &rewriter,
+                                    edsc::ScopedContext &context, ModuleOp mod,
+                                    Location loc, StringRef callee,
+                                    unsigned arity, unsigned envSize) const {
+    auto name = (callee + "$closure").str();
+    if (auto thunk = mod.lookupSymbol<LLVM::LLVMFuncOp>(name)) return thunk;
+
+    auto termTy = getUsizeType();
+    auto termPtrTy = termTy.getPointerTo();
+    auto int32Ty = getI32Type();
+
+    // The callee takes the environment ahead of the arguments
+    SmallVector<LLVMType, 4> calleeArgTypes(envSize + arity, termTy);
+    calleeArgTypes.insert(calleeArgTypes.begin(), getProcessContextType());
+    auto calleeRef = getOrInsertFunction(rewriter, mod, callee, termTy,
+                                         calleeArgTypes);
+
+    SmallVector<LLVMType, 4> argTypes(arity + 1, termTy);
+    argTypes.insert(argTypes.begin(), getProcessContextType());
+    auto thunkTy =
+        LLVMType::getFunctionTy(termTy, argTypes, /*isVarArg=*/false);
+
+    PatternRewriter::InsertionGuard insertGuard(rewriter);
+    rewriter.setInsertionPointToStart(mod.getBody());
+    auto thunk = rewriter.create<LLVM::LLVMFuncOp>(loc, name, thunkTy,
+                                                   LLVM::Linkage::Internal);
+    SmallVector<Type, 4> blockArgTypes(argTypes.begin(), argTypes.end());
+    Block *entry = rewriter.createBlock(&thunk.getBody(), {}, blockArgTypes);
+
+    rewriter.setInsertionPointToStart(entry);
+    auto closurePtrTy = getClosureType(envSize).getPointerTo();
+    Value closure = unbox(rewriter, context, closurePtrTy,
+                          entry->getArgument(arity + 1));
+    Value cns0 = llvm_constant(int32Ty, getI32Attr(rewriter, 0));
+    Value envField = llvm_constant(int32Ty, getI32Attr(rewriter, 5));
+    SmallVector<Value, 4> args;
+    args.push_back(entry->getArgument(0));
+    for (unsigned i = 0; i < envSize; i++) {
+      Value index = llvm_constant(int32Ty, getI32Attr(rewriter, i));
+      args.push_back(llvm_load(llvm_gep(
+          termPtrTy, closure, ArrayRef<Value>({cns0, envField, index}))));
+    }
+    for (unsigned i = 1; i <= arity; i++) args.push_back(entry->getArgument(i));
+    auto callOp = rewriter.create<LLVM::CallOp>(
+        loc, ArrayRef<Type>{termTy}, args,
+        ArrayRef<NamedAttribute>{rewriter.getNamedAttr("callee", calleeRef)});
+    rewriter.create<LLVM::ReturnOp>(loc, callOp.getResult(0));
+    return thunk;
+  }
+};
+
+// Lowers a call to a fun which is not known statically, checking that the
+// callee is a closure of the expected arity before calling its code:
+//
+//   if !is_boxed(%fun): br ^badfun
+//   %ptr = unbox %fun
+//   if !is_closure(%ptr.header): br ^badfun
+//   if %ptr.arity != arity: br ^badarity
+//   %result = %ptr.code(process, args..., %fun)
+//   br ^cont(%result)
+// ^badfun:
+//   br ^cont(__lumen_builtin_raise_badfun(process, %fun))
+// ^badarity:
+//   br ^cont(__lumen_builtin_raise_badarity(process, %fun, argv, argc))
+//
+// The raising builtins return NONE, which the caller then returns. All of the
+// checks are expected to pass, so that those calls are laid out away from the
+// call of the fun. The fields are those of the runtime's `Closure`, see
+// `getClosureType`.
+struct CallIndirectOpConversion : public BuiltinOpConversion<CallIndirectOp> {
+  using BuiltinOpConversion::BuiltinOpConversion;
+
+  PatternMatchResult matchAndRewrite(
+      CallIndirectOp op, ArrayRef<Value> operands,
+      ConversionPatternRewriter &rewriter) const override {
+    edsc::ScopedContext context(rewriter, op.getLoc());
+    CallIndirectOpOperandAdaptor adaptor(operands);
+
+    auto loc = op.getLoc();
+    ModuleOp parentModule = op.getParentOfType<ModuleOp>();
+    auto termTy = getUsizeType();
+    auto termPtrTy = termTy.getPointerTo();
+    auto i8Ty = LLVMType::getInt8Ty(dialect);
+    auto i8PtrTy = LLVMType::getInt8PtrTy(dialect);
+    auto int32Ty = getI32Type();
+    auto arity = op.getArity();
+
+    Value fun = adaptor.callee();
+    SmallVector<Value, 4> args(adaptor.args().begin(), adaptor.args().end());
+    Value process = getProcessContext(op);
+    if (!process) return matchFailure();
+
+    SmallVector<LLVMType, 4> argTypes(arity + 1, termTy);
+    argTypes.insert(argTypes.begin(), getProcessContextType());
+    auto codeTy = LLVMType::getFunctionTy(termTy, argTypes, /*isVarArg=*/false);
+
+    // Split the block at the call, the continuation receives the result
+    Block *currentBlock = rewriter.getInsertionBlock();
+    Block *contBlock =
+        rewriter.splitBlock(currentBlock, rewriter.getInsertionPoint());
+    Value result = contBlock->addArgument(termTy);
+
+    Block *headerBlock = rewriter.createBlock(contBlock);
+    Block *arityBlock = rewriter.createBlock(contBlock);
+    Block *callBlock = rewriter.createBlock(contBlock);
+    Block *badfunBlock = rewriter.createBlock(contBlock);
+    Block *badarityBlock = rewriter.createBlock(contBlock);
+
+    // Each check branches to the next one, or to the block which raises
+    auto branchIf = [&](Value isOk, Block *next, Block *raise) {
+      rewriter.create<LLVM::CondBrOp>(
+          loc, expectTrue(rewriter, parentModule, loc, isOk),
+          ArrayRef<Block *>({next, raise}),
+          ArrayRef<ValueRange>({ValueRange(), ValueRange()}));
+    };
+
+    rewriter.setInsertionPointToEnd(currentBlock);
+    branchIf(isBoxed(rewriter, fun), headerBlock, badfunBlock);
+
+    rewriter.setInsertionPointToEnd(headerBlock);
+    // The size of the environment does not matter, as it is not accessed
+    auto closurePtrTy = getClosureType(0).getPointerTo();
+    Value ptr = unbox(rewriter, context, closurePtrTy, fun);
+    Value cns0 = llvm_constant(int32Ty, getI32Attr(rewriter, 0));
+    Value header = llvm_load(llvm_bitcast(termPtrTy, ptr));
+    Value size;
+    branchIf(isHeader(rewriter, header, TypeKind::Closure, size), arityBlock,
+             badfunBlock);
+
+    rewriter.setInsertionPointToEnd(arityBlock);
+    Value arityField = llvm_constant(int32Ty, getI32Attr(rewriter, 3));
+    Value funArity = llvm_load(llvm_gep(i8Ty.getPointerTo(), ptr,
+                                        ArrayRef<Value>({cns0, arityField})));
+    Value arityConst =
+        llvm_constant(i8Ty, rewriter.getIntegerAttr(rewriter.getIntegerType(8),
+                                                    arity));
+    branchIf(llvm_icmp(getI1Type(), LLVM::ICmpPredicate::eq, funArity,
+                       arityConst),
+             callBlock, badarityBlock);
+
+    // Call the code of the closure, passing the closure last
+    rewriter.setInsertionPointToEnd(callBlock);
+    Value codeField = llvm_constant(int32Ty, getI32Attr(rewriter, 4));
+    Value codePtr = llvm_load(llvm_gep(i8PtrTy.getPointerTo(), ptr,
+                                       ArrayRef<Value>({cns0, codeField})));
+    Value code = llvm_bitcast(codeTy.getPointerTo(), codePtr);
+    SmallVector<Value, 6> callOperands;
+    callOperands.push_back(code);
+    callOperands.push_back(process);
+    callOperands.append(args.begin(), args.end());
+    callOperands.push_back(fun);
+    auto callOp = rewriter.create<LLVM::CallOp>(
+        loc, ArrayRef<Type>{termTy}, callOperands, ArrayRef<NamedAttribute>{});
+    rewriter.create<LLVM::BrOp>(
+        loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+        ArrayRef<ValueRange>(ValueRange(callOp.getResult(0))));
+
+    // Raise badfun, with the callee as the reason
+    rewriter.setInsertionPointToEnd(badfunBlock);
+    auto badfun = getOrInsertFunction(rewriter, parentModule,
+                                      "__lumen_builtin_raise_badfun", termTy,
+                                      {getProcessContextType(), termTy});
+    auto badfunOp = rewriter.create<mlir::CallOp>(
+        loc, badfun, ArrayRef<Type>{termTy}, ArrayRef<Value>({process, fun}));
+    rewriter.create<LLVM::BrOp>(
+        loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+        ArrayRef<ValueRange>(ValueRange(badfunOp.getResult(0))));
+
+    // Raise badarity, with the callee and the arguments as the reason, which
+    // are passed on the stack, as there may be any number of them
+    rewriter.setInsertionPointToEnd(badarityBlock);
+    Value argc = llvm_constant(termTy, getIntegerAttr(rewriter, arity));
+    Value allocN = llvm_constant(
+        termTy, getIntegerAttr(rewriter, std::max<unsigned>(arity, 1)));
+    auto align = rewriter.getI64IntegerAttr(targetInfo.pointerSizeInBits / 8);
+    Value argv = llvm_alloca(termPtrTy, allocN, align);
+    for (unsigned i = 0; i < arity; i++) {
+      Value index = llvm_constant(int32Ty, getI32Attr(rewriter, i));
+      llvm_store(args[i], llvm_gep(termPtrTy, argv, ArrayRef<Value>({index})));
+    }
+    auto badarity = getOrInsertFunction(
+        rewriter, parentModule, "__lumen_builtin_raise_badarity", termTy,
+        {getProcessContextType(), termTy, termPtrTy, termTy});
+    auto badarityOp = rewriter.create<mlir::CallOp>(
+        loc, badarity, ArrayRef<Type>{termTy},
+        ArrayRef<Value>({process, fun, argv, argc}));
+    rewriter.create<LLVM::BrOp>(
+        loc, ArrayRef<Value>(), ArrayRef<Block *>(contBlock),
+        ArrayRef<ValueRange>(ValueRange(badarityOp.getResult(0))));
+
+    rewriter.replaceOp(op, {result});
+    return matchSuccess();
+  }
+};
+
 struct ConsOpConversion : public EIROpConversion<ConsOp> {
   using EIROpConversion::EIROpConversion;
 
@@ -1281,15 +2836,26 @@ void populateEIRToLLVMConversionPatterns(OwningRewritePatternList &patterns,
                                          TargetInfo &targetInfo) {
   patterns
       .insert<CondBranchOpConversion, UnreachableOpConversion, CallOpConversion,
+              DynamicCallOpConversion, CallIndirectOpConversion,
               YieldOpConversion, GetElementPtrOpConversion, LoadOpConversion,
               IsTypeOpConversion, CastOpConversion,
               /*
               LogicalAndOpConversion,
               LogicalOrOpConversion,
               */
-              CmpEqOpConversion,
+              CmpEqOpConversion, CmpNeqOpConversion,
+              AddOpConversion, SubOpConversion, MulOpConversion,
+              DivOpConversion, RemOpConversion, NegOpConversion,
+              BandOpConversion, BorOpConversion, BxorOpConversion,
+              BnotOpConversion, BslOpConversion, BsrOpConversion,
+              TupleSizeOpConversion, TupleElementOpConversion,
+              TupleSetElementOpConversion, HdOpConversion, TlOpConversion,
+              ByteSizeOpConversion, MapSizeOpConversion, SelfOpConversion,
+              NodeOpConversion, MakeRefOpConversion,
+              ReceiveStartOpConversion, ReceivePeekOpConversion,
+              ReceiveWaitOpConversion, ReceiveDoneOpConversion,
+              ReceiveMarkOpConversion, ReceiveSetOpConversion,
               /*
-              CmpNeqOpConversion,
               CmpLtOpConversion,
               CmpLteOpConversion,
               CmpGtOpConversion,
@@ -1299,7 +2865,7 @@ void populateEIRToLLVMConversionPatterns(OwningRewritePatternList &patterns,
               TupleOpConversion,
               */
               TraceCaptureOpConversion, TraceConstructOpConversion,
-              ConsOpConversion, TupleOpConversion,
+              ConsOpConversion, TupleOpConversion, ClosureOpConversion,
               /*
               BinaryPushOpConversion,
               */
@@ -1335,10 +2901,10 @@ class ConvertEIRToLLVMPass : public mlir::ModulePass<ConvertEIRToLLVMPass> {
     auto &context = getContext();
     LLVMTypeConverter converter(&context);
 
-    // Initialize target-specific type information, using
-    // the LLVMDialect contained in the type converter to
-    // create named types
-    auto targetInfo = TargetInfo(targetMachine, *converter.getDialect());
+    // Fetch target-specific type information, using the LLVMDialect
+    // contained in the type converter to create named types the
+    // first time this context is lowered for this target
+    auto &targetInfo = TargetInfo::get(targetMachine, *converter.getDialect());
 
     // Populate conversion patterns
     OwningRewritePatternList patterns;
@@ -0,0 +1,79 @@
+// RUN: lumen-opt -split-input-file -lumen-eir-to-llvm %s | LumenFileCheck %s
+
+// BIFs with a cheap common case are lowered inline, behind checks which fall
+// back to calling the runtime, passing it the process, as in:
+//
+//   size(T) -> tuple_size(T).
+//   head(L) -> hd(L).
+
+// CHECK-LABEL: llvm.func @size(%[[PROC:[0-9a-z]+]]: !llvm<"i8*">
+// CHECK: llvm.call @llvm.expect.i1(
+// CHECK-NEXT: llvm.cond_br
+// CHECK: llvm.call @llvm.expect.i1(
+// CHECK-NEXT: llvm.cond_br
+// CHECK-NOT: llvm.call @__lumen_builtin_tuple.size
+// CHECK: llvm.br ^bb[[CONT:[0-9]+]](
+// CHECK-NEXT: ^bb{{[0-9]+}}:
+// CHECK-NEXT: %[[SLOW:[0-9]+]] = llvm.call @__lumen_builtin_tuple.size(%[[PROC]],
+// CHECK-NEXT: llvm.br ^bb[[CONT]](%[[SLOW]] : !llvm.i64)
+// CHECK-NEXT: ^bb[[CONT]](%[[RESULT:arg[0-9]+]]: !llvm.i64):
+// CHECK-NEXT: llvm.return %[[RESULT]]
+
+// CHECK-LABEL: llvm.func @head(%[[PROC:[0-9a-z]+]]: !llvm<"i8*">
+// CHECK: llvm.call @llvm.expect.i1(
+// CHECK-NEXT: llvm.cond_br
+// CHECK-NOT: llvm.call @__lumen_builtin_list.hd
+// CHECK: llvm.load
+// CHECK-NEXT: llvm.br ^bb[[CONT:[0-9]+]](
+// CHECK-NEXT: ^bb{{[0-9]+}}:
+// CHECK-NEXT: %[[SLOW:[0-9]+]] = llvm.call @__lumen_builtin_list.hd(%[[PROC]],
+// CHECK-NEXT: llvm.br ^bb[[CONT]](%[[SLOW]] : !llvm.i64)
+module {
+  eir.func @size(%t: !eir.term) -> !eir.term {
+    %size = eir.tuple.size %t : (!eir.term) -> !eir.term
+    eir.return %size : !eir.term
+  }
+
+  eir.func @head(%l: !eir.term) -> !eir.term {
+    %hd = eir.list.hd %l : (!eir.term) -> !eir.term
+    eir.return %hd : !eir.term
+  }
+}
+
+// -----
+
+// Those with no cheap common case always call the runtime, as in:
+//
+//   set(I, T, V) -> setelement(I, T, V).
+//   entries(M) -> map_size(M).
+//   ref() -> make_ref().
+
+// CHECK-LABEL: llvm.func @set(%[[PROC:[0-9a-z]+]]: !llvm<"i8*">
+// CHECK-NOT: llvm.cond_br
+// CHECK: %[[RESULT:[0-9]+]] = llvm.call @__lumen_builtin_tuple.setelement(%[[PROC]],
+// CHECK-NEXT: llvm.return %[[RESULT]]
+
+// CHECK-LABEL: llvm.func @entries(%[[PROC:[0-9a-z]+]]: !llvm<"i8*">
+// CHECK-NOT: llvm.cond_br
+// CHECK: %[[RESULT:[0-9]+]] = llvm.call @__lumen_builtin_map.size(%[[PROC]],
+// CHECK-NEXT: llvm.return %[[RESULT]]
+
+// CHECK-LABEL: llvm.func @ref(%[[PROC:[0-9a-z]+]]: !llvm<"i8*">
+// CHECK: %[[RESULT:[0-9]+]] = llvm.call @__lumen_builtin_make_ref(%[[PROC]])
+// CHECK-NEXT: llvm.return %[[RESULT]]
+module {
+  eir.func @set(%i: !eir.term, %t: !eir.term, %v: !eir.term) -> !eir.term {
+    %r = eir.tuple.setelement %i, %t, %v : (!eir.term, !eir.term, !eir.term) -> !eir.term
+    eir.return %r : !eir.term
+  }
+
+  eir.func @entries(%m: !eir.term) -> !eir.term {
+    %size = eir.map.size %m : (!eir.term) -> !eir.term
+    eir.return %size : !eir.term
+  }
+
+  eir.func @ref() -> !eir.term {
+    %ref = eir.make_ref : () -> !eir.term
+    eir.return %ref : !eir.term
+  }
+}
@@ -0,0 +1,36 @@
+// RUN: lumen-opt -lumen-eir-to-llvm %s | LumenFileCheck %s
+
+// A closure is laid out as the runtime's `Closure`, with its environment in
+// the last field, and its thunk passes the environment to the callee, in
+// order, ahead of the arguments the fun is applied to, as in:
+//
+//   outer(X, Y) -> fun (A) -> lifted(X, Y, A) end.
+
+// CHECK-LABEL: llvm.func @lifted$closure(
+// CHECK-SAME: %[[PROCESS:arg0]]: {{.*}}, %[[ARG:arg1]]: !llvm.i64, %[[CLOSURE:arg2]]: !llvm.i64)
+// CHECK: %[[ENV:[0-9]+]] = llvm.mlir.constant(5 : i32) : !llvm.i32
+// CHECK-NEXT: %[[INDEX0:[0-9]+]] = llvm.mlir.constant(0 : i32) : !llvm.i32
+// CHECK-NEXT: %[[PTR0:[0-9]+]] = llvm.getelementptr %{{[0-9]+}}[%{{[0-9]+}}, %[[ENV]], %[[INDEX0]]]
+// CHECK-NEXT: %[[ENV0:[0-9]+]] = llvm.load %[[PTR0]]
+// CHECK-NEXT: %[[INDEX1:[0-9]+]] = llvm.mlir.constant(1 : i32) : !llvm.i32
+// CHECK-NEXT: %[[PTR1:[0-9]+]] = llvm.getelementptr %{{[0-9]+}}[%{{[0-9]+}}, %[[ENV]], %[[INDEX1]]]
+// CHECK-NEXT: %[[ENV1:[0-9]+]] = llvm.load %[[PTR1]]
+// CHECK-NEXT: %[[RESULT:[0-9]+]] = llvm.call @lifted(%[[PROCESS]], %[[ENV0]], %[[ENV1]], %[[ARG]])
+// CHECK-NEXT: llvm.return %[[RESULT]]
+
+// CHECK-LABEL: llvm.func @outer(
+// CHECK-SAME: %{{arg0}}: {{.*}}, %[[X:arg1]]: !llvm.i64, %[[Y:arg2]]: !llvm.i64)
+// CHECK: llvm.mlir.constant(@lifted$closure)
+// CHECK: llvm.insertvalue %[[X]], %{{[0-9]+}}[5, 0]
+// CHECK-NEXT: llvm.insertvalue %[[Y]], %{{[0-9]+}}[5, 1]
+// CHECK-NOT: llvm.insertvalue
+module {
+  eir.func @lifted(%x: !eir.term, %y: !eir.term, %a: !eir.term) -> !eir.term {
+    eir.return %y : !eir.term
+  }
+
+  eir.func @outer(%x: !eir.term, %y: !eir.term) -> !eir.term {
+    %f = eir.closure @lifted(%x, %y) {arity = 1 : i32, module = 1 : i64, function = 2 : i64} : (!eir.term, !eir.term) -> !eir.closure
+    eir.return %f : !eir.closure
+  }
+}
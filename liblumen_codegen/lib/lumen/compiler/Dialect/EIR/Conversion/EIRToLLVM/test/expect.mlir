@@ -0,0 +1,44 @@
+// RUN: lumen-opt -lumen-eir-to-llvm %s | LumenFileCheck %s
+
+// Branches which expect a value of their condition, e.g. those to the error
+// destination of a call, pass it on to LLVM with `llvm.expect`, to be turned
+// into branch weights, and drop the attribute
+
+// CHECK-LABEL: llvm.func @unlikely(
+// CHECK: %[[FALSE:[0-9]+]] = llvm.mlir.constant({{false|0 : i1}}) : !llvm.i1
+// CHECK-NEXT: %[[COND:[0-9]+]] = llvm.call @llvm.expect.i1(%{{[0-9a-z]+}}, %[[FALSE]])
+// CHECK-NEXT: llvm.cond_br %[[COND]], ^bb1(%{{[0-9a-z]+}} : !llvm.i64), ^bb2(%{{[0-9a-z]+}} : !llvm.i64){{$}}
+
+// CHECK-LABEL: llvm.func @likely(
+// CHECK: %[[TRUE:[0-9]+]] = llvm.mlir.constant({{true|1 : i1}}) : !llvm.i1
+// CHECK-NEXT: %[[COND:[0-9]+]] = llvm.call @llvm.expect.i1(%{{[0-9a-z]+}}, %[[TRUE]])
+// CHECK-NEXT: llvm.cond_br %[[COND]], ^bb1(%{{[0-9a-z]+}} : !llvm.i64), ^bb2(%{{[0-9a-z]+}} : !llvm.i64){{$}}
+
+// CHECK-LABEL: llvm.func @unknown(
+// CHECK-NOT: llvm.expect.i1
+// CHECK: llvm.cond_br
+module {
+  eir.func @unlikely(%c: !eir.bool, %a: !eir.term, %b: !eir.term) -> !eir.term {
+    eir.cond_br %c, ^error(%a : !eir.term), ^ok(%b : !eir.term) {expect = false}
+  ^error(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^ok(%r: !eir.term):
+    eir.return %r : !eir.term
+  }
+
+  eir.func @likely(%c: !eir.bool, %a: !eir.term, %b: !eir.term) -> !eir.term {
+    eir.cond_br %c, ^ok(%a : !eir.term), ^error(%b : !eir.term) {expect = true}
+  ^ok(%r: !eir.term):
+    eir.return %r : !eir.term
+  ^error(%e: !eir.term):
+    eir.return %e : !eir.term
+  }
+
+  eir.func @unknown(%c: !eir.bool, %a: !eir.term, %b: !eir.term) -> !eir.term {
+    eir.cond_br %c, ^ok(%a : !eir.term), ^error(%b : !eir.term)
+  ^ok(%r: !eir.term):
+    eir.return %r : !eir.term
+  ^error(%e: !eir.term):
+    eir.return %e : !eir.term
+  }
+}
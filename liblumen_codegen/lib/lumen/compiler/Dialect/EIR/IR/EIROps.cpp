@@ -730,6 +730,15 @@ void lowerPatternMatch(OpBuilder &builder, Value selector,
         llvm_unreachable("unexpected match pattern type!");
     }
   }
+
+  // Falling through every pattern is a badmatch, so mark the branches to the
+  // fallback as unlikely, which lets LLVM move it out of line
+  if (failed) {
+    for (auto *pred : failed->getPredecessors()) {
+      if (auto condBr = dyn_cast<CondBranchOp>(pred->getTerminator()))
+        condBr.setExpectedCondition(condBr.getTrueDest() != failed);
+    }
+  }
   builder.restoreInsertionPoint(finalIp);
 }
 
@@ -349,6 +349,8 @@ Type EirDialect::parseType(mlir::DialectAsmParser &parser) const {
 
   auto loc = parser.getNameLoc();
   auto context = getContext();
+  // `none`
+  if (typeNameLit == "none") return NoneType::get(context);
   // `term`
   if (typeNameLit == "term") return TermType::get(context);
   // `list`
@@ -361,8 +363,9 @@ Type EirDialect::parseType(mlir::DialectAsmParser &parser) const {
   if (typeNameLit == "float") return FloatType::get(context);
   // `atom`
   if (typeNameLit == "atom") return AtomType::get(context);
-  // `boolean`
-  if (typeNameLit == "boolean") return BooleanType::get(context);
+  // `bool`, as printed, or `boolean`
+  if (typeNameLit == "bool" || typeNameLit == "boolean")
+    return BooleanType::get(context);
   // `fixnum`
   if (typeNameLit == "fixnum") return FixnumType::get(context);
   // `bigint`
@@ -385,6 +388,8 @@ Type EirDialect::parseType(mlir::DialectAsmParser &parser) const {
   if (typeNameLit == "tuple") return parseTuple(context, parser);
   // `box` `<` type `>`
   if (typeNameLit == "box") return parseTypeSingleton<BoxType>(context, parser);
+  // `ref` `<` type `>`
+  if (typeNameLit == "ref") return parseTypeSingleton<RefType>(context, parser);
 
   parser.emitError(loc, "unknown EIR type " + typeNameLit);
   return {};
@@ -403,12 +408,13 @@ void printTuple(TupleType type, llvm::raw_ostream &os,
   auto arity = type.getArity();
   // Single element is always uniform
   if (arity == 0) {
-    os << "0x?";
+    os << "0x?>";
     return;
   }
   if (arity == 1) {
     os << "1x";
     p.printType(type.getElementType(0));
+    os << '>';
     return;
   }
   // Check for uniformity to print more compact representation
@@ -424,6 +430,7 @@ void printTuple(TupleType type, llvm::raw_ostream &os,
   if (uniform) {
     os << arity << 'x';
     p.printType(ty);
+    os << '>';
     return;
   }
 
@@ -0,0 +1,155 @@
+#include "lumen/compiler/Dialect/EIR/Transforms/Passes.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Target/TargetMachine.h"
+#include "lumen/compiler/Target/TargetInfo.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Module.h"
+#include "mlir/Pass/Pass.h"
+
+namespace LLVM = ::mlir::LLVM;
+
+using ::llvm::StringRef;
+using ::llvm::TargetMachine;
+
+namespace lumen {
+namespace eir {
+
+namespace {
+
+// The prefix shared by all runtime builtins called by lowered code
+static const char *kBuiltinPrefix = "__lumen_builtin_";
+
+/// The runtime calls emitted for a single lowered function
+struct FunctionReport {
+  std::string name;
+  uint64_t builtinCalls = 0;
+  uint64_t allocations = 0;
+  uint64_t typeChecks = 0;
+  uint64_t exceptionChecks = 0;
+  uint64_t mapGets = 0;
+  llvm::StringMap<uint64_t> builtins;
+
+  llvm::json::Value toJSON() const {
+    llvm::json::Object callees;
+    for (auto &entry : builtins) callees[entry.getKey()] = entry.getValue();
+    return llvm::json::Object{
+        {"name", name},
+        {"builtin_calls", builtinCalls},
+        {"allocations", allocations},
+        {"type_checks", typeChecks},
+        {"exception_checks", exceptionChecks},
+        {"map_gets", mapGets},
+        {"builtins", std::move(callees)},
+    };
+  }
+};
+
+static bool isTypeCheck(StringRef callee) {
+  return callee == "__lumen_builtin_is_type" ||
+         callee == "__lumen_builtin_is_tuple" ||
+         callee == "__lumen_builtin_is_boxed_type";
+}
+
+// Returns true if `value` is the NONE constant, which is what calls return to
+// signal that an exception was raised (see `ModuleBuilder::build_static_call`)
+static bool isNoneConstant(mlir::Value value, TargetInfo &targetInfo) {
+  auto constOp = llvm::dyn_cast_or_null<LLVM::ConstantOp>(value.getDefiningOp());
+  if (!constOp) return false;
+  auto attr = constOp.value().dyn_cast<mlir::IntegerAttr>();
+  if (!attr) return false;
+  return attr.getValue().getLimitedValue() ==
+         targetInfo.getNoneValue().getLimitedValue();
+}
+
+/// Reports how much of each function still goes through the runtime, i.e. the
+/// calls to builtins, allocations, type checks, and exception checks emitted by
+/// `ConvertEIRToLLVMPass`. This pass does not modify the module.
+class CodegenReportPass : public mlir::ModulePass<CodegenReportPass> {
+ public:
+  CodegenReportPass(TargetMachine *targetMachine_, llvm::raw_ostream *os_,
+                    bool emitRemarks_)
+      : targetMachine(targetMachine_), os(os_), emitRemarks(emitRemarks_) {}
+
+  void runOnModule() override {
+    auto *dialect =
+        getContext().getRegisteredDialect<LLVM::LLVMDialect>();
+    auto &targetInfo = TargetInfo::get(targetMachine, *dialect);
+
+    mlir::ModuleOp mod = getModule();
+    llvm::json::Array functions;
+    for (auto func : mod.getOps<LLVM::LLVMFuncOp>()) {
+      if (func.isExternal()) continue;
+
+      FunctionReport report;
+      report.name = func.getName().str();
+      func.walk([&](LLVM::CallOp call) {
+        auto calleeAttr = call.getAttrOfType<mlir::FlatSymbolRefAttr>("callee");
+        if (!calleeAttr) return;
+        StringRef callee = calleeAttr.getValue();
+
+        if (callee == "erlang:map_get/2") {
+          report.mapGets += 1;
+          return;
+        }
+        if (!callee.startswith(kBuiltinPrefix)) return;
+
+        report.builtinCalls += 1;
+        report.builtins[callee] += 1;
+        if (callee == "__lumen_builtin_malloc") {
+          report.allocations += 1;
+        } else if (isTypeCheck(callee)) {
+          report.typeChecks += 1;
+        } else if (callee == "__lumen_builtin_cmpeq") {
+          for (auto operand : call.getOperands()) {
+            if (isNoneConstant(operand, targetInfo)) {
+              report.exceptionChecks += 1;
+              break;
+            }
+          }
+        }
+      });
+
+      if (emitRemarks) {
+        mlir::emitRemark(func.getLoc())
+            << "[codegen-report] " << report.name << ": "
+            << report.builtinCalls << " builtin calls, " << report.allocations
+            << " allocations, " << report.typeChecks << " type checks, "
+            << report.exceptionChecks << " exception checks, "
+            << report.mapGets << " calls to erlang:map_get/2";
+      }
+      functions.push_back(report.toJSON());
+    }
+
+    if (os) {
+      llvm::json::Object moduleReport{
+          {"module", mod.getName().getValueOr("anonymous")},
+          {"functions", std::move(functions)},
+      };
+      *os << llvm::formatv("{0:2}",
+                           llvm::json::Value(std::move(moduleReport)))
+          << "\n";
+      os->flush();
+    }
+
+    markAllAnalysesPreserved();
+  }
+
+ private:
+  TargetMachine *targetMachine;
+  llvm::raw_ostream *os;
+  bool emitRemarks;
+};
+
+}  // namespace
+
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>> createCodegenReportPass(
+    TargetMachine *targetMachine, llvm::raw_ostream *os, bool emitRemarks) {
+  return std::make_unique<CodegenReportPass>(targetMachine, os, emitRemarks);
+}
+
+}  // namespace eir
+}  // namespace lumen
@@ -0,0 +1,375 @@
+#include "lumen/compiler/Dialect/EIR/Transforms/Passes.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "lumen/compiler/Dialect/EIR/IR/EIROps.h"
+#include "lumen/compiler/Dialect/EIR/IR/EIRTypes.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/Module.h"
+#include "mlir/Pass/Pass.h"
+
+using ::llvm::SmallVector;
+using ::mlir::Block;
+using ::mlir::BlockArgument;
+using ::mlir::OpBuilder;
+using ::mlir::Operation;
+using ::mlir::Value;
+
+namespace lumen {
+namespace eir {
+
+namespace {
+
+// The suffix given to the multi-value variant of a function
+static const char *kMultiValueSuffix = "$multi";
+
+// Returns true if `cond` is the result of comparing `value` to NONE, i.e. the
+// check that a call raised, see `ModuleBuilder::build_call_result`
+static bool isNoneCheckOf(Value cond, Value value) {
+  auto cmp = llvm::dyn_cast_or_null<CmpEqOp>(cond.getDefiningOp());
+  if (!cmp) return false;
+  Value lhs = cmp.lhs();
+  Value rhs = cmp.rhs();
+  if (lhs != value) std::swap(lhs, rhs);
+  return lhs == value &&
+         llvm::isa_and_nonnull<ConstantNoneOp>(rhs.getDefiningOp());
+}
+
+// Returns true if `value` is always NONE, i.e. it is the NONE constant, or a
+// block argument which is only passed when a call raised
+static bool isNone(Value value) {
+  if (Operation *def = value.getDefiningOp())
+    return llvm::isa<ConstantNoneOp>(def);
+
+  auto arg = value.cast<BlockArgument>();
+  Block *block = arg.getOwner();
+  if (block->isEntryBlock() || block->hasNoPredecessors()) return false;
+  for (Block *pred : block->getPredecessors()) {
+    auto condBr = llvm::dyn_cast<CondBranchOp>(pred->getTerminator());
+    if (!condBr || condBr.getFalseDest() == block) return false;
+    Value incoming = condBr.getTrueOperand(arg.getArgNumber());
+    if (!isNoneCheckOf(condBr.getCondition(), incoming)) return false;
+  }
+  return true;
+}
+
+// Returns the arity of the tuples `func` returns, if every return either
+// returns a tuple constructed in `func`, all of the same arity, or NONE
+static Optional<unsigned> getReturnedTupleArity(FuncOp func) {
+  if (func.isExternal() || func.getType().getNumResults() != 1)
+    return llvm::None;
+
+  Optional<unsigned> arity;
+  bool eligible = true;
+  func.walk([&](ReturnOp ret) {
+    if (!eligible) return;
+    if (ret.getNumOperands() != 1) {
+      eligible = false;
+      return;
+    }
+    Value value = ret.getOperand(0);
+    if (auto tuple = llvm::dyn_cast_or_null<TupleOp>(value.getDefiningOp())) {
+      unsigned numElements = tuple.getNumOperands();
+      if (numElements == 0 || (arity && *arity != numElements))
+        eligible = false;
+      arity = numElements;
+      return;
+    }
+    if (!isNone(value)) eligible = false;
+  });
+
+  if (!eligible) return llvm::None;
+  return arity;
+}
+
+/// A call whose result is only checked for NONE, and otherwise passed to a
+/// continuation block which is only reachable from the call
+struct CallSite {
+  CallOp call;
+  CondBranchOp condBr;
+  unsigned resultIndex;
+
+  Block *getContinuation() { return condBr.getFalseDest(); }
+};
+
+static Optional<CallSite> getCallSite(CallOp call) {
+  if (call.getNumResults() != 1) return llvm::None;
+  Value result = call.getResult(0);
+
+  CondBranchOp condBr;
+  for (Operation *user : result.getUsers()) {
+    auto cmp = llvm::dyn_cast<CmpEqOp>(user);
+    if (!cmp) continue;
+    if (!isNoneCheckOf(cmp.getResult(), result)) return llvm::None;
+    for (Operation *cmpUser : cmp.getResult().getUsers()) {
+      auto br = llvm::dyn_cast<CondBranchOp>(cmpUser);
+      if (!br || br.getCondition() != cmp.getResult()) return llvm::None;
+      if (condBr && condBr != br) return llvm::None;
+      condBr = br;
+    }
+  }
+  if (!condBr || condBr.getTrueDest() == condBr.getFalseDest())
+    return llvm::None;
+  for (Operation *user : result.getUsers())
+    if (user != condBr.getOperation() && !llvm::isa<CmpEqOp>(user))
+      return llvm::None;
+
+  // The result must be passed to the continuation exactly once, and the
+  // continuation must only be reachable from the call
+  Block *cont = condBr.getFalseDest();
+  if (cont->getSinglePredecessor() != call.getOperation()->getBlock())
+    return llvm::None;
+  Optional<unsigned> resultIndex;
+  for (unsigned i = 0, e = condBr.getNumFalseOperands(); i < e; ++i) {
+    if (condBr.getFalseOperand(i) != result) continue;
+    if (resultIndex) return llvm::None;
+    resultIndex = i;
+  }
+  if (!resultIndex) return llvm::None;
+
+  return CallSite{call, condBr, *resultIndex};
+}
+
+static llvm::SmallPtrSet<Block *, 16> getReachableBlocks(mlir::Region &region) {
+  llvm::SmallPtrSet<Block *, 16> reachable;
+  SmallVector<Block *, 8> worklist{&region.front()};
+  while (!worklist.empty()) {
+    Block *block = worklist.pop_back_val();
+    if (!reachable.insert(block).second) continue;
+    Operation *terminator = block->getTerminator();
+    for (unsigned i = 0, e = terminator->getNumSuccessors(); i < e; ++i)
+      worklist.push_back(terminator->getSuccessor(i));
+  }
+  return reachable;
+}
+
+static void eraseUnreachableBlocks(mlir::Region &region) {
+  auto reachable = getReachableBlocks(region);
+  SmallVector<Block *, 4> unreachable;
+  for (Block &block : region)
+    if (!reachable.count(&block)) unreachable.push_back(&block);
+  for (Block *block : unreachable) block->dropAllReferences();
+  for (Block *block : unreachable) block->dropAllDefinedValueUses();
+  for (Block *block : unreachable) block->erase();
+}
+
+// Rewrites the tuple matches on `tuple` to use `elements` directly, see the
+// tuple pattern in `lowerPatternMatch`:
+//
+//   %isTuple = eir.is_type(%tuple) : box<tuple<N>>
+//   eir.cond_br %isTuple, ^split, ^next
+// ^split:
+//   %boxed = eir.cast %tuple : box<tuple<N>>
+//   %ptr = eir.getelementptr %boxed[i + 1]
+//   %element = eir.load %ptr
+//
+// The type check becomes an unconditional branch, and the loads are replaced
+// by the corresponding element.
+static void forwardTupleElements(Value tuple, ArrayRef<Value> elements) {
+  unsigned arity = elements.size();
+  auto isTupleOfArity = [&](Type type) {
+    auto boxTy = type.dyn_cast_or_null<BoxType>();
+    if (!boxTy) return false;
+    auto tupleTy = boxTy.getBoxedType().dyn_cast_or_null<TupleType>();
+    return tupleTy && tupleTy.hasStaticShape() && tupleTy.getArity() == arity;
+  };
+  auto usersOf = [](Value value) {
+    return SmallVector<Operation *, 2>(value.getUsers().begin(),
+                                       value.getUsers().end());
+  };
+
+  for (Operation *user : usersOf(tuple)) {
+    if (auto isType = llvm::dyn_cast<IsTypeOp>(user)) {
+      if (!isTupleOfArity(isType.getMatchType())) continue;
+      for (Operation *check : usersOf(isType.getResult())) {
+        auto condBr = llvm::dyn_cast<CondBranchOp>(check);
+        if (!condBr || condBr.getCondition() != isType.getResult()) continue;
+        OpBuilder builder(condBr);
+        SmallVector<Value, 2> args(condBr.true_operand_begin(),
+                                   condBr.true_operand_end());
+        builder.create<BranchOp>(condBr.getLoc(), condBr.getTrueDest(), args);
+        condBr.erase();
+      }
+      if (isType.use_empty()) isType.erase();
+      continue;
+    }
+
+    if (auto castOp = llvm::dyn_cast<CastOp>(user)) {
+      if (!isTupleOfArity(castOp.getResult().getType())) continue;
+      for (Operation *op : usersOf(castOp.getResult())) {
+        auto gep = llvm::dyn_cast<GetElementPtrOp>(op);
+        if (!gep || gep.getNumOperands() != 1) continue;
+        uint64_t index = gep.getIndex();
+        if (index < 1 || index > arity) continue;
+        for (Operation *load : usersOf(gep.getResult())) {
+          if (!llvm::isa<LoadOp>(load)) continue;
+          load->getResult(0).replaceAllUsesWith(elements[index - 1]);
+          load->erase();
+        }
+        if (gep.use_empty()) gep.erase();
+      }
+      if (castOp.use_empty()) castOp.erase();
+    }
+  }
+}
+
+/// Lets functions which always return a tuple of the same arity return its
+/// elements as multiple values instead, so that calls which immediately match
+/// on the result do not allocate the tuple at all.
+///
+/// For each such function `f`, the body is moved to a new function `f$multi`,
+/// which returns the elements of the tuple, or NONE in every result if it
+/// raised. `f` itself becomes a wrapper which calls `f$multi` and boxes the
+/// result, so that it keeps the ABI expected by the dispatch table, other
+/// modules, and the runtime. Calls to `f` in this module which only check the
+/// result for NONE, and then pass it to a continuation, are redirected to
+/// `f$multi`, and any tuple match on the result in that continuation is
+/// rewritten to use the returned elements directly. The tuple is only
+/// constructed in the continuation if the match does not account for all of
+/// its uses.
+class MultiValueReturnPass : public mlir::ModulePass<MultiValueReturnPass> {
+ public:
+  void runOnModule() override {
+    mlir::ModuleOp mod = getModule();
+
+    SmallVector<std::pair<FuncOp, unsigned>, 4> candidates;
+    for (auto func : mod.getOps<FuncOp>()) {
+      if (func.getName().endswith(kMultiValueSuffix)) continue;
+      if (auto arity = getReturnedTupleArity(func))
+        candidates.emplace_back(func, *arity);
+    }
+    if (candidates.empty()) return;
+
+    // Find the call sites which can use the multi-value variant
+    llvm::DenseMap<Operation *, SmallVector<CallSite, 2>> callSites;
+    for (auto &candidate : candidates)
+      callSites[candidate.first.getOperation()];
+    mod.walk([&](CallOp call) {
+      auto callee = mod.lookupSymbol<FuncOp>(call.getCallee());
+      if (!callee) return;
+      auto it = callSites.find(callee.getOperation());
+      if (it == callSites.end()) return;
+      if (auto site = getCallSite(call)) it->second.push_back(*site);
+    });
+
+    llvm::SmallPtrSet<mlir::Region *, 4> rewritten;
+    for (auto &candidate : candidates) {
+      auto &sites = callSites[candidate.first.getOperation()];
+      if (sites.empty()) continue;
+      auto multi = createMultiValueFunction(candidate.first, candidate.second);
+      if (!multi) continue;
+      for (auto &site : sites) {
+        rewriteCallSite(site, multi);
+        rewritten.insert(site.getContinuation()->getParent());
+      }
+    }
+
+    // Matches which can no longer fail leave their other patterns unreachable
+    for (auto *region : rewritten) eraseUnreachableBlocks(*region);
+  }
+
+ private:
+  // Moves the body of `func` to a new function returning `arity` values, and
+  // makes `func` a wrapper around it
+  FuncOp createMultiValueFunction(FuncOp func, unsigned arity) {
+    mlir::ModuleOp mod = getModule();
+    auto name = (func.getName() + kMultiValueSuffix).str();
+    if (mod.lookupSymbol(name)) return nullptr;
+
+    auto loc = func.getLoc();
+    OpBuilder builder(func);
+    builder.setInsertionPointAfter(func);
+    auto termTy = builder.getType<TermType>();
+    auto fnTy = func.getType();
+    SmallVector<Type, 2> resultTypes(arity, termTy);
+    auto multiTy = builder.getFunctionType(fnTy.getInputs(), resultTypes);
+    auto multi = builder.create<FuncOp>(loc, name, multiTy);
+    multi.getBody().takeBody(func.getBody());
+
+    // Return the elements of the tuple, or NONE in every result
+    SmallVector<ReturnOp, 4> returns;
+    multi.walk([&](ReturnOp ret) { returns.push_back(ret); });
+    for (auto ret : returns) {
+      Value value = ret.getOperand(0);
+      SmallVector<Value, 2> results;
+      auto tuple = llvm::dyn_cast_or_null<TupleOp>(value.getDefiningOp());
+      if (tuple)
+        results.append(tuple.operand_begin(), tuple.operand_end());
+      else
+        results.append(arity, value);
+      OpBuilder retBuilder(ret);
+      retBuilder.create<ReturnOp>(ret.getLoc(), results);
+      ret.erase();
+      if (tuple && tuple.use_empty()) tuple.erase();
+    }
+
+    // The wrapper boxes the results, unless the callee raised
+    Block *entry = func.addEntryBlock();
+    Block *ok = func.addBlock();
+    Block *err = func.addBlock();
+    builder.setInsertionPointToEnd(entry);
+    SmallVector<Value, 4> args(entry->args_begin(), entry->args_end());
+    auto call = builder.create<CallOp>(loc, multi, args);
+    Value first = call.getResult(0);
+    Value none = builder.create<ConstantNoneOp>(loc);
+    Value isErr = builder.create<CmpEqOp>(loc, first, none, /*strict=*/false);
+    auto condBr = builder.create<CondBranchOp>(loc, isErr, err, ValueRange(),
+                                               ok, ValueRange());
+    condBr.setExpectedCondition(false);
+    builder.setInsertionPointToEnd(err);
+    builder.create<ReturnOp>(loc, first);
+    builder.setInsertionPointToEnd(ok);
+    SmallVector<Value, 2> elements(call.result_begin(), call.result_end());
+    Value tuple = builder.create<TupleOp>(loc, elements);
+    builder.create<ReturnOp>(loc, tuple);
+
+    return multi;
+  }
+
+  void rewriteCallSite(CallSite &site, FuncOp multi) {
+    CallOp call = site.call;
+    OpBuilder builder(call);
+    auto multiCall =
+        builder.create<CallOp>(call.getLoc(), multi, call.getOperands());
+    SmallVector<Value, 2> elements(multiCall.result_begin(),
+                                   multiCall.result_end());
+
+    // Forward the elements to the continuation, which the call dominates, and
+    // only construct the tuple there if it is still needed. Uses left in
+    // blocks which the match made unreachable are dropped along with them
+    Block *cont = site.getContinuation();
+    Value tuple = cont->getArgument(site.resultIndex);
+    forwardTupleElements(tuple, elements);
+    auto reachable = getReachableBlocks(*cont->getParent());
+    bool needed = llvm::any_of(tuple.getUsers(), [&](Operation *user) {
+      return reachable.count(user->getBlock());
+    });
+    if (needed) {
+      OpBuilder contBuilder = OpBuilder::atBlockBegin(cont);
+      Value boxed = contBuilder.create<TupleOp>(call.getLoc(), elements);
+      tuple.replaceAllUsesWith(boxed);
+    } else {
+      tuple.replaceAllUsesWith(elements.front());
+    }
+    cont->eraseArgument(site.resultIndex);
+
+    // The first result is NONE if the callee raised, so it stands in for the
+    // tuple in the NONE check, and on the error path
+    call.getResult(0).replaceAllUsesWith(elements.front());
+    call.erase();
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>>
+createMultiValueReturnPass() {
+  return std::make_unique<MultiValueReturnPass>();
+}
+
+static mlir::PassRegistration<MultiValueReturnPass> pass(
+    "lumen-eir-multi-value-return",
+    "Return tuples built by a function as multiple values to local calls");
+
+}  // namespace eir
+}  // namespace lumen
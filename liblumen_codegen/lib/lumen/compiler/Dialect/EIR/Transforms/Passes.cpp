@@ -5,6 +5,7 @@
 #include "llvm/Target/TargetMachine.h"
 #include "lumen/compiler/Dialect/EIR/Conversion/EIRToLLVM/ConvertEIRToLLVM.h"
 #include "lumen/compiler/Dialect/EIR/IR/EIROps.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Pass/PassManager.h"
 #include "mlir/Pass/PassRegistry.h"
 #include "mlir/Transforms/Passes.h"
@@ -13,10 +14,20 @@ namespace lumen {
 namespace eir {
 
 void buildEIRTransformPassPipeline(mlir::OpPassManager &passManager,
-                                   llvm::TargetMachine *targetMachine) {
+                                   llvm::TargetMachine *targetMachine,
+                                   llvm::raw_ostream *report,
+                                   bool emitRemarks) {
+  passManager.addPass(createMultiValueReturnPass());
+  passManager.addPass(createReceiveMarkerPass());
   passManager.addPass(createConvertEIRToLLVMPass(targetMachine));
-  passManager.addPass(mlir::createCanonicalizerPass());
-  passManager.addPass(mlir::createCSEPass());
+  if (report || emitRemarks) {
+    passManager.addPass(
+        createCodegenReportPass(targetMachine, report, emitRemarks));
+  }
+  // Cleanup is done per-function, so that it can be run in parallel
+  mlir::OpPassManager &funcPM = passManager.nest<mlir::LLVM::LLVMFuncOp>();
+  funcPM.addPass(mlir::createCanonicalizerPass());
+  funcPM.addPass(mlir::createCSEPass());
   // passManager.addPass(createGlobalInitializationPass());
   // TODO: run symbol DCE pass.
 }
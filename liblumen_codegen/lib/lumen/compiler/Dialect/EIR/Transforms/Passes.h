@@ -9,7 +9,8 @@
 
 namespace llvm {
 class TargetMachine;
-}
+class raw_ostream;
+}  // namespace llvm
 
 namespace lumen {
 namespace eir {
@@ -28,8 +29,42 @@ namespace eir {
 //   <run conversion to EIR/etc>
 //   buildEIRTransformPassPipeline & run
 //   <run target serialization/etc>
+//
+// If `report` is given, or `emitRemarks` is set, a codegen report is produced
+// for the lowered module, see `createCodegenReportPass`.
 void buildEIRTransformPassPipeline(mlir::OpPassManager &passManager,
-                                   llvm::TargetMachine *targetMachine);
+                                   llvm::TargetMachine *targetMachine,
+                                   llvm::raw_ostream *report = nullptr,
+                                   bool emitRemarks = false);
+
+//===----------------------------------------------------------------------===//
+// Optimizations
+//===----------------------------------------------------------------------===//
+
+// Lets functions which always return a tuple of the same arity return its
+// elements as multiple values to the calls in the same module, so that calls
+// which immediately match on the tuple do not allocate it. The functions keep
+// their original signature for other callers, via a wrapper.
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>> createMultiValueReturnPass();
+
+// Lets receives which only accept messages containing a reference made by
+// `erlang:make_ref/0` skip the messages which were in the mailbox before it was
+// made, by marking the end of the mailbox when the reference is made.
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>> createReceiveMarkerPass();
+
+//===----------------------------------------------------------------------===//
+// Analysis
+//===----------------------------------------------------------------------===//
+
+// Counts, per function, the calls to runtime builtins, allocations, type checks
+// and exception checks emitted when lowering EIR to the LLVM dialect.
+//
+// The counts are written to `os` as JSON, if given, and are emitted as remarks
+// on each function if `emitRemarks` is set. Must run directly after the
+// conversion to LLVM, before any cleanup passes.
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>> createCodegenReportPass(
+    llvm::TargetMachine *targetMachine, llvm::raw_ostream *os,
+    bool emitRemarks);
 
 //===----------------------------------------------------------------------===//
 // Module Analysis and Assignment
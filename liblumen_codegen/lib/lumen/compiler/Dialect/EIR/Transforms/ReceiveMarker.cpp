@@ -0,0 +1,245 @@
+#include "lumen/compiler/Dialect/EIR/Transforms/Passes.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "lumen/compiler/Dialect/EIR/IR/EIROps.h"
+#include "mlir/Analysis/Dominance.h"
+#include "mlir/IR/Builders.h"
+#include "mlir/IR/Module.h"
+#include "mlir/Pass/Pass.h"
+
+using ::llvm::SmallPtrSet;
+using ::llvm::SmallPtrSetImpl;
+using ::llvm::SmallVector;
+using ::llvm::SmallVectorImpl;
+using ::mlir::Block;
+using ::mlir::BlockArgument;
+using ::mlir::OpBuilder;
+using ::mlir::Operation;
+using ::mlir::Value;
+
+namespace lumen {
+namespace eir {
+
+namespace {
+
+// Gets the values passed to the block argument `arg` by each predecessor of
+// its block, returning false if a predecessor is not a branch
+static bool getIncomingValues(BlockArgument arg,
+                              SmallVectorImpl<Value> &incoming) {
+  Block *block = arg.getOwner();
+  if (block->isEntryBlock() || block->hasNoPredecessors()) return false;
+  unsigned index = arg.getArgNumber();
+  for (Block *pred : block->getPredecessors()) {
+    Operation *terminator = pred->getTerminator();
+    if (auto br = llvm::dyn_cast<BranchOp>(terminator)) {
+      incoming.push_back(br.getOperand(index));
+      continue;
+    }
+    auto condBr = llvm::dyn_cast<CondBranchOp>(terminator);
+    if (!condBr) return false;
+    if (condBr.getTrueDest() == block)
+      incoming.push_back(condBr.getTrueOperand(index));
+    if (condBr.getFalseDest() == block)
+      incoming.push_back(condBr.getFalseOperand(index));
+  }
+  return true;
+}
+
+// Returns the value defined by an operation which `value` always is, looking
+// through the block arguments it is passed along as
+static Value resolveValue(Value value, SmallPtrSetImpl<Block *> &visited) {
+  auto arg = value.dyn_cast<BlockArgument>();
+  if (!arg) return value;
+  if (!visited.insert(arg.getOwner()).second) return nullptr;
+
+  SmallVector<Value, 2> incoming;
+  if (!getIncomingValues(arg, incoming)) return nullptr;
+  Value resolved;
+  for (Value in : incoming) {
+    Value def = resolveValue(in, visited);
+    if (!def || (resolved && def != resolved)) return nullptr;
+    resolved = def;
+  }
+  return resolved;
+}
+
+// Returns true if `value` is `message`, or an element of it, e.g. as loaded by
+// a tuple or cons pattern, see `lowerPatternMatch`
+static bool isPartOf(Value value, Value message,
+                     SmallPtrSetImpl<Block *> &visited) {
+  if (value == message) return true;
+
+  if (auto arg = value.dyn_cast<BlockArgument>()) {
+    if (!visited.insert(arg.getOwner()).second) return false;
+    SmallVector<Value, 2> incoming;
+    if (!getIncomingValues(arg, incoming)) return false;
+    return llvm::all_of(incoming, [&](Value in) {
+      return isPartOf(in, message, visited);
+    });
+  }
+
+  Operation *def = value.getDefiningOp();
+  if (auto load = llvm::dyn_cast<LoadOp>(def))
+    return isPartOf(load.ref(), message, visited);
+  if (auto gep = llvm::dyn_cast<GetElementPtrOp>(def))
+    return isPartOf(gep.base(), message, visited);
+  if (auto cast = llvm::dyn_cast<CastOp>(def))
+    return isPartOf(cast.input(), message, visited);
+  return false;
+}
+
+// If `cond` compares part of `message` to a reference made by
+// `erlang:make_ref/0`, returns the operation which made it
+static MakeRefOp getReferenceCheckedBy(Value cond, Value message) {
+  auto cmp = llvm::dyn_cast_or_null<CmpEqOp>(cond.getDefiningOp());
+  if (!cmp) return {};
+
+  Value lhs = cmp.lhs();
+  Value rhs = cmp.rhs();
+  for (unsigned i = 0; i < 2; ++i, std::swap(lhs, rhs)) {
+    SmallPtrSet<Block *, 4> visited;
+    if (!isPartOf(lhs, message, visited)) continue;
+    visited.clear();
+    Value ref = resolveValue(rhs, visited);
+    if (!ref) continue;
+    if (auto makeRef = llvm::dyn_cast_or_null<MakeRefOp>(ref.getDefiningOp()))
+      return makeRef;
+  }
+  return {};
+}
+
+/// The loop a receive started by `start` scans the mailbox with, as built by
+/// `ModuleBuilder::build_receive_wait`:
+///
+///   %ref = eir.receive.start(%timeout)
+///   ...
+///   eir.cond_br %isNone, ^raise(%ref), ^loop(..., %ref)
+/// ^loop(...):
+///   eir.br ^peek
+/// ^peek:
+///   %msg = eir.receive.peek()
+///   ...
+///   eir.cond_br %isEmpty, ^wait, ^message(..., %msg)
+struct ReceiveLoop {
+  Block *loop;
+  Block *peek;
+  Block *wait;
+  Block *message;
+  Value msg;
+};
+
+static Optional<ReceiveLoop> getReceiveLoop(ReceiveStartOp start) {
+  Block *startBlock = start.getOperation()->getBlock();
+  auto startBr = llvm::dyn_cast<CondBranchOp>(startBlock->getTerminator());
+  if (!startBr) return llvm::None;
+
+  Block *loop = startBr.getFalseDest();
+  auto loopBr = llvm::dyn_cast<BranchOp>(loop->getTerminator());
+  if (!loopBr) return llvm::None;
+
+  Block *peek = loopBr.getDest();
+  if (!llvm::isa<ReceivePeekOp>(peek->front())) return llvm::None;
+  auto peekBr = llvm::dyn_cast<CondBranchOp>(peek->getTerminator());
+  if (!peekBr || peekBr.getNumFalseOperands() == 0) return llvm::None;
+
+  Block *message = peekBr.getFalseDest();
+  unsigned msgIndex = peekBr.getNumFalseOperands() - 1;
+  if (peekBr.getFalseOperand(msgIndex) != peek->front().getResult(0))
+    return llvm::None;
+  if (message->getSinglePredecessor() != peek) return llvm::None;
+
+  return ReceiveLoop{loop, peek, peekBr.getTrueDest(), message,
+                     message->getArgument(msgIndex)};
+}
+
+// Returns the reference made by `erlang:make_ref/0` which every message the
+// receive accepts must contain, if there is one. This is the case when every
+// path from the peek to an `eir.receive.done` passes a successful comparison
+// of part of the message with that reference.
+static MakeRefOp getRequiredReference(const ReceiveLoop &receive) {
+  MakeRefOp required;
+  SmallPtrSet<Block *, 16> visited{receive.loop, receive.peek, receive.wait};
+  SmallVector<Block *, 8> worklist{receive.message};
+  while (!worklist.empty()) {
+    Block *block = worklist.pop_back_val();
+    if (!visited.insert(block).second) continue;
+
+    // The message is accepted without checking for the reference
+    bool accepts = llvm::any_of(
+        *block, [](Operation &op) { return llvm::isa<ReceiveDoneOp>(op); });
+    if (accepts) return {};
+
+    // Messages which do not contain the reference fall through to the next
+    // clause, or back to the loop
+    Operation *terminator = block->getTerminator();
+    if (auto condBr = llvm::dyn_cast<CondBranchOp>(terminator)) {
+      if (auto makeRef =
+              getReferenceCheckedBy(condBr.getCondition(), receive.msg)) {
+        if (required && required != makeRef) return {};
+        required = makeRef;
+        worklist.push_back(condBr.getFalseDest());
+        continue;
+      }
+    }
+    for (unsigned i = 0, e = terminator->getNumSuccessors(); i < e; ++i)
+      worklist.push_back(terminator->getSuccessor(i));
+  }
+  return required;
+}
+
+/// Lets a receive which only accepts messages containing a reference made by
+/// `erlang:make_ref/0` skip the messages which were already in the mailbox
+/// when it was made, as BEAM does, e.g. for the reply to a `gen_server:call`.
+///
+/// The end of the mailbox is saved with `eir.receive.mark` directly after the
+/// reference is made, as it cannot have been sent yet, and the receive moves
+/// its cursor there with `eir.receive.set` once started. The runtime only
+/// honours the last reference marked, so the receive is still correct, if
+/// slower, when another reference has been made in between.
+class ReceiveMarkerPass : public mlir::ModulePass<ReceiveMarkerPass> {
+ public:
+  void runOnModule() override {
+    mlir::ModuleOp mod = getModule();
+
+    for (auto func : mod.getOps<FuncOp>()) {
+      SmallVector<ReceiveStartOp, 2> starts;
+      func.walk([&](ReceiveStartOp start) { starts.push_back(start); });
+      if (starts.empty()) continue;
+
+      mlir::DominanceInfo domInfo(func);
+      SmallPtrSet<Operation *, 2> marked;
+      for (auto start : starts) {
+        auto receive = getReceiveLoop(start);
+        if (!receive) continue;
+        MakeRefOp makeRef = getRequiredReference(*receive);
+        if (!makeRef ||
+            !domInfo.properlyDominates(makeRef.getOperation(),
+                                       start.getOperation()))
+          continue;
+
+        Value ref = makeRef.getResult();
+        if (marked.insert(makeRef.getOperation()).second) {
+          OpBuilder builder(makeRef.getOperation()->getBlock(),
+                            ++Block::iterator(makeRef.getOperation()));
+          builder.create<ReceiveMarkOp>(makeRef.getLoc(), ref);
+        }
+        OpBuilder builder(start.getOperation()->getBlock(),
+                          ++Block::iterator(start.getOperation()));
+        builder.create<ReceiveSetOp>(start.getLoc(), ref);
+      }
+    }
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<mlir::OpPassBase<mlir::ModuleOp>> createReceiveMarkerPass() {
+  return std::make_unique<ReceiveMarkerPass>();
+}
+
+static mlir::PassRegistration<ReceiveMarkerPass> pass(
+    "lumen-eir-receive-marker",
+    "Let receives for a new reference skip older messages");
+
+}  // namespace eir
+}  // namespace lumen
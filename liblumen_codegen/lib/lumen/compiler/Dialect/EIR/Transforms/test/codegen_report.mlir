@@ -0,0 +1,36 @@
+// RUN: lumen-opt -lumen-codegen-report -verify-diagnostics %s | LumenFileCheck %s
+
+// Each defined function is reported, counting its calls to runtime builtins,
+// and of those, the allocations, type checks, and comparisons with NONE which
+// check whether a call raised. External functions are not reported.
+
+// CHECK: "functions": [
+// CHECK-DAG: "name": "f"
+// CHECK-DAG: "builtin_calls": 4
+// CHECK-DAG: "allocations": 1
+// CHECK-DAG: "type_checks": 1
+// CHECK-DAG: "exception_checks": 1
+// CHECK-DAG: "map_gets": 1
+// CHECK-DAG: "__lumen_builtin_cmpeq": 2
+// CHECK-DAG: "__lumen_builtin_is_tuple": 1
+// CHECK-DAG: "__lumen_builtin_malloc": 1
+// CHECK-DAG: "module": "report"
+module @report {
+  llvm.func @__lumen_builtin_malloc(!llvm.i64) -> !llvm<"i8*">
+  llvm.func @__lumen_builtin_is_tuple(!llvm.i64, !llvm.i64) -> !llvm.i1
+  llvm.func @__lumen_builtin_cmpeq(!llvm.i64, !llvm.i64) -> !llvm.i1
+  llvm.func @"erlang:map_get/2"(!llvm.i64, !llvm.i64) -> !llvm.i64
+
+  // expected-remark@+1 {{[codegen-report] f: 4 builtin calls, 1 allocations, 1 type checks, 1 exception checks, 1 calls to erlang:map_get/2}}
+  llvm.func @f(%arg0: !llvm.i64, %arg1: !llvm.i64) -> !llvm.i64 {
+    %size = llvm.mlir.constant(16 : i64) : !llvm.i64
+    %0 = llvm.call @__lumen_builtin_malloc(%size) : (!llvm.i64) -> !llvm<"i8*">
+    %arity = llvm.mlir.constant(2 : i64) : !llvm.i64
+    %1 = llvm.call @__lumen_builtin_is_tuple(%arity, %arg0) : (!llvm.i64, !llvm.i64) -> !llvm.i1
+    %2 = llvm.call @"erlang:map_get/2"(%arg0, %arg1) : (!llvm.i64, !llvm.i64) -> !llvm.i64
+    %none = llvm.mlir.constant(0 : i64) : !llvm.i64
+    %3 = llvm.call @__lumen_builtin_cmpeq(%2, %none) : (!llvm.i64, !llvm.i64) -> !llvm.i1
+    %4 = llvm.call @__lumen_builtin_cmpeq(%2, %arg0) : (!llvm.i64, !llvm.i64) -> !llvm.i1
+    llvm.return %2 : !llvm.i64
+  }
+}
@@ -0,0 +1,121 @@
+// RUN: lumen-opt -split-input-file -lumen-eir-multi-value-return %s | LumenFileCheck %s
+
+// A function which always returns a pair returns its elements to a call which
+// matches on the result, and keeps its signature for every other caller
+
+// CHECK-LABEL: eir.func @pair(
+// CHECK-SAME: %[[A:arg[0-9]+]]: !eir.term, %[[B:arg[0-9]+]]: !eir.term) -> !eir.term
+// CHECK-NEXT: %[[RESULTS:[0-9]+]]:2 = eir.call @pair$multi(%[[A]], %[[B]])
+// CHECK: eir.cmp.eq %[[RESULTS]]#0
+// CHECK: %[[TUPLE:[0-9]+]] = eir.tuple(%[[RESULTS]]#0, %[[RESULTS]]#1)
+// CHECK-NEXT: eir.return %[[TUPLE]]
+// CHECK: eir.return %[[RESULTS]]#0
+
+// CHECK-LABEL: eir.func @pair$multi(
+// CHECK-SAME: %[[A:arg[0-9]+]]: !eir.term, %[[B:arg[0-9]+]]: !eir.term) -> (!eir.term, !eir.term)
+// CHECK-NEXT: eir.return %[[B]], %[[A]] : !eir.term, !eir.term
+
+// CHECK-LABEL: eir.func @swap(
+// CHECK-NEXT: %[[RESULTS:[0-9]+]]:2 = eir.call @pair$multi(
+// CHECK-NOT: eir.tuple
+// CHECK-NOT: eir.is_type
+// CHECK-NOT: eir.load
+// CHECK: eir.math.add %[[RESULTS]]#0, %[[RESULTS]]#1
+// CHECK-NOT: eir.unreachable
+module {
+  eir.func @pair(%a: !eir.term, %b: !eir.term) -> !eir.term {
+    %t = eir.tuple(%b, %a) : (!eir.term, !eir.term) -> !eir.tuple<2x!eir.term>
+    eir.return %t : !eir.tuple<2x!eir.term>
+  }
+
+  eir.func @swap(%a: !eir.term, %b: !eir.term) -> !eir.term {
+    %r = eir.call @pair(%a, %b) : (!eir.term, !eir.term) -> !eir.term
+    %none = "eir.constant.none"() {value = unit} : () -> !eir.none
+    %raised = eir.cmp.eq %r, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %raised, ^raise(%r : !eir.term), ^match(%r : !eir.term)
+  ^raise(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^match(%t: !eir.term):
+    %isPair = eir.is_type(%t) {type = !eir.box<!eir.tuple<2x!eir.term>>} : (!eir.term) -> !eir.bool
+    eir.cond_br %isPair, ^split, ^badmatch
+  ^split:
+    %boxed = eir.cast %t : !eir.term to !eir.box<!eir.tuple<2x!eir.term>>
+    %p1 = "eir.getelementptr"(%boxed) {index = 1 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %x = eir.load(%p1) : (!eir.ref<!eir.term>) -> !eir.term
+    %p2 = "eir.getelementptr"(%boxed) {index = 2 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %y = eir.load(%p2) : (!eir.ref<!eir.term>) -> !eir.term
+    %sum = eir.math.add %x, %y : (!eir.term, !eir.term) -> !eir.term
+    eir.return %sum : !eir.term
+  ^badmatch:
+    eir.unreachable
+  }
+}
+
+// -----
+
+// A call which uses the result other than by matching on it gets the tuple,
+// which is only built once the call is known not to have raised
+
+// CHECK-LABEL: eir.func @keep(
+// CHECK-NEXT: %[[RESULTS:[0-9]+]]:2 = eir.call @pair$multi(
+// CHECK: eir.cond_br %{{[0-9]+}}, ^bb1(%[[RESULTS]]#0 : !eir.term), ^bb2
+// CHECK: ^bb2:
+// CHECK-NEXT: %[[TUPLE:[0-9]+]] = eir.tuple(%[[RESULTS]]#0, %[[RESULTS]]#1)
+// CHECK-NEXT: eir.return %[[TUPLE]]
+module {
+  eir.func @pair(%a: !eir.term, %b: !eir.term) -> !eir.term {
+    %t = eir.tuple(%a, %b) : (!eir.term, !eir.term) -> !eir.tuple<2x!eir.term>
+    eir.return %t : !eir.tuple<2x!eir.term>
+  }
+
+  eir.func @keep(%a: !eir.term, %b: !eir.term) -> !eir.term {
+    %r = eir.call @pair(%a, %b) : (!eir.term, !eir.term) -> !eir.term
+    %none = "eir.constant.none"() {value = unit} : () -> !eir.none
+    %raised = eir.cmp.eq %r, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %raised, ^raise(%r : !eir.term), ^done(%r : !eir.term)
+  ^raise(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^done(%t: !eir.term):
+    eir.return %t : !eir.term
+  }
+}
+
+// -----
+
+// Functions which may return something other than a tuple of one arity, or
+// which are not called in this module, are left alone
+
+// CHECK-LABEL: eir.func @either(
+// CHECK-NOT: $multi
+// CHECK-LABEL: eir.func @unused(
+// CHECK-NOT: $multi
+// CHECK-LABEL: eir.func @caller(
+// CHECK-NEXT: eir.call @either(
+// CHECK-NOT: $multi
+module {
+  eir.func @either(%a: !eir.term, %c: !eir.bool) -> !eir.term {
+    eir.cond_br %c, ^pair, ^triple
+  ^pair:
+    %p = eir.tuple(%a, %a) : (!eir.term, !eir.term) -> !eir.tuple<2x!eir.term>
+    eir.return %p : !eir.tuple<2x!eir.term>
+  ^triple:
+    %t = eir.tuple(%a, %a, %a) : (!eir.term, !eir.term, !eir.term) -> !eir.tuple<3x!eir.term>
+    eir.return %t : !eir.tuple<3x!eir.term>
+  }
+
+  eir.func @unused(%a: !eir.term) -> !eir.term {
+    %t = eir.tuple(%a, %a) : (!eir.term, !eir.term) -> !eir.tuple<2x!eir.term>
+    eir.return %t : !eir.tuple<2x!eir.term>
+  }
+
+  eir.func @caller(%a: !eir.term, %c: !eir.bool) -> !eir.term {
+    %r = eir.call @either(%a, %c) : (!eir.term, !eir.bool) -> !eir.term
+    %none = "eir.constant.none"() {value = unit} : () -> !eir.none
+    %raised = eir.cmp.eq %r, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %raised, ^raise(%r : !eir.term), ^done(%r : !eir.term)
+  ^raise(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^done(%t: !eir.term):
+    eir.return %t : !eir.term
+  }
+}
@@ -0,0 +1,102 @@
+// RUN: lumen-opt -split-input-file -lumen-eir-receive-marker %s | LumenFileCheck %s
+
+// A receive which only accepts replies tagged with a new reference starts from
+// the end of the mailbox as it was when the reference was made, as in:
+//
+//   Ref = make_ref(),
+//   receive {Ref, Reply} -> Reply after Timeout -> timeout end
+
+// CHECK-LABEL: eir.func @call(
+// CHECK: %[[REF:[0-9]+]] = eir.make_ref
+// CHECK-NEXT: eir.receive.mark(%[[REF]]) : !eir.term
+// CHECK: eir.receive.start
+// CHECK-NEXT: eir.receive.set(%[[REF]]) : !eir.term
+// CHECK-NOT: eir.receive.mark
+// CHECK-NOT: eir.receive.set
+module {
+  eir.func @call(%timeout: !eir.term) -> !eir.term {
+    %none = "eir.constant.none"() {value = unit} : () -> !eir.none
+    %ref = eir.make_ref : () -> !eir.term
+    %start = eir.receive.start %timeout : (!eir.term) -> !eir.term
+    %invalid = eir.cmp.eq %start, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %invalid, ^raise(%start : !eir.term), ^loop(%start : !eir.term)
+  ^raise(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^loop(%r: !eir.term):
+    eir.br ^peek
+  ^peek:
+    %msg = eir.receive.peek() : !eir.term
+    %empty = eir.cmp.eq %msg, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %empty, ^wait, ^message(%msg : !eir.term)
+  ^wait:
+    %timedOut = eir.receive.wait() : !eir.bool
+    eir.cond_br %timedOut, ^timeout, ^peek
+  ^timeout:
+    eir.return %timeout : !eir.term
+  ^message(%m: !eir.term):
+    %isPair = eir.is_type(%m) {type = !eir.box<!eir.tuple<2x!eir.term>>} : (!eir.term) -> !eir.bool
+    eir.cond_br %isPair, ^split, ^loop(%r : !eir.term)
+  ^split:
+    %boxed = eir.cast %m : !eir.term to !eir.box<!eir.tuple<2x!eir.term>>
+    %p1 = "eir.getelementptr"(%boxed) {index = 1 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %tag = eir.load(%p1) : (!eir.ref<!eir.term>) -> !eir.term
+    %isRef = eir.cmp.eq %tag, %ref : (!eir.term, !eir.term) -> !eir.bool
+    eir.cond_br %isRef, ^accept, ^loop(%r : !eir.term)
+  ^accept:
+    eir.receive.done
+    %p2 = "eir.getelementptr"(%boxed) {index = 2 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %reply = eir.load(%p2) : (!eir.ref<!eir.term>) -> !eir.term
+    eir.return %reply : !eir.term
+  }
+}
+
+// -----
+
+// A receive with a clause which accepts messages without the reference must
+// scan the whole mailbox, as in:
+//
+//   Ref = make_ref(),
+//   receive {Ref, Reply} -> Reply; Other -> Other end
+
+// CHECK-LABEL: eir.func @either(
+// CHECK-NOT: eir.receive.mark
+// CHECK-NOT: eir.receive.set
+module {
+  eir.func @either(%timeout: !eir.term) -> !eir.term {
+    %none = "eir.constant.none"() {value = unit} : () -> !eir.none
+    %ref = eir.make_ref : () -> !eir.term
+    %start = eir.receive.start %timeout : (!eir.term) -> !eir.term
+    %invalid = eir.cmp.eq %start, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %invalid, ^raise(%start : !eir.term), ^loop(%start : !eir.term)
+  ^raise(%e: !eir.term):
+    eir.return %e : !eir.term
+  ^loop(%r: !eir.term):
+    eir.br ^peek
+  ^peek:
+    %msg = eir.receive.peek() : !eir.term
+    %empty = eir.cmp.eq %msg, %none : (!eir.term, !eir.none) -> !eir.bool
+    eir.cond_br %empty, ^wait, ^message(%msg : !eir.term)
+  ^wait:
+    %timedOut = eir.receive.wait() : !eir.bool
+    eir.cond_br %timedOut, ^timeout, ^peek
+  ^timeout:
+    eir.return %timeout : !eir.term
+  ^message(%m: !eir.term):
+    %isPair = eir.is_type(%m) {type = !eir.box<!eir.tuple<2x!eir.term>>} : (!eir.term) -> !eir.bool
+    eir.cond_br %isPair, ^split, ^other
+  ^split:
+    %boxed = eir.cast %m : !eir.term to !eir.box<!eir.tuple<2x!eir.term>>
+    %p1 = "eir.getelementptr"(%boxed) {index = 1 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %tag = eir.load(%p1) : (!eir.ref<!eir.term>) -> !eir.term
+    %isRef = eir.cmp.eq %tag, %ref : (!eir.term, !eir.term) -> !eir.bool
+    eir.cond_br %isRef, ^accept, ^other
+  ^accept:
+    eir.receive.done
+    %p2 = "eir.getelementptr"(%boxed) {index = 2 : index} : (!eir.box<!eir.tuple<2x!eir.term>>) -> !eir.ref<!eir.term>
+    %reply = eir.load(%p2) : (!eir.ref<!eir.term>) -> !eir.term
+    eir.return %reply : !eir.term
+  ^other:
+    eir.receive.done
+    eir.return %m : !eir.term
+  }
+}
@@ -0,0 +1,139 @@
+#include "lumen/compiler/Support/Statistics.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/PassTimingInfo.h"
+#include "mlir/Pass/Pass.h"
+
+using namespace lumen;
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct PassTime {
+  uint64_t runs = 0;
+  double seconds = 0.0;
+};
+
+/// The process-wide statistics table shared by all compiler workers
+struct Statistics {
+  std::mutex mutex;
+  std::map<std::string, PassTime> passTimes;
+  std::map<std::string, uint64_t> rewrites;
+  std::map<std::pair<std::string, std::string>, uint64_t> runtimeCalls;
+  std::vector<std::tuple<std::string, std::string, uint64_t>> irSizes;
+
+  static Statistics &get() {
+    static Statistics statistics;
+    return statistics;
+  }
+};
+
+}  // namespace
+
+static std::atomic<bool> timingEnabled(false);
+static std::atomic<bool> countingEnabled(false);
+
+// The start times of the passes currently running on this thread; passes
+// nested by a pass manager adaptor run on the adaptor's worker threads, so
+// before/after notifications are always balanced per thread
+static thread_local std::vector<Clock::time_point> passStartTimes;
+
+// Pass manager adaptors only run their nested pipelines, whose passes are
+// timed individually, so they are skipped to avoid counting time twice
+static bool isAdaptorPass(mlir::Pass *pass) {
+  return pass->getName().startswith("mlir::detail::");
+}
+
+bool stats::isTimingEnabled() { return timingEnabled.load(); }
+
+bool stats::isCountingEnabled() { return countingEnabled.load(); }
+
+void stats::recordPassTime(llvm::StringRef pass, double seconds) {
+  auto &statistics = Statistics::get();
+  std::lock_guard<std::mutex> lock(statistics.mutex);
+  auto &entry = statistics.passTimes[pass.str()];
+  entry.runs += 1;
+  entry.seconds += seconds;
+}
+
+void stats::recordRewrite(llvm::StringRef opName) {
+  auto &statistics = Statistics::get();
+  std::lock_guard<std::mutex> lock(statistics.mutex);
+  statistics.rewrites[opName.str()] += 1;
+}
+
+void stats::recordRuntimeCall(llvm::StringRef opName, llvm::StringRef callee) {
+  auto &statistics = Statistics::get();
+  std::lock_guard<std::mutex> lock(statistics.mutex);
+  statistics.runtimeCalls[std::make_pair(opName.str(), callee.str())] += 1;
+}
+
+void stats::recordIRSize(llvm::StringRef module, llvm::StringRef stage,
+                         uint64_t size) {
+  auto &statistics = Statistics::get();
+  std::lock_guard<std::mutex> lock(statistics.mutex);
+  statistics.irSizes.emplace_back(module.str(), stage.str(), size);
+}
+
+void stats::PassTimingInstrumentation::runBeforePass(mlir::Pass *pass,
+                                                     mlir::Operation *op) {
+  if (isAdaptorPass(pass)) return;
+  passStartTimes.push_back(Clock::now());
+}
+
+void stats::PassTimingInstrumentation::runAfterPass(mlir::Pass *pass,
+                                                    mlir::Operation *op) {
+  if (isAdaptorPass(pass)) return;
+  assert(!passStartTimes.empty() && "unbalanced pass instrumentation");
+  std::chrono::duration<double> elapsed = Clock::now() - passStartTimes.back();
+  passStartTimes.pop_back();
+  recordPassTime(pass->getName(), elapsed.count());
+}
+
+void stats::PassTimingInstrumentation::runAfterPassFailed(
+    mlir::Pass *pass, mlir::Operation *op) {
+  runAfterPass(pass, op);
+}
+
+extern "C" void LLVMLumenEnableStatistics(bool timing, bool counting) {
+  timingEnabled.store(timing);
+  countingEnabled.store(counting);
+}
+
+extern "C" void LLVMLumenVisitStatistics(LumenStatisticVisitor visitor,
+                                         void *data) {
+  auto &statistics = Statistics::get();
+  std::lock_guard<std::mutex> lock(statistics.mutex);
+  for (auto &entry : statistics.passTimes) {
+    visitor(data, LumenStatisticKind::PassTime, entry.first.c_str(), nullptr,
+            entry.second.runs, entry.second.seconds);
+  }
+  for (auto &entry : statistics.rewrites) {
+    visitor(data, LumenStatisticKind::Rewrite, entry.first.c_str(), nullptr,
+            entry.second, 0.0);
+  }
+  for (auto &entry : statistics.runtimeCalls) {
+    visitor(data, LumenStatisticKind::RuntimeCall, entry.first.first.c_str(),
+            entry.first.second.c_str(), entry.second, 0.0);
+  }
+  for (auto &entry : statistics.irSizes) {
+    visitor(data, LumenStatisticKind::IRSize, std::get<0>(entry).c_str(),
+            std::get<1>(entry).c_str(), std::get<2>(entry), 0.0);
+  }
+}
+
+// Writes the report of LLVM's `-time-passes` timers to the given string, and
+// resets them, so that they are not printed again when LLVM shuts down
+extern "C" void LLVMLumenWriteLLVMTimingsToString(RustStringRef str) {
+  RawRustStringOstream os(str);
+  llvm::reportAndResetTimings(&os);
+}
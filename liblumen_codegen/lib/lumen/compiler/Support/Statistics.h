@@ -0,0 +1,73 @@
+#ifndef LUMEN_SUPPORT_STATISTICS_H
+#define LUMEN_SUPPORT_STATISTICS_H
+
+#include <stdint.h>
+
+#include "llvm/ADT/StringRef.h"
+#include "lumen/compiler/Support/RustString.h"
+#include "mlir/Pass/PassInstrumentation.h"
+
+namespace mlir {
+class Operation;
+class Pass;
+}  // namespace mlir
+
+namespace lumen {
+namespace stats {
+
+/// Returns true if pass timings should be recorded
+bool isTimingEnabled();
+
+/// Returns true if rewrite counters and IR sizes should be recorded
+bool isCountingEnabled();
+
+/// Records `seconds` of wall time spent running the pass named `pass`
+void recordPassTime(llvm::StringRef pass, double seconds);
+
+/// Records a successful rewrite of an operation named `opName`
+void recordRewrite(llvm::StringRef opName);
+
+/// Records that lowering an operation named `opName` produced a call to the
+/// runtime function `callee`, rather than inline code
+void recordRuntimeCall(llvm::StringRef opName, llvm::StringRef callee);
+
+/// Records the size of `module` at the given stage of the pipeline
+void recordIRSize(llvm::StringRef module, llvm::StringRef stage,
+                  uint64_t size);
+
+/// Records the wall time of every pass run by the pass manager it is added to
+///
+/// Timings are accumulated in a process-wide table, so that the passes run by
+/// all compiler workers are reported together, rather than per-module as is
+/// done by `PassManager::enableTiming`.
+class PassTimingInstrumentation : public mlir::PassInstrumentation {
+ public:
+  void runBeforePass(mlir::Pass *pass, mlir::Operation *op) override;
+  void runAfterPass(mlir::Pass *pass, mlir::Operation *op) override;
+  void runAfterPassFailed(mlir::Pass *pass, mlir::Operation *op) override;
+};
+
+}  // namespace stats
+}  // namespace lumen
+
+/// The kind of a statistic passed to a `LumenStatisticVisitor`
+///
+/// NOTE: This must be kept in sync with `StatisticKind` in stats.rs
+enum class LumenStatisticKind : uint32_t {
+  PassTime = 0,
+  Rewrite,
+  RuntimeCall,
+  IRSize,
+};
+
+typedef void (*LumenStatisticVisitor)(void *data, LumenStatisticKind kind,
+                                      const char *name, const char *detail,
+                                      uint64_t count, double seconds);
+
+extern "C" {
+void LLVMLumenEnableStatistics(bool timing, bool counting);
+void LLVMLumenVisitStatistics(LumenStatisticVisitor visitor, void *data);
+void LLVMLumenWriteLLVMTimingsToString(RustStringRef str);
+}
+
+#endif
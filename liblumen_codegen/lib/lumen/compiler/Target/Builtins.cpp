@@ -0,0 +1,118 @@
+#include "lumen/compiler/Target/Builtins.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+using ::llvm::Attribute;
+using ::llvm::AttributeList;
+using ::llvm::StringRef;
+
+using namespace lumen;
+
+// The runtime functions called by code lowered from EIR; those not listed
+// here are declared without attributes.
+//
+// These are `extern "C"` functions in the runtime, which is built with
+// `panic = "unwind"`, so only those which cannot panic are `nounwind`. Those
+// which raise store the exception on the current process and return NONE,
+// which is a write, and so are `BuiltinMemory::Any`, but they also panic on a
+// system exception, such as running out of heap, so they may unwind.
+static const BuiltinDescriptor builtins[] = {
+    // Type tests and comparisons only read the terms they are given. The type
+    // tests only panic on a type the compiler never emits, and cmpeq catches
+    // any panic
+    {"__lumen_builtin_is_type", BuiltinMemory::ReadOnly, true, true, false,
+     false},
+    {"__lumen_builtin_is_boxed_type", BuiltinMemory::ReadOnly, true, true,
+     false, false},
+    {"__lumen_builtin_is_tuple", BuiltinMemory::ReadOnly, true, true, false,
+     false},
+    {"__lumen_builtin_cmpeq", BuiltinMemory::ReadOnly, true, true, false,
+     true},
+    // The pid and node of the current process do not change while it runs
+    {"__lumen_builtin_self", BuiltinMemory::ReadOnly, true, true, false,
+     false},
+    {"__lumen_builtin_node", BuiltinMemory::ReadOnly, true, true, false,
+     false},
+    // Returns null rather than panicking when the heap is exhausted
+    {"__lumen_builtin_malloc", BuiltinMemory::Any, true, true, true, false},
+    {"__lumen_builtin_math.", BuiltinMemory::Any, false, true, false, true},
+    {"__lumen_builtin_tuple.", BuiltinMemory::Any, false, true, false, true},
+    {"__lumen_builtin_list.", BuiltinMemory::Any, false, true, false, true},
+    {"__lumen_builtin_binary.byte_size", BuiltinMemory::Any, false, true,
+     false, false},
+    {"__lumen_builtin_map.size", BuiltinMemory::Any, false, true, false,
+     false},
+    {"__lumen_builtin_make_ref", BuiltinMemory::Any, false, true, false,
+     false},
+    {"__lumen_builtin_printf", BuiltinMemory::Any, false, true, false, false},
+    {"__lumen_builtin_trace_construct", BuiltinMemory::Any, false, true, false,
+     false},
+    {"__lumen_builtin_trace_capture", BuiltinMemory::Any, true, true, false,
+     false},
+    // Switch to the scheduler, which may never resume the process
+    {"__lumen_builtin_yield", BuiltinMemory::Any, false, false, false, false},
+    {"__lumen_builtin_receive_wait", BuiltinMemory::Any, false, false, false,
+     false},
+    // The rest of a receive only moves the cursor of the process's mailbox
+    {"__lumen_builtin_receive_", BuiltinMemory::Any, true, true, false, true},
+    // Store an exception on the process for the caller to return
+    {"__lumen_builtin_raise_", BuiltinMemory::Any, false, true, false, true},
+};
+
+namespace lumen {
+
+const BuiltinDescriptor *lookupBuiltin(StringRef name) {
+  if (!name.startswith("__lumen_builtin_")) return nullptr;
+
+  auto *it = llvm::find_if(builtins, [&](const BuiltinDescriptor &builtin) {
+    return builtin.prefix ? name.startswith(builtin.name)
+                          : name == builtin.name;
+  });
+  return it == std::end(builtins) ? nullptr : it;
+}
+
+void addBuiltinAttributes(llvm::Function &fn,
+                          const BuiltinDescriptor &builtin) {
+  if (builtin.noUnwind) fn.addFnAttr(Attribute::NoUnwind);
+  if (builtin.willReturn) fn.addFnAttr(Attribute::WillReturn);
+
+  switch (builtin.memory) {
+    case BuiltinMemory::None:
+      fn.addFnAttr(Attribute::ReadNone);
+      fn.addFnAttr(Attribute::NoFree);
+      break;
+    case BuiltinMemory::ReadOnly:
+      fn.addFnAttr(Attribute::ReadOnly);
+      fn.addFnAttr(Attribute::NoFree);
+      break;
+    case BuiltinMemory::Any:
+      break;
+  }
+
+  if (builtin.allocator) {
+    // Allocations are aligned to a term, and may fail, so are not `nonnull`;
+    // as their size is dynamic, `allocsize` stands in for `dereferenceable`.
+    // The size follows the process being allocated on
+    auto &context = fn.getContext();
+    auto &dataLayout = fn.getParent()->getDataLayout();
+    fn.addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+    fn.addAttribute(AttributeList::ReturnIndex,
+                    Attribute::getWithAlignment(
+                        context, dataLayout.getPointerABIAlignment(0)));
+    fn.addFnAttr(Attribute::getWithAllocSizeArgs(context, 1, llvm::None));
+  }
+}
+
+void addBuiltinAttributes(llvm::Module &module) {
+  for (auto &fn : module.functions()) {
+    if (!fn.isDeclaration()) continue;
+    if (auto *builtin = lookupBuiltin(fn.getName()))
+      addBuiltinAttributes(fn, *builtin);
+  }
+}
+
+}  // namespace lumen
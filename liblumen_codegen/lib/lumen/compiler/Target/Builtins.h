@@ -0,0 +1,56 @@
+#ifndef LUMEN_TARGET_BUILTINS_H
+#define LUMEN_TARGET_BUILTINS_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+
+namespace lumen {
+
+/// The memory a runtime builtin may access, from the point of view of
+/// generated code
+enum class BuiltinMemory {
+  /// Computed from its arguments alone
+  None,
+  /// Reads terms, e.g. the header of a boxed term, but writes nothing
+  ReadOnly,
+  /// Allocates on the process heap, or stores an exception on the process
+  Any,
+};
+
+/// Describes what LLVM may assume about calls to a `__lumen_builtin_*`
+/// function, so that calls to pure builtins can be CSE'd, hoisted out of
+/// loops, or deleted when unused
+struct BuiltinDescriptor {
+  llvm::StringRef name;
+  BuiltinMemory memory;
+  /// Whether the builtin never panics, and so never unwinds into generated
+  /// code
+  bool noUnwind;
+  /// Whether every call returns, i.e. the builtin never yields or exits the
+  /// current process
+  bool willReturn;
+  /// Whether the builtin returns a fresh allocation, the size of which is its
+  /// second argument, following the process it is allocated on
+  bool allocator;
+  /// Whether `name` is a prefix, for builtins with variants specialised for
+  /// the target CPU, e.g. `__lumen_builtin_cmpeq`
+  bool prefix;
+};
+
+/// Returns the descriptor for the builtin named `name`, if there is one
+const BuiltinDescriptor *lookupBuiltin(llvm::StringRef name);
+
+/// Adds the attributes implied by `builtin` to the declaration `fn`
+void addBuiltinAttributes(llvm::Function &fn,
+                          const BuiltinDescriptor &builtin);
+
+/// Adds attributes to the declarations of every builtin in `module`
+void addBuiltinAttributes(llvm::Module &module);
+
+}  // namespace lumen
+
+#endif  // LUMEN_TARGET_BUILTINS_H
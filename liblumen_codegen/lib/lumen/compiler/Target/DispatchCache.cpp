@@ -0,0 +1,32 @@
+#include "lumen/compiler/Target/DispatchCache.h"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+using ::llvm::AtomicOrdering;
+using ::llvm::LoadInst;
+using ::llvm::StoreInst;
+
+namespace lumen {
+
+void addDispatchCacheOrdering(llvm::Module &module) {
+  auto align = module.getDataLayout().getPointerABIAlignment(0);
+
+  for (auto &global : module.globals()) {
+    if (!global.getName().startswith(dispatchCachePrefix)) continue;
+
+    for (auto *user : global.users()) {
+      if (auto *load = llvm::dyn_cast<LoadInst>(user)) {
+        load->setAlignment(align);
+        load->setAtomic(AtomicOrdering::Acquire);
+      } else if (auto *store = llvm::dyn_cast<StoreInst>(user)) {
+        // The cache is only ever the address stored to, never the value
+        if (store->getPointerOperand() != &global) continue;
+        store->setAlignment(align);
+        store->setAtomic(AtomicOrdering::Release);
+      }
+    }
+  }
+}
+
+}  // namespace lumen
@@ -0,0 +1,31 @@
+#ifndef LUMEN_TARGET_DISPATCHCACHE_H
+#define LUMEN_TARGET_DISPATCHCACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+
+namespace lumen {
+
+/// The prefix of the names of the per-call-site caches emitted by the lowering
+/// of `eir.call.dynamic`, each of which points to the call target last
+/// resolved at that site
+const llvm::StringRef dispatchCachePrefix = "__lumen_dispatch_cache.";
+
+/// Makes the loads of the dispatch caches in `module` acquire loads, and the
+/// stores to them release stores.
+///
+/// The caches are shared by every scheduler thread running the call site, and
+/// the release/acquire pair makes the fields of a target visible to a thread
+/// before the pointer to it is. On x86_64 both are plain moves, so a cache hit
+/// costs the same as before.
+///
+/// This must run on the module as translated from the LLVM dialect, which has
+/// no way to express atomic orderings on loads and stores.
+void addDispatchCacheOrdering(llvm::Module &module);
+
+}  // namespace lumen
+
+#endif  // LUMEN_TARGET_DISPATCHCACHE_H
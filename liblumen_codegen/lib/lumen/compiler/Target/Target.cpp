@@ -11,11 +11,18 @@
 #include "llvm-c/Target.h"
 #include "llvm-c/TargetMachine.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CBindingWrapping.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 using ::llvm::Optional;
 
@@ -160,7 +167,90 @@ extern "C" bool LLVMTargetMachineEmitToFileDescriptor(
   return false;
 }
 
+/// Emits the given module as `numUnits` separate files, one per path in
+/// `paths`, by partitioning the module and running codegen on each partition
+/// in parallel.
+///
+/// Each partition is codegened in its own LLVMContext with its own
+/// TargetMachine (configured identically to `t`), so the given module is
+/// cloned rather than consumed, and remains usable by the caller.
+extern "C" bool LLVMTargetMachineEmitCodegenUnits(
+    LLVMTargetMachineRef t, LLVMModuleRef m, const char **paths,
+    unsigned numUnits, LLVMCodeGenFileType codegen, char **errorMessage) {
+  TargetMachine *tm = unwrap(t);
+  llvm::Module *mod = unwrap(m);
+  mod->setDataLayout(tm->createDataLayout());
+
+  llvm::CodeGenFileType ft;
+  switch (codegen) {
+    case LLVMCodeGenFileType::LLVMAssemblyFile:
+      ft = llvm::CodeGenFileType::CGFT_AssemblyFile;
+      break;
+    default:
+      ft = llvm::CodeGenFileType::CGFT_ObjectFile;
+      break;
+  }
+
+  llvm::SmallVector<std::unique_ptr<llvm::raw_fd_ostream>, 8> streams;
+  llvm::SmallVector<llvm::raw_pwrite_stream *, 8> outputs;
+  for (unsigned i = 0; i < numUnits; ++i) {
+    std::error_code ec;
+    auto stream = std::make_unique<llvm::raw_fd_ostream>(
+        paths[i], ec, llvm::sys::fs::OF_None);
+    if (ec) {
+      std::string error =
+          "unable to open codegen unit output '" + std::string(paths[i]) +
+          "': " + ec.message();
+      *errorMessage = strdup(error.c_str());
+      return true;
+    }
+    outputs.push_back(stream.get());
+    streams.push_back(std::move(stream));
+  }
+
+  auto factory = [tm]() {
+    return std::unique_ptr<TargetMachine>(tm->getTarget().createTargetMachine(
+        tm->getTargetTriple().getTriple(), tm->getTargetCPU(),
+        tm->getTargetFeatureString(), tm->Options, tm->getRelocationModel(),
+        tm->getCodeModel(), tm->getOptLevel()));
+  };
+
+  auto clone = llvm::CloneModule(*mod);
+  llvm::splitCodeGen(std::move(clone), outputs, /*BCOSs=*/{}, factory, ft);
+
+  for (auto &stream : streams) {
+    stream->close();
+    if (stream->has_error()) {
+      std::string error = "failed to write codegen unit: " +
+                          stream->error().message();
+      stream->clear_error();
+      *errorMessage = strdup(error.c_str());
+      return true;
+    }
+  }
+
+  return false;
+}
+
 namespace lumen {
+void splitColdCode(TargetMachine *tm, llvm::Module &mod) {
+  if (tm->getOptLevel() == llvm::CodeGenOpt::None) return;
+
+  llvm::legacy::PassManager pass;
+  pass.add(
+      llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+  pass.add(llvm::createLowerExpectIntrinsicPass());
+  pass.add(llvm::createHotColdSplittingPass());
+  pass.run(mod);
+
+  // The outlined functions are marked cold, but are only placed apart from
+  // the rest of the code when given a section prefix
+  for (auto &fn : mod) {
+    if (!fn.isDeclaration() && fn.hasFnAttribute(llvm::Attribute::Cold))
+      fn.setSectionPrefix(".unlikely");
+  }
+}
+
 llvm::CodeModel::Model toLLVM(CodeModel cm) {
   switch (cm) {
     case CodeModel::Small:
@@ -47,6 +47,18 @@ llvm::CodeGenOpt::Level toLLVM(OptLevel level);
 unsigned toLLVM(SizeLevel level);
 
 llvm::Reloc::Model toLLVM(RelocMode mode);
+
+/// Moves cold code, e.g. the fallback of a pattern match, which ends in
+/// `unreachable`, out of line into `.text.unlikely`, to reduce i-cache
+/// pressure on the hot path.
+///
+/// The EIR lowering weights branches to error handling with `llvm.expect`,
+/// which is lowered to branch weights here for block placement to use, as
+/// no IR optimization pipeline runs before codegen.
+///
+/// This transforms `mod` in place, so it runs once, when the module is
+/// translated to LLVM IR, rather than each time the module is emitted.
+void splitColdCode(llvm::TargetMachine *tm, llvm::Module &mod);
 }  // namespace lumen
 
 #endif
@@ -1,10 +1,16 @@
 #include "lumen/compiler/Target/TargetInfo.h"
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/Target/TargetMachine.h"
 #include "lumen/compiler/Dialect/EIR/IR/EIRTypes.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
@@ -33,6 +39,8 @@ extern "C" uint64_t lumen_box_tag(Encoding *encoding);
 extern "C" uint64_t lumen_literal_tag(Encoding *encoding);
 extern "C" MaskInfo lumen_immediate_mask(Encoding *encoding);
 extern "C" MaskInfo lumen_header_mask(Encoding *encoding);
+extern "C" int64_t lumen_min_fixnum(Encoding *encoding);
+extern "C" int64_t lumen_max_fixnum(Encoding *encoding);
 
 namespace lumen {
 
@@ -50,6 +58,17 @@ TargetInfo::TargetInfo(llvm::TargetMachine *targetMachine, LLVMDialect &dialect)
   bool supportsNanboxing = archType == llvm::Triple::ArchType::x86_64;
   impl->encoding = Encoding{pointerSizeInBits, supportsNanboxing};
 
+  // When the target CPU is known to support them, builtins specialised for
+  // wider vector extensions are called directly, rather than relying on the
+  // runtime to dispatch to them based on the CPU it finds itself running on
+  if (archType == llvm::Triple::ArchType::x86_64) {
+    auto *subtargetInfo = targetMachine->getMCSubtargetInfo();
+    if (subtargetInfo->checkFeatures("+avx2,+avx512f,+avx512bw"))
+      impl->builtinSuffix = ".avx512";
+    else if (subtargetInfo->checkFeatures("+avx2"))
+      impl->builtinSuffix = ".avx2";
+  }
+
   // Initialize named types
   LLVMType intNTy = LLVMType::getIntNTy(&dialect, pointerSizeInBits);
   LLVMType i8PtrTy = LLVMType::getInt8PtrTy(&dialect);
@@ -89,6 +108,21 @@ TargetInfo::TargetInfo(llvm::TargetMachine *targetMachine, LLVMDialect &dialect)
   impl->literalTag = lumen_literal_tag(&impl->encoding);
   impl->immediateMask = lumen_immediate_mask(&impl->encoding);
   impl->headerMask = lumen_header_mask(&impl->encoding);
+
+  // Fixnums are tagged in the low bits when the immediate value is shifted,
+  // otherwise the tag occupies all of the bits above the immediate value
+  auto fixnumTypeKind = TypeKind::Fixnum - mlir::Type::FIRST_EIR_TYPE;
+  impl->fixnumTag = lumen_encode_immediate(&impl->encoding, fixnumTypeKind, 0);
+  auto &immediateMask = impl->immediateMask;
+  if (immediateMask.requiresShift()) {
+    impl->fixnumMask = immediateMask.mask;
+  } else {
+    impl->fixnumMask =
+        APInt(pointerSizeInBits, ~immediateMask.mask, /*signed=*/false)
+            .getLimitedValue();
+  }
+  impl->minFixnum = lumen_min_fixnum(&impl->encoding);
+  impl->maxFixnum = lumen_max_fixnum(&impl->encoding);
 }
 
 TargetInfo::TargetInfo(const TargetInfo &other)
@@ -96,6 +130,28 @@ TargetInfo::TargetInfo(const TargetInfo &other)
       pointerSizeInBits(other.pointerSizeInBits),
       impl(new TargetInfoImpl(*other.impl)) {}
 
+TargetInfo &TargetInfo::get(llvm::TargetMachine *targetMachine,
+                            LLVMDialect &dialect) {
+  using CacheKey = std::pair<mlir::MLIRContext *, std::string>;
+
+  static std::mutex cacheMutex;
+  static std::map<CacheKey, std::unique_ptr<TargetInfo>> cache;
+
+  // NOTE: Contexts are pooled for the lifetime of the compiler, so entries are
+  // never evicted. The lock only guards the cache itself, a given TargetInfo is
+  // only ever used by the thread which has its context checked out.
+  std::string target = targetMachine->getTargetTriple().getTriple();
+  target += ":" + targetMachine->getTargetCPU().str();
+  target += ":" + targetMachine->getTargetFeatureString().str();
+  CacheKey key(dialect.getContext(), target);
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  auto &entry = cache[key];
+  if (!entry) {
+    entry.reset(new TargetInfo(targetMachine, dialect));
+  }
+  return *entry;
+}
+
 LLVMType TargetInfo::getTermType() { return impl->pointerWidthIntTy; }
 LLVMType TargetInfo::getConsType() { return impl->consTy; }
 LLVMType TargetInfo::getFloatType() { return impl->floatTy; }
@@ -127,6 +183,8 @@ APInt TargetInfo::encodeHeader(unsigned type, uint64_t arity) {
   return APInt(pointerSizeInBits, encoded, /*signed=*/false);
 }
 
+StringRef TargetInfo::getBuiltinSuffix() const { return impl->builtinSuffix; }
+
 APInt &TargetInfo::getNilValue() const { return impl->nil; }
 APInt &TargetInfo::getNoneValue() const { return impl->none; }
 
@@ -136,5 +194,9 @@ uint64_t TargetInfo::boxTag() const { return impl->boxTag; }
 uint64_t TargetInfo::literalTag() const { return impl->literalTag; }
 MaskInfo &TargetInfo::immediateMask() const { return impl->immediateMask; }
 MaskInfo &TargetInfo::headerMask() const { return impl->headerMask; }
+uint64_t TargetInfo::fixnumTag() const { return impl->fixnumTag; }
+uint64_t TargetInfo::fixnumMask() const { return impl->fixnumMask; }
+int64_t TargetInfo::minFixnum() const { return impl->minFixnum; }
+int64_t TargetInfo::maxFixnum() const { return impl->maxFixnum; }
 
 }  // namespace lumen
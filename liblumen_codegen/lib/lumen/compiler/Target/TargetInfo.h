@@ -36,6 +36,7 @@ struct TargetInfoImpl {
   TargetInfoImpl() {}
   TargetInfoImpl(const TargetInfoImpl &other)
       : triple(other.triple),
+        builtinSuffix(other.builtinSuffix),
         encoding(other.encoding),
         pointerWidthIntTy(other.pointerWidthIntTy),
         i1Ty(other.i1Ty),
@@ -51,9 +52,14 @@ struct TargetInfoImpl {
         boxTag(other.boxTag),
         literalTag(other.literalTag),
         immediateMask(other.immediateMask),
-        headerMask(other.headerMask) {}
+        headerMask(other.headerMask),
+        fixnumTag(other.fixnumTag),
+        fixnumMask(other.fixnumMask),
+        minFixnum(other.minFixnum),
+        maxFixnum(other.maxFixnum) {}
 
   std::string triple;
+  std::string builtinSuffix;
 
   Encoding encoding;
 
@@ -72,6 +78,10 @@ struct TargetInfoImpl {
   uint64_t literalTag;
   MaskInfo immediateMask;
   MaskInfo headerMask;
+  uint64_t fixnumTag;
+  uint64_t fixnumMask;
+  int64_t minFixnum;
+  int64_t maxFixnum;
 };
 
 class TargetInfo {
@@ -79,6 +89,16 @@ class TargetInfo {
   explicit TargetInfo(llvm::TargetMachine *, mlir::LLVM::LLVMDialect &);
   explicit TargetInfo(const TargetInfo &other);
 
+  /// Returns the TargetInfo for the given target and dialect, constructing it
+  /// on first use.
+  ///
+  /// The named struct types held by a TargetInfo are uniqued in the context
+  /// which owns the dialect, so instances are cached per context and target
+  /// (i.e. triple, CPU and features). Contexts are reused across compilation
+  /// units, so this avoids rebuilding (and renaming) those types on every
+  /// lowering.
+  static TargetInfo &get(llvm::TargetMachine *, mlir::LLVM::LLVMDialect &);
+
   bool is_x86_64() const { return archType == llvm::Triple::ArchType::x86_64; }
   bool is_wasm32() const { return archType == llvm::Triple::ArchType::wasm32; }
   bool requiresPackedFloats() const { return !is_x86_64(); }
@@ -96,6 +116,11 @@ class TargetInfo {
   llvm::APInt encodeImmediate(uint32_t type, uint64_t value);
   llvm::APInt encodeHeader(uint32_t type, uint64_t arity);
 
+  /// Returns the suffix of the variants of bulk builtins (e.g. `.avx2`) which
+  /// were built for the features of the target CPU, or an empty string if the
+  /// generic variants must be used. See `FeatureLevel` in `liblumen_core`.
+  llvm::StringRef getBuiltinSuffix() const;
+
   llvm::APInt &getNilValue() const;
   llvm::APInt &getNoneValue() const;
 
@@ -106,6 +131,15 @@ class TargetInfo {
   MaskInfo &immediateMask() const;
   MaskInfo &headerMask() const;
 
+  /// A term is a fixnum if masking it with `fixnumMask` yields `fixnumTag`.
+  /// The untagged value is in `immediateMask`, shifted by its shift.
+  uint64_t fixnumTag() const;
+  uint64_t fixnumMask() const;
+  /// The range of values which can be represented as fixnums, values outside
+  /// of this range must be promoted to bigints
+  int64_t minFixnum() const;
+  int64_t maxFixnum() const;
+
   unsigned pointerSizeInBits;
 
  private:
@@ -0,0 +1,75 @@
+#include "lumen/compiler/Target/TermMetadata.h"
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PatternMatch.h"
+#include "lumen/compiler/Target/TargetInfo.h"
+
+using ::llvm::APInt;
+using ::llvm::IntToPtrInst;
+using ::llvm::LoadInst;
+using ::llvm::MDNode;
+using ::llvm::Value;
+
+using namespace lumen;
+
+// Returns true if `ptr` unboxes a list, rather than a boxed term, i.e. it is
+// the pointer to a cons cell, which has no header.
+//
+// Lists are unboxed by clearing the bits of the list mask, see
+// `do_unbox_list` in the EIR lowering.
+static bool isUnboxedList(IntToPtrInst *ptr, uint64_t listMask) {
+  using namespace llvm::PatternMatch;
+
+  const APInt *mask;
+  if (!match(ptr->getOperand(0), m_And(m_Value(), m_APInt(mask))))
+    return false;
+  return (~*mask).getZExtValue() == listMask;
+}
+
+namespace lumen {
+
+void addTermMetadata(llvm::Module &module, TargetInfo &targetInfo) {
+  auto &context = module.getContext();
+  auto &dataLayout = module.getDataLayout();
+  auto listMask = targetInfo.listMask();
+
+  llvm::MDBuilder mdBuilder(context);
+  MDNode *root = mdBuilder.createTBAARoot("Lumen terms");
+  MDNode *headerTy = mdBuilder.createTBAAScalarTypeNode("header", root);
+  MDNode *termTy = mdBuilder.createTBAAScalarTypeNode("term", root);
+  MDNode *headerTag = mdBuilder.createTBAAStructTagNode(headerTy, headerTy, 0);
+  MDNode *termTag = mdBuilder.createTBAAStructTagNode(termTy, termTy, 0);
+  MDNode *invariant = MDNode::get(context, {});
+
+  for (auto &fn : module.functions()) {
+    for (auto &block : fn) {
+      for (auto &inst : block) {
+        auto *load = llvm::dyn_cast<LoadInst>(&inst);
+        if (!load || load->isVolatile()) continue;
+
+        Value *ptr = load->getPointerOperand();
+        auto *unboxed = llvm::dyn_cast<IntToPtrInst>(
+            llvm::GetUnderlyingObject(ptr, dataLayout));
+        if (!unboxed) continue;
+
+        // The header is the first word of a boxed term; anything else is a
+        // term, including elements at a dynamic index, which are bounds
+        // checked against the header
+        int64_t offset = 0;
+        Value *base =
+            llvm::GetPointerBaseWithConstantOffset(ptr, offset, dataLayout);
+        bool isHeader = base == unboxed && offset == 0 &&
+                        !isUnboxedList(unboxed, listMask);
+
+        load->setMetadata(llvm::LLVMContext::MD_tbaa,
+                          isHeader ? headerTag : termTag);
+        load->setMetadata(llvm::LLVMContext::MD_invariant_load, invariant);
+      }
+    }
+  }
+}
+
+}  // namespace lumen
@@ -0,0 +1,26 @@
+#ifndef LUMEN_TARGET_TERMMETADATA_H
+#define LUMEN_TARGET_TERMMETADATA_H
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+
+namespace lumen {
+class TargetInfo;
+
+/// Adds aliasing metadata to the loads from boxed terms in `module`, i.e. loads
+/// from pointers obtained by unboxing a term or list.
+///
+/// Terms are immutable once boxed, as they are written only while being
+/// constructed, so these loads are marked `!invariant.load`, which lets GVN and
+/// LICM keep their results in registers across calls, such as allocations.
+/// They are also given TBAA tags, distinguishing the header word of a boxed
+/// term from its term slots.
+///
+/// This must run on the module as translated from the LLVM dialect, before it
+/// is optimized, as it recognizes unboxing by the `inttoptr` it lowers to.
+void addTermMetadata(llvm::Module &module, TargetInfo &targetInfo);
+
+}  // namespace lumen
+
+#endif  // LUMEN_TARGET_TERMMETADATA_H
@@ -0,0 +1,39 @@
+// RUN: lumen-translate %s | LumenFileCheck %s
+
+// Runtime builtins are declared with attributes describing what LLVM may
+// assume about calls to them, see Builtins.cpp:
+//
+// - comparisons only read memory, always return, and never unwind
+// - allocations return fresh, term-aligned memory, the size of which follows
+//   the process it is allocated on, and return null rather than unwinding
+// - BIFs always return, but may unwind, as they panic on system exceptions
+// - waiting for a message may never return, and may unwind
+
+// CHECK-DAG: declare i1 @__lumen_builtin_cmpeq({{.*}}) #[[CMPEQ:[0-9]+]]
+// CHECK-DAG: declare noalias align 8 {{.*}} @__lumen_builtin_malloc({{.*}}) #[[MALLOC:[0-9]+]]
+// CHECK-DAG: declare i64 @__lumen_builtin_tuple.size({{.*}}) #[[SIZE:[0-9]+]]
+// CHECK-DAG: declare i1 @__lumen_builtin_receive_wait({{[^)]*}}){{$}}
+// CHECK-DAG: attributes #[[CMPEQ]] = { nofree nounwind readonly willreturn }
+// CHECK-DAG: attributes #[[MALLOC]] = { allocsize(1) nounwind willreturn }
+// CHECK-DAG: attributes #[[SIZE]] = { willreturn }
+module {
+  eir.func @lifted(%x: !eir.term, %a: !eir.term) -> !eir.term {
+    eir.return %x : !eir.term
+  }
+
+  eir.func @builtins(%x: !eir.term, %y: !eir.term) -> !eir.term {
+    %eq = eir.cmp.eq %x, %y : (!eir.term, !eir.term) -> !eir.bool
+    eir.cond_br %eq, ^fun, ^size
+  ^fun:
+    %f = eir.closure @lifted(%x) {arity = 1 : i32, module = 1 : i64, function = 2 : i64} : (!eir.term) -> !eir.closure
+    eir.return %f : !eir.closure
+  ^size:
+    %size = eir.tuple.size %x : (!eir.term) -> !eir.term
+    eir.cond_br %eq, ^wait, ^done(%size : !eir.term)
+  ^wait:
+    %timedOut = eir.receive.wait() : !eir.bool
+    eir.br ^done(%y : !eir.term)
+  ^done(%r: !eir.term):
+    eir.return %r : !eir.term
+  }
+}
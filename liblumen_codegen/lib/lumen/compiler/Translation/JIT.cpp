@@ -0,0 +1,141 @@
+#include "llvm-c/TargetMachine.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CBindingWrapping.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+#include "lumen/compiler/Support/RustString.h"
+#include "lumen/compiler/Target/Target.h"
+
+using namespace lumen;
+
+using ::llvm::Error;
+using ::llvm::StringRef;
+using ::llvm::TargetMachine;
+using ::llvm::orc::CompileOnDemandLayer;
+using ::llvm::orc::DynamicLibrarySearchGenerator;
+using ::llvm::orc::JITTargetMachineBuilder;
+using ::llvm::orc::LLLazyJIT;
+using ::llvm::orc::LLLazyJITBuilder;
+using ::llvm::orc::ThreadSafeModule;
+
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(TargetMachine, LLVMTargetMachineRef);
+
+namespace {
+/// An in-process JIT used by `lumen run --jit`
+///
+/// Modules are added lazily by default, in which case a function is only
+/// compiled the first time it is called, via a stub which calls back into
+/// the JIT. Runtime symbols are resolved against shared libraries loaded into
+/// the current process, so no objects are written, and no linker is invoked.
+struct LumenJIT {
+  std::unique_ptr<LLLazyJIT> jit;
+};
+}  // namespace
+
+typedef struct LumenOpaqueJIT *LumenJITRef;
+
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(LumenJIT, LumenJITRef);
+
+// Writes the given error to `errorOut`, consuming it, and returns true if
+// there was an error at all
+static bool reportError(Error err, RustStringRef errorOut) {
+  if (!err) return false;
+  RawRustStringOstream os(errorOut);
+  llvm::logAllUnhandledErrors(std::move(err), os);
+  return true;
+}
+
+extern "C" LumenJITRef LLVMLumenCreateJIT(LLVMTargetMachineRef tm,
+                                          OptLevel opt,
+                                          unsigned numCompileThreads,
+                                          RustStringRef errorOut) {
+  TargetMachine *targetMachine = unwrap(tm);
+
+  // Compile for the same target as the ahead-of-time compiler would
+  JITTargetMachineBuilder jtmb(targetMachine->getTargetTriple());
+  jtmb.setCPU(targetMachine->getTargetCPU());
+  jtmb.addFeatures({targetMachine->getTargetFeatureString().str()});
+  jtmb.setCodeGenOptLevel(toLLVM(opt));
+
+  auto jit = LLLazyJITBuilder()
+                 .setJITTargetMachineBuilder(std::move(jtmb))
+                 .setNumCompileThreads(numCompileThreads)
+                 .create();
+  if (!jit) {
+    reportError(jit.takeError(), errorOut);
+    return nullptr;
+  }
+
+  // Only compile the function which was actually requested, rather than the
+  // whole module it belongs to; its callees are compiled as they are called
+  (*jit)->setPartitionFunction(CompileOnDemandLayer::compileRequested);
+
+  auto *lumenJIT = new LumenJIT();
+  lumenJIT->jit = std::move(*jit);
+  return wrap(lumenJIT);
+}
+
+extern "C" void LLVMLumenDisposeJIT(LumenJITRef j) { delete unwrap(j); }
+
+/// Makes the exported symbols of the given shared library available to JIT
+/// compiled code. If `path` is null, the symbols of the current process are
+/// used instead, e.g. for libc.
+extern "C" bool LLVMLumenJITAddDynamicLibrary(LumenJITRef j, const char *path,
+                                              RustStringRef errorOut) {
+  LLLazyJIT &jit = *unwrap(j)->jit;
+  char globalPrefix = jit.getDataLayout().getGlobalPrefix();
+
+  auto generator =
+      path ? DynamicLibrarySearchGenerator::Load(path, globalPrefix)
+           : DynamicLibrarySearchGenerator::GetForCurrentProcess(globalPrefix);
+  if (!generator) return !reportError(generator.takeError(), errorOut);
+
+  jit.getMainJITDylib().addGenerator(std::move(*generator));
+  return true;
+}
+
+/// Adds a module, given as LLVM bitcode, to the JIT
+///
+/// The module is parsed into a context of its own, as the context it was
+/// generated in belongs to the compiler's context pool. If `lazy` is set,
+/// functions in the module are compiled on first call, otherwise the whole
+/// module is compiled the first time any of its symbols are looked up.
+extern "C" bool LLVMLumenJITAddBitcode(LumenJITRef j, const char *name,
+                                       const char *data, size_t len,
+                                       bool lazy, RustStringRef errorOut) {
+  LLLazyJIT &jit = *unwrap(j)->jit;
+
+  auto buffer = llvm::MemoryBuffer::getMemBuffer(
+      StringRef(data, len), name, /*RequiresNullTerminator=*/false);
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto mod = llvm::parseBitcodeFile(buffer->getMemBufferRef(), *context);
+  if (!mod) return !reportError(mod.takeError(), errorOut);
+
+  ThreadSafeModule tsm(std::move(*mod), std::move(context));
+  Error err = lazy ? jit.addLazyIRModule(std::move(tsm))
+                   : jit.addIRModule(std::move(tsm));
+  return !reportError(std::move(err), errorOut);
+}
+
+/// Returns the address of the given symbol, compiling it if necessary
+///
+/// Returns null if the symbol could not be found, or failed to compile.
+extern "C" void *LLVMLumenJITLookup(LumenJITRef j, const char *symbol,
+                                    RustStringRef errorOut) {
+  LLLazyJIT &jit = *unwrap(j)->jit;
+
+  auto sym = jit.lookup(symbol);
+  if (!sym) {
+    reportError(sym.takeError(), errorOut);
+    return nullptr;
+  }
+  return reinterpret_cast<void *>(static_cast<uintptr_t>(sym->getAddress()));
+}
@@ -6,8 +6,14 @@
 #include "llvm/Target/TargetMachine.h"
 #include "lumen/compiler/Dialect/EIR/Transforms/Passes.h"
 #include "lumen/compiler/Support/MLIR.h"
+#include "lumen/compiler/Support/RustString.h"
+#include "lumen/compiler/Support/Statistics.h"
+#include "lumen/compiler/Target/Builtins.h"
+#include "lumen/compiler/Target/DispatchCache.h"
 #include "lumen/compiler/Target/Target.h"
 #include "lumen/compiler/Target/TargetInfo.h"
+#include "lumen/compiler/Target/TermMetadata.h"
+#include "lumen/compiler/Translation/LLVMIR.h"
 #include "mlir/Conversion/StandardToLLVM/ConvertStandardToLLVMPass.h"
 #include "mlir/ExecutionEngine/ExecutionEngine.h"
 #include "mlir/ExecutionEngine/OptUtils.h"
@@ -32,10 +38,47 @@ DEFINE_SIMPLE_CONVERSION_FUNCTIONS(TargetMachine, LLVMTargetMachineRef);
 
 using CodeGenOptLevel = ::llvm::CodeGenOpt::Level;
 
+static StringRef stringifyDialect(TargetDialect dialect) {
+  switch (dialect) {
+    case TargetDialect::TargetEIR:
+      return "eir";
+    case TargetDialect::TargetStandard:
+      return "standard";
+    case TargetDialect::TargetLLVM:
+      return "llvm-dialect";
+    default:
+      return "unknown";
+  }
+}
+
+// Records the number of operations in the given module for `-Z print-stats`
+static void recordModuleSize(ModuleOp mod, StringRef stage) {
+  uint64_t numOps = 0;
+  mod.walk([&](mlir::Operation *) { ++numOps; });
+  stats::recordIRSize(mod.getName().getValueOr("anonymous"), stage, numOps);
+}
+
+namespace lumen {
+
+void annotateTranslatedModule(llvm::Module &module,
+                              TargetMachine *targetMachine,
+                              mlir::LLVM::LLVMDialect &dialect) {
+  // The EIR lowering declares runtime builtins without attributes, and emits
+  // loads without metadata or atomic orderings, as the LLVM dialect has no way
+  // to express them; they are added now that we have LLVM IR
+  addBuiltinAttributes(module);
+  addDispatchCacheOrdering(module);
+  addTermMetadata(module, TargetInfo::get(targetMachine, dialect));
+}
+
+}  // namespace lumen
+
 extern "C" MLIRModuleRef MLIRLowerModule(MLIRContextRef context,
                                          MLIRModuleRef m, TargetDialect dialect,
-                                         OptLevel opt,
-                                         LLVMTargetMachineRef tm) {
+                                         OptLevel opt, LLVMTargetMachineRef tm,
+                                         bool enableMultithreading,
+                                         RustStringRef report,
+                                         bool emitRemarks) {
   MLIRContext *ctx = unwrap(context);
   ModuleOp *mod = unwrap(m);
   TargetMachine *targetMachine = unwrap(tm);
@@ -43,8 +86,17 @@ extern "C" MLIRModuleRef MLIRLowerModule(MLIRContextRef context,
 
   PassManager pm(ctx);
   mlir::applyPassManagerCLOptions(pm);
-  // pm.enableTiming();
-  // pm.enableStatistics();
+  // Nested function pipelines are run in parallel across the functions of the
+  // module, unless disabled, e.g. when the caller is already saturating cores
+  pm.disableMultithreading(!enableMultithreading);
+  // Pass timings are aggregated across all modules, rather than reported
+  // per-module via `enableTiming`, see `-Z time-passes`
+  if (stats::isTimingEnabled())
+    pm.addInstrumentation(std::make_unique<stats::PassTimingInstrumentation>());
+
+  // The codegen report, if requested, is written to the given Rust string
+  std::unique_ptr<RawRustStringOstream> reportStream;
+  if (report) reportStream = std::make_unique<RawRustStringOstream>(report);
 
   bool enableOpt = optLevel >= CodeGenOptLevel::None;
   bool lowerToStandard = dialect >= TargetDialect::TargetStandard;
@@ -60,7 +112,8 @@ extern "C" MLIRModuleRef MLIRLowerModule(MLIRContextRef context,
   }
 
   if (lowerToStandard || lowerToLLVM) {
-    buildEIRTransformPassPipeline(pm, targetMachine);
+    buildEIRTransformPassPipeline(pm, targetMachine, reportStream.get(),
+                                  emitRemarks);
 
     // Add optimizations if enabled
     if (enableOpt) {
@@ -73,10 +126,15 @@ extern "C" MLIRModuleRef MLIRLowerModule(MLIRContextRef context,
   }
 
   OwningModuleRef ownedMod(*mod);
+  bool countSizes = stats::isCountingEnabled();
+  if (countSizes) recordModuleSize(*ownedMod, "eir");
+
   if (mlir::failed(pm.run(*ownedMod))) {
     return nullptr;
   }
 
+  if (countSizes) recordModuleSize(*ownedMod, stringifyDialect(dialect));
+
   return wrap(new ModuleOp(ownedMod.release()));
 }
 
@@ -111,6 +169,17 @@ extern "C" LLVMModuleRef MLIRLowerToLLVMIR(MLIRModuleRef m,
   llvmModPtr->setDataLayout(targetMachine->createDataLayout());
   llvmModPtr->setTargetTriple(targetTriple.getTriple());
 
+  auto *dialect =
+      ownedMod->getContext()->getRegisteredDialect<mlir::LLVM::LLVMDialect>();
+  annotateTranslatedModule(*llvmModPtr, targetMachine, *dialect);
+  // Done here rather than when emitting, as the same module may be emitted
+  // more than once, e.g. as assembly and then as an object
+  splitColdCode(targetMachine, *llvmModPtr);
+
+  if (stats::isCountingEnabled())
+    stats::recordIRSize(llvmModPtr->getModuleIdentifier(), "llvm-ir",
+                        llvmModPtr->getInstructionCount());
+
   // mlir::ExecutionEngine::setupTargetTriple(llvmModPtr.get());
 
   // L::outs() << L::format("Making optimizing transformer with %p",
@@ -0,0 +1,28 @@
+#ifndef LUMEN_TRANSLATION_LLVMIR_H
+#define LUMEN_TRANSLATION_LLVMIR_H
+
+namespace llvm {
+class Module;
+class TargetMachine;
+}  // namespace llvm
+
+namespace mlir {
+namespace LLVM {
+class LLVMDialect;
+}  // namespace LLVM
+}  // namespace mlir
+
+namespace lumen {
+
+/// Adds what the LLVM dialect cannot express to `module`, as just translated
+/// from it: the attributes of runtime builtin declarations, and the orderings
+/// and metadata of loads.
+///
+/// The module must already have the data layout of `targetMachine`.
+void annotateTranslatedModule(llvm::Module &module,
+                              llvm::TargetMachine *targetMachine,
+                              mlir::LLVM::LLVMDialect &dialect);
+
+}  // namespace lumen
+
+#endif  // LUMEN_TRANSLATION_LLVMIR_H
@@ -4,6 +4,7 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CBindingWrapping.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -509,6 +510,101 @@ extern "C" MLIRValueRef MLIRBuildTraceConstructOp(MLIRModuleBuilderRef,
   return nullptr;
 }
 
+//===----------------------------------------------------------------------===//
+// Receive
+//===----------------------------------------------------------------------===//
+
+// The `receive_start`, `receive_wait` and `receive_done` intrinsics of EIR
+// are translated to the receive ops, see EIROps.td
+
+extern "C" void MLIRBuildReceiveStart(MLIRModuleBuilderRef b,
+                                      MLIRBlockRef contBlock,
+                                      MLIRValueRef *contArgv,
+                                      unsigned contArgc, MLIRValueRef t) {
+  ModuleBuilder *builder = unwrap(b);
+  Block *cont = unwrap(contBlock);
+  SmallVector<Value, 1> contArgs;
+  unwrapValues(contArgv, contArgc, contArgs);
+  builder->build_receive_start(unwrap(t), cont, contArgs);
+}
+
+void ModuleBuilder::build_receive_start(Value timeout, Block *cont,
+                                        ArrayRef<Value> contArgs) {
+  // An invalid timeout raises, like a call would
+  auto startOp =
+      builder.create<ReceiveStartOp>(builder.getUnknownLoc(), timeout);
+  build_call_result(startOp.getResult(), /*isTail=*/false, cont, contArgs,
+                    /*err=*/nullptr, {});
+}
+
+extern "C" void MLIRBuildReceiveWait(MLIRModuleBuilderRef b,
+                                     MLIRBlockRef timeoutBlock,
+                                     MLIRValueRef *timeoutArgv,
+                                     unsigned timeoutArgc,
+                                     MLIRBlockRef messageBlock,
+                                     MLIRValueRef *messageArgv,
+                                     unsigned messageArgc) {
+  ModuleBuilder *builder = unwrap(b);
+  Block *timeout = unwrap(timeoutBlock);
+  Block *message = unwrap(messageBlock);
+  SmallVector<Value, 1> timeoutArgs;
+  unwrapValues(timeoutArgv, timeoutArgc, timeoutArgs);
+  SmallVector<Value, 1> messageArgs;
+  unwrapValues(messageArgv, messageArgc, messageArgs);
+  builder->build_receive_wait(timeout, timeoutArgs, message, messageArgs);
+}
+
+// The message continuation branches back to the block containing
+// `receive_wait` when the message does not match, so this builds the loop
+// header in its own block, which peeks at the next message, and passes it to
+// the message continuation, or waits for one if there are none left
+void ModuleBuilder::build_receive_wait(Block *timeout,
+                                       ArrayRef<Value> timeoutArgs,
+                                       Block *message,
+                                       ArrayRef<Value> messageArgs) {
+  auto loc = builder.getUnknownLoc();
+  Block *current = builder.getBlock();
+  Region *region = current->getParent();
+  Block *peekBlock = builder.createBlock(region);
+  Block *waitBlock = builder.createBlock(region);
+
+  builder.setInsertionPointToEnd(current);
+  builder.create<BranchOp>(loc, peekBlock);
+
+  builder.setInsertionPointToEnd(peekBlock);
+  Value msg = builder.create<ReceivePeekOp>(loc);
+  Value none = builder.create<ConstantNoneOp>(loc);
+  Value isEmpty = builder.create<CmpEqOp>(loc, msg, none, /*strict=*/false);
+  SmallVector<Value, 2> messageArgsFinal(messageArgs.begin(),
+                                         messageArgs.end());
+  messageArgsFinal.push_back(msg);
+  builder.create<CondBranchOp>(loc, isEmpty, waitBlock, ArrayRef<Value>{},
+                               message, messageArgsFinal);
+
+  builder.setInsertionPointToEnd(waitBlock);
+  Value timedOut = builder.create<ReceiveWaitOp>(loc);
+  auto condBr = builder.create<CondBranchOp>(
+      loc, timedOut, timeout, timeoutArgs, peekBlock, ArrayRef<Value>{});
+  condBr.setExpectedCondition(false);
+}
+
+extern "C" void MLIRBuildReceiveDone(MLIRModuleBuilderRef b,
+                                     MLIRBlockRef contBlock,
+                                     MLIRValueRef *contArgv,
+                                     unsigned contArgc) {
+  ModuleBuilder *builder = unwrap(b);
+  Block *cont = unwrap(contBlock);
+  SmallVector<Value, 2> contArgs;
+  unwrapValues(contArgv, contArgc, contArgs);
+  builder->build_receive_done(cont, contArgs);
+}
+
+void ModuleBuilder::build_receive_done(Block *cont, ArrayRef<Value> contArgs) {
+  auto loc = builder.getUnknownLoc();
+  builder.create<ReceiveDoneOp>(loc);
+  builder.create<BranchOp>(loc, cont, contArgs);
+}
+
 //===----------------------------------------------------------------------===//
 // MapOp
 //===----------------------------------------------------------------------===//
@@ -577,8 +673,9 @@ void ModuleBuilder::build_map_insert_op(Value map, Value key, Value val,
   // Then branch to either the ok block, or the error block
   ValueRange okArgs = {newMap};
   ValueRange errArgs = {};
-  builder.create<CondBranchOp>(builder.getUnknownLoc(), isOk, ok, okArgs, err,
-                               errArgs);
+  auto condBr = builder.create<CondBranchOp>(builder.getUnknownLoc(), isOk, ok,
+                                             okArgs, err, errArgs);
+  condBr.setExpectedCondition(true);
 }
 
 void ModuleBuilder::build_map_update_op(Value map, Value key, Value val,
@@ -594,8 +691,9 @@ void ModuleBuilder::build_map_update_op(Value map, Value key, Value val,
   // Then branch to either the ok block, or the error block
   ValueRange okArgs = {newMap};
   ValueRange errArgs = {};
-  builder.create<CondBranchOp>(builder.getUnknownLoc(), isOk, ok, okArgs, err,
-                               errArgs);
+  auto condBr = builder.create<CondBranchOp>(builder.getUnknownLoc(), isOk, ok,
+                                             okArgs, err, errArgs);
+  condBr.setExpectedCondition(true);
 }
 
 //===----------------------------------------------------------------------===//
@@ -753,36 +851,162 @@ extern "C" void MLIRBuildStaticCall(MLIRModuleBuilderRef b, const char *name,
                              errArgs);
 }
 
-static bool is_intrinsic(StringRef target) {
-  // PrintOp
-  if (target == "erlang:print/1") {
-    return true;
-  }
-  return false;
+namespace {
+
+// Builds the operation a call to an intrinsic is translated to, returning its
+// result, which is always a term
+using IntrinsicBuilder = Value (*)(OpBuilder &builder, Location loc,
+                                   ArrayRef<Value> args);
+
+struct Intrinsic {
+  // The callee, e.g. `erlang:element/2`
+  StringRef name;
+  IntrinsicBuilder build;
+  // Whether the intrinsic can raise, i.e. produce NONE. The result of those
+  // which cannot is passed straight to the ok destination, without the NONE
+  // check or a branch to the error destination.
+  bool canFail;
+};
+
+}  // namespace
+
+template <typename Op>
+static Value build_unary_intrinsic(OpBuilder &builder, Location loc,
+                                   ArrayRef<Value> args) {
+  return builder.create<Op>(loc, args[0]);
+}
+
+template <typename Op>
+static Value build_binary_intrinsic(OpBuilder &builder, Location loc,
+                                    ArrayRef<Value> args) {
+  return builder.create<Op>(loc, args[0], args[1]);
+}
+
+template <typename Op>
+static Value build_builtin_intrinsic(OpBuilder &builder, Location loc,
+                                     ArrayRef<Value> args) {
+  return builder.create<Op>(loc, ValueRange(args));
+}
+
+// Guards produce a boolean, which is converted to the atoms `true`/`false`
+static Value build_boolean_term(OpBuilder &builder, Location loc, Value cond) {
+  auto termTy = builder.getType<TermType>();
+  return builder.create<CastOp>(loc, cond, termTy);
+}
+
+template <typename T>
+static Value build_is_type_intrinsic(OpBuilder &builder, Location loc,
+                                     ArrayRef<Value> args) {
+  auto matchType = builder.getType<T>();
+  Value isType = builder.create<IsTypeOp>(loc, args[0], matchType);
+  return build_boolean_term(builder, loc, isType);
+}
+
+template <typename T>
+static Value build_is_boxed_type_intrinsic(OpBuilder &builder, Location loc,
+                                           ArrayRef<Value> args) {
+  auto matchType = builder.getType<BoxType>(builder.getType<T>());
+  Value isType = builder.create<IsTypeOp>(loc, args[0], matchType);
+  return build_boolean_term(builder, loc, isType);
+}
+
+template <typename Op>
+static Value build_exact_comparison_intrinsic(OpBuilder &builder, Location loc,
+                                              ArrayRef<Value> args) {
+  Value cmp = builder.create<Op>(loc, args[0], args[1], /*strict=*/true);
+  return build_boolean_term(builder, loc, cmp);
+}
+
+static Value build_print_intrinsic(OpBuilder &builder, Location loc,
+                                   ArrayRef<Value> args) {
+  auto termTy = builder.getType<TermType>();
+  return builder.create<PrintOp>(loc, termTy, args);
+}
+
+// BIFs which are translated to dedicated operations, rather than calls, so
+// that they can be lowered to inline code
+static const Intrinsic intrinsics[] = {
+    {"erlang:print/1", build_print_intrinsic, true},
+    // Arithmetic and bitwise operators, with inline fast paths for fixnums
+    {"erlang:+/2", build_binary_intrinsic<AddOp>, true},
+    {"erlang:-/2", build_binary_intrinsic<SubOp>, true},
+    {"erlang:*/2", build_binary_intrinsic<MulOp>, true},
+    {"erlang:div/2", build_binary_intrinsic<DivOp>, true},
+    {"erlang:rem/2", build_binary_intrinsic<RemOp>, true},
+    {"erlang:-/1", build_unary_intrinsic<NegOp>, true},
+    {"erlang:band/2", build_binary_intrinsic<BandOp>, true},
+    {"erlang:bor/2", build_binary_intrinsic<BorOp>, true},
+    {"erlang:bxor/2", build_binary_intrinsic<BxorOp>, true},
+    {"erlang:bnot/1", build_unary_intrinsic<BnotOp>, true},
+    {"erlang:bsl/2", build_binary_intrinsic<BslOp>, true},
+    {"erlang:bsr/2", build_binary_intrinsic<BsrOp>, true},
+    // Accessors, which raise badarg when given the wrong type
+    {"erlang:element/2", build_builtin_intrinsic<TupleElementOp>, true},
+    {"erlang:setelement/3", build_builtin_intrinsic<TupleSetElementOp>, true},
+    {"erlang:tuple_size/1", build_builtin_intrinsic<TupleSizeOp>, true},
+    {"erlang:hd/1", build_builtin_intrinsic<HdOp>, true},
+    {"erlang:tl/1", build_builtin_intrinsic<TlOp>, true},
+    {"erlang:byte_size/1", build_builtin_intrinsic<ByteSizeOp>, true},
+    {"erlang:map_size/1", build_builtin_intrinsic<MapSizeOp>, true},
+    {"erlang:self/0", build_builtin_intrinsic<SelfOp>, false},
+    {"erlang:node/0", build_builtin_intrinsic<NodeOp>, false},
+    {"erlang:make_ref/0", build_builtin_intrinsic<MakeRefOp>, false},
+    // Type checks and exact comparisons, which accept any term
+    {"erlang:is_atom/1", build_is_type_intrinsic<AtomType>, false},
+    {"erlang:is_float/1", build_is_type_intrinsic<FloatType>, false},
+    {"erlang:is_integer/1", build_is_type_intrinsic<IntegerType>, false},
+    {"erlang:is_list/1", build_is_type_intrinsic<ListType>, false},
+    {"erlang:is_number/1", build_is_type_intrinsic<NumberType>, false},
+    {"erlang:is_function/1", build_is_boxed_type_intrinsic<ClosureType>,
+     false},
+    {"erlang:is_map/1", build_is_boxed_type_intrinsic<MapType>, false},
+    {"erlang:is_tuple/1", build_is_boxed_type_intrinsic<eir::TupleType>,
+     false},
+    {"erlang:=:=/2", build_exact_comparison_intrinsic<CmpEqOp>, false},
+    {"erlang:=/=/2", build_exact_comparison_intrinsic<CmpNeqOp>, false},
+};
+
+static const Intrinsic *lookup_intrinsic(StringRef target) {
+  static const llvm::StringMap<const Intrinsic *> registry = [] {
+    llvm::StringMap<const Intrinsic *> map;
+    for (auto &intrinsic : intrinsics) map[intrinsic.name] = &intrinsic;
+    return map;
+  }();
+  auto it = registry.find(target);
+  if (it == registry.end()) return nullptr;
+  return it->second;
 }
 
 void ModuleBuilder::translate_call_to_intrinsic(
     StringRef target, ArrayRef<Value> args, bool isTail, Block *ok,
     ArrayRef<Value> okArgs, Block *err, ArrayRef<Value> errArgs) {
-  Value result;
-  if (target == "erlang:print/1") {
-    result = build_print_op(args);
+  auto intrinsic = lookup_intrinsic(target);
+  assert(intrinsic && "expected call to intrinsic");
+
+  auto loc = builder.getUnknownLoc();
+  Value result = intrinsic->build(builder, loc, args);
+
+  // Intrinsics which can fail raise like calls do, i.e. they produce NONE
+  if (intrinsic->canFail) {
+    build_call_result(result, isTail, ok, okArgs, err, errArgs);
+    return;
   }
 
-  assert(isTail && "unsupported intrinsic usage");
-  // If this is a tail call, we're returning the results directly
-  if (isTail) {
-    // Return result of call directly
-    builder.create<ReturnOp>(builder.getUnknownLoc(), result);
+  // Otherwise the result is returned, or passed to the ok destination directly
+  if (isTail || !ok) {
+    builder.create<ReturnOp>(loc, result);
     return;
   }
+  SmallVector<Value, 1> okArgsFinal(okArgs.begin(), okArgs.end());
+  okArgsFinal.push_back(result);
+  builder.create<BranchOp>(loc, ok, okArgsFinal);
 }
 
 void ModuleBuilder::build_static_call(StringRef target, ArrayRef<Value> args,
                                       bool isTail, Block *ok,
                                       ArrayRef<Value> okArgs, Block *err,
                                       ArrayRef<Value> errArgs) {
-  if (is_intrinsic(target)) {
+  if (lookup_intrinsic(target)) {
     translate_call_to_intrinsic(target, args, isTail, ok, okArgs, err, errArgs);
     return;
   }
@@ -819,6 +1043,78 @@ void ModuleBuilder::build_static_call(StringRef target, ArrayRef<Value> args,
   // Get result value reference
   Value callResult = call->getResult(0);
 
+  build_call_result(callResult, isTail, ok, okArgs, err, errArgs);
+}
+
+extern "C" void MLIRBuildDynamicCall(MLIRModuleBuilderRef b, MLIRValueRef m,
+                                     MLIRValueRef f, MLIRValueRef *argv,
+                                     unsigned argc, bool isTail,
+                                     MLIRBlockRef okBlock, MLIRValueRef *okArgv,
+                                     unsigned okArgc, MLIRBlockRef errBlock,
+                                     MLIRValueRef *errArgv, unsigned errArgc) {
+  ModuleBuilder *builder = unwrap(b);
+  Value module = unwrap(m);
+  Value function = unwrap(f);
+  Block *ok = unwrap(okBlock);
+  Block *err = unwrap(errBlock);
+  SmallVector<Value, 2> args;
+  unwrapValues(argv, argc, args);
+  SmallVector<Value, 1> okArgs;
+  unwrapValues(okArgv, okArgc, okArgs);
+  SmallVector<Value, 1> errArgs;
+  unwrapValues(errArgv, errArgc, errArgs);
+  builder->build_dynamic_call(module, function, args, isTail, ok, okArgs, err,
+                              errArgs);
+}
+
+void ModuleBuilder::build_dynamic_call(Value module, Value function,
+                                       ArrayRef<Value> args, bool isTail,
+                                       Block *ok, ArrayRef<Value> okArgs,
+                                       Block *err, ArrayRef<Value> errArgs) {
+  // The callee is resolved and cached at the call site when lowered, see
+  // DynamicCallOpConversion
+  auto call = builder.create<DynamicCallOp>(builder.getUnknownLoc(), module,
+                                            function, args);
+  build_call_result(call.getResult(), isTail, ok, okArgs, err, errArgs);
+}
+
+extern "C" void MLIRBuildClosureCall(MLIRModuleBuilderRef b, MLIRValueRef c,
+                                     MLIRValueRef *argv, unsigned argc,
+                                     bool isTail, MLIRBlockRef okBlock,
+                                     MLIRValueRef *okArgv, unsigned okArgc,
+                                     MLIRBlockRef errBlock,
+                                     MLIRValueRef *errArgv, unsigned errArgc) {
+  ModuleBuilder *builder = unwrap(b);
+  Value closure = unwrap(c);
+  Block *ok = unwrap(okBlock);
+  Block *err = unwrap(errBlock);
+  SmallVector<Value, 2> args;
+  unwrapValues(argv, argc, args);
+  SmallVector<Value, 1> okArgs;
+  unwrapValues(okArgv, okArgc, okArgs);
+  SmallVector<Value, 1> errArgs;
+  unwrapValues(errArgv, errArgc, errArgs);
+  builder->build_closure_call(closure, args, isTail, ok, okArgs, err, errArgs);
+}
+
+void ModuleBuilder::build_closure_call(Value closure, ArrayRef<Value> args,
+                                       bool isTail, Block *ok,
+                                       ArrayRef<Value> okArgs, Block *err,
+                                       ArrayRef<Value> errArgs) {
+  // The type and arity of the closure are checked when lowered, see
+  // CallIndirectOpConversion
+  auto call =
+      builder.create<CallIndirectOp>(builder.getUnknownLoc(), closure, args);
+  build_call_result(call.getResult(), isTail, ok, okArgs, err, errArgs);
+}
+
+// Handles the result of a call, which is NONE if the callee raised an
+// exception, by either returning it directly, or branching to the ok/err
+// destinations, creating whichever of those do not exist. Raising is the
+// exception, so the branch to the err destination is marked as unlikely
+void ModuleBuilder::build_call_result(Value callResult, bool isTail, Block *ok,
+                                      ArrayRef<Value> okArgs, Block *err,
+                                      ArrayRef<Value> errArgs) {
   auto currentBlock = builder.getBlock();
   auto currentRegion = currentBlock->getParent();
 
@@ -853,8 +1149,9 @@ void ModuleBuilder::build_static_call(StringRef target, ArrayRef<Value> args,
     okArgsFinal.push_back(callResult);
     errArgsFinal.append(errArgs.begin(), errArgs.end());
     errArgsFinal.push_back(callResult);
-    builder.create<CondBranchOp>(builder.getUnknownLoc(), isErr, err,
-                                 errArgsFinal, ok, okArgsFinal);
+    auto condBr = builder.create<CondBranchOp>(
+        builder.getUnknownLoc(), isErr, err, errArgsFinal, ok, okArgsFinal);
+    condBr.setExpectedCondition(false);
   } else if (!err) {
     // When not successful, the function throws.
     // - Create err block with an argument for the error value
@@ -872,8 +1169,9 @@ void ModuleBuilder::build_static_call(StringRef target, ArrayRef<Value> args,
     okArgsFinal.append(okArgs.begin(), okArgs.end());
     okArgsFinal.push_back(callResult);
     errArgsFinal.push_back(callResult);
-    builder.create<CondBranchOp>(builder.getUnknownLoc(), isErr, err,
-                                 errArgsFinal, ok, okArgsFinal);
+    auto condBr = builder.create<CondBranchOp>(
+        builder.getUnknownLoc(), isErr, err, errArgsFinal, ok, okArgsFinal);
+    condBr.setExpectedCondition(false);
   } else {
     // Simplest case, both ok/err branches already exist
     Value rhs = builder.create<ConstantNoneOp>(builder.getUnknownLoc());
@@ -883,8 +1181,9 @@ void ModuleBuilder::build_static_call(StringRef target, ArrayRef<Value> args,
     okArgsFinal.push_back(callResult);
     errArgsFinal.append(errArgs.begin(), errArgs.end());
     errArgsFinal.push_back(callResult);
-    builder.create<CondBranchOp>(builder.getUnknownLoc(), isErr, err,
-                                 errArgsFinal, ok, okArgsFinal);
+    auto condBr = builder.create<CondBranchOp>(
+        builder.getUnknownLoc(), isErr, err, errArgsFinal, ok, okArgsFinal);
+    condBr.setExpectedCondition(false);
   }
 }
 
@@ -918,6 +1217,26 @@ Value ModuleBuilder::build_tuple(ArrayRef<Value> elements) {
   return op.getResult();
 }
 
+extern "C" MLIRValueRef MLIRConstructClosure(MLIRModuleBuilderRef b,
+                                             const char *name, unsigned arity,
+                                             uint64_t module,
+                                             uint64_t function,
+                                             MLIRValueRef *ev, unsigned ec) {
+  ModuleBuilder *builder = unwrap(b);
+  StringRef callee(name);
+  SmallVector<Value, 2> env;
+  unwrapValues(ev, ec, env);
+  return wrap(builder->build_closure(callee, arity, module, function, env));
+}
+
+Value ModuleBuilder::build_closure(StringRef callee, unsigned arity,
+                                   uint64_t module, uint64_t function,
+                                   ArrayRef<Value> env) {
+  auto op = builder.create<ClosureOp>(builder.getUnknownLoc(), callee, arity,
+                                      module, function, env);
+  return op.getResult();
+}
+
 extern "C" MLIRValueRef MLIRConstructMap(MLIRModuleBuilderRef b, MapEntry *ev,
                                          unsigned ec) {
   ModuleBuilder *builder = unwrap(b);
@@ -199,6 +199,18 @@ class ModuleBuilder {
                          Block *ok, ArrayRef<Value> okArgs, Block *err,
                          ArrayRef<Value> errArgs);
 
+  void build_dynamic_call(Value module, Value function, ArrayRef<Value> args,
+                          bool isTail, Block *ok, ArrayRef<Value> okArgs,
+                          Block *err, ArrayRef<Value> errArgs);
+
+  void build_closure_call(Value closure, ArrayRef<Value> args, bool isTail,
+                          Block *ok, ArrayRef<Value> okArgs, Block *err,
+                          ArrayRef<Value> errArgs);
+
+  void build_call_result(Value callResult, bool isTail, Block *ok,
+                         ArrayRef<Value> okArgs, Block *err,
+                         ArrayRef<Value> errArgs);
+
   //===----------------------------------------------------------------------===//
   // Operations
   //===----------------------------------------------------------------------===//
@@ -224,12 +236,20 @@ class ModuleBuilder {
   Value build_logical_or(Value lhs, Value rhs);
   Value build_cons(Value head, Value tail);
   Value build_tuple(ArrayRef<Value> elements);
+  Value build_closure(StringRef callee, unsigned arity, uint64_t module,
+                      uint64_t function, ArrayRef<Value> env);
   Value build_map(ArrayRef<MapEntry> entries);
 
   Value build_print_op(ArrayRef<Value> args);
   void build_trace_capture_op(Block *dest,
                               ArrayRef<MLIRValueRef> destArgs = {});
 
+  void build_receive_start(Value timeout, Block *cont,
+                           ArrayRef<Value> contArgs);
+  void build_receive_wait(Block *timeout, ArrayRef<Value> timeoutArgs,
+                          Block *message, ArrayRef<Value> messageArgs);
+  void build_receive_done(Block *cont, ArrayRef<Value> contArgs);
+
   //===----------------------------------------------------------------------===//
   // Constants
   //===----------------------------------------------------------------------===//
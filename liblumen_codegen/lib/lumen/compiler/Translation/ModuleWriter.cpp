@@ -88,11 +88,14 @@ extern "C" bool MLIREmitToFileDescriptor(MLIRModuleRef m, int fd,
   return false;
 }
 
-extern "C" LLVMMemoryBufferRef MLIREmitToMemoryBuffer(MLIRModuleRef m) {
+extern "C" LLVMMemoryBufferRef MLIREmitToMemoryBuffer(MLIRModuleRef m,
+                                                     bool printLocations) {
   mlir::ModuleOp *mod = unwrap(m);
   llvm::SmallString<0> codeString;
   llvm::raw_svector_ostream oStream(codeString);
-  mod->print(oStream);
+  mlir::OpPrintingFlags flags;
+  if (printLocations) flags.enableDebugInfo();
+  mod->print(oStream, flags);
   llvm::StringRef data = oStream.str();
   return LLVMCreateMemoryBufferWithMemoryRangeCopy(data.data(), data.size(),
                                                    "");
@@ -0,0 +1,29 @@
+#ifndef LUMEN_TOOLS_HOSTTARGETMACHINE_H
+#define LUMEN_TOOLS_HOSTTARGETMACHINE_H
+
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <memory>
+#include <string>
+
+// The conversion to the LLVM dialect takes the pointer width and term encoding
+// from a target machine, for which lit tests use the host
+inline llvm::TargetMachine *getHostTargetMachine() {
+  static std::unique_ptr<llvm::TargetMachine> targetMachine = [] {
+    llvm::InitializeNativeTarget();
+    std::string triple = llvm::sys::getProcessTriple();
+    std::string error;
+    auto *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) llvm::report_fatal_error(error);
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions(), llvm::None));
+  }();
+  return targetMachine.get();
+}
+
+#endif  // LUMEN_TOOLS_HOSTTARGETMACHINE_H
@@ -0,0 +1,100 @@
+// Runs passes over MLIR modules containing EIR, for the lit tests of each
+// dialect, e.g.:
+//
+//   lumen-opt -lumen-eir-multi-value-return foo.mlir | FileCheck foo.mlir
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "lumen/compiler/Dialect/EIR/Conversion/EIRToLLVM/ConvertEIRToLLVM.h"
+#include "lumen/compiler/Dialect/EIR/IR/EIRDialect.h"
+#include "lumen/compiler/Dialect/EIR/Transforms/Passes.h"
+#include "lumen/compiler/Support/RustString.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/IR/Dialect.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Support/MlirOptMain.h"
+#include "tools/HostTargetMachine.h"
+
+static llvm::cl::opt<std::string> inputFilename(llvm::cl::Positional,
+                                                llvm::cl::desc("<input file>"),
+                                                llvm::cl::init("-"));
+
+static llvm::cl::opt<std::string> outputFilename(
+    "o", llvm::cl::desc("Output filename"), llvm::cl::value_desc("filename"),
+    llvm::cl::init("-"));
+
+static llvm::cl::opt<bool> splitInputFile(
+    "split-input-file",
+    llvm::cl::desc("Split the input file into pieces and process each "
+                   "chunk independently"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> verifyDiagnostics(
+    "verify-diagnostics",
+    llvm::cl::desc("Check that emitted diagnostics match "
+                   "expected-* lines on the corresponding line"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> verifyPasses(
+    "verify-each",
+    llvm::cl::desc("Run the verifier after each transformation pass"),
+    llvm::cl::init(true));
+
+// The RustString helpers in Support write through this, which liblumen_llvm
+// provides to the compiler. Nothing this tool runs produces a RustString.
+extern "C" void LLVMRustStringWriteImpl(RustStringRef, const char *, size_t) {
+  llvm_unreachable("lumen-opt cannot write to a Rust string");
+}
+
+static mlir::PassPipelineRegistration<> eirToLLVM(
+    "lumen-eir-to-llvm", "Convert EIR to the LLVM dialect for the host",
+    [](mlir::OpPassManager &pm) {
+      pm.addPass(
+          lumen::eir::createConvertEIRToLLVMPass(getHostTargetMachine()));
+    });
+
+static mlir::PassPipelineRegistration<> codegenReport(
+    "lumen-codegen-report",
+    "Report runtime calls made by LLVM dialect functions, as JSON on stdout "
+    "and as remarks",
+    [](mlir::OpPassManager &pm) {
+      pm.addPass(lumen::eir::createCodegenReportPass(
+          getHostTargetMachine(), &llvm::outs(), /*emitRemarks=*/true));
+    });
+
+int main(int argc, char **argv) {
+  llvm::InitLLVM y(argc, argv);
+
+  mlir::registerDialect<mlir::LLVM::LLVMDialect>();
+  mlir::registerDialect<lumen::eir::EirDialect>();
+
+  mlir::registerPassManagerCLOptions();
+  mlir::PassPipelineCLParser passPipeline("", "Compiler passes to run");
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "Lumen modular optimizer driver\n");
+
+  std::string errorMessage;
+  auto file = mlir::openInputFile(inputFilename, &errorMessage);
+  if (!file) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+
+  auto output = mlir::openOutputFile(outputFilename, &errorMessage);
+  if (!output) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+
+  if (failed(mlir::MlirOptMain(output->os(), std::move(file), passPipeline,
+                               splitInputFile, verifyDiagnostics,
+                               verifyPasses))) {
+    return 1;
+  }
+  output->keep();
+  return 0;
+}
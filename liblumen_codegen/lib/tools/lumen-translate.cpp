@@ -0,0 +1,86 @@
+// Lowers MLIR modules containing EIR to LLVM IR for the host, as the compiler
+// does, for the lit tests of what is only added after translation, e.g.:
+//
+//   lumen-translate foo.mlir | FileCheck foo.mlir
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "lumen/compiler/Dialect/EIR/Conversion/EIRToLLVM/ConvertEIRToLLVM.h"
+#include "lumen/compiler/Dialect/EIR/IR/EIRDialect.h"
+#include "lumen/compiler/Support/RustString.h"
+#include "lumen/compiler/Translation/LLVMIR.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Dialect.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/Module.h"
+#include "mlir/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Support/FileUtilities.h"
+#include "mlir/Target/LLVMIR.h"
+#include "tools/HostTargetMachine.h"
+
+static llvm::cl::opt<std::string> inputFilename(llvm::cl::Positional,
+                                                llvm::cl::desc("<input file>"),
+                                                llvm::cl::init("-"));
+
+static llvm::cl::opt<std::string> outputFilename(
+    "o", llvm::cl::desc("Output filename"), llvm::cl::value_desc("filename"),
+    llvm::cl::init("-"));
+
+// See lumen-opt
+extern "C" void LLVMRustStringWriteImpl(RustStringRef, const char *, size_t) {
+  llvm_unreachable("lumen-translate cannot write to a Rust string");
+}
+
+int main(int argc, char **argv) {
+  llvm::InitLLVM y(argc, argv);
+
+  mlir::registerDialect<mlir::LLVM::LLVMDialect>();
+  mlir::registerDialect<lumen::eir::EirDialect>();
+
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "Lumen EIR to LLVM IR translator\n");
+
+  std::string errorMessage;
+  auto file = mlir::openInputFile(inputFilename, &errorMessage);
+  if (!file) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+
+  auto output = mlir::openOutputFile(outputFilename, &errorMessage);
+  if (!output) {
+    llvm::errs() << errorMessage << "\n";
+    return 1;
+  }
+
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(std::move(file), llvm::SMLoc());
+  mlir::MLIRContext context;
+  mlir::SourceMgrDiagnosticHandler diagnosticHandler(sourceMgr, &context);
+
+  mlir::OwningModuleRef mod = mlir::parseSourceFile(sourceMgr, &context);
+  if (!mod) return 1;
+
+  auto *targetMachine = getHostTargetMachine();
+  mlir::PassManager pm(&context);
+  pm.addPass(lumen::eir::createConvertEIRToLLVMPass(targetMachine));
+  if (mlir::failed(pm.run(*mod))) return 1;
+
+  // As MLIRLowerToLLVMIR does
+  auto llvmModule = mlir::translateModuleToLLVMIR(*mod);
+  if (!llvmModule) return 1;
+  llvmModule->setDataLayout(targetMachine->createDataLayout());
+  llvmModule->setTargetTriple(targetMachine->getTargetTriple().getTriple());
+  auto *dialect = context.getRegisteredDialect<mlir::LLVM::LLVMDialect>();
+  lumen::annotateTranslatedModule(*llvmModule, targetMachine, *dialect);
+
+  llvmModule->print(output->os(), nullptr);
+  output->keep();
+  return 0;
+}
@@ -1,109 +1,183 @@
 use std::collections::HashSet;
-use std::ffi::CString;
 use std::fs::File;
 use std::path::Path;
 use std::sync::Arc;
 
+use anyhow::anyhow;
+
 use libeir_intern::Symbol;
 
+use liblumen_core::util::phf;
+
 use crate::codegen::CompiledModule;
 use crate::llvm::*;
 use crate::Result;
 
+/// The name of the generated atom table module
+pub const NAME: &'static str = "liblumen_crt_atoms";
+
 /// Generates an LLVM module containing the raw atom table data for the current build
 ///
-/// Process is as follows:
-/// - Generate a constant for each atom string
-/// - Generate a constant array containing `ConstantAtom` structs for all atoms:
-///   - Has type `{ i64, i8* }`
-///   - First field is the id of the `Symbol`
-///   - Second field is the pointer to the string constant
-/// - Generate the __LUMEN_ATOM_TABLE global as a pointer to the first element of the array
-/// - Generate the __LUMEN_ATOM_TABLE_SIZE global with the number of elements in the array
-pub fn compile_atom_table(
+/// The table is used in place by the runtime (see `liblumen_core::atoms::StaticAtomTable`),
+/// so everything needed to look atoms up, by id or by name, is computed here:
+/// - Generate a minimal perfect hash function for the atom strings
+/// - Generate a constant containing the bytes of all atom strings, laid out contiguously
+/// - Generate a constant array containing `AtomData` structs for each atom, indexed by id:
+///   - Has type `{ i64, i32, i32 }`
+///   - First field is the hash of the atom string
+///   - Second field is the offset of the atom string in the string data
+///   - Third field is the length of the atom string, or `u32::MAX` for unused ids
+/// - Generate constant arrays for the displacements and slots of the hash table
+/// - Generate the __LUMEN_ATOM_TABLE global, a `StaticAtomTable` referencing the above
+pub fn generate_atom_table(
     context: &Context,
     target_machine: &TargetMachine,
     mut atoms: HashSet<Symbol>,
-    output_dir: &Path,
-) -> Result<Arc<CompiledModule>> {
-    const NAME: &'static str = "liblumen_crt_atoms";
-
+) -> Result<Module> {
     let builder = ModuleBuilder::new(NAME, context, target_machine)?;
 
     // Ensure true/false are always present
     atoms.insert(Symbol::intern("false"));
     atoms.insert(Symbol::intern("true"));
 
-    fn insert_atom<'ctx>(builder: &ModuleBuilder<'ctx>, atom: Symbol) -> Result<LLVMValueRef> {
-        // We remap true/false to 1/0 respectively
-        let id = atom.as_usize();
-        // Each atom must be a null-terminated string
-        let s = CString::new(atom.as_str().get()).unwrap();
-        let size = s.as_bytes().len();
-        // Each atom has type `[? x i8]` where `?` is the number of bytes in the string
-        let i8_type = builder.get_i8_type();
-        let string_type = builder.get_array_type(size + 1, i8_type);
-        // The initializer is just the string contents
-        let init = builder.build_constant_cstring(s, /* null_terminate= */ true);
-        let constant =
-            builder.add_constant(string_type, &format!("__atom{}.value", id), Some(init));
-        // The atom constants are not accessible directly, only via the table
-        builder.set_linkage(constant, Linkage::Private);
-        builder.set_alignment(constant, 8);
-        Ok(constant)
-    }
+    // Order atoms by id, so that the generated table is deterministic
+    let mut atoms: Vec<Symbol> = atoms.into_iter().collect();
+    atoms.sort_by_key(|atom| atom.as_usize());
 
-    // Generate globals/constants for each atom
-    let mut values = Vec::with_capacity(atoms.len());
-    for atom in atoms.iter().copied() {
-        values.push((atom, insert_atom(&builder, atom)?));
+    // Lay out the atom strings contiguously
+    let mut strings = Vec::new();
+    let mut spans = Vec::with_capacity(atoms.len());
+    for atom in atoms.iter() {
+        let s = atom.as_str();
+        let bytes = s.get().as_bytes();
+        let offset = strings.len();
+        strings.extend_from_slice(bytes);
+        spans.push((offset, bytes.len()));
     }
+    if strings.len() > (u32::max_value() as usize) {
+        return Err(anyhow!("atom table too large: {} bytes", strings.len()));
+    }
+
+    // Generate the hash function
+    let string_of = |i: usize| {
+        let (offset, len) = spans[i];
+        &strings[offset..(offset + len)]
+    };
+    let state = phf::generate(atoms.len(), |seed, i| phf::hash_bytes(seed, string_of(i)));
 
-    // Generate constants array entries
     let i8_type = builder.get_i8_type();
-    let i8ptr_type = builder.get_pointer_type(i8_type);
+    let i32_type = builder.get_i32_type();
     let i64_type = builder.get_i64_type();
-    let entry_type = builder.get_struct_type(Some("ConstantAtom"), &[i64_type, i8ptr_type]);
+    let usize_type = builder.get_usize_type();
 
-    let mut entries = Vec::with_capacity(values.len());
-    for (sym, value) in values.iter() {
-        let id = builder.build_constant_uint(i64_type, sym.as_usize());
-        let ptr = builder.build_const_inbounds_gep(*value, &[0, 0]);
-        entries.push(builder.build_constant_struct(entry_type, &[id, ptr]));
-    }
+    let add_private_constant = |name: &str, init: LLVMValueRef| {
+        let ty = unsafe { llvm_sys::core::LLVMTypeOf(init) };
+        let constant = builder.add_constant(ty, name, Some(init));
+        builder.set_linkage(constant, Linkage::Private);
+        builder.set_alignment(constant, 8);
+        builder.build_const_inbounds_gep(constant, &[0, 0])
+    };
 
-    // Generate constants array
-    let entries_const_init = builder.build_constant_array(entry_type, entries.as_slice());
-    let entries_const_ty = unsafe { llvm_sys::core::LLVMTypeOf(entries_const_init) };
-    let entries_const = builder.add_constant(
-        entries_const_ty,
-        "__LUMEN_ATOM_TABLE_ENTRIES",
-        Some(entries_const_init),
+    // Generate string data
+    let strings_init = builder.build_constant_bytes(strings.as_slice());
+    let strings_ptr = add_private_constant("__LUMEN_ATOM_TABLE_STRINGS", strings_init);
+
+    // Generate atom data, indexed by id
+    let data_type = builder.get_struct_type(Some("AtomData"), &[i64_type, i32_type, i32_type]);
+    let id_limit = atoms.last().map(|atom| atom.as_usize() + 1).unwrap_or(0);
+    let unused = builder.build_constant_struct(
+        data_type,
+        &[
+            builder.build_constant_uint(i64_type, 0),
+            builder.build_constant_uint(i32_type, 0),
+            builder.build_constant_uint(i32_type, u32::max_value() as usize),
+        ],
     );
-    builder.set_linkage(entries_const, Linkage::Private);
-    builder.set_alignment(entries_const, 8);
+    let mut data = vec![unused; id_limit];
+    for (i, atom) in atoms.iter().enumerate() {
+        let (offset, len) = spans[i];
+        let hash = phf::hash_bytes(state.seed, string_of(i));
+        data[atom.as_usize()] = builder.build_constant_struct(
+            data_type,
+            &[
+                builder.build_constant_uint(i64_type, hash as usize),
+                builder.build_constant_uint(i32_type, offset),
+                builder.build_constant_uint(i32_type, len),
+            ],
+        );
+    }
+    let data_init = builder.build_constant_array(data_type, data.as_slice());
+    let data_ptr = add_private_constant("__LUMEN_ATOM_TABLE_ATOMS", data_init);
+
+    // Generate hash table displacements and slots
+    let disp_type = builder.get_struct_type(Some("Displacement"), &[i32_type, i32_type]);
+    let displacements = state
+        .displacements
+        .iter()
+        .map(|disp| {
+            builder.build_constant_struct(
+                disp_type,
+                &[
+                    builder.build_constant_uint(i32_type, disp.d1 as usize),
+                    builder.build_constant_uint(i32_type, disp.d2 as usize),
+                ],
+            )
+        })
+        .collect::<Vec<_>>();
+    let disp_init = builder.build_constant_array(disp_type, displacements.as_slice());
+    let disp_ptr = add_private_constant("__LUMEN_ATOM_TABLE_DISPLACEMENTS", disp_init);
+
+    let slots = state
+        .map
+        .iter()
+        .map(|i| builder.build_constant_uint(i32_type, atoms[*i].as_usize()))
+        .collect::<Vec<_>>();
+    let slots_init = builder.build_constant_array(i32_type, slots.as_slice());
+    let slots_ptr = add_private_constant("__LUMEN_ATOM_TABLE_SLOTS", slots_init);
 
     // Generate atom table global itself
-    let entry_ptr_type = builder.get_pointer_type(entry_type);
-    let table_global_init = builder.build_const_inbounds_gep(entries_const, &[0, 0]);
-    let table_global = builder.add_global(
-        entry_ptr_type,
-        "__LUMEN_ATOM_TABLE",
-        Some(table_global_init),
+    let table_type = builder.get_struct_type(
+        Some("StaticAtomTable"),
+        &[
+            i64_type,
+            usize_type,
+            usize_type,
+            usize_type,
+            builder.get_pointer_type(disp_type),
+            builder.get_pointer_type(i32_type),
+            builder.get_pointer_type(data_type),
+            builder.get_pointer_type(i8_type),
+        ],
     );
-    builder.set_alignment(table_global, 8);
-
-    // Generate atom table size global
-    let table_size_global_init = builder.build_constant_uint(i64_type, entries.len());
-    let table_size_global = builder.add_global(
-        i64_type,
-        "__LUMEN_ATOM_TABLE_SIZE",
-        Some(table_size_global_init),
+    let table_init = builder.build_constant_struct(
+        table_type,
+        &[
+            builder.build_constant_uint(i64_type, state.seed as usize),
+            builder.build_constant_uint(usize_type, atoms.len()),
+            builder.build_constant_uint(usize_type, id_limit),
+            builder.build_constant_uint(usize_type, displacements.len()),
+            disp_ptr,
+            slots_ptr,
+            data_ptr,
+            strings_ptr,
+        ],
     );
-    builder.set_alignment(table_size_global, 8);
+    let table = builder.add_constant(table_type, "__LUMEN_ATOM_TABLE", Some(table_init));
+    builder.set_alignment(table, 8);
 
     // Finalize module
-    let module = builder.finish();
+    Ok(builder.finish())
+}
+
+/// Generates the atom table module (see `generate_atom_table`), and emits it as an
+/// object file in `output_dir`
+pub fn compile_atom_table(
+    context: &Context,
+    target_machine: &TargetMachine,
+    atoms: HashSet<Symbol>,
+    output_dir: &Path,
+) -> Result<Arc<CompiledModule>> {
+    let module = generate_atom_table(context, target_machine, atoms)?;
     // Open object file for writing
     let path = output_dir.join(&format!("{}.o", NAME));
     let mut file = File::create(path.as_path())?;
@@ -9,14 +9,20 @@ use crate::linker::LinkerInfo;
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub struct CompiledModule {
     name: String,
-    object: Option<PathBuf>,
+    objects: Vec<PathBuf>,
     bytecode: Option<PathBuf>,
 }
 impl CompiledModule {
     pub fn new(name: String, object: Option<PathBuf>, bytecode: Option<PathBuf>) -> Self {
+        Self::with_objects(name, object.into_iter().collect(), bytecode)
+    }
+
+    /// Creates a module which was split into multiple codegen units, each
+    /// with its own object file
+    pub fn with_objects(name: String, objects: Vec<PathBuf>, bytecode: Option<PathBuf>) -> Self {
         Self {
             name,
-            object,
+            objects,
             bytecode,
         }
     }
@@ -25,8 +31,9 @@ impl CompiledModule {
         &self.name
     }
 
-    pub fn object(&self) -> Option<&Path> {
-        self.object.as_deref()
+    /// Returns the object files produced for this module, if any
+    pub fn objects(&self) -> impl Iterator<Item = &Path> {
+        self.objects.iter().map(|p| p.as_path())
     }
 
     pub fn bytecode(&self) -> Option<&Path> {
@@ -1,20 +1,60 @@
-use liblumen_llvm::string::RustString;
+use liblumen_llvm::string::{self, RustString};
 use liblumen_session::DiagnosticsHandler;
 
 use crate::mlir::builder::ffi::foreign_types as mlir;
+use crate::mlir::builder::ffi::ContextRef;
 
-pub type MLIRDiagnosticHandler = extern "C" fn(&mlir::DiagnosticInfo, *mut libc::c_void);
+/// Returns non-zero if the diagnostic should be propagated to the next handler
+pub type MLIRDiagnosticHandler =
+    unsafe extern "C" fn(&mlir::DiagnosticInfo, *mut libc::c_void) -> libc::c_int;
+
+/// mlir::DiagnosticSeverity
+#[derive(Debug, Copy, Clone, PartialEq)]
+#[repr(C)]
+#[allow(dead_code)] // Variants constructed by C++.
+pub enum DiagnosticSeverity {
+    Note,
+    Warning,
+    Error,
+    Remark,
+}
 
 extern "C" {
     #[allow(improper_ctypes)]
     pub fn MLIRGetDiagnosticEngine(context: &mlir::Context) -> &'static mut mlir::DiagnosticEngine;
     #[allow(improper_ctypes)]
     pub fn MLIRRegisterDiagnosticHandler(
-        context: &mlir::Context,
+        context: ContextRef,
         handler: *const DiagnosticsHandler,
-        callback: &MLIRDiagnosticHandler,
+        callback: MLIRDiagnosticHandler,
     );
 
     #[allow(improper_ctypes)]
-    pub fn MLIRWriteDiagnosticToString(d: &mlir::DiagnosticInfo, s: &RustString);
+    pub fn MLIRGetDiagnosticSeverity(d: &mlir::DiagnosticInfo) -> DiagnosticSeverity;
+    #[allow(improper_ctypes)]
+    pub fn MLIRWriteDiagnosticInfoToString(d: &mlir::DiagnosticInfo, s: &RustString);
+}
+
+/// Routes remarks raised in the given MLIR context to `handler`
+///
+/// Errors and warnings are propagated to MLIR's default handling, which prints
+/// them to stderr; only remarks, which MLIR otherwise drops, are handled here.
+///
+/// NOTE: `handler` must outlive the context.
+pub unsafe fn register_remark_handler(context: ContextRef, handler: *const DiagnosticsHandler) {
+    MLIRRegisterDiagnosticHandler(context, handler, handle_remark);
+}
+
+unsafe extern "C" fn handle_remark(
+    d: &mlir::DiagnosticInfo,
+    handler: *mut libc::c_void,
+) -> libc::c_int {
+    if MLIRGetDiagnosticSeverity(d) != DiagnosticSeverity::Remark {
+        return 1;
+    }
+    let handler = &*(handler as *const DiagnosticsHandler);
+    let message = string::build_string(|s| MLIRWriteDiagnosticInfoToString(d, s))
+        .expect("got a non-UTF8 diagnostic from MLIR");
+    handler.info(format!("remark: {}\n", message));
+    0
 }
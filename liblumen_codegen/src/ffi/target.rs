@@ -13,6 +13,8 @@ use liblumen_util::error::FatalError;
 use crate::ffi::{self, util};
 use crate::llvm::{ModuleRef, TargetMachine, TargetMachineRef};
 
+pub type TargetMachineFactory = Arc<dyn Fn() -> Result<TargetMachine, String> + Send + Sync>;
+
 extern "C" {
     pub fn PrintTargetCPUs(TM: TargetMachineRef);
 
@@ -55,6 +57,15 @@ extern "C" {
         codegen: LLVMCodeGenFileType,
         error_message: *mut *mut libc::c_char,
     ) -> bool;
+
+    pub fn LLVMTargetMachineEmitCodegenUnits(
+        T: TargetMachineRef,
+        M: ModuleRef,
+        paths: *const *const libc::c_char,
+        num_units: libc::c_uint,
+        codegen: LLVMCodeGenFileType,
+        error_message: *mut *mut libc::c_char,
+    ) -> bool;
 }
 
 pub fn print_target_cpus(options: &Options, diagnostics: &DiagnosticsHandler) {
@@ -88,11 +99,23 @@ pub fn create_target_machine(
         .unwrap_or_else(|err| llvm_err(diagnostics, &err).raise())
 }
 
+/// Returns a factory which constructs target machines configured for codegen
+///
+/// This allows callers which need more than one target machine (e.g. one per
+/// worker context) to pay the cost of option processing only once.
+pub fn create_target_machine_factory(
+    options: &Options,
+    find_features: bool,
+) -> TargetMachineFactory {
+    let opt_level = options.codegen_opts.opt_level.unwrap_or(OptLevel::No);
+    target_machine_factory(options, opt_level, find_features)
+}
+
 fn target_machine_factory(
     options: &Options,
     opt_level: OptLevel,
     find_features: bool,
-) -> Arc<dyn Fn() -> Result<TargetMachine, String> + Send + Sync> {
+) -> TargetMachineFactory {
     let reloc_mode = get_reloc_mode(options);
 
     let (opt_level, _) = util::to_llvm_opt_settings(opt_level);
@@ -184,7 +207,7 @@ pub fn llvm_target_features(options: &Options) -> impl Iterator<Item = &str> {
         .features
         .split(',')
         .chain(cmdline)
-        .filter(|l| l.is_empty())
+        .filter(|l| !l.is_empty())
 }
 
 pub fn target_cpu(options: &Options) -> &str {
@@ -235,3 +258,43 @@ pub fn llvm_err(handler: &DiagnosticsHandler, msg: &str) -> FatalError {
         None => handler.fatal_str(&msg),
     }
 }
+
+/// Creates a target machine for the host, for tests which need one without the
+/// `Options` that the compiler driver constructs
+#[cfg(test)]
+pub(crate) fn host_target_machine() -> Result<TargetMachine, String> {
+    use std::ptr;
+    use std::sync::Once;
+
+    use llvm_sys::core::LLVMDisposeMessage;
+    use llvm_sys::target_machine::*;
+
+    static INIT: Once = Once::new();
+    INIT.call_once(|| unsafe {
+        llvm_sys::target::LLVM_InitializeNativeTarget();
+        llvm_sys::target::LLVM_InitializeNativeAsmPrinter();
+    });
+
+    unsafe {
+        let triple = LLVMGetDefaultTargetTriple();
+        let mut target = ptr::null_mut();
+        let mut error = ptr::null_mut();
+        if LLVMGetTargetFromTriple(triple, &mut target, &mut error) != 0 {
+            let message = CStr::from_ptr(error).to_string_lossy().into_owned();
+            LLVMDisposeMessage(error);
+            LLVMDisposeMessage(triple);
+            return Err(message);
+        }
+        let tm = LLVMCreateTargetMachine(
+            target,
+            triple,
+            b"generic\0".as_ptr() as *const _,
+            b"\0".as_ptr() as *const _,
+            LLVMCodeGenOptLevel::LLVMCodeGenLevelNone,
+            LLVMRelocMode::LLVMRelocDefault,
+            LLVMCodeModel::LLVMCodeModelDefault,
+        );
+        LLVMDisposeMessage(triple);
+        Ok(TargetMachine::new(tm))
+    }
+}
@@ -42,7 +42,7 @@ unsafe fn configure_llvm(options: &Options) {
             llvm_c_strs.push(s);
         };
         add("lumen"); // fake program name
-        if options.debugging_opts.time_llvm_passes {
+        if crate::stats::llvm_timing_enabled(options) {
             add("-time-passes");
         }
         match options
@@ -83,6 +83,9 @@ unsafe fn configure_llvm(options: &Options) {
     llvm_sys::target::LLVM_InitializeAllDisassemblers();
 
     LLVMLumenSetLLVMOptions(llvm_args.len() as libc::c_int, llvm_args.as_ptr());
+
+    // Enable collection of pass timings/statistics, if requested
+    crate::stats::init(options);
 }
 
 pub fn to_llvm_opt_settings(cfg: OptLevel) -> (CodeGenOptLevel, CodeGenOptSize) {
@@ -0,0 +1,321 @@
+///! This module provides in-process execution of compiled modules, used by
+///! `lumen run --jit`.
+///!
+///! Modules are handed to the JIT as LLVM bitcode, and are compiled lazily, one
+///! function at a time, the first time each function is called. The runtime is
+///! loaded as a shared library, and the startup sequence normally performed by
+///! `liblumen_crt` is performed by `Jit::run`, so no object files are written,
+///! and no linker is invoked.
+use std::ffi::CString;
+use std::path::{Path, PathBuf};
+use std::ptr;
+
+use anyhow::anyhow;
+
+use liblumen_core::atoms::StaticAtomTable;
+use liblumen_core::symbols::StaticSymbolTable;
+use liblumen_llvm::string::{self, RustString};
+use liblumen_session::Options;
+
+use crate::ffi::util::to_llvm_opt_settings;
+use crate::ffi::CodeGenOptLevel;
+use crate::linker::link::archive_search_paths;
+use crate::llvm::{TargetMachine, TargetMachineRef};
+use crate::Result;
+
+/// The runtime libraries which must be available to JIT-compiled code, in the
+/// order in which they are loaded
+///
+/// NOTE: These must be built as shared libraries, since the static archives
+/// used when linking executables each bundle their own copy of libstd
+const RUNTIME_LIBRARIES: &[&'static str] = &["lumen_rt_minimal"];
+
+pub enum JitImpl {}
+pub type JitRef = *mut JitImpl;
+
+/// An in-process JIT compiler
+pub struct Jit {
+    jit: JitRef,
+}
+unsafe impl Send for Jit {}
+impl Jit {
+    /// Creates a new JIT targeting the same machine as `target_machine`
+    ///
+    /// If `num_threads` is non-zero, functions are compiled on a pool of that many
+    /// threads, otherwise they are compiled on the thread which first calls them.
+    pub fn new(
+        options: &Options,
+        target_machine: &TargetMachine,
+        num_threads: usize,
+    ) -> Result<Self> {
+        let (opt, _size) = to_llvm_opt_settings(options.opt_level);
+        Self::with_opt_level(target_machine, opt, num_threads)
+    }
+
+    fn with_opt_level(
+        target_machine: &TargetMachine,
+        opt: CodeGenOptLevel,
+        num_threads: usize,
+    ) -> Result<Self> {
+        let num_threads = num_threads as libc::c_uint;
+        let mut jit = ptr::null_mut();
+        let error = string::build_string(|s| {
+            jit = unsafe { LLVMLumenCreateJIT(target_machine.as_ref(), opt, num_threads, s) };
+        })
+        .unwrap_or_default();
+        if jit.is_null() {
+            return Err(anyhow!("unable to create jit: {}", error));
+        }
+        Ok(Self { jit })
+    }
+
+    /// Makes the runtime, and the C library of the current process, available
+    /// to JIT-compiled code
+    pub fn load_runtime(&mut self, options: &Options) -> Result<()> {
+        self.load_library(None)?;
+        if options.codegen_opts.no_std.unwrap_or(false) {
+            return Ok(());
+        }
+        let search_paths = archive_search_paths(options);
+        for name in RUNTIME_LIBRARIES {
+            let path = find_shared_library(name, &search_paths, options)?;
+            self.load_library(Some(&path))?;
+        }
+        Ok(())
+    }
+
+    /// Makes the exported symbols of the shared library at `path` available to
+    /// JIT-compiled code, or those of the current process if `None`
+    pub fn load_library(&mut self, path: Option<&Path>) -> Result<()> {
+        let path = path
+            .map(|p| CString::new(p.to_string_lossy().into_owned()))
+            .transpose()?;
+        let path_ptr = path.as_ref().map(|p| p.as_ptr()).unwrap_or(ptr::null());
+        let mut loaded = false;
+        let error = string::build_string(|s| {
+            loaded = unsafe { LLVMLumenJITAddDynamicLibrary(self.jit, path_ptr, s) };
+        })
+        .unwrap_or_default();
+        if !loaded {
+            return Err(anyhow!("unable to load library: {}", error));
+        }
+        Ok(())
+    }
+
+    /// Adds the module contained in `bitcode` to the JIT
+    ///
+    /// If `lazy` is true, each function in the module is compiled on first call,
+    /// otherwise the whole module is compiled when it is first referenced.
+    pub fn add_module(&mut self, name: &str, bitcode: &[u8], lazy: bool) -> Result<()> {
+        let cname = CString::new(name)?;
+        let mut added = false;
+        let error = string::build_string(|s| {
+            added = unsafe {
+                LLVMLumenJITAddBitcode(
+                    self.jit,
+                    cname.as_ptr(),
+                    bitcode.as_ptr() as *const libc::c_char,
+                    bitcode.len(),
+                    lazy,
+                    s,
+                )
+            };
+        })
+        .unwrap_or_default();
+        if !added {
+            return Err(anyhow!("unable to add module '{}' to jit: {}", name, error));
+        }
+        Ok(())
+    }
+
+    /// Returns the address of `symbol`, compiling it first if necessary
+    pub fn lookup(&self, symbol: &str) -> Result<*const ()> {
+        let csymbol = CString::new(symbol)?;
+        let mut address = ptr::null();
+        let error = string::build_string(|s| {
+            address = unsafe { LLVMLumenJITLookup(self.jit, csymbol.as_ptr(), s) };
+        })
+        .unwrap_or_default();
+        if address.is_null() {
+            return Err(anyhow!("unable to resolve '{}': {}", symbol, error));
+        }
+        Ok(address)
+    }
+
+    /// Starts the runtime, returning the exit status of the program
+    ///
+    /// This performs the same initialization as `main_internal` in `liblumen_crt`,
+    /// against the atom and symbol tables added to the JIT. The standard library's
+    /// runtime is already running in this process, so there is no `lang_start`.
+    pub fn run(&self) -> Result<i32> {
+        type InitAtomTable = unsafe extern "C" fn(*const StaticAtomTable) -> bool;
+        type InitDispatchTable = unsafe extern "C" fn(*const StaticSymbolTable) -> bool;
+        type Entry = unsafe extern "C" fn() -> i32;
+
+        let atom_table = self.lookup("__LUMEN_ATOM_TABLE")? as *const StaticAtomTable;
+        let symbol_table = self.lookup("__LUMEN_SYMBOL_TABLE")? as *const StaticSymbolTable;
+        unsafe {
+            let init_atoms: InitAtomTable = self.lookup_fn("InitializeLumenAtomTable")?;
+            if !init_atoms(atom_table) {
+                return Ok(102);
+            }
+            let init_dispatch: InitDispatchTable =
+                self.lookup_fn("InitializeLumenDispatchTable")?;
+            if !init_dispatch(symbol_table) {
+                return Ok(103);
+            }
+            let entry: Entry = self.lookup_fn("lumen_entry")?;
+            Ok(entry())
+        }
+    }
+
+    unsafe fn lookup_fn<F: Copy>(&self, symbol: &str) -> Result<F> {
+        let address = self.lookup(symbol)?;
+        Ok(std::mem::transmute_copy::<*const (), F>(&address))
+    }
+}
+impl Drop for Jit {
+    fn drop(&mut self) {
+        unsafe { LLVMLumenDisposeJIT(self.jit) }
+    }
+}
+
+fn find_shared_library(name: &str, search_paths: &[PathBuf], options: &Options) -> Result<PathBuf> {
+    let filename = format!(
+        "{}{}{}",
+        options.target.options.dll_prefix, name, options.target.options.dll_suffix
+    );
+    for path in search_paths {
+        let test = path.join(&filename);
+        if test.exists() {
+            return Ok(test);
+        }
+    }
+    Err(anyhow!(
+        "could not find shared library {} in search paths {:?}, \
+         the runtime must be built as a shared library to use the jit",
+        filename,
+        search_paths
+    ))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use crate::ffi::target::host_target_machine;
+    use crate::llvm::Context;
+
+    // `labs` is resolved against the current process, as libc is for Erlang code
+    const ABS_TWICE: &str = r#"
+declare i64 @labs(i64)
+
+define i64 @twice(i64 %x) {
+  %r = add i64 %x, %x
+  ret i64 %r
+}
+
+define i64 @abs_twice(i64 %x) {
+  %t = call i64 @twice(i64 %x)
+  %r = call i64 @labs(i64 %t)
+  ret i64 %r
+}
+"#;
+
+    fn jit(num_threads: usize) -> Jit {
+        let target_machine = host_target_machine().unwrap();
+        let mut jit =
+            Jit::with_opt_level(&target_machine, CodeGenOptLevel::None, num_threads).unwrap();
+        jit.load_library(None).unwrap();
+        jit
+    }
+
+    fn add_abs_twice(jit: &mut Jit, lazy: bool) {
+        let target_machine = host_target_machine().unwrap();
+        let module = Context::new()
+            .parse_string(ABS_TWICE, "abs_twice", target_machine.as_ref())
+            .unwrap();
+        jit.add_module("abs_twice", &module.to_bitcode(), lazy)
+            .unwrap();
+    }
+
+    fn call_abs_twice(jit: &Jit, x: i64) -> i64 {
+        type AbsTwice = unsafe extern "C" fn(i64) -> i64;
+
+        unsafe {
+            let abs_twice: AbsTwice = jit.lookup_fn("abs_twice").unwrap();
+            abs_twice(x)
+        }
+    }
+
+    #[test]
+    fn lazily_added_functions_are_compiled_when_called() {
+        let mut jit = jit(0);
+        add_abs_twice(&mut jit, true);
+
+        assert_eq!(call_abs_twice(&jit, -21), 42);
+        assert_eq!(call_abs_twice(&jit, 4), 8);
+    }
+
+    #[test]
+    fn modules_can_be_compiled_eagerly_on_compile_threads() {
+        let mut jit = jit(2);
+        add_abs_twice(&mut jit, false);
+
+        assert_eq!(call_abs_twice(&jit, -21), 42);
+    }
+
+    #[test]
+    fn undefined_symbols_cannot_be_looked_up() {
+        let jit = jit(0);
+
+        let err = jit.lookup("undefined").unwrap_err();
+        assert!(err.to_string().starts_with("unable to resolve 'undefined'"));
+    }
+
+    #[test]
+    fn invalid_bitcode_is_rejected() {
+        let mut jit = jit(0);
+
+        let err = jit.add_module("invalid", b"not bitcode", true).unwrap_err();
+        assert!(err
+            .to_string()
+            .starts_with("unable to add module 'invalid' to jit"));
+    }
+}
+
+extern "C" {
+    #[allow(improper_ctypes)]
+    pub fn LLVMLumenCreateJIT(
+        tm: TargetMachineRef,
+        opt: CodeGenOptLevel,
+        num_compile_threads: libc::c_uint,
+        error: &RustString,
+    ) -> JitRef;
+
+    pub fn LLVMLumenDisposeJIT(jit: JitRef);
+
+    #[allow(improper_ctypes)]
+    pub fn LLVMLumenJITAddDynamicLibrary(
+        jit: JitRef,
+        path: *const libc::c_char,
+        error: &RustString,
+    ) -> bool;
+
+    #[allow(improper_ctypes)]
+    pub fn LLVMLumenJITAddBitcode(
+        jit: JitRef,
+        name: *const libc::c_char,
+        data: *const libc::c_char,
+        len: libc::size_t,
+        lazy: bool,
+        error: &RustString,
+    ) -> bool;
+
+    #[allow(improper_ctypes)]
+    pub fn LLVMLumenJITLookup(
+        jit: JitRef,
+        symbol: *const libc::c_char,
+        error: &RustString,
+    ) -> *const ();
+}
@@ -6,9 +6,12 @@
 pub mod atoms;
 pub mod codegen;
 pub mod ffi;
+pub mod jit;
 pub mod linker;
 pub mod llvm;
 pub mod mlir;
+pub mod pool;
+pub mod stats;
 pub mod symbol_table;
 
 pub use self::ffi::target::{self, print_target_cpus, print_target_features};
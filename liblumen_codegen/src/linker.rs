@@ -15,7 +15,7 @@ use liblumen_target::{LinkerFlavor, LldFlavor};
 
 use self::command::Command;
 
-pub use self::link::link_binary;
+pub use self::link::{link_binary, output_file};
 
 #[derive(PartialEq, Clone, Debug)]
 pub enum LibSource {
@@ -42,7 +42,7 @@ pub fn link_binary(
         );
     }
 
-    for obj in codegen_results.modules.iter().filter_map(|m| m.object()) {
+    for obj in codegen_results.modules.iter().flat_map(|m| m.objects()) {
         check_file_is_writeable(obj)?;
     }
 
@@ -52,21 +52,7 @@ pub fn link_binary(
         .map_err(|err| anyhow!("couldn't create a temp dir: {}", err))?;
 
     let output_dir = options.output_dir();
-    let output_file = options
-        .output_file
-        .as_ref()
-        .map(|of| of.clone())
-        .unwrap_or_else(|| {
-            let name = PathBuf::from(options.project_name.as_str());
-            let ext = match project_type {
-                ProjectType::Executable => "exe",
-                ProjectType::Staticlib => "a",
-                _ => "o",
-            };
-            let mut p = output_dir.as_path().join(name);
-            p.set_extension(ext);
-            p
-        });
+    let output_file = output_file(options);
 
     match project_type {
         ProjectType::Staticlib => {
@@ -86,7 +72,7 @@ pub fn link_binary(
     }
 
     // Remove the temporary object file and metadata if we aren't saving temps
-    for obj in codegen_results.modules.iter().filter_map(|m| m.object()) {
+    for obj in codegen_results.modules.iter().flat_map(|m| m.objects()) {
         if let Err(e) = remove(obj) {
             diagnostics.error(e);
         }
@@ -623,6 +609,25 @@ pub fn preserve_objects_for_their_debuginfo(options: &Options) -> bool {
     false
 }
 
+/// Returns the path of the binary produced by `link_binary`
+pub fn output_file(options: &Options) -> PathBuf {
+    options
+        .output_file
+        .as_ref()
+        .map(|of| of.clone())
+        .unwrap_or_else(|| {
+            let name = PathBuf::from(options.project_name.as_str());
+            let ext = match options.project_type {
+                ProjectType::Executable => "exe",
+                ProjectType::Staticlib => "a",
+                _ => "o",
+            };
+            let mut p = options.output_dir().join(name);
+            p.set_extension(ext);
+            p
+        })
+}
+
 pub fn archive_search_paths(options: &Options) -> Vec<PathBuf> {
     options
         .target_filesearch(PathKind::Native)
@@ -818,7 +823,7 @@ fn link_args(
 
     cmd.include_path(&fix_windows_verbatim_for_gcc(&lib_path));
 
-    for obj in codegen_results.modules.iter().filter_map(|m| m.object()) {
+    for obj in codegen_results.modules.iter().flat_map(|m| m.objects()) {
         cmd.add_object(obj);
     }
     cmd.output_filename(output_file);
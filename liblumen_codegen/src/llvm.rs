@@ -13,7 +13,7 @@ use std::ffi::CString;
 use std::fmt;
 use std::mem::MaybeUninit;
 use std::os;
-use std::path::Path;
+use std::path::{Path, PathBuf};
 use std::ptr;
 
 use anyhow::anyhow;
@@ -248,6 +248,17 @@ impl Module {
         Ok(())
     }
 
+    /// Serializes this module as LLVM bitcode in memory
+    ///
+    /// This is used to move a module out of the context it was generated in,
+    /// e.g. into a context owned by the JIT.
+    pub fn to_bitcode(&self) -> Vec<u8> {
+        use llvm_sys::bit_writer::LLVMWriteBitcodeToMemoryBuffer;
+
+        let buffer = MemoryBuffer::new(unsafe { LLVMWriteBitcodeToMemoryBuffer(self.module) });
+        buffer.as_slice().to_vec()
+    }
+
     /// Emit this module as (textual) assembly
     pub fn emit_asm(&self, f: &mut std::fs::File) -> anyhow::Result<()> {
         self.emit_file(f, LLVMCodeGenFileType::LLVMAssemblyFile)
@@ -285,6 +296,53 @@ impl Module {
         Ok(())
     }
 
+    /// Emit this module as N binary object files, one per path in `paths`
+    ///
+    /// The module is partitioned into `paths.len()` codegen units, which are
+    /// compiled in parallel; the resulting objects must all be linked together.
+    pub fn emit_obj_units(&self, paths: &[PathBuf]) -> anyhow::Result<()> {
+        use crate::ffi::target::LLVMTargetMachineEmitCodegenUnits;
+
+        let paths = paths
+            .iter()
+            .map(|p| CString::new(p.to_string_lossy().into_owned()))
+            .collect::<std::result::Result<Vec<_>, _>>()?;
+        let path_ptrs = paths.iter().map(|p| p.as_ptr()).collect::<Vec<_>>();
+        let mut err_string = MaybeUninit::uninit();
+        let failed = unsafe {
+            LLVMTargetMachineEmitCodegenUnits(
+                self.target_machine,
+                self.module,
+                path_ptrs.as_ptr(),
+                path_ptrs.len() as libc::c_uint,
+                LLVMCodeGenFileType::LLVMObjectFile,
+                err_string.as_mut_ptr(),
+            )
+        };
+
+        if failed {
+            let err_string = LLVMString::new(unsafe { err_string.assume_init() });
+            return Err(anyhow!("{}", err_string));
+        }
+
+        Ok(())
+    }
+
+    /// Returns the number of functions defined (not just declared) in this module
+    pub fn num_defined_functions(&self) -> usize {
+        use llvm_sys::core::{LLVMGetFirstFunction, LLVMGetNextFunction, LLVMIsDeclaration};
+
+        let mut count = 0;
+        let mut fun = unsafe { LLVMGetFirstFunction(self.module) };
+        while !fun.is_null() {
+            if unsafe { LLVMIsDeclaration(fun) } == 0 {
+                count += 1;
+            }
+            fun = unsafe { LLVMGetNextFunction(fun) };
+        }
+        count
+    }
+
     pub fn as_ref(&self) -> ModuleRef {
         self.module
     }
@@ -344,3 +402,85 @@ extern "C" {
         error_message: *mut *mut libc::c_char,
     ) -> bool;
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::env;
+    use std::fs;
+    use std::process;
+
+    use crate::ffi::target::host_target_machine;
+
+    const FUNCTIONS: &str = r#"
+declare i64 @external(i64)
+
+define i64 @a(i64 %x) {
+  %r = call i64 @external(i64 %x)
+  ret i64 %r
+}
+
+define i64 @b(i64 %x) {
+  %r = call i64 @a(i64 %x)
+  ret i64 %r
+}
+
+define i64 @c(i64 %x) {
+  ret i64 %x
+}
+"#;
+
+    fn parse(target_machine: &TargetMachine) -> Module {
+        let mut context = Context::new();
+        context
+            .parse_string(FUNCTIONS, "units", target_machine.as_ref())
+            .unwrap()
+    }
+
+    #[test]
+    fn declarations_are_not_defined_functions() {
+        let target_machine = host_target_machine().unwrap();
+        let module = parse(&target_machine);
+
+        assert_eq!(module.num_defined_functions(), 3);
+    }
+
+    #[test]
+    fn codegen_units_are_emitted_to_each_path() {
+        let target_machine = host_target_machine().unwrap();
+        let module = parse(&target_machine);
+
+        let dir = env::temp_dir().join(format!("lumen-codegen-units-{}", process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let paths = vec![dir.join("units.cgu0.o"), dir.join("units.cgu1.o")];
+        let result = module.emit_obj_units(&paths);
+        let sizes = paths
+            .iter()
+            .map(|path| fs::metadata(path).map(|m| m.len()).unwrap_or(0))
+            .collect::<Vec<_>>();
+        fs::remove_dir_all(&dir).unwrap();
+
+        result.unwrap();
+        assert!(sizes.iter().all(|&size| size > 0), "{:?}", sizes);
+        // The module is cloned before it is partitioned
+        assert_eq!(module.num_defined_functions(), 3);
+    }
+
+    #[test]
+    fn codegen_units_which_cannot_be_opened_are_errors() {
+        let target_machine = host_target_machine().unwrap();
+        let module = parse(&target_machine);
+
+        let dir = env::temp_dir()
+            .join(format!("lumen-codegen-units-{}", process::id()))
+            .join("missing");
+        let err = module
+            .emit_obj_units(&[dir.join("units.cgu0.o")])
+            .unwrap_err();
+
+        assert!(err
+            .to_string()
+            .starts_with("unable to open codegen unit output"));
+    }
+}
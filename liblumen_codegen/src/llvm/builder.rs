@@ -129,9 +129,12 @@ impl<'ctx> ModuleBuilder<'ctx> {
         }
     }
 
+    /// Erlang functions take the process they run in as an implicit first argument,
+    /// followed by `arity` terms
     pub fn get_erlang_function_type(&self, arity: usize) -> LLVMTypeRef {
         let term_type = self.get_term_type();
-        let mut params = Vec::with_capacity(arity);
+        let mut params = Vec::with_capacity(arity + 1);
+        params.push(self.get_pointer_type(self.get_i8_type()));
         for _ in 0..arity {
             params.push(term_type);
         }
@@ -194,6 +197,19 @@ impl<'ctx> ModuleBuilder<'ctx> {
         }
     }
 
+    pub fn build_constant_bytes(&self, bytes: &[u8]) -> LLVMValueRef {
+        use llvm_sys::core::LLVMConstStringInContext;
+
+        unsafe {
+            LLVMConstStringInContext(
+                self.context.as_ref(),
+                bytes.as_ptr() as *const libc::c_char,
+                bytes.len() as libc::c_uint,
+                /* dont_null_terminate= */ true as libc::c_int,
+            )
+        }
+    }
+
     pub fn build_constant_array(&self, ty: LLVMTypeRef, values: &[LLVMValueRef]) -> LLVMValueRef {
         use llvm_sys::core::LLVMConstArray;
 
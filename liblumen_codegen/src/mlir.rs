@@ -9,11 +9,11 @@ use std::mem::MaybeUninit;
 use std::os;
 use std::path::Path;
 use std::ptr;
-use std::thread::{self, ThreadId};
 
 use anyhow::anyhow;
 
-use liblumen_session::{Emit, OutputType};
+use liblumen_llvm::string::{build_string, RustString};
+use liblumen_session::{DiagnosticsHandler, Emit, OutputType};
 use liblumen_util as util;
 
 use super::Result;
@@ -42,24 +42,32 @@ impl fmt::Display for Dialect {
     }
 }
 
+/// An MLIR context
+///
+/// Contexts are not thread-safe, but may be moved between threads; access is
+/// serialized by checking contexts out of a `ContextPool` (see `crate::pool`).
 pub struct Context {
     context: ContextRef,
-    thread_id: ThreadId,
+    // Referenced by the diagnostic handler registered with the context
+    #[allow(dead_code)]
+    diagnostics: Box<DiagnosticsHandler>,
 }
 unsafe impl Send for Context {}
 unsafe impl Sync for Context {}
 impl Context {
-    pub fn new(thread_id: ThreadId) -> Self {
+    pub fn new(diagnostics: &DiagnosticsHandler) -> Self {
         let context = unsafe { MLIRCreateContext() };
-        Self { context, thread_id }
+        let diagnostics = Box::new(diagnostics.clone());
+        unsafe {
+            crate::ffi::diagnostics::register_remark_handler(context, diagnostics.as_ref());
+        }
+        Self {
+            context,
+            diagnostics,
+        }
     }
 
     pub fn parse_file<P: AsRef<Path>>(&self, filename: P) -> Result<Module> {
-        debug_assert_eq!(
-            self.thread_id,
-            thread::current().id(),
-            "contexts cannot be shared across threads"
-        );
         let s = filename.as_ref().to_string_lossy().into_owned();
         let f = CString::new(s)?;
         let result = unsafe { MLIRParseFile(self.as_ref(), f.as_ptr()) };
@@ -71,11 +79,6 @@ impl Context {
     }
 
     pub fn parse_string<I: AsRef<[u8]>>(&self, name: &str, input: I) -> Result<Module> {
-        debug_assert_eq!(
-            self.thread_id,
-            thread::current().id(),
-            "contexts cannot be shared across threads"
-        );
         let buffer = MemoryBuffer::create_from_slice(input.as_ref(), name);
         let result = unsafe { MLIRParseBuffer(self.as_ref(), buffer.into_mut()) };
         if result.is_null() {
@@ -86,11 +89,6 @@ impl Context {
     }
 
     pub fn as_ref(&self) -> ContextRef {
-        debug_assert_eq!(
-            self.thread_id,
-            thread::current().id(),
-            "contexts cannot be shared across threads"
-        );
         self.context
     }
 }
@@ -116,25 +114,40 @@ impl Module {
         Self(RefCell::new(ptr))
     }
 
+    /// Lowers this module to the given dialect
+    ///
+    /// If `codegen_report` is set, the codegen report for the lowered module is
+    /// returned as JSON; if `codegen_remarks` is set, the same information is
+    /// emitted as remarks on each function. Both require lowering to LLVM.
     pub fn lower(
         &self,
         context: &Context,
         dialect: Dialect,
         opt: CodeGenOptLevel,
         target_machine: &llvm::TargetMachine,
-    ) -> Result<()> {
-        let result = unsafe {
-            MLIRLowerModule(
-                context.as_ref(),
-                self.as_ref(),
-                dialect,
-                opt,
-                target_machine.as_ref(),
-            )
-        };
+        enable_multithreading: bool,
+        codegen_report: bool,
+        codegen_remarks: bool,
+    ) -> Result<Option<String>> {
+        let mut result = ptr::null_mut();
+        let report = build_string(|report| {
+            let report = if codegen_report { Some(report) } else { None };
+            result = unsafe {
+                MLIRLowerModule(
+                    context.as_ref(),
+                    self.as_ref(),
+                    dialect,
+                    opt,
+                    target_machine.as_ref(),
+                    enable_multithreading,
+                    report,
+                    codegen_remarks,
+                )
+            };
+        })?;
         if !result.is_null() {
             self.0.replace(result);
-            return Ok(());
+            return Ok(if codegen_report { Some(report) } else { None });
         }
         Err(anyhow!("lowering to {} failed", dialect))
     }
@@ -175,6 +188,14 @@ impl Module {
         }
     }
 
+    /// Prints this module to an in-memory buffer, in textual form
+    ///
+    /// Locations are only printed if `with_locations` is set.
+    pub fn to_memory_buffer(&self, with_locations: bool) -> MemoryBuffer<'static> {
+        let buffer = unsafe { MLIREmitToMemoryBuffer(self.as_ref(), with_locations) };
+        MemoryBuffer::new(buffer)
+    }
+
     pub fn as_ref(&self) -> ModuleRef {
         unsafe { *self.0.as_ptr() }
     }
@@ -227,6 +248,9 @@ extern "C" {
         dialect: Dialect,
         opt: CodeGenOptLevel,
         target_machine: TargetMachineRef,
+        enable_multithreading: bool,
+        report: Option<&RustString>,
+        emit_remarks: bool,
     ) -> ModuleRef;
 
     pub fn MLIRLowerToLLVMIR(
@@ -251,5 +275,116 @@ extern "C" {
         error_message: *mut *mut libc::c_char,
     ) -> bool;
 
-    pub fn MLIREmitToMemoryBuffer(M: ModuleRef) -> llvm::memory_buffer::MemoryBufferRef;
+    pub fn MLIREmitToMemoryBuffer(
+        M: ModuleRef,
+        print_locations: bool,
+    ) -> llvm::memory_buffer::MemoryBufferRef;
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::collections::HashSet;
+    use std::ffi::CStr;
+    use std::sync::{Arc, Once, RwLock};
+
+    use libeir_diagnostics::{CodeMap, NullEmitter};
+
+    use liblumen_session::DiagnosticsConfig;
+
+    use crate::ffi::target::host_target_machine;
+    use crate::ffi::util::LLVMLumenSetLLVMOptions;
+
+    // The header of a tuple, and the head of a cons cell, are loaded inline
+    const LOADS: &str = r#"
+module @loads {
+  eir.func @size(%t: !eir.term) -> !eir.term {
+    %size = eir.tuple.size %t : (!eir.term) -> !eir.term
+    eir.return %size : !eir.term
+  }
+
+  eir.func @head(%l: !eir.term) -> !eir.term {
+    %hd = eir.list.hd %l : (!eir.term) -> !eir.term
+    eir.return %hd : !eir.term
+  }
+}
+"#;
+
+    // Lowers the given EIR to LLVM IR for the host, in textual form
+    fn lower_to_llvm_ir(input: &str) -> String {
+        // Registers the dialects, as `crate::init` does for the compiler
+        static INIT: Once = Once::new();
+        INIT.call_once(|| unsafe {
+            let argv = [b"lumen\0".as_ptr() as *const libc::c_char];
+            LLVMLumenSetLLVMOptions(1, argv.as_ptr());
+        });
+
+        let diagnostics = DiagnosticsHandler::new(
+            DiagnosticsConfig {
+                warnings_as_errors: false,
+                no_warn: false,
+            },
+            Arc::new(RwLock::new(CodeMap::new())),
+            Arc::new(NullEmitter::new()),
+        );
+        let target_machine = host_target_machine().unwrap();
+        let context = Context::new(&diagnostics);
+        let module = context.parse_string("input", input).unwrap();
+        module
+            .lower(
+                &context,
+                Dialect::LLVM,
+                CodeGenOptLevel::None,
+                &target_machine,
+                false,
+                false,
+                false,
+            )
+            .unwrap();
+        let module = module
+            .lower_to_llvm_ir(
+                None,
+                CodeGenOptLevel::None,
+                CodeGenOptSize::None,
+                &target_machine,
+            )
+            .unwrap();
+
+        unsafe {
+            use llvm_sys::core::{LLVMDisposeMessage, LLVMPrintModuleToString};
+
+            let ir = LLVMPrintModuleToString(module.as_ref());
+            let text = CStr::from_ptr(ir).to_string_lossy().into_owned();
+            LLVMDisposeMessage(ir);
+            text
+        }
+    }
+
+    #[test]
+    fn loads_from_boxed_terms_are_invariant() {
+        let ir = lower_to_llvm_ir(LOADS);
+        let loads: Vec<&str> = ir.lines().filter(|l| l.contains(" = load ")).collect();
+        assert_eq!(loads.len(), 2, "{}", ir);
+        for load in &loads {
+            assert!(load.contains("!invariant.load"), "{}", load);
+        }
+    }
+
+    #[test]
+    fn headers_and_terms_have_distinct_tbaa_tags() {
+        let ir = lower_to_llvm_ir(LOADS);
+        assert!(ir.contains("!\"header\""), "{}", ir);
+        assert!(ir.contains("!\"term\""), "{}", ir);
+
+        let tags: HashSet<&str> = ir
+            .lines()
+            .filter(|l| l.contains(" = load "))
+            .map(|l| {
+                let start = l.find("!tbaa ").expect(l) + "!tbaa ".len();
+                l[start..].split(',').next().unwrap()
+            })
+            .collect();
+        assert_eq!(tags.len(), 2, "{}", ir);
+    }
 }
@@ -355,6 +355,35 @@ extern "C" {
         err_argc: libc::c_uint,
     );
 
+    pub fn MLIRBuildDynamicCall(
+        builder: ModuleBuilderRef,
+        module: ValueRef,
+        function: ValueRef,
+        argv: *const ValueRef,
+        argc: libc::c_uint,
+        is_tail: bool,
+        ok_block: BlockRef,
+        ok_argv: *const ValueRef,
+        ok_argc: libc::c_uint,
+        err_block: BlockRef,
+        err_argv: *const ValueRef,
+        err_argc: libc::c_uint,
+    );
+
+    pub fn MLIRBuildClosureCall(
+        builder: ModuleBuilderRef,
+        closure: ValueRef,
+        argv: *const ValueRef,
+        argc: libc::c_uint,
+        is_tail: bool,
+        ok_block: BlockRef,
+        ok_argv: *const ValueRef,
+        ok_argc: libc::c_uint,
+        err_block: BlockRef,
+        err_argv: *const ValueRef,
+        err_argc: libc::c_uint,
+    );
+
     //---------------
     // Operations
     //---------------
@@ -369,6 +398,29 @@ extern "C" {
     );
     pub fn MLIRBuildTraceConstructOp(builder: ModuleBuilderRef, trace: ValueRef) -> ValueRef;
 
+    pub fn MLIRBuildReceiveStart(
+        builder: ModuleBuilderRef,
+        cont_block: BlockRef,
+        cont_argv: *const ValueRef,
+        cont_argc: libc::c_uint,
+        timeout: ValueRef,
+    );
+    pub fn MLIRBuildReceiveWait(
+        builder: ModuleBuilderRef,
+        timeout_block: BlockRef,
+        timeout_argv: *const ValueRef,
+        timeout_argc: libc::c_uint,
+        message_block: BlockRef,
+        message_argv: *const ValueRef,
+        message_argc: libc::c_uint,
+    );
+    pub fn MLIRBuildReceiveDone(
+        builder: ModuleBuilderRef,
+        cont_block: BlockRef,
+        cont_argv: *const ValueRef,
+        cont_argc: libc::c_uint,
+    );
+
     pub fn MLIRBuildMapOp(builder: ModuleBuilderRef, op: MapUpdate);
     pub fn MLIRBuildIsEqualOp(
         builder: ModuleBuilderRef,
@@ -416,6 +468,15 @@ extern "C" {
         elements: *const ValueRef,
         num_elements: libc::c_uint,
     ) -> ValueRef;
+    pub fn MLIRConstructClosure(
+        builder: ModuleBuilderRef,
+        name: *const libc::c_char,
+        arity: libc::c_uint,
+        module: u64,
+        function: u64,
+        env: *const ValueRef,
+        env_size: libc::c_uint,
+    ) -> ValueRef;
     pub fn MLIRConstructMap(
         builder: ModuleBuilderRef,
         pairs: *const MapEntry,
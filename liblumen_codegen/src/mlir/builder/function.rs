@@ -71,13 +71,7 @@ impl<'a, 'm, 'f> FunctionBuilder<'a, 'm, 'f> {
                 self.with_scope(ident.clone(), loc, f, &analysis, data, options)
                     .and_then(|scope| scope.build())?
             } else {
-                let arity = f.block_args(entry_block).len() - 2;
-                let fun = Ident::from_str(&format!("{}-fun-{}", ident.name, arity));
-                let fi = FunctionIdent {
-                    module: ident.module.clone(),
-                    name: fun,
-                    arity,
-                };
+                let fi = closure_ident(f, entry_block);
                 {
                     self.builder.atoms_mut().insert(fi.name.name);
                 }
@@ -109,10 +103,19 @@ impl<'a, 'm, 'f> FunctionBuilder<'a, 'm, 'f> {
             .expect("expected function to have escape continuation");
 
         // Construct signature
+        //
+        // Funs take the values they capture as implicit arguments, ahead of the explicit ones,
+        // so that calls to known funs can pass their environment directly
         let mut signature = Signature::new(CallConv::Fast);
         let entry_args = eir.block_args(data.entry);
+        let env = closure_env(eir, analysis, data.entry);
         {
-            signature.params.reserve(entry_args.len() - 2);
+            signature.params.reserve(env.len() + entry_args.len() - 2);
+            for captured in env.iter().copied() {
+                signature.params.push(block_arg_to_param(
+                    eir, captured, /* is_implicit */ true,
+                ));
+            }
             for arg in entry_args.iter().skip(2).copied() {
                 signature
                     .params
@@ -122,10 +125,10 @@ impl<'a, 'm, 'f> FunctionBuilder<'a, 'm, 'f> {
         }
 
         // Construct the parameter value metadata
-        let entry_params = entry_args
+        let entry_params = env
             .iter()
-            .skip(2)
             .copied()
+            .chain(entry_args.iter().skip(2).copied())
             .enumerate()
             .map(|(i, v)| (signature.params[i].clone(), Some(v)))
             .collect::<Vec<_>>();
@@ -271,6 +274,12 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
         false
     }
 
+    /// Returns the identifier of the function lifted from the fun whose entry is the given block
+    #[inline]
+    pub fn closure_ident(&self, entry: ir::Block) -> FunctionIdent {
+        closure_ident(self.eir, entry)
+    }
+
     /// Gets the constant reference represented by the given value
     ///
     /// Panics if the value is not a constant
@@ -449,13 +458,10 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
         // in that case the runtime stack stuff that exists will mostly go away.
         debug_in!(self, "building stack frame for function in init block");
 
-        // If this is a closure, extract the environment
-        // A closure will have more than 1 live value, otherwise it is a regular function
+        // If this is a closure, the environment was passed as implicit arguments,
+        // which the init block maps to the captured values, see `with_scope`
         let live = self.live_at(init_block);
         debug_in!(self, "found {} live values in the entry block", live.size());
-        if live.size() > 0 {
-            todo!("closure env unpacking");
-        }
 
         // Clone the init block, the clone will be used like the EIR entry block
         // The init block, meanwhile, is used to set up any frame layout/init required
@@ -470,7 +476,7 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
         debug_in!(self, "switching to entry block");
         self.position_at_end(entry_block);
 
-        let root_block = self.eir.block_entry();
+        let root_block = self.data.entry;
 
         // Make sure all blocks are created first
         let mut blocks = Vec::with_capacity(self.data.scope.len());
@@ -744,6 +750,12 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
                 }
                 let callee = Callee::new(self, ir_callee)?;
                 debug_in!(self, "callee = {}", &callee);
+                // Funs defined in this function are called directly, with their environment
+                if let ir::ValueKind::Block(entry) = self.value_kind(ir_callee) {
+                    let env = self.build_closure_env(entry)?;
+                    debug_in!(self, "callee env = {:?}", &env);
+                    args.splice(0..0, env);
+                }
                 let ok = if self.func.is_return_ir(ir_ok) {
                     CallSuccess::Return
                 } else {
@@ -956,12 +968,50 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
                 OpKind::TraceConstruct(capture)
             }
             // Symbol + per-intrinsic args
+            //
+            // The receive intrinsics are terminators, which are translated to the
+            // receive operations, the rest produce a value
             ir::OpKind::Intrinsic(name) => {
                 debug_in!(self, "block contains intrinsic {:?}", name);
-                OpKind::Intrinsic(Intrinsic {
-                    name,
-                    args: reads.to_vec(),
-                })
+                match name.as_str().get() {
+                    // (cont: fn(recv_ref), timeout)
+                    "receive_start" => {
+                        let block = self.get_block_by_value(reads[0]);
+                        let args = self.build_target_block_args(block, &[]);
+                        let timeout = self.build_value(reads[1])?;
+                        OpKind::ReceiveStart(ReceiveStart {
+                            cont: Branch { block, args },
+                            timeout,
+                        })
+                    }
+                    // (timeout: fn(), message: fn(msg))
+                    "receive_wait" => {
+                        let timeout = self.get_block_by_value(reads[0]);
+                        let timeout_args = self.build_target_block_args(timeout, &[]);
+                        let message = self.get_block_by_value(reads[1]);
+                        let message_args = self.build_target_block_args(message, &[]);
+                        OpKind::ReceiveWait(ReceiveWait {
+                            timeout: Branch {
+                                block: timeout,
+                                args: timeout_args,
+                            },
+                            message: Branch {
+                                block: message,
+                                args: message_args,
+                            },
+                        })
+                    }
+                    // (cont: fn(values..), values..)
+                    "receive_done" => {
+                        let block = self.get_block_by_value(reads[0]);
+                        let args = self.build_target_block_args(block, &reads[1..]);
+                        OpKind::ReceiveDone(Branch { block, args })
+                    }
+                    _ => OpKind::Intrinsic(Intrinsic {
+                        name,
+                        args: reads.to_vec(),
+                    }),
+                }
             }
             // When encountered, this instruction traps; it also informs the optimizer that we
             // intend to never reach this point during execution
@@ -980,10 +1030,11 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
     /// If the value does not yet have a definition in the current block, then
     /// one is created, by lowering the value via its corresponding primitive operation.
     ///
-    /// Panics if the given value is a block reference, or a block argument.
-    /// The former are always invalid where values are expected, and the latter should
-    /// never happen, as block arguments are defined when the block is created, so
-    /// lookups should never fail. If the lookup fails, then we have a compiler bug.
+    /// Block references used as values are funs, which are lowered to closures.
+    ///
+    /// Panics if the given value is a block argument. This should never happen, as
+    /// block arguments are defined when the block is created, so lookups should
+    /// never fail. If the lookup fails, then we have a compiler bug.
     pub(super) fn build_value(&mut self, ir_value: ir::Value) -> Result<Value> {
         let value = self
             .build_value_opt(ir_value)?
@@ -1000,9 +1051,7 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
         let value_opt = match self.eir.value_kind(ir_value) {
             ir::ValueKind::Const(c) => Some(self.build_constant_value(ir_value, c)?),
             ir::ValueKind::PrimOp(op) => self.build_primop_value(ir_value, op)?,
-            ir::ValueKind::Block(b) => {
-                unreachable!("block {:?} used as a value ({:?})", b, ir_value)
-            }
+            ir::ValueKind::Block(b) => Some(self.build_closure_value(ir_value, b)?),
             ir::ValueKind::Argument(b, i) => {
                 unreachable!("block argument {:?}:{} should already be defined", b, i)
             }
@@ -1018,6 +1067,27 @@ impl<'f, 'o> ScopedFunctionBuilder<'f, 'o> {
             .and_then(|vopt| vopt.ok_or_else(|| anyhow!("expected constant to have result")))
     }
 
+    /// This function returns a Value that represents the fun whose entry is the given block,
+    /// i.e. a closure over the function lifted from it, capturing its environment
+    #[inline]
+    fn build_closure_value(&mut self, ir_value: ir::Value, entry: ir::Block) -> Result<Value> {
+        debug_in!(self, "building closure from block {:?}", entry);
+        let callee = self.closure_ident(entry);
+        let env = self.build_closure_env(entry)?;
+        OpBuilder::build_one_result(self, ir_value, OpKind::Closure(Closure { callee, env }))
+    }
+
+    /// Builds the values captured by the fun whose entry is the given block, in the
+    /// order the lifted function takes them
+    fn build_closure_env(&mut self, entry: ir::Block) -> Result<Vec<Value>> {
+        let captured = closure_env(self.eir, self.analysis, entry);
+        let mut env = Vec::with_capacity(captured.len());
+        for value in captured {
+            env.push(self.build_value(value)?);
+        }
+        Ok(env)
+    }
+
     /// This function returns a Value that represents the result of the given IR value
     /// lowered as a primitive operation.
     ///
@@ -1285,6 +1355,39 @@ pub(super) fn value_to_const_kind<'f>(
     function.const_kind(constant)
 }
 
+/// Shared helper to construct the identifier of the function lifted from the fun whose
+/// entry is the given block
+///
+/// The entry block is part of the name, as a function may define several funs of the same arity
+pub(super) fn closure_ident(f: &ir::Function, entry: ir::Block) -> FunctionIdent {
+    let ident = f.ident();
+    let arity = f.block_args(entry).len() - 2;
+    let name = format!("{}-fun-{}-{}", ident.name, entry.index(), arity);
+    FunctionIdent {
+        module: ident.module.clone(),
+        name: Ident::from_str(&name),
+        arity,
+    }
+}
+
+/// Shared helper to get the values captured by the fun whose entry is the given block
+///
+/// These are the values live at its entry, other than its arguments, in a stable order,
+/// so that the lifted function and the closures over it agree on the layout
+pub(super) fn closure_env(
+    f: &ir::Function,
+    analysis: &LowerData,
+    entry: ir::Block,
+) -> Vec<ir::Value> {
+    let args = f.block_args(entry);
+    analysis
+        .live
+        .live_at(entry)
+        .iter()
+        .filter(|v| !args.contains(v))
+        .collect()
+}
+
 /// Shared helper to construct a Param from an EIR value
 pub(super) fn block_arg_to_param(f: &ir::Function, arg: ir::Value, is_implicit: bool) -> Param {
     let span = value_location(f, arg);
@@ -33,11 +33,15 @@ pub enum OpKind {
     LogicOp(LogicalOperator),
     Constant(ir::Const),
     FunctionRef(Callee),
+    Closure(Closure),
     Tuple(Vec<Value>),
     Cons(Value, Value),
     Map(Vec<(Value, Value)>),
     TraceCapture(Branch),
     TraceConstruct(Value),
+    ReceiveStart(ReceiveStart),
+    ReceiveWait(ReceiveWait),
+    ReceiveDone(Branch),
     Intrinsic(Intrinsic),
 }
 
@@ -68,6 +72,7 @@ pub enum Callee {
         function: Value,
         arity: usize,
     },
+    Closure(Value),
 }
 impl Callee {
     pub fn new<'f, 'o>(
@@ -76,8 +81,18 @@ impl Callee {
     ) -> Result<Self> {
         use libeir_ir::ValueKind;
 
-        let op = builder.get_primop(callee_value);
-        debug_assert_eq!(ir::PrimOpKind::CaptureFunction, *builder.primop_kind(op));
+        let op = match builder.value_kind(callee_value) {
+            // Funs defined in this function are called directly, with their
+            // environment passed ahead of the arguments by the caller
+            ValueKind::Block(entry) => return Ok(Self::Static(builder.closure_ident(entry))),
+            ValueKind::PrimOp(op)
+                if *builder.primop_kind(op) == ir::PrimOpKind::CaptureFunction =>
+            {
+                op
+            }
+            // Anything else is a fun which is only known at runtime
+            _ => return Ok(Self::Closure(builder.build_value(callee_value)?)),
+        };
         let reads = builder.primop_reads(op);
         let num_reads = reads.len();
         // Figure out if this is a statically known function
@@ -135,10 +150,18 @@ impl fmt::Display for Callee {
                 function,
                 arity,
             } => write!(f, "{:?}:{:?}/{}", module, function, arity),
+            Self::Closure(closure) => write!(f, "{:?}", closure),
         }
     }
 }
 
+/// A fun defined in the current function, closing over the values in `env`
+#[derive(Debug, Clone)]
+pub struct Closure {
+    pub callee: FunctionIdent,
+    pub env: Vec<Value>,
+}
+
 #[derive(Debug, Clone)]
 pub struct Call {
     pub callee: Callee,
@@ -188,6 +211,18 @@ pub struct Pattern {
     pub args: Vec<ir::Value>,
 }
 
+#[derive(Debug, Clone)]
+pub struct ReceiveStart {
+    pub cont: Branch,
+    pub timeout: Value,
+}
+
+#[derive(Debug, Clone)]
+pub struct ReceiveWait {
+    pub timeout: Branch,
+    pub message: Branch,
+}
+
 #[derive(Debug, Clone)]
 pub struct Intrinsic {
     pub name: libeir_intern::Symbol,
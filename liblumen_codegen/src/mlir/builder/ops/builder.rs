@@ -65,6 +65,7 @@ impl OpBuilder {
             OpKind::LogicOp(op) => LogicOpBuilder::build(builder, ir_value, op),
             OpKind::Constant(c) => ConstantBuilder::build(builder, ir_value, c),
             OpKind::FunctionRef(callee) => CalleeBuilder::build(builder, ir_value, callee),
+            OpKind::Closure(closure) => ClosureBuilder::build(builder, ir_value, closure),
             OpKind::Tuple(elements) => TupleBuilder::build(builder, ir_value, elements.as_slice()),
             OpKind::Cons(head, tail) => ConsBuilder::build(builder, ir_value, head, tail),
             OpKind::Map(items) => MapBuilder::build(builder, ir_value, items.as_slice()),
@@ -74,6 +75,9 @@ impl OpBuilder {
             OpKind::TraceConstruct(capture) => {
                 TraceConstructBuilder::build(builder, ir_value, capture)
             }
+            OpKind::ReceiveStart(op) => ReceiveStartBuilder::build(builder, op),
+            OpKind::ReceiveWait(op) => ReceiveWaitBuilder::build(builder, op),
+            OpKind::ReceiveDone(cont) => ReceiveDoneBuilder::build(builder, cont),
             OpKind::Intrinsic(op) => IntrinsicBuilder::build(builder, ir_value, op),
         }
     }
@@ -1,5 +1,7 @@
 use std::ffi::CString;
 
+use crate::mlir::builder::traits::*;
+
 use super::*;
 
 pub struct CallBuilder;
@@ -10,41 +12,41 @@ impl CallBuilder {
         ir_value: Option<ir::Value>,
         op: Call,
     ) -> Result<Option<Value>> {
+        let args = op
+            .args
+            .iter()
+            .copied()
+            .map(|v| builder.value_ref(v))
+            .collect::<Vec<_>>();
+        builder.debug(&format!("call args: {:?}", args.as_slice()));
+        let mut ok_args = Vec::new();
+        let ok_block = match op.ok {
+            CallSuccess::Branch(Branch { block, args }) => {
+                for arg in args.iter().copied() {
+                    ok_args.push(builder.value_ref(arg));
+                }
+                builder.block_ref(block)
+            }
+            _ => Default::default(),
+        };
+        builder.debug(&format!("call ok args: {:?}", ok_args.as_slice()));
+        let mut err_args = Vec::new();
+        let err_block = match op.err {
+            CallError::Branch(Branch { block, args }) => {
+                for arg in args.iter().copied() {
+                    err_args.push(builder.value_ref(arg));
+                }
+                builder.block_ref(block)
+            }
+            _ => Default::default(),
+        };
+        builder.debug(&format!("call err args: {:?}", err_args.as_slice()));
+
         match op.callee {
             Callee::Static(ref ident) => {
                 builder.debug(&format!("static call target is {}", ident));
 
-                let is_local = builder.is_current_module(ident.module.name);
                 let name = CString::new(ident.to_string()).unwrap();
-                let args = op
-                    .args
-                    .iter()
-                    .copied()
-                    .map(|v| builder.value_ref(v))
-                    .collect::<Vec<_>>();
-                builder.debug(&format!("static call args: {:?}", args.as_slice()));
-                let mut ok_args = Vec::new();
-                let ok_block = match op.ok {
-                    CallSuccess::Branch(Branch { block, args }) => {
-                        for arg in args.iter().copied() {
-                            ok_args.push(builder.value_ref(arg));
-                        }
-                        builder.block_ref(block)
-                    }
-                    _ => Default::default(),
-                };
-                builder.debug(&format!("static call ok args: {:?}", ok_args.as_slice()));
-                let mut err_args = Vec::new();
-                let err_block = match op.err {
-                    CallError::Branch(Branch { block, args }) => {
-                        for arg in args.iter().copied() {
-                            err_args.push(builder.value_ref(arg));
-                        }
-                        builder.block_ref(block)
-                    }
-                    _ => Default::default(),
-                };
-                builder.debug(&format!("static call err args: {:?}", err_args.as_slice()));
                 unsafe {
                     MLIRBuildStaticCall(
                         builder.as_ref(),
@@ -60,11 +62,63 @@ impl CallBuilder {
                         err_args.len() as libc::c_uint,
                     );
                 }
+            }
+            Callee::Closure(closure) => {
+                builder.debug(&format!("indirect call target is {}", op.callee));
 
-                Ok(None)
+                unsafe {
+                    MLIRBuildClosureCall(
+                        builder.as_ref(),
+                        builder.value_ref(closure),
+                        args.as_ptr(),
+                        args.len() as libc::c_uint,
+                        op.is_tail,
+                        ok_block,
+                        ok_args.as_ptr(),
+                        ok_args.len() as libc::c_uint,
+                        err_block,
+                        err_args.as_ptr(),
+                        err_args.len() as libc::c_uint,
+                    );
+                }
+            }
+            callee => {
+                builder.debug(&format!("dynamic call target is {}", callee));
+
+                let (module, function) = match callee {
+                    Callee::LocalDynamic {
+                        module, function, ..
+                    } => {
+                        let module = module
+                            .name
+                            .as_value_ref(builder.as_ref(), builder.options())?;
+                        (module, builder.value_ref(function))
+                    }
+                    Callee::GlobalDynamic {
+                        module, function, ..
+                    } => (builder.value_ref(module), builder.value_ref(function)),
+                    Callee::Static(_) | Callee::Closure(_) => unreachable!(),
+                };
+                unsafe {
+                    MLIRBuildDynamicCall(
+                        builder.as_ref(),
+                        module,
+                        function,
+                        args.as_ptr(),
+                        args.len() as libc::c_uint,
+                        op.is_tail,
+                        ok_block,
+                        ok_args.as_ptr(),
+                        ok_args.len() as libc::c_uint,
+                        err_block,
+                        err_args.as_ptr(),
+                        err_args.len() as libc::c_uint,
+                    );
+                }
             }
-            callee => todo!("unimplemented call type {:?}", callee),
         }
+
+        Ok(None)
     }
 }
 
@@ -72,14 +126,69 @@ pub struct CalleeBuilder;
 
 impl CalleeBuilder {
     pub fn build<'f, 'o>(
-        _builder: &mut ScopedFunctionBuilder<'f, 'o>,
+        builder: &mut ScopedFunctionBuilder<'f, 'o>,
         ir_value: Option<ir::Value>,
         callee: Callee,
     ) -> Result<Option<Value>> {
-        todo!(
-            "build function reference constant for {:?} = {:?}",
-            ir_value,
-            callee
-        );
+        match callee {
+            // `fun M:F/A` is a closure with an empty environment
+            Callee::Static(ident) => ClosureBuilder::build(
+                builder,
+                ir_value,
+                Closure {
+                    callee: ident,
+                    env: Vec::new(),
+                },
+            ),
+            callee => todo!(
+                "build function reference constant for {:?} = {:?}",
+                ir_value,
+                callee
+            ),
+        }
+    }
+}
+
+pub struct ClosureBuilder;
+
+impl ClosureBuilder {
+    pub fn build<'f, 'o>(
+        builder: &mut ScopedFunctionBuilder<'f, 'o>,
+        ir_value: Option<ir::Value>,
+        closure: Closure,
+    ) -> Result<Option<Value>> {
+        builder.debug(&format!(
+            "closure over {} with env: {:?}",
+            closure.callee,
+            closure.env.as_slice()
+        ));
+
+        let env = closure
+            .env
+            .iter()
+            .copied()
+            .map(|v| builder.value_ref(v))
+            .collect::<Vec<_>>();
+        let name = CString::new(closure.callee.to_string()).unwrap();
+        // The module and function are already in the atom table, as the constants of `fun
+        // M:F/A`, or as the current module and the name of the lifted function
+        let module = closure.callee.module.name.as_usize() as u64;
+        let function = closure.callee.name.name.as_usize() as u64;
+
+        let closure_ref = unsafe {
+            MLIRConstructClosure(
+                builder.as_ref(),
+                name.as_ptr(),
+                closure.callee.arity as libc::c_uint,
+                module,
+                function,
+                env.as_ptr(),
+                env.len() as libc::c_uint,
+            )
+        };
+        assert!(!closure_ref.is_null());
+
+        let closure = builder.new_value(ir_value, closure_ref, ValueDef::Result(0));
+        Ok(Some(closure))
     }
 }
@@ -0,0 +1,101 @@
+use super::*;
+
+/// Handles the receive_start intrinsic
+///
+/// This operation is a terminator, it starts a selective receive with the
+/// given timeout, and branches to the receive loop, passing along a handle
+/// for the receive. An invalid timeout raises.
+pub struct ReceiveStartBuilder;
+impl ReceiveStartBuilder {
+    pub fn build<'f, 'o>(
+        builder: &mut ScopedFunctionBuilder<'f, 'o>,
+        op: ReceiveStart,
+    ) -> Result<Option<Value>> {
+        let ReceiveStart { cont, timeout } = op;
+        let (cont_ref, cont_args) = branch_refs(builder, &cont);
+        let timeout_ref = builder.value_ref(timeout);
+
+        unsafe {
+            MLIRBuildReceiveStart(
+                builder.as_ref(),
+                cont_ref,
+                cont_args.as_ptr(),
+                cont_args.len() as libc::c_uint,
+                timeout_ref,
+            );
+        }
+        Ok(None)
+    }
+}
+
+/// Handles the receive_wait intrinsic
+///
+/// This operation is a terminator, it branches to the message continuation
+/// with the next message in the mailbox, waiting for one if every message has
+/// been seen, or to the timeout continuation if the receive times out.
+///
+/// The message continuation branches back to the block containing this
+/// operation when the message does not match.
+pub struct ReceiveWaitBuilder;
+impl ReceiveWaitBuilder {
+    pub fn build<'f, 'o>(
+        builder: &mut ScopedFunctionBuilder<'f, 'o>,
+        op: ReceiveWait,
+    ) -> Result<Option<Value>> {
+        let ReceiveWait { timeout, message } = op;
+        let (timeout_ref, timeout_args) = branch_refs(builder, &timeout);
+        let (message_ref, message_args) = branch_refs(builder, &message);
+
+        unsafe {
+            MLIRBuildReceiveWait(
+                builder.as_ref(),
+                timeout_ref,
+                timeout_args.as_ptr(),
+                timeout_args.len() as libc::c_uint,
+                message_ref,
+                message_args.as_ptr(),
+                message_args.len() as libc::c_uint,
+            );
+        }
+        Ok(None)
+    }
+}
+
+/// Handles the receive_done intrinsic
+///
+/// This operation is a terminator, it removes the message which matched from
+/// the mailbox, and branches to the continuation with the values bound by
+/// the match.
+pub struct ReceiveDoneBuilder;
+impl ReceiveDoneBuilder {
+    pub fn build<'f, 'o>(
+        builder: &mut ScopedFunctionBuilder<'f, 'o>,
+        cont: Branch,
+    ) -> Result<Option<Value>> {
+        let (cont_ref, cont_args) = branch_refs(builder, &cont);
+
+        unsafe {
+            MLIRBuildReceiveDone(
+                builder.as_ref(),
+                cont_ref,
+                cont_args.as_ptr(),
+                cont_args.len() as libc::c_uint,
+            );
+        }
+        Ok(None)
+    }
+}
+
+fn branch_refs<'f, 'o>(
+    builder: &ScopedFunctionBuilder<'f, 'o>,
+    branch: &Branch,
+) -> (BlockRef, Vec<ValueRef>) {
+    let block_ref = builder.block_ref(branch.block);
+    let args = branch
+        .args
+        .iter()
+        .copied()
+        .map(|a| builder.value_ref(a))
+        .collect::<Vec<_>>();
+    (block_ref, args)
+}
@@ -0,0 +1,225 @@
+use std::fmt;
+use std::ops::Deref;
+use std::sync::{Arc, Mutex, RwLock};
+
+use log::debug;
+
+use liblumen_session::{DiagnosticsHandler, Options};
+
+use crate::ffi::target::{self, TargetMachineFactory};
+use crate::llvm;
+use crate::mlir;
+
+/// Identifies a slot in a `ContextPool`
+///
+/// This is used in place of a thread identifier when keying queries which
+/// produce context-bound values (e.g. MLIR/LLVM modules), since a worker may
+/// be handed any slot, and the same slot is reused by many workers over the
+/// course of a compilation session.
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Hash, PartialOrd, Ord)]
+pub struct ContextId(usize);
+impl ContextId {
+    pub fn index(&self) -> usize {
+        self.0
+    }
+}
+impl fmt::Display for ContextId {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "#{}", self.0)
+    }
+}
+
+/// The set of context objects owned by a single pool slot
+///
+/// None of these objects are safe to use concurrently, but they may be moved
+/// between threads, so long as only the thread which holds the slot uses them.
+pub struct PooledContexts {
+    pub mlir: Arc<mlir::Context>,
+    pub llvm: Arc<llvm::Context>,
+    pub target_machine: Arc<llvm::TargetMachine>,
+}
+
+/// A pool of pre-initialized MLIR/LLVM contexts shared by all compiler workers
+///
+/// Constructing a context is relatively expensive: the registered dialects are
+/// instantiated, and the first lowering against the context builds all of the
+/// target-specific type information (see `TargetInfo` on the C++ side). Rather
+/// than doing that on every worker thread, workers check a slot out of the pool
+/// for the duration of a compilation unit, and check it back in when finished,
+/// so the number of contexts created is bounded by the peak concurrency of the
+/// compiler, not the number of threads or modules.
+///
+/// Slots are created lazily, the first time a checkout finds no idle slot.
+pub struct ContextPool {
+    factory: TargetMachineFactory,
+    diagnostics: DiagnosticsHandler,
+    slots: RwLock<Vec<Arc<PooledContexts>>>,
+    idle: Mutex<Vec<ContextId>>,
+}
+impl ContextPool {
+    pub fn new(options: &Options, diagnostics: DiagnosticsHandler) -> Self {
+        let factory = target::create_target_machine_factory(options, false);
+        Self {
+            factory,
+            diagnostics,
+            slots: RwLock::new(Vec::new()),
+            idle: Mutex::new(Vec::new()),
+        }
+    }
+
+    /// Checks out an idle context slot, creating a new one if none are available
+    ///
+    /// The slot is returned to the pool when the returned guard is dropped.
+    pub fn checkout(&self) -> PooledContext<'_> {
+        let idle = self.idle.lock().unwrap().pop();
+        let id = idle.unwrap_or_else(|| self.create());
+        let contexts = self.get(id);
+        debug!("checked out context {} from pool", id);
+        PooledContext {
+            pool: self,
+            id,
+            contexts,
+        }
+    }
+
+    /// Returns the contexts for the given slot
+    ///
+    /// NOTE: This does not check the slot out, callers must only access slots
+    /// which they have checked out themselves.
+    pub fn get(&self, id: ContextId) -> Arc<PooledContexts> {
+        let slots = self.slots.read().unwrap();
+        slots[id.index()].clone()
+    }
+
+    /// Returns the number of slots created so far
+    pub fn len(&self) -> usize {
+        self.slots.read().unwrap().len()
+    }
+
+    fn create(&self) -> ContextId {
+        let target_machine = (self.factory)()
+            .unwrap_or_else(|err| target::llvm_err(&self.diagnostics, &err).raise());
+        let contexts = Arc::new(PooledContexts {
+            mlir: Arc::new(mlir::Context::new(&self.diagnostics)),
+            llvm: Arc::new(llvm::Context::new()),
+            target_machine: Arc::new(target_machine),
+        });
+        let mut slots = self.slots.write().unwrap();
+        let id = ContextId(slots.len());
+        debug!("constructing new context {} for pool", id);
+        slots.push(contexts);
+        id
+    }
+
+    fn checkin(&self, id: ContextId) {
+        debug!("checked in context {} to pool", id);
+        self.idle.lock().unwrap().push(id);
+    }
+}
+impl fmt::Debug for ContextPool {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "ContextPool(slots = {})", self.len())
+    }
+}
+
+/// A guard representing exclusive ownership of a `ContextPool` slot
+pub struct PooledContext<'p> {
+    pool: &'p ContextPool,
+    id: ContextId,
+    contexts: Arc<PooledContexts>,
+}
+impl<'p> PooledContext<'p> {
+    pub fn id(&self) -> ContextId {
+        self.id
+    }
+}
+impl<'p> Deref for PooledContext<'p> {
+    type Target = PooledContexts;
+
+    fn deref(&self) -> &Self::Target {
+        self.contexts.deref()
+    }
+}
+impl<'p> Drop for PooledContext<'p> {
+    fn drop(&mut self) {
+        self.pool.checkin(self.id);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use libeir_diagnostics::{CodeMap, NullEmitter};
+
+    use liblumen_session::DiagnosticsConfig;
+
+    // Builds a pool whose slots get target machines for the host
+    fn pool() -> ContextPool {
+        let factory: TargetMachineFactory = Arc::new(target::host_target_machine);
+        let diagnostics = DiagnosticsHandler::new(
+            DiagnosticsConfig {
+                warnings_as_errors: false,
+                no_warn: false,
+            },
+            Arc::new(RwLock::new(CodeMap::new())),
+            Arc::new(NullEmitter::new()),
+        );
+
+        ContextPool {
+            factory,
+            diagnostics,
+            slots: RwLock::new(Vec::new()),
+            idle: Mutex::new(Vec::new()),
+        }
+    }
+
+    #[test]
+    fn slots_are_created_lazily() {
+        let pool = pool();
+        assert_eq!(pool.len(), 0);
+
+        let context = pool.checkout();
+        assert_eq!(context.id(), ContextId(0));
+        assert_eq!(pool.len(), 1);
+    }
+
+    #[test]
+    fn checked_in_slots_are_reused() {
+        let pool = pool();
+
+        let (id, mlir, target_machine) = {
+            let context = pool.checkout();
+            (
+                context.id(),
+                context.mlir.clone(),
+                context.target_machine.clone(),
+            )
+        };
+
+        let context = pool.checkout();
+        assert_eq!(context.id(), id);
+        assert!(Arc::ptr_eq(&context.mlir, &mlir));
+        assert!(Arc::ptr_eq(&context.target_machine, &target_machine));
+        assert_eq!(pool.len(), 1);
+    }
+
+    #[test]
+    fn slots_are_bounded_by_peak_concurrency() {
+        let pool = pool();
+
+        {
+            let first = pool.checkout();
+            let second = pool.checkout();
+            assert_ne!(first.id(), second.id());
+            assert!(!Arc::ptr_eq(&first.llvm, &second.llvm));
+        }
+        assert_eq!(pool.len(), 2);
+
+        for _ in 0..4 {
+            let _first = pool.checkout();
+            let _second = pool.checkout();
+        }
+        assert_eq!(pool.len(), 2);
+    }
+}
@@ -0,0 +1,601 @@
+use std::ffi::CStr;
+use std::fmt::Write as FmtWrite;
+use std::io::{self, Write};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::{Duration, Instant};
+
+use liblumen_llvm::string::{self, RustString};
+use liblumen_session::{Options, StatsFormat};
+use liblumen_util::time::duration_to_secs_str;
+
+/// Returns true if pass and module timings should be gathered
+pub fn timing_enabled(options: &Options) -> bool {
+    options.debugging_opts.time_passes || options.debugging_opts.print_stats
+}
+
+/// Returns true if MLIR pass timings should be gathered
+pub fn mlir_timing_enabled(options: &Options) -> bool {
+    timing_enabled(options) || options.debugging_opts.time_mlir_passes
+}
+
+/// Returns true if LLVM's own pass timers should be enabled
+pub fn llvm_timing_enabled(options: &Options) -> bool {
+    timing_enabled(options) || options.debugging_opts.time_llvm_passes
+}
+
+/// Returns true if rewrite counters and IR sizes should be gathered
+pub fn counting_enabled(options: &Options) -> bool {
+    options.debugging_opts.print_stats
+}
+
+/// Returns true if a statistics report should be printed when finished
+pub fn enabled(options: &Options) -> bool {
+    mlir_timing_enabled(options) || counting_enabled(options)
+}
+
+/// Enables collection of statistics in the MLIR/LLVM backend, per the given options
+pub(crate) fn init(options: &Options) {
+    unsafe {
+        LLVMLumenEnableStatistics(mlir_timing_enabled(options), counting_enabled(options));
+    }
+}
+
+/// The stages of the compilation pipeline which are timed individually
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum Stage {
+    /// Building MLIR from EIR with the `ModuleBuilder`
+    Build = 0,
+    /// Lowering the EIR dialect to the LLVM dialect (`MLIRLowerModule`)
+    LowerToLLVMDialect,
+    /// Translating the LLVM dialect to LLVM IR (`MLIRLowerToLLVMIR`)
+    LowerToLLVMIR,
+    /// Generating object files
+    Emit,
+    /// Linking the final binary
+    Link,
+}
+impl Stage {
+    pub const ALL: [Stage; 5] = [
+        Stage::Build,
+        Stage::LowerToLLVMDialect,
+        Stage::LowerToLLVMIR,
+        Stage::Emit,
+        Stage::Link,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Stage::Build => "build",
+            Stage::LowerToLLVMDialect => "lower-to-llvm-dialect",
+            Stage::LowerToLLVMIR => "lower-to-llvm-ir",
+            Stage::Emit => "emit",
+            Stage::Link => "link",
+        }
+    }
+}
+
+/// The cumulative time spent in each stage, in nanoseconds, indexed by `Stage`
+static STAGE_NANOS: [AtomicU64; 5] = [
+    AtomicU64::new(0),
+    AtomicU64::new(0),
+    AtomicU64::new(0),
+    AtomicU64::new(0),
+    AtomicU64::new(0),
+];
+
+/// Runs `f`, adding the wall time it takes to the total for `stage`, if statistics
+/// are enabled
+///
+/// Stages run concurrently on all workers, so the totals are the sum of the time
+/// spent by each worker, and may exceed the total wall time of the build.
+pub fn time_stage<T, F>(options: &Options, stage: Stage, f: F) -> T
+where
+    F: FnOnce() -> T,
+{
+    if !enabled(options) {
+        return f();
+    }
+    let start = Instant::now();
+    let result = f();
+    let nanos = start.elapsed().as_nanos() as u64;
+    STAGE_NANOS[stage as usize].fetch_add(nanos, Ordering::Relaxed);
+    result
+}
+
+/// The cumulative wall time spent in a single stage of the pipeline
+#[derive(Debug, Clone)]
+pub struct StageTiming {
+    pub stage: Stage,
+    pub duration: Duration,
+}
+
+/// The wall time spent compiling a single module
+#[derive(Debug, Clone)]
+pub struct ModuleTiming {
+    pub name: String,
+    pub duration: Duration,
+}
+
+/// The cumulative wall time spent in a single MLIR pass, across all modules
+#[derive(Debug, Clone)]
+pub struct PassTiming {
+    pub name: String,
+    pub runs: u64,
+    pub duration: Duration,
+}
+
+/// The number of times an operation was rewritten when lowering to LLVM
+#[derive(Debug, Clone)]
+pub struct Rewrite {
+    pub op: String,
+    pub count: u64,
+}
+
+/// The number of times lowering an operation produced a call into the runtime
+#[derive(Debug, Clone)]
+pub struct RuntimeCall {
+    pub op: String,
+    pub callee: String,
+    pub count: u64,
+}
+
+/// The size of a module at some stage of the pipeline
+///
+/// For MLIR stages this is the number of operations, for LLVM IR it is the
+/// number of instructions.
+#[derive(Debug, Clone)]
+pub struct IRSize {
+    pub module: String,
+    pub stage: String,
+    pub size: u64,
+}
+
+/// An aggregated report of the statistics gathered by all compiler workers
+#[derive(Debug, Clone, Default)]
+pub struct Statistics {
+    pub total: Duration,
+    /// The peak resident set size of the compiler, in bytes, if known
+    pub peak_rss: Option<u64>,
+    pub stages: Vec<StageTiming>,
+    pub modules: Vec<ModuleTiming>,
+    pub passes: Vec<PassTiming>,
+    pub rewrites: Vec<Rewrite>,
+    pub runtime_calls: Vec<RuntimeCall>,
+    pub ir_sizes: Vec<IRSize>,
+    pub llvm_timings: Option<String>,
+}
+impl Statistics {
+    /// Collects the statistics recorded by the backend, along with the module
+    /// timings gathered by the caller
+    ///
+    /// NOTE: This should only be called once all workers have finished, as
+    /// LLVM's pass timers are reset when read.
+    pub fn collect(options: &Options, total: Duration, mut modules: Vec<ModuleTiming>) -> Self {
+        modules.sort_by(|a, b| b.duration.cmp(&a.duration));
+
+        let stages = Stage::ALL
+            .iter()
+            .map(|stage| StageTiming {
+                stage: *stage,
+                duration: Duration::from_nanos(
+                    STAGE_NANOS[*stage as usize].load(Ordering::Relaxed),
+                ),
+            })
+            .collect();
+
+        let mut stats = Self {
+            total,
+            peak_rss: peak_rss(),
+            stages,
+            modules,
+            ..Default::default()
+        };
+        unsafe {
+            LLVMLumenVisitStatistics(
+                visit_statistic,
+                &mut stats as *mut Self as *mut libc::c_void,
+            );
+        }
+        stats.passes.sort_by(|a, b| b.duration.cmp(&a.duration));
+        stats.rewrites.sort_by(|a, b| b.count.cmp(&a.count));
+        stats.runtime_calls.sort_by(|a, b| b.count.cmp(&a.count));
+
+        if llvm_timing_enabled(options) {
+            let timings = string::build_string(|s| unsafe { LLVMLumenWriteLLVMTimingsToString(s) })
+                .expect("got a non-UTF8 timing report from LLVM");
+            if !timings.trim().is_empty() {
+                stats.llvm_timings = Some(timings);
+            }
+        }
+
+        stats
+    }
+
+    /// Writes this report to the given writer in the requested format
+    pub fn write(&self, format: StatsFormat, out: &mut dyn Write) -> io::Result<()> {
+        match format {
+            StatsFormat::Text => self.write_text(out),
+            StatsFormat::Json => self.write_json(out),
+        }
+    }
+
+    fn write_text(&self, out: &mut dyn Write) -> io::Result<()> {
+        writeln!(out, "===== Compiler Statistics =====")?;
+        writeln!(out, "total: {}s", duration_to_secs_str(self.total))?;
+        if let Some(peak_rss) = self.peak_rss {
+            writeln!(out, "peak rss: {} KiB", peak_rss / 1024)?;
+        }
+        writeln!(out, "\nStages (cumulative wall time):")?;
+        for stage in self.stages.iter() {
+            writeln!(
+                out,
+                "  {:>9}s  {}",
+                duration_to_secs_str(stage.duration),
+                stage.stage.name()
+            )?;
+        }
+        if !self.modules.is_empty() {
+            writeln!(out, "\nModules (wall time):")?;
+            for module in self.modules.iter() {
+                writeln!(
+                    out,
+                    "  {:>9}s  {}",
+                    duration_to_secs_str(module.duration),
+                    &module.name
+                )?;
+            }
+        }
+        if !self.passes.is_empty() {
+            writeln!(out, "\nMLIR passes (cumulative wall time, runs):")?;
+            for pass in self.passes.iter() {
+                writeln!(
+                    out,
+                    "  {:>9}s  {:>8}  {}",
+                    duration_to_secs_str(pass.duration),
+                    pass.runs,
+                    &pass.name
+                )?;
+            }
+        }
+        if !self.rewrites.is_empty() {
+            writeln!(out, "\nRewrites (EIR to LLVM):")?;
+            for rewrite in self.rewrites.iter() {
+                writeln!(out, "  {:>10}  {}", rewrite.count, &rewrite.op)?;
+            }
+        }
+        if !self.runtime_calls.is_empty() {
+            writeln!(out, "\nRuntime calls (EIR to LLVM):")?;
+            for call in self.runtime_calls.iter() {
+                writeln!(
+                    out,
+                    "  {:>10}  {} -> {}",
+                    call.count, &call.op, &call.callee
+                )?;
+            }
+        }
+        if !self.ir_sizes.is_empty() {
+            writeln!(out, "\nIR sizes (operations or instructions):")?;
+            for size in self.ir_sizes.iter() {
+                writeln!(
+                    out,
+                    "  {:>10}  {} ({})",
+                    size.size, &size.module, &size.stage
+                )?;
+            }
+        }
+        if let Some(ref timings) = self.llvm_timings {
+            writeln!(out, "\nLLVM passes:")?;
+            out.write_all(timings.as_bytes())?;
+        }
+        Ok(())
+    }
+
+    fn write_json(&self, out: &mut dyn Write) -> io::Result<()> {
+        let mut json = String::new();
+        json.push('{');
+        let _ = write!(json, "\"total\":{}", self.total.as_secs_f64());
+        match self.peak_rss {
+            None => json.push_str(",\"peak_rss\":null"),
+            Some(peak_rss) => {
+                let _ = write!(json, ",\"peak_rss\":{}", peak_rss);
+            }
+        }
+
+        json.push_str(",\"stages\":[");
+        for (i, stage) in self.stages.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"name\":");
+            push_json_str(&mut json, stage.stage.name());
+            let _ = write!(json, ",\"seconds\":{}}}", stage.duration.as_secs_f64());
+        }
+        json.push(']');
+
+        json.push_str(",\"modules\":[");
+        for (i, module) in self.modules.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"name\":");
+            push_json_str(&mut json, &module.name);
+            let _ = write!(json, ",\"seconds\":{}}}", module.duration.as_secs_f64());
+        }
+
+        json.push_str("],\"passes\":[");
+        for (i, pass) in self.passes.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"name\":");
+            push_json_str(&mut json, &pass.name);
+            let _ = write!(
+                json,
+                ",\"runs\":{},\"seconds\":{}}}",
+                pass.runs,
+                pass.duration.as_secs_f64()
+            );
+        }
+
+        json.push_str("],\"rewrites\":[");
+        for (i, rewrite) in self.rewrites.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"op\":");
+            push_json_str(&mut json, &rewrite.op);
+            let _ = write!(json, ",\"count\":{}}}", rewrite.count);
+        }
+
+        json.push_str("],\"runtime_calls\":[");
+        for (i, call) in self.runtime_calls.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"op\":");
+            push_json_str(&mut json, &call.op);
+            json.push_str(",\"callee\":");
+            push_json_str(&mut json, &call.callee);
+            let _ = write!(json, ",\"count\":{}}}", call.count);
+        }
+
+        json.push_str("],\"ir_sizes\":[");
+        for (i, size) in self.ir_sizes.iter().enumerate() {
+            if i > 0 {
+                json.push(',');
+            }
+            json.push_str("{\"module\":");
+            push_json_str(&mut json, &size.module);
+            json.push_str(",\"stage\":");
+            push_json_str(&mut json, &size.stage);
+            let _ = write!(json, ",\"size\":{}}}", size.size);
+        }
+
+        json.push_str("],\"llvm_passes\":");
+        match self.llvm_timings {
+            None => json.push_str("null"),
+            Some(ref timings) => push_json_str(&mut json, timings),
+        }
+        json.push('}');
+
+        writeln!(out, "{}", json)
+    }
+}
+
+/// Returns the peak resident set size of this process, in bytes
+#[cfg(unix)]
+fn peak_rss() -> Option<u64> {
+    let mut usage = std::mem::MaybeUninit::<libc::rusage>::uninit();
+    if unsafe { libc::getrusage(libc::RUSAGE_SELF, usage.as_mut_ptr()) } != 0 {
+        return None;
+    }
+    let max_rss = unsafe { usage.assume_init() }.ru_maxrss as u64;
+    // macOS reports bytes, everything else reports kilobytes
+    if cfg!(target_os = "macos") {
+        Some(max_rss)
+    } else {
+        Some(max_rss * 1024)
+    }
+}
+
+#[cfg(not(unix))]
+fn peak_rss() -> Option<u64> {
+    None
+}
+
+fn push_json_str(json: &mut String, s: &str) {
+    json.push('"');
+    for c in s.chars() {
+        match c {
+            '"' => json.push_str("\\\""),
+            '\\' => json.push_str("\\\\"),
+            '\n' => json.push_str("\\n"),
+            '\r' => json.push_str("\\r"),
+            '\t' => json.push_str("\\t"),
+            c if (c as u32) < 0x20 => {
+                let _ = write!(json, "\\u{:04x}", c as u32);
+            }
+            c => json.push(c),
+        }
+    }
+    json.push('"');
+}
+
+/// LumenStatisticKind
+#[derive(Debug, Copy, Clone, PartialEq)]
+#[repr(u32)]
+#[allow(dead_code)] // Variants constructed by C++.
+enum StatisticKind {
+    PassTime = 0,
+    Rewrite,
+    RuntimeCall,
+    IRSize,
+}
+
+unsafe extern "C" fn visit_statistic(
+    data: *mut libc::c_void,
+    kind: StatisticKind,
+    name: *const libc::c_char,
+    detail: *const libc::c_char,
+    count: u64,
+    seconds: f64,
+) {
+    let stats = &mut *(data as *mut Statistics);
+    let name = CStr::from_ptr(name).to_string_lossy().into_owned();
+    let detail = if detail.is_null() {
+        String::new()
+    } else {
+        CStr::from_ptr(detail).to_string_lossy().into_owned()
+    };
+    match kind {
+        StatisticKind::PassTime => stats.passes.push(PassTiming {
+            name,
+            runs: count,
+            duration: Duration::from_secs_f64(seconds),
+        }),
+        StatisticKind::Rewrite => stats.rewrites.push(Rewrite { op: name, count }),
+        StatisticKind::RuntimeCall => stats.runtime_calls.push(RuntimeCall {
+            op: name,
+            callee: detail,
+            count,
+        }),
+        StatisticKind::IRSize => stats.ir_sizes.push(IRSize {
+            module: name,
+            stage: detail,
+            size: count,
+        }),
+    }
+}
+
+type StatisticVisitor = unsafe extern "C" fn(
+    data: *mut libc::c_void,
+    kind: StatisticKind,
+    name: *const libc::c_char,
+    detail: *const libc::c_char,
+    count: u64,
+    seconds: f64,
+);
+
+extern "C" {
+    fn LLVMLumenEnableStatistics(timing: bool, counting: bool);
+    fn LLVMLumenVisitStatistics(visitor: StatisticVisitor, data: *mut libc::c_void);
+    #[allow(improper_ctypes)]
+    fn LLVMLumenWriteLLVMTimingsToString(s: &RustString);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::ffi::CString;
+
+    fn visit(stats: &mut Statistics, kind: StatisticKind, name: &str, detail: Option<&str>) {
+        let name = CString::new(name).unwrap();
+        let detail = detail.map(|detail| CString::new(detail).unwrap());
+        unsafe {
+            visit_statistic(
+                stats as *mut Statistics as *mut libc::c_void,
+                kind,
+                name.as_ptr(),
+                detail
+                    .as_ref()
+                    .map_or(std::ptr::null(), |detail| detail.as_ptr()),
+                3,
+                0.5,
+            );
+        }
+    }
+
+    fn report() -> Statistics {
+        Statistics {
+            total: Duration::from_millis(1500),
+            stages: vec![StageTiming {
+                stage: Stage::Build,
+                duration: Duration::from_millis(250),
+            }],
+            modules: vec![ModuleTiming {
+                name: "init".to_string(),
+                duration: Duration::from_millis(1000),
+            }],
+            rewrites: vec![Rewrite {
+                op: "eir.call".to_string(),
+                count: 2,
+            }],
+            ..Default::default()
+        }
+    }
+
+    fn write(stats: &Statistics, format: StatsFormat) -> String {
+        let mut out = Vec::new();
+        stats.write(format, &mut out).unwrap();
+        String::from_utf8(out).unwrap()
+    }
+
+    #[test]
+    fn visited_statistics_are_added_by_kind() {
+        let mut stats = Statistics::default();
+        visit(&mut stats, StatisticKind::PassTime, "canonicalize", None);
+        visit(&mut stats, StatisticKind::Rewrite, "eir.cons", None);
+        visit(
+            &mut stats,
+            StatisticKind::RuntimeCall,
+            "eir.map.insert",
+            Some("__lumen_builtin_map.insert"),
+        );
+        visit(&mut stats, StatisticKind::IRSize, "init", Some("llvm-ir"));
+
+        assert_eq!(stats.passes.len(), 1);
+        assert_eq!(stats.passes[0].name, "canonicalize");
+        assert_eq!(stats.passes[0].runs, 3);
+        assert_eq!(stats.passes[0].duration, Duration::from_millis(500));
+        assert_eq!(stats.rewrites.len(), 1);
+        assert_eq!(stats.rewrites[0].op, "eir.cons");
+        assert_eq!(stats.runtime_calls.len(), 1);
+        assert_eq!(stats.runtime_calls[0].callee, "__lumen_builtin_map.insert");
+        assert_eq!(stats.ir_sizes.len(), 1);
+        assert_eq!(stats.ir_sizes[0].module, "init");
+        assert_eq!(stats.ir_sizes[0].stage, "llvm-ir");
+        assert_eq!(stats.ir_sizes[0].size, 3);
+    }
+
+    #[test]
+    fn json_report_is_a_single_object() {
+        let json = write(&report(), StatsFormat::Json);
+
+        assert_eq!(
+            json,
+            concat!(
+                "{\"total\":1.5,\"peak_rss\":null,",
+                "\"stages\":[{\"name\":\"build\",\"seconds\":0.25}],",
+                "\"modules\":[{\"name\":\"init\",\"seconds\":1}],",
+                "\"passes\":[],",
+                "\"rewrites\":[{\"op\":\"eir.call\",\"count\":2}],",
+                "\"runtime_calls\":[],",
+                "\"ir_sizes\":[],",
+                "\"llvm_passes\":null}\n"
+            )
+        );
+    }
+
+    #[test]
+    fn json_strings_are_escaped() {
+        let mut json = String::new();
+        push_json_str(&mut json, "a \"b\" \\c\n\t\u{1}é");
+
+        assert_eq!(json, "\"a \\\"b\\\" \\\\c\\n\\t\\u0001é\"");
+    }
+
+    #[test]
+    fn text_report_omits_empty_sections() {
+        let text = write(&report(), StatsFormat::Text);
+
+        assert!(text.starts_with("===== Compiler Statistics =====\n"));
+        assert!(text.contains("\nModules (wall time):\n"));
+        assert!(text.contains("\nRewrites (EIR to LLVM):\n"));
+        assert!(text.contains("         2  eir.call\n"));
+        assert!(!text.contains("MLIR passes"));
+        assert!(!text.contains("Runtime calls"));
+        assert!(!text.contains("IR sizes"));
+        assert!(!text.contains("LLVM passes"));
+    }
+}
@@ -8,27 +8,33 @@ use std::sync::Arc;
 use libeir_intern::{Ident, Symbol};
 use libeir_ir::FunctionIdent;
 
-use liblumen_core::symbols::FunctionSymbol;
+use liblumen_core::symbols::{FunctionSymbol, StaticSymbolTable};
+use liblumen_core::util::phf;
 
 use crate::codegen::CompiledModule;
 use crate::llvm::*;
 use crate::Result;
 
+/// The name of the generated symbol table module
+pub const NAME: &'static str = "liblumen_crt_dispatch";
+
 /// Generates an LLVM module containing the raw symbol table data for the current build
 ///
-/// This is similar to the atom table generation, but simpler, in that we just generate
-/// a large list of `FunctionSybmol` structs, which reference extern declarations of all
-/// the functions defined by the build. At link time these will be resolved to pointers
-/// to the actual functions, and when we boot the runtime, we can reify this array into
-/// a more efficient search structure for dispatch.
-pub fn compile_symbol_table(
+/// This is similar to the atom table generation, in that the table is used in place by the
+/// runtime (see `liblumen_core::symbols::StaticSymbolTable`):
+/// - Generate a `FunctionSymbol` struct for every function defined by the build, which
+/// reference extern declarations of those functions; at link time these will be resolved
+/// to pointers to the actual functions. These are sorted by (module, function, arity), so
+/// that the functions of each module are contiguous
+/// - Generate a `ModuleSymbols` struct for each module, with the range of its functions
+/// - Generate a minimal perfect hash function for the symbols, and constant arrays for the
+/// displacements and slots of the hash table
+/// - Generate the __LUMEN_SYMBOL_TABLE global, a `StaticSymbolTable` referencing the above
+pub fn generate_symbol_table(
     context: &Context,
     target_machine: &TargetMachine,
     symbols: HashSet<FunctionSymbol>,
-    output_dir: &Path,
-) -> Result<Arc<CompiledModule>> {
-    const NAME: &'static str = "liblumen_crt_dispatch";
-
+) -> Result<Module> {
     let builder = ModuleBuilder::new(NAME, context, target_machine)?;
 
     fn declare_extern_symbol<'ctx>(
@@ -47,18 +53,42 @@ pub fn compile_symbol_table(
         Ok(builder.build_function(&name, ty))
     }
 
+    // Order symbols by key, so that modules are contiguous, and the table is deterministic
+    let mut symbols: Vec<FunctionSymbol> = symbols.into_iter().collect();
+    symbols.sort_by_key(|symbol| (symbol.module, symbol.function, symbol.arity));
+
+    // Generate the hash function
+    let state = phf::generate(symbols.len(), |seed, i| {
+        let symbol = &symbols[i];
+        StaticSymbolTable::hash(seed, symbol.module, symbol.function, symbol.arity)
+    });
+
+    let add_private_constant = |name: &str, init: LLVMValueRef| {
+        let ty = unsafe { llvm_sys::core::LLVMTypeOf(init) };
+        let constant = builder.add_constant(ty, name, Some(init));
+        builder.set_linkage(constant, Linkage::Private);
+        builder.set_alignment(constant, 8);
+        builder.build_const_inbounds_gep(constant, &[0, 0])
+    };
+
     // Translate FunctionIdent to FunctionSymbol with pointer to declared function
     let usize_type = builder.get_usize_type();
     let i8_type = builder.get_i8_type();
+    let i32_type = builder.get_i32_type();
+    let i64_type = builder.get_i64_type();
     let fn_ptr_type = builder.get_pointer_type(builder.get_opaque_function_type());
     let function_type = builder.get_struct_type(
         Some("FunctionSymbol"),
         &[usize_type, usize_type, i8_type, fn_ptr_type],
     );
 
-    // Build values for array
+    // Build values for array, and the range of each module
+    let module_type =
+        builder.get_struct_type(Some("ModuleSymbols"), &[usize_type, i32_type, i32_type]);
     let mut functions = Vec::with_capacity(symbols.len());
-    for symbol in symbols.iter() {
+    let mut modules = Vec::new();
+    let mut module_start = 0;
+    for (i, symbol) in symbols.iter().enumerate() {
         let decl = declare_extern_symbol(&builder, symbol)?;
         let decl_ptr = builder.build_pointer_cast(decl, fn_ptr_type);
         let module = builder.build_constant_uint(usize_type, symbol.module);
@@ -67,36 +97,87 @@ pub fn compile_symbol_table(
         let function =
             builder.build_constant_struct(function_type, &[module, fun, arity, decl_ptr]);
         functions.push(function);
+
+        let is_module_end = symbols
+            .get(i + 1)
+            .map(|next| next.module != symbol.module)
+            .unwrap_or(true);
+        if is_module_end {
+            modules.push(builder.build_constant_struct(
+                module_type,
+                &[
+                    module,
+                    builder.build_constant_uint(i32_type, module_start),
+                    builder.build_constant_uint(i32_type, i + 1 - module_start),
+                ],
+            ));
+            module_start = i + 1;
+        }
     }
 
     // Generate global array of all idents
     let functions_const_init = builder.build_constant_array(function_type, functions.as_slice());
-    let functions_const_ty = unsafe { llvm_sys::core::LLVMTypeOf(functions_const_init) };
-    let functions_const = builder.add_constant(
-        functions_const_ty,
-        "__LUMEN_SYMBOL_TABLE_ENTRIES",
-        Some(functions_const_init),
-    );
-    builder.set_linkage(functions_const, Linkage::Private);
-    builder.set_alignment(functions_const, 8);
-
-    let function_ptr_type = builder.get_pointer_type(function_type);
-    let table_global_init = builder.build_const_inbounds_gep(functions_const, &[0, 0]);
-    let table_global = builder.add_global(
-        function_ptr_type,
-        "__LUMEN_SYMBOL_TABLE",
-        Some(table_global_init),
-    );
-    builder.set_alignment(table_global, 8);
+    let functions_ptr = add_private_constant("__LUMEN_SYMBOL_TABLE_ENTRIES", functions_const_init);
 
-    // Generate array length global
-    let table_size_global_init = builder.build_constant_uint(usize_type, functions.len());
-    let table_size_global = builder.add_global(
-        usize_type,
-        "__LUMEN_SYMBOL_TABLE_SIZE",
-        Some(table_size_global_init),
+    // Generate global array of module ranges
+    let modules_const_init = builder.build_constant_array(module_type, modules.as_slice());
+    let modules_ptr = add_private_constant("__LUMEN_SYMBOL_TABLE_MODULES", modules_const_init);
+
+    // Generate hash table displacements and slots
+    let disp_type = builder.get_struct_type(Some("Displacement"), &[i32_type, i32_type]);
+    let displacements = state
+        .displacements
+        .iter()
+        .map(|disp| {
+            builder.build_constant_struct(
+                disp_type,
+                &[
+                    builder.build_constant_uint(i32_type, disp.d1 as usize),
+                    builder.build_constant_uint(i32_type, disp.d2 as usize),
+                ],
+            )
+        })
+        .collect::<Vec<_>>();
+    let disp_init = builder.build_constant_array(disp_type, displacements.as_slice());
+    let disp_ptr = add_private_constant("__LUMEN_SYMBOL_TABLE_DISPLACEMENTS", disp_init);
+
+    let slots = state
+        .map
+        .iter()
+        .map(|i| builder.build_constant_uint(i32_type, *i))
+        .collect::<Vec<_>>();
+    let slots_init = builder.build_constant_array(i32_type, slots.as_slice());
+    let slots_ptr = add_private_constant("__LUMEN_SYMBOL_TABLE_SLOTS", slots_init);
+
+    // Generate symbol table global itself
+    let table_type = builder.get_struct_type(
+        Some("StaticSymbolTable"),
+        &[
+            i64_type,
+            usize_type,
+            usize_type,
+            usize_type,
+            builder.get_pointer_type(disp_type),
+            builder.get_pointer_type(i32_type),
+            builder.get_pointer_type(function_type),
+            builder.get_pointer_type(module_type),
+        ],
     );
-    builder.set_alignment(table_size_global, 8);
+    let table_init = builder.build_constant_struct(
+        table_type,
+        &[
+            builder.build_constant_uint(i64_type, state.seed as usize),
+            builder.build_constant_uint(usize_type, functions.len()),
+            builder.build_constant_uint(usize_type, displacements.len()),
+            builder.build_constant_uint(usize_type, modules.len()),
+            disp_ptr,
+            slots_ptr,
+            functions_ptr,
+            modules_ptr,
+        ],
+    );
+    let table = builder.add_constant(table_type, "__LUMEN_SYMBOL_TABLE", Some(table_init));
+    builder.set_alignment(table, 8);
 
     // We have to build a shim for the Rust libstd `lang_start_internal`
     // function to start the Rust runtime. Since that symbol is internal,
@@ -128,7 +209,18 @@ pub fn compile_symbol_table(
     builder.build_return(lang_start_call);
 
     // Finalize module
-    let module = builder.finish();
+    Ok(builder.finish())
+}
+
+/// Generates the symbol table module (see `generate_symbol_table`), and emits it as an
+/// object file in `output_dir`
+pub fn compile_symbol_table(
+    context: &Context,
+    target_machine: &TargetMachine,
+    symbols: HashSet<FunctionSymbol>,
+    output_dir: &Path,
+) -> Result<Arc<CompiledModule>> {
+    let module = generate_symbol_table(context, target_machine, symbols)?;
     // Open object file for writing
     let path = output_dir.join(&format!("{}.o", NAME));
     let mut file = File::create(path.as_path())?;
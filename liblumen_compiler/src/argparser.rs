@@ -30,6 +30,7 @@ pub fn parser<'a, 'b>() -> App<'a, 'b> {
         )
         .subcommand(print_command())
         .subcommand(compile_command())
+        .subcommand(run_command())
 }
 
 pub fn print_print_help() {
@@ -42,6 +43,10 @@ pub fn print_compile_help() {
         .expect("unable to print help");
 }
 
+pub fn print_run_help() {
+    run_command().print_help().expect("unable to print help");
+}
+
 fn print_command<'a, 'b>() -> App<'a, 'b> {
     let target = self::target_arg();
     App::new("print")
@@ -75,10 +80,27 @@ fn print_command<'a, 'b>() -> App<'a, 'b> {
 }
 
 fn compile_command<'a, 'b>() -> App<'a, 'b> {
+    compiler_args(
+        App::new("compile").about("Compiles Erlang sources to an executable or shared library"),
+    )
+}
+
+fn run_command<'a, 'b>() -> App<'a, 'b> {
+    compiler_args(App::new("run").about("Compiles Erlang sources and runs the result")).arg(
+        Arg::with_name("jit")
+            .help(
+                "Compile in memory and run in-process, rather than linking an executable.\n\
+                 Functions are compiled on first call, and no object files are written.",
+            )
+            .next_line_help(true)
+            .long("jit"),
+    )
+}
+
+/// Adds the arguments shared by all commands which compile sources
+fn compiler_args<'a, 'b>(app: App<'a, 'b>) -> App<'a, 'b> {
     let target = self::target_arg();
-    App::new("compile")
-        .about("Compiles Erlang sources to an executable or shared library")
-        .setting(AppSettings::DeriveDisplayOrder)
+    app.setting(AppSettings::DeriveDisplayOrder)
         .arg(
             Arg::with_name("input")
                 .index(1)
@@ -1,5 +1,6 @@
 pub(crate) mod compile;
 pub(crate) mod print;
+pub(crate) mod run;
 
 use std::sync::{Arc, RwLock};
 
@@ -1,7 +1,7 @@
+use std::io;
 use std::ops::Deref;
 use std::path::PathBuf;
 use std::sync::{mpsc::channel, Arc, RwLock};
-use std::thread;
 use std::time::Instant;
 
 use anyhow::anyhow;
@@ -16,6 +16,8 @@ use log::debug;
 use libeir_diagnostics::{CodeMap, Emitter};
 
 use liblumen_codegen::linker::{self, LinkerInfo};
+use liblumen_codegen::pool::ContextPool;
+use liblumen_codegen::stats::{self, ModuleTiming, Stage, Statistics};
 use liblumen_codegen::{
     self as codegen,
     codegen::{CodegenResults, ProjectInfo},
@@ -43,8 +45,11 @@ pub fn handle_command<'a>(
     // Initialize codegen backend
     codegen::init(&options);
 
+    // Construct the context pool shared by all workers
+    let context_pool = Arc::new(ContextPool::new(&options, diagnostics.clone()));
+
     // Build query database
-    let mut db = CompilerDatabase::new(codemap, diagnostics);
+    let mut db = CompilerDatabase::new(codemap, diagnostics, context_pool);
 
     // The core of the query system is the initial set of options provided to the compiler
     //
@@ -62,7 +67,14 @@ pub fn handle_command<'a>(
     }
 
     let start = Instant::now();
-    let pool = ThreadPool::new(num_cpus::get());
+    // LLVM's pass timers are process-wide, and cannot be used by more than one
+    // thread at a time, so modules are compiled one at a time when they are on
+    let num_workers = if stats::llvm_timing_enabled(&db.options()) {
+        1
+    } else {
+        num_cpus::get()
+    };
+    let pool = ThreadPool::new(num_workers);
     let (tx, rx) = channel();
     for input in inputs.iter().cloned() {
         debug!("spawning worker for {:?}", input);
@@ -71,12 +83,20 @@ pub fn handle_command<'a>(
         pool.execute(move || {
             let thread_id = std::thread::current().id();
             debug!("starting to compile on thread {:?}", thread_id);
+            let module_start = Instant::now();
             let compilation_result = snapshot.compile(input);
+            let timing = ModuleTiming {
+                name: snapshot
+                    .lookup_intern_input(input)
+                    .source_name()
+                    .to_string(),
+                duration: module_start.elapsed(),
+            };
             debug!(
                 "compilation finished on thread {:?} {:?}",
                 thread_id, &compilation_result
             );
-            tx.send(compilation_result)
+            tx.send((timing, compilation_result))
                 .expect("worker failed: unable to send compiled module back to main thread");
         });
     }
@@ -93,15 +113,17 @@ pub fn handle_command<'a>(
     debug!("awaiting results from workers ({} units)", num_inputs);
 
     let mut received = 0;
+    let mut module_timings = Vec::with_capacity(num_inputs);
     {
         let diagnostics = db.diagnostics();
         loop {
             match rx.recv() {
-                Ok(compile_result) => {
+                Ok((timing, compile_result)) => {
                     debug!(
                         "received compilation result from worker: {:?}",
                         &compile_result
                     );
+                    module_timings.push(timing);
                     if let Ok(compiled_module) = compile_result {
                         diagnostics.success("Compiled", &compiled_module.name());
                         codegen_results.modules.push(compiled_module);
@@ -133,9 +155,11 @@ pub fn handle_command<'a>(
     // NOTE: This does not go through the query system, since atoms
     // are not inputs to the query system, but gathered globally during
     // compilation.
-    let thread_id = thread::current().id();
-    let context = db.llvm_context(thread_id);
-    let target_machine = db.get_target_machine(thread_id);
+    let context_pool = db.context_pool().clone();
+    let pooled = context_pool.checkout();
+    debug!("compiled with {} pooled contexts", context_pool.len());
+    let context = pooled.llvm.clone();
+    let target_machine = pooled.target_machine.clone();
     let atoms = db.take_atoms();
     let symbols = db.take_symbols();
     let output_dir = db.output_dir();
@@ -156,11 +180,24 @@ pub fn handle_command<'a>(
 
     // Link all compiled objects
     let diagnostics = db.diagnostics();
-    if let Err(err) = linker::link_binary(&options, &diagnostics, &codegen_results) {
+    let linked = stats::time_stage(&options, Stage::Link, || {
+        linker::link_binary(&options, &diagnostics, &codegen_results)
+    });
+    if let Err(err) = linked {
         diagnostics.error(err);
         return Err(anyhow!("failed to link binary"));
     }
 
+    // Report statistics gathered across all workers, if requested
+    if stats::enabled(&options) {
+        let statistics = Statistics::collect(&options, start.elapsed(), module_timings);
+        let format = options.debugging_opts.stats_format.unwrap_or_default();
+        let stdout = io::stdout();
+        if let Err(err) = statistics.write(format, &mut stdout.lock()) {
+            diagnostics.io_error(err);
+        }
+    }
+
     let duration = HumanDuration::since(start);
     diagnostics.success(
         "Finished",
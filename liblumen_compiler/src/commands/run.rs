@@ -0,0 +1,169 @@
+use std::ops::Deref;
+use std::path::PathBuf;
+use std::process::Command;
+use std::sync::{mpsc::channel, Arc, RwLock};
+use std::time::Instant;
+
+use anyhow::anyhow;
+
+use clap::ArgMatches;
+
+use executors::crossbeam_channel_pool::ThreadPool;
+use executors::Executor;
+
+use log::debug;
+
+use libeir_diagnostics::{CodeMap, Emitter};
+
+use liblumen_codegen as codegen;
+use liblumen_codegen::jit::Jit;
+use liblumen_codegen::linker;
+use liblumen_codegen::pool::ContextPool;
+use liblumen_session::{CodegenOptions, DebuggingOptions, Options};
+use liblumen_util::time::HumanDuration;
+
+use crate::commands::*;
+use crate::compiler::{prelude::*, *};
+
+pub fn handle_command<'a>(
+    c_opts: CodegenOptions,
+    z_opts: DebuggingOptions,
+    matches: &ArgMatches<'a>,
+    cwd: PathBuf,
+    emitter: Option<Arc<dyn Emitter>>,
+) -> anyhow::Result<()> {
+    if !matches.is_present("jit") {
+        return run_executable(c_opts, z_opts, matches, cwd, emitter);
+    }
+
+    // Extract options from provided arguments
+    let options = Options::new(c_opts, z_opts, cwd, &matches)?;
+    // Construct empty code map for use in compilation
+    let codemap = Arc::new(RwLock::new(CodeMap::new()));
+    // Set up diagnostics
+    let diagnostics = create_diagnostics_handler(&options, codemap.clone(), emitter);
+
+    // Initialize codegen backend
+    codegen::init(&options);
+
+    // Construct the context pool shared by all workers
+    let context_pool = Arc::new(ContextPool::new(&options, diagnostics.clone()));
+
+    // Build query database
+    let mut db = CompilerDatabase::new(codemap, diagnostics, context_pool);
+    db.set_options(Arc::new(options));
+
+    let inputs = db.inputs().unwrap_or_else(abort_on_err);
+    let num_inputs = inputs.len();
+    if num_inputs < 1 {
+        db.diagnostics()
+            .fatal_str("No input sources found!")
+            .raise();
+    }
+
+    // Lower all inputs to LLVM IR in parallel, as `compile` does, but stop
+    // short of code generation, which the JIT performs on demand
+    let start = Instant::now();
+    let pool = ThreadPool::new(num_cpus::get());
+    let (tx, rx) = channel();
+    for input in inputs.iter().cloned() {
+        let tx = tx.clone();
+        let snapshot = db.snapshot();
+        pool.execute(move || {
+            let name = snapshot
+                .lookup_intern_input(input)
+                .source_name()
+                .to_string();
+            let result = snapshot.get_llvm_bitcode(input);
+            tx.send((name, result))
+                .expect("worker failed: unable to send bitcode back to main thread");
+        });
+    }
+    drop(tx);
+
+    let mut modules = Vec::with_capacity(num_inputs);
+    for (name, result) in rx.iter() {
+        if let Ok(bitcode) = result {
+            modules.push((name, bitcode));
+        }
+    }
+    {
+        let diagnostics = db.diagnostics();
+        if let Err(ref reason) = pool.shutdown() {
+            diagnostics.fatal_str(reason).raise();
+        }
+        diagnostics.abort_if_errors();
+    }
+
+    let options = db.options();
+    let context_pool = db.context_pool().clone();
+    let pooled = context_pool.checkout();
+    let target_machine = pooled.target_machine.clone();
+
+    // Generate the atom and symbol tables, as for an executable; these have to be
+    // serialized while the pooled context they were generated in is checked out
+    let atom_table = codegen::atoms::generate_atom_table(
+        pooled.llvm.deref(),
+        target_machine.deref(),
+        db.take_atoms(),
+    )?
+    .to_bitcode();
+    let symbol_table = codegen::symbol_table::generate_symbol_table(
+        pooled.llvm.deref(),
+        target_machine.deref(),
+        db.take_symbols(),
+    )?
+    .to_bitcode();
+
+    let mut jit = Jit::new(&options, target_machine.deref(), num_cpus::get())?;
+    jit.load_runtime(&options)?;
+    for (name, bitcode) in modules.iter() {
+        jit.add_module(name, bitcode.as_slice(), /* lazy= */ true)?;
+    }
+    // The tables are data, and are needed in full as soon as the runtime starts
+    jit.add_module(codegen::atoms::NAME, atom_table.as_slice(), false)?;
+    // This module also contains the `lang_start` shim used by executables, which
+    // must never be materialized here, so it is only compiled on demand
+    jit.add_module(codegen::symbol_table::NAME, symbol_table.as_slice(), true)?;
+    drop(pooled);
+
+    let diagnostics = db.diagnostics();
+    let duration = HumanDuration::since(start);
+    diagnostics.success(
+        "Running",
+        &format!("{} (prepared in {:#})", options.project_name, duration),
+    );
+    debug!("starting runtime in jit");
+
+    match jit.run()? {
+        0 => Ok(()),
+        status => Err(anyhow!(
+            "{} exited with status {}",
+            options.project_name,
+            status
+        )),
+    }
+}
+
+/// Compiles and links an executable, as `lumen compile` does, then runs it
+fn run_executable<'a>(
+    c_opts: CodegenOptions,
+    z_opts: DebuggingOptions,
+    matches: &ArgMatches<'a>,
+    cwd: PathBuf,
+    emitter: Option<Arc<dyn Emitter>>,
+) -> anyhow::Result<()> {
+    let options = Options::new(c_opts.clone(), z_opts.clone(), cwd.clone(), &matches)?;
+    compile::handle_command(c_opts, z_opts, matches, cwd, emitter)?;
+
+    let executable = linker::output_file(&options);
+    debug!("running {:?}", &executable);
+    let status = Command::new(&executable)
+        .status()
+        .map_err(|err| anyhow!("unable to run {}: {}", executable.display(), err))?;
+    if status.success() {
+        Ok(())
+    } else {
+        Err(anyhow!("{} exited with {}", options.project_name, status))
+    }
+}
@@ -1,3 +1,4 @@
+mod cache;
 mod intern;
 mod queries;
 mod query_groups;
@@ -14,6 +15,7 @@ use salsa::Snapshot;
 use libeir_diagnostics::{CodeMap, Diagnostic};
 use libeir_intern::Symbol;
 
+use liblumen_codegen::pool::ContextPool;
 use liblumen_core::symbols::FunctionSymbol;
 use liblumen_incremental::{InternedInput, InternerStorage};
 pub use liblumen_incremental::{ParserDatabase, ParserDatabaseBase};
@@ -33,9 +35,14 @@ pub struct CompilerDatabase {
     codemap: Arc<RwLock<CodeMap>>,
     atoms: Arc<Mutex<HashSet<Symbol>>>,
     symbols: Arc<Mutex<HashSet<FunctionSymbol>>>,
+    context_pool: Arc<ContextPool>,
 }
 impl CompilerDatabase {
-    pub fn new(codemap: Arc<RwLock<CodeMap>>, diagnostics: DiagnosticsHandler) -> Self {
+    pub fn new(
+        codemap: Arc<RwLock<CodeMap>>,
+        diagnostics: DiagnosticsHandler,
+        context_pool: Arc<ContextPool>,
+    ) -> Self {
         let mut atoms = HashSet::default();
         atoms.insert(Symbol::intern("false"));
         atoms.insert(Symbol::intern("true"));
@@ -45,6 +52,7 @@ impl CompilerDatabase {
             codemap,
             atoms: Arc::new(Mutex::new(atoms)),
             symbols: Arc::new(Mutex::new(HashSet::default())),
+            context_pool,
         }
     }
 }
@@ -65,6 +73,7 @@ impl salsa::ParallelDatabase for CompilerDatabase {
             codemap: self.codemap.clone(),
             atoms: self.atoms.clone(),
             symbols: self.symbols.clone(),
+            context_pool: self.context_pool.clone(),
         })
     }
 }
@@ -150,6 +159,10 @@ impl ParserDatabaseBase for CompilerDatabase {
 }
 
 impl CodegenDatabaseBase for CompilerDatabase {
+    fn context_pool(&self) -> &Arc<ContextPool> {
+        &self.context_pool
+    }
+
     fn take_atoms(&mut self) -> HashSet<Symbol> {
         let atoms = Arc::get_mut(&mut self.atoms).unwrap().get_mut().unwrap();
         let empty = HashSet::default();
@@ -0,0 +1,362 @@
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+
+use log::debug;
+
+use sha2::{Digest, Sha256};
+
+use liblumen_codegen::{self as codegen, mlir};
+use liblumen_session::{DebugInfo, Input, Options, OutputType};
+
+/// The name of the cached bitcode file in a cache entry
+const BITCODE_FILE: &'static str = "module.bc";
+
+/// The output types which can be produced without running the lowering/codegen
+/// pipeline, and so do not prevent the use of a cached object.
+const CACHEABLE_OUTPUT_TYPES: &[OutputType] = &[
+    OutputType::AST,
+    OutputType::EIR,
+    OutputType::EIRDialect,
+    OutputType::LLVMBitcode,
+    OutputType::Object,
+    OutputType::Exe,
+];
+
+/// A persistent, content-addressed cache of compiled modules
+///
+/// Entries are keyed by a hash of the EIR dialect module text, plus everything
+/// else which influences the generated code (compiler and LLVM versions, target,
+/// CPU/features, optimization level, and all codegen and debugging options), and
+/// contain the object file(s) and, if it was requested, the bitcode produced for
+/// that module. The module text includes locations when debug info is on, as they
+/// are baked into the objects.
+///
+/// The cache is only used if a directory is given with `-C object-cache`. Nothing
+/// is ever evicted from it, which is up to whoever configured it.
+///
+/// Each entry is a directory named by its key; it is populated under a temporary
+/// name and then renamed into place, so concurrent compilers never observe a
+/// partially written entry.
+#[derive(Debug, Clone)]
+pub struct ObjectCache {
+    dir: PathBuf,
+}
+
+/// A cache key, i.e. the hex-encoded digest of a module and its build settings
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct CacheKey(String);
+
+/// The artifacts restored from a cache hit
+#[derive(Debug)]
+pub struct CachedModule {
+    pub objects: Vec<PathBuf>,
+    pub bytecode: Option<PathBuf>,
+}
+
+impl ObjectCache {
+    /// Returns the cache configured by the given options, if caching is enabled
+    pub fn new(options: &Options) -> Option<Self> {
+        if options.debugging_opts.no_object_cache {
+            return None;
+        }
+        let dir = options.codegen_opts.object_cache.clone()?;
+        Some(Self { dir })
+    }
+
+    /// Returns true if nothing other than the final artifacts are requested for
+    /// the given input, i.e. the compilation pipeline can be skipped for it
+    ///
+    /// Remarks are emitted while lowering and optimizing, so are never cached.
+    pub fn is_cacheable(options: &Options, input: &Input) -> bool {
+        options.codegen_opts.remark.is_empty()
+            && options
+                .output_types
+                .keys()
+                .filter(|ty| options.output_types.maybe_emit(input, **ty).is_some())
+                .all(|ty| CACHEABLE_OUTPUT_TYPES.contains(ty))
+    }
+
+    /// Computes the cache key for the given EIR dialect module
+    pub fn key(&self, options: &Options, module: &mlir::Module) -> CacheKey {
+        let features = codegen::target::llvm_target_features(options)
+            .collect::<Vec<_>>()
+            .join(",");
+
+        let mut hasher = KeyHasher::new();
+        hasher
+            .field("lumen", crate::LUMEN_RELEASE.as_bytes())
+            .field("commit", crate::LUMEN_COMMIT_HASH.as_bytes())
+            .field("llvm", codegen::llvm_version().as_bytes())
+            .field("target", format!("{:?}", options.target).as_bytes())
+            .field("cpu", codegen::target::target_cpu(options).as_bytes())
+            .field("features", features.as_bytes())
+            .field("opt", format!("{:?}", options.opt_level).as_bytes())
+            .field("debuginfo", format!("{:?}", options.debug_info).as_bytes())
+            .field(
+                "debug-assertions",
+                format!("{:?}", options.debug_assertions).as_bytes(),
+            )
+            .field(
+                "remap-path-prefix",
+                format!("{:?}", options.source_path_prefix).as_bytes(),
+            )
+            .field("codegen", format!("{:?}", options.codegen_opts).as_bytes())
+            .field(
+                "debugging",
+                format!("{:?}", options.debugging_opts).as_bytes(),
+            )
+            .field(
+                "module",
+                module
+                    .to_memory_buffer(options.debug_info != DebugInfo::None)
+                    .as_slice(),
+            );
+        hasher.finish()
+    }
+
+    /// Looks up the given key, and if present, copies the cached artifacts to
+    /// `obj_path` and `bc_path` (when given)
+    ///
+    /// Cached object files are copied rather than referenced, as the linker
+    /// removes intermediate objects once it is done with them.
+    pub fn restore(
+        &self,
+        key: &CacheKey,
+        obj_path: &Path,
+        bc_path: Option<&Path>,
+    ) -> io::Result<Option<CachedModule>> {
+        let entry = self.dir.join(&key.0);
+        if !entry.is_dir() {
+            debug!("object cache miss for {}", &key.0);
+            return Ok(None);
+        }
+
+        let cached_bc = entry.join(BITCODE_FILE);
+        if bc_path.is_some() && !cached_bc.is_file() {
+            debug!("object cache entry {} has no bitcode, ignoring", &key.0);
+            return Ok(None);
+        }
+
+        let mut units = Vec::new();
+        for i in 0.. {
+            let cached_obj = entry.join(unit_filename(i));
+            if !cached_obj.is_file() {
+                break;
+            }
+            units.push(cached_obj);
+        }
+        if units.is_empty() {
+            return Ok(None);
+        }
+
+        let objects = if units.len() == 1 {
+            vec![obj_path.to_path_buf()]
+        } else {
+            (0..units.len())
+                .map(|i| obj_path.with_extension(format!("cgu{}.o", i)))
+                .collect()
+        };
+        for (cached, obj) in units.iter().zip(objects.iter()) {
+            fs::copy(cached, obj)?;
+        }
+        let bytecode = match bc_path {
+            None => None,
+            Some(bc_path) => {
+                fs::copy(&cached_bc, bc_path)?;
+                Some(bc_path.to_path_buf())
+            }
+        };
+
+        debug!("object cache hit for {}", &key.0);
+        Ok(Some(CachedModule { objects, bytecode }))
+    }
+
+    /// Stores the given artifacts under the given key
+    ///
+    /// If an entry already exists for the key (e.g. populated concurrently by
+    /// another compiler process), the existing entry is kept.
+    pub fn store(
+        &self,
+        key: &CacheKey,
+        objects: &[PathBuf],
+        bc_path: Option<&Path>,
+    ) -> io::Result<()> {
+        if objects.is_empty() {
+            return Ok(());
+        }
+        let entry = self.dir.join(&key.0);
+        if entry.is_dir() {
+            return Ok(());
+        }
+
+        let tmp = self
+            .dir
+            .join(format!(".{}.{}.tmp", &key.0, std::process::id()));
+        fs::create_dir_all(&tmp)?;
+        for (i, obj) in objects.iter().enumerate() {
+            fs::copy(obj, tmp.join(unit_filename(i)))?;
+        }
+        if let Some(bc_path) = bc_path {
+            fs::copy(bc_path, tmp.join(BITCODE_FILE))?;
+        }
+
+        if let Err(err) = fs::rename(&tmp, &entry) {
+            let _ = fs::remove_dir_all(&tmp);
+            if !entry.is_dir() {
+                return Err(err);
+            }
+        }
+        debug!("stored object cache entry {}", &key.0);
+        Ok(())
+    }
+}
+
+/// Hashes the named fields which make up a `CacheKey`
+struct KeyHasher(Sha256);
+impl KeyHasher {
+    fn new() -> Self {
+        Self(Sha256::new())
+    }
+
+    /// Adds a field to the key
+    ///
+    /// Names and values are prefixed with their lengths, so that moving bytes from
+    /// one field to the next changes the key.
+    fn field(&mut self, name: &str, value: &[u8]) -> &mut Self {
+        for bytes in &[name.as_bytes(), value] {
+            self.0.input(&(bytes.len() as u64).to_le_bytes());
+            self.0.input(bytes);
+        }
+        self
+    }
+
+    fn finish(self) -> CacheKey {
+        CacheKey(format!("{:x}", self.0.result()))
+    }
+}
+
+fn unit_filename(index: usize) -> String {
+    format!("{}.o", index)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn key(fields: &[(&str, &str)]) -> CacheKey {
+        let mut hasher = KeyHasher::new();
+        for (name, value) in fields {
+            hasher.field(name, value.as_bytes());
+        }
+        hasher.finish()
+    }
+
+    /// Returns an empty directory for a test to use as a cache
+    fn cache_dir(test: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!(
+            "lumen-object-cache-{}-{}",
+            test,
+            std::process::id()
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    fn write(path: &Path, contents: &str) -> PathBuf {
+        fs::write(path, contents).unwrap();
+        path.to_path_buf()
+    }
+
+    #[test]
+    fn key_depends_on_every_field() {
+        let base = [("target", "x86_64-apple-darwin"), ("module", "module {}")];
+        assert_eq!(key(&base), key(&base));
+        assert_eq!(key(&base).0.len(), 64);
+
+        assert_ne!(
+            key(&base),
+            key(&[
+                ("target", "x86_64-unknown-linux-gnu"),
+                ("module", "module {}")
+            ])
+        );
+        assert_ne!(
+            key(&base),
+            key(&[("target", "x86_64-apple-darwin"), ("module", "module { }")])
+        );
+        assert_ne!(key(&base), key(&base[..1]));
+    }
+
+    #[test]
+    fn key_does_not_depend_only_on_the_concatenated_fields() {
+        assert_ne!(
+            key(&[("cpu", "ab"), ("features", "c")]),
+            key(&[("cpu", "a"), ("features", "bc")])
+        );
+        assert_ne!(key(&[("cpu", "")]), key(&[("cp", "u")]));
+    }
+
+    #[test]
+    fn stored_objects_are_restored() {
+        let dir = cache_dir("restore");
+        let cache = ObjectCache {
+            dir: dir.join("cache"),
+        };
+        let key = key(&[("module", "restore")]);
+        let obj_path = dir.join("module.o");
+        let bc_path = dir.join("module.bc");
+
+        assert!(cache.restore(&key, &obj_path, None).unwrap().is_none());
+
+        let objects = vec![
+            write(&dir.join("a.o"), "unit 0"),
+            write(&dir.join("b.o"), "unit 1"),
+        ];
+        write(&bc_path, "bitcode");
+        cache.store(&key, &objects, Some(&bc_path)).unwrap();
+        fs::remove_file(&bc_path).unwrap();
+
+        let restored = cache
+            .restore(&key, &obj_path, Some(&bc_path))
+            .unwrap()
+            .unwrap();
+        assert_eq!(restored.objects.len(), 2);
+        for (restored, contents) in restored.objects.iter().zip(&["unit 0", "unit 1"]) {
+            assert_eq!(&fs::read_to_string(restored).unwrap(), contents);
+        }
+        assert_eq!(restored.bytecode.as_ref(), Some(&bc_path));
+        assert_eq!(fs::read_to_string(&bc_path).unwrap(), "bitcode");
+
+        let _ = fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn existing_entries_are_kept() {
+        let dir = cache_dir("existing");
+        let cache = ObjectCache {
+            dir: dir.join("cache"),
+        };
+        let key = key(&[("module", "existing")]);
+        let obj_path = dir.join("module.o");
+
+        let first = write(&dir.join("first.o"), "first");
+        cache.store(&key, &[first], None).unwrap();
+        let second = write(&dir.join("second.o"), "second");
+        cache.store(&key, &[second], None).unwrap();
+
+        let restored = cache.restore(&key, &obj_path, None).unwrap().unwrap();
+        assert_eq!(restored.objects, vec![obj_path.clone()]);
+        assert_eq!(fs::read_to_string(&obj_path).unwrap(), "first");
+
+        // An entry without bitcode can't satisfy a request for it
+        let bc_path = dir.join("module.bc");
+        assert!(cache
+            .restore(&key, &obj_path, Some(&bc_path))
+            .unwrap()
+            .is_none());
+
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
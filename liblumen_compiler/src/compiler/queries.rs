@@ -1,16 +1,19 @@
+use std::io::Write;
 use std::ops::Deref;
 use std::sync::Arc;
-use std::thread::{self, ThreadId};
 
 use anyhow::anyhow;
 
 use log::debug;
 
 use liblumen_codegen::mlir::{self, Dialect, GeneratedModule};
+use liblumen_codegen::pool::ContextId;
+use liblumen_codegen::stats::{self, Stage};
 use liblumen_codegen::{self as codegen, codegen::CompiledModule, llvm};
 use liblumen_incremental::{InternedInput, QueryResult};
-use liblumen_session::{Input, InputType, OutputType};
+use liblumen_session::{Input, InputType, Options, OutputType};
 
+use crate::compiler::cache::ObjectCache;
 use crate::compiler::query_groups::*;
 
 macro_rules! to_query_result {
@@ -22,31 +25,21 @@ macro_rules! to_query_result {
     };
 }
 
-/// Create context for MLIR
-pub(super) fn mlir_context<C>(_db: &C, thread_id: ThreadId) -> Arc<mlir::Context>
-where
-    C: CodegenDatabase,
-{
-    use codegen::mlir::Context;
-    debug!("constructing new mlir context for thread {:?}", thread_id);
-    Arc::new(Context::new(thread_id))
-}
-
 /// Parse MLIR source file
 pub(super) fn parse_mlir_module<C>(
     db: &C,
-    thread_id: ThreadId,
+    context_id: ContextId,
     input: InternedInput,
 ) -> QueryResult<Arc<mlir::Module>>
 where
     C: CodegenDatabase,
 {
     let input_info = db.lookup_intern_input(input);
-    let context = db.mlir_context(thread_id);
+    let context = db.mlir_context(context_id);
 
     let parsed = match input_info {
         Input::File(ref path) => {
-            debug!("parsing mlir from file for {:?} on {:?}", input, thread_id);
+            debug!("parsing mlir from file for {:?} on {:?}", input, context_id);
             to_query_result!(db, context.parse_file(path))
         }
         Input::Str {
@@ -56,7 +49,7 @@ where
         } => {
             debug!(
                 "parsing mlir from string for {:?} on {:?}",
-                input, thread_id
+                input, context_id
             );
             to_query_result!(db, context.parse_string(input, name))
         }
@@ -67,18 +60,21 @@ where
 /// Convert EIR to MLIR/EIR
 pub(super) fn generate_mlir<C>(
     db: &C,
-    thread_id: ThreadId,
+    context_id: ContextId,
     input: InternedInput,
 ) -> QueryResult<Arc<mlir::Module>>
 where
     C: CodegenDatabase,
 {
     let module = db.input_eir(input)?;
-    let context = db.mlir_context(thread_id);
+    let context = db.mlir_context(context_id);
     let options = db.options();
-    debug!("generating mlir for {:?} on {:?}", input, thread_id);
-    let target_machine = db.get_target_machine(thread_id);
-    match mlir::builder::build(&module, &context, &options, target_machine.deref()) {
+    debug!("generating mlir for {:?} on {:?}", input, context_id);
+    let target_machine = db.get_target_machine(context_id);
+    let built = stats::time_stage(&options, Stage::Build, || {
+        mlir::builder::build(&module, &context, &options, target_machine.deref())
+    });
+    match built {
         Ok(GeneratedModule {
             module: mlir_module,
             atoms,
@@ -99,7 +95,7 @@ where
 /// Either load MLIR input directly, or lower EIR to MLIR, depending on type of input
 pub(super) fn get_eir_dialect_module<C>(
     db: &C,
-    thread_id: ThreadId,
+    context_id: ContextId,
     input: InternedInput,
 ) -> QueryResult<Arc<mlir::Module>>
 where
@@ -108,14 +104,14 @@ where
     match db.input_type(input) {
         InputType::Erlang => {
             debug!("input {:?} is erlang", input);
-            Ok(db.generate_mlir(thread_id, input)?)
+            Ok(db.generate_mlir(context_id, input)?)
         }
         InputType::MLIR => {
             debug!("input {:?} is mlir", input);
-            Ok(db.parse_mlir_module(thread_id, input)?)
+            Ok(db.parse_mlir_module(context_id, input)?)
         }
         InputType::Unknown(None) => {
-            debug!("unknown input type for {:?} on {:?}", input, thread_id);
+            debug!("unknown input type for {:?} on {:?}", input, context_id);
             db.diagnostics()
                 .error(anyhow!("invalid input, expected .erl or .mlir"));
             Err(())
@@ -123,7 +119,7 @@ where
         InputType::Unknown(Some(ref ext)) => {
             debug!(
                 "unsupported input type '{}' for {:?} on {:?}",
-                ext, input, thread_id
+                ext, input, context_id
             );
             db.diagnostics().error(anyhow!(
                 "invalid input extension ({}), expected .erl or .mlir",
@@ -134,83 +130,95 @@ where
     }
 }
 
+/// The name by which the codegen report is selected with `-C remark`
+const CODEGEN_REPORT_PASS: &'static str = "codegen-report";
+
 pub(super) fn get_llvm_dialect_module<C>(
     db: &C,
-    thread_id: ThreadId,
+    context_id: ContextId,
     input: InternedInput,
 ) -> QueryResult<Arc<mlir::Module>>
 where
     C: CodegenDatabase,
 {
     let options = db.options();
-    let context = db.mlir_context(thread_id);
-    let module = db.get_eir_dialect_module(thread_id, input)?;
+    let context = db.mlir_context(context_id);
+    let module = db.get_eir_dialect_module(context_id, input)?;
 
     // Lower to LLVM dialect
     let (opt, _size) = codegen::ffi::util::to_llvm_opt_settings(options.opt_level);
     debug!(
         "lowering mlir to llvm dialect for {:?} on {:?} with opt-level={}",
-        input, thread_id, opt
+        input, context_id, opt
     );
-    let target_machine = db.get_target_machine(thread_id);
-    to_query_result!(
+    let target_machine = db.get_target_machine(context_id);
+    let enable_multithreading = !options.debugging_opts.no_parallel_mlir;
+    let input_info = db.lookup_intern_input(input);
+    let codegen_report = options
+        .output_types
+        .maybe_emit(&input_info, OutputType::CodegenReport)
+        .is_some();
+    let codegen_remarks = options.codegen_opts.remark.contains(CODEGEN_REPORT_PASS);
+    let report = to_query_result!(
         db,
-        module.lower(&context, Dialect::LLVM, opt, &target_machine)
+        stats::time_stage(&options, Stage::LowerToLLVMDialect, || {
+            module.lower(
+                &context,
+                Dialect::LLVM,
+                opt,
+                &target_machine,
+                enable_multithreading,
+                codegen_report,
+                codegen_remarks,
+            )
+        })
     );
 
     // Emit LLVM dialect
     db.maybe_emit_file_with_opts(&options, input, module.deref())?;
 
-    Ok(module)
-}
-
-/// Create context for LLVM
-pub(super) fn llvm_context<C>(_db: &C, thread_id: ThreadId) -> Arc<llvm::Context>
-where
-    C: CodegenDatabase,
-{
-    use codegen::llvm::Context;
-    debug!("constructing new llvm context for thread {:?}", thread_id);
-    Arc::new(Context::new())
-}
+    // Emit codegen report
+    if let Some(report) = report {
+        db.maybe_emit_file_with_callback_and_opts(
+            &options,
+            input,
+            OutputType::CodegenReport,
+            |outfile| {
+                debug!("emitting codegen report for {:?}", input);
+                outfile.write_all(report.as_bytes())?;
+                Ok(())
+            },
+        )?;
+    }
 
-pub(super) fn get_target_machine<C>(db: &C, thread_id: ThreadId) -> Arc<llvm::TargetMachine>
-where
-    C: CodegenDatabase,
-{
-    let options = db.options();
-    let diagnostics = db.diagnostics();
-    debug!("constructing new target machine for thread {:?}", thread_id);
-    Arc::new(codegen::target::create_target_machine(
-        &options,
-        diagnostics,
-        false,
-    ))
+    Ok(module)
 }
 
 pub(super) fn get_llvm_module<C>(
     db: &C,
-    thread_id: ThreadId,
+    context_id: ContextId,
     input: InternedInput,
 ) -> QueryResult<Arc<llvm::Module>>
 where
     C: CodegenDatabase,
 {
     let options = db.options();
-    let mlir_module = db.get_llvm_dialect_module(thread_id, input)?;
+    let mlir_module = db.get_llvm_dialect_module(context_id, input)?;
 
     // Convert to LLVM IR
     let (opt, size) = codegen::ffi::util::to_llvm_opt_settings(options.opt_level);
     debug!(
         "generating llvm for {:?} on {:?} with opt-level={} and size-level={}",
-        input, thread_id, opt, size
+        input, context_id, opt, size
     );
-    let target_machine = db.get_target_machine(thread_id);
+    let target_machine = db.get_target_machine(context_id);
     debug!("using target machine {:?}", &target_machine);
     let source_name = get_input_source_name(db, input);
     let module = to_query_result!(
         db,
-        mlir_module.lower_to_llvm_ir(source_name, opt, size, &target_machine)
+        stats::time_stage(&options, Stage::LowerToLLVMIR, || {
+            mlir_module.lower_to_llvm_ir(source_name, opt, size, &target_machine)
+        })
     );
 
     // Emit LLVM IR
@@ -230,11 +238,40 @@ where
     Ok(Arc::new(module))
 }
 
+/// Generates the LLVM IR for the given input as bitcode, for use by the JIT
+///
+/// Like `compile`, this checks out a context for the duration of the query, but
+/// rather than emitting object files, the module is serialized so that it can
+/// be reloaded in a context owned by the JIT once the pooled context is released.
+pub(super) fn get_llvm_bitcode<C>(db: &C, input: InternedInput) -> QueryResult<Arc<Vec<u8>>>
+where
+    C: CodegenDatabase,
+{
+    let pool = db.context_pool().clone();
+    let pooled = pool.checkout();
+    let context_id = pooled.id();
+
+    let input_info = db.lookup_intern_input(input);
+    db.diagnostics()
+        .success("Compiling", input_info.source_name());
+    debug!(
+        "generating bitcode for {:?} ({:?}) with context {}",
+        input, &input_info, context_id
+    );
+
+    let module = db.get_llvm_module(context_id, input)?;
+    Ok(Arc::new(module.to_bitcode()))
+}
+
 pub(super) fn compile<C>(db: &C, input: InternedInput) -> QueryResult<Arc<CompiledModule>>
 where
     C: CodegenDatabase,
 {
-    let thread_id = thread::current().id();
+    // Check out a context for the duration of this compilation unit; it is
+    // returned to the pool for use by other workers when this query returns
+    let pool = db.context_pool().clone();
+    let pooled = pool.checkout();
+    let context_id = pooled.id();
 
     let options = db.options();
     let input_info = db.lookup_intern_input(input);
@@ -242,15 +279,51 @@ where
 
     diagnostics.success("Compiling", input_info.source_name());
     debug!(
-        "compiling {:?} ({:?}) on thread {:?}",
-        input, &input_info, thread_id
+        "compiling {:?} ({:?}) with context {}",
+        input, &input_info, context_id
     );
 
+    let module_name = input_info.file_stem().to_string_lossy().into_owned();
+    let obj_path = options
+        .output_types
+        .maybe_emit(&input_info, OutputType::Object)
+        .map(|filename| db.output_dir().join(filename));
+    let bc_path = options
+        .output_types
+        .maybe_emit(&input_info, OutputType::LLVMBitcode)
+        .map(|filename| db.output_dir().join(filename));
+
+    // Consult the object cache, if enabled and no intermediate artifacts
+    // were requested; a hit skips lowering and code generation entirely
+    let cache = ObjectCache::new(&options)
+        .filter(|_| obj_path.is_some() && ObjectCache::is_cacheable(&options, &input_info));
+    let cache_key = if let Some(ref cache) = cache {
+        let eir_module = db.get_eir_dialect_module(context_id, input)?;
+        let key = cache.key(&options, &eir_module);
+        match cache.restore(&key, obj_path.as_deref().unwrap(), bc_path.as_deref()) {
+            Ok(Some(cached)) => {
+                debug!("reusing cached objects for {:?}", input);
+                return Ok(Arc::new(CompiledModule::with_objects(
+                    module_name,
+                    cached.objects,
+                    cached.bytecode,
+                )));
+            }
+            Ok(None) => Some(key),
+            Err(err) => {
+                diagnostics.warn(format!("unable to read from object cache: {}", err));
+                Some(key)
+            }
+        }
+    } else {
+        None
+    };
+
     // Get LLVM IR module
-    // We provide the current thread ID as part of the query, since the context
+    // We provide the pooled context ID as part of the query, since the context
     // object of an LLVM module is not thread-safe, we only want to fulfill a
-    // request for a module if the query occurs on the same thread
-    let module = db.get_llvm_module(thread_id, input)?;
+    // request for a module using the context we currently have checked out
+    let module = db.get_llvm_module(context_id, input)?;
 
     // Emit textual assembly file
     db.maybe_emit_file_with_callback_and_opts(&options, input, OutputType::Assembly, |outfile| {
@@ -258,26 +331,49 @@ where
         module.emit_asm(outfile)
     })?;
 
-    // Emit object file
-    let obj_path = db.maybe_emit_file_with_callback_and_opts(
-        &options,
-        input,
-        OutputType::Object,
-        |outfile| {
-            debug!("emitting object file for {:?}", input);
-            module.emit_obj(outfile)
-        },
-    )?;
+    // Emit object file(s)
+    let num_units = codegen_units(&options, &module);
+    let obj_paths = stats::time_stage(&options, Stage::Emit, || -> QueryResult<Vec<_>> {
+        if num_units > 1 {
+            match obj_path {
+                None => Ok(Vec::new()),
+                Some(ref obj_path) => {
+                    let unit_paths = (0..num_units)
+                        .map(|i| obj_path.with_extension(format!("cgu{}.o", i)))
+                        .collect::<Vec<_>>();
+                    debug!(
+                        "emitting object files for {:?} as {} codegen units",
+                        input, num_units
+                    );
+                    to_query_result!(db, module.emit_obj_units(&unit_paths));
+                    Ok(unit_paths)
+                }
+            }
+        } else {
+            let obj_path = db.maybe_emit_file_with_callback_and_opts(
+                &options,
+                input,
+                OutputType::Object,
+                |outfile| {
+                    debug!("emitting object file for {:?}", input);
+                    module.emit_obj(outfile)
+                },
+            )?;
+            Ok(obj_path.into_iter().collect())
+        }
+    })?;
 
-    // Gather compiled module metadata
-    let bc_path = options
-        .output_types
-        .maybe_emit(&input_info, OutputType::LLVMBitcode)
-        .map(|filename| db.output_dir().join(filename));
+    // Populate the object cache for subsequent compilations
+    if let (Some(cache), Some(key)) = (cache, cache_key) {
+        if let Err(err) = cache.store(&key, &obj_paths, bc_path.as_deref()) {
+            diagnostics.warn(format!("unable to write to object cache: {}", err));
+        }
+    }
 
-    let compiled = Arc::new(CompiledModule::new(
-        input_info.file_stem().to_string_lossy().into_owned(),
-        obj_path,
+    // Gather compiled module metadata
+    let compiled = Arc::new(CompiledModule::with_objects(
+        module_name,
+        obj_paths,
         bc_path,
     ));
 
@@ -285,6 +381,37 @@ where
     Ok(compiled)
 }
 
+/// The number of functions below which splitting a module into multiple
+/// codegen units costs more than it saves
+const MIN_FUNCTIONS_PER_CODEGEN_UNIT: usize = 256;
+
+/// Determines how many codegen units to split the given module into
+///
+/// If `-C codegen-units` was given, it is used as an upper bound, otherwise
+/// large modules are split across the available cores. Small modules are never
+/// split, as the cost of partitioning and re-parsing outweighs the gain, and
+/// nothing is split under `-Z no-parallel-llvm`, as the units are emitted in
+/// parallel.
+fn codegen_units(options: &Options, module: &llvm::Module) -> usize {
+    // LLVM's pass timers cannot be used concurrently, see `stats::llvm_timing_enabled`
+    if options.debugging_opts.no_parallel_llvm || codegen::stats::llvm_timing_enabled(options) {
+        return 1;
+    }
+    let max_units = options
+        .codegen_opts
+        .codegen_units
+        .map(|n| n as usize)
+        .unwrap_or_else(num_cpus::get)
+        .max(1);
+    num_codegen_units(module.num_defined_functions(), max_units)
+}
+
+fn num_codegen_units(num_functions: usize, max_units: usize) -> usize {
+    (num_functions / MIN_FUNCTIONS_PER_CODEGEN_UNIT)
+        .max(1)
+        .min(max_units)
+}
+
 fn get_input_source_name<C>(db: &C, input: InternedInput) -> Option<String>
 where
     C: CodegenDatabase,
@@ -296,3 +423,28 @@ where
         Input::Str { ref name, .. } => Some(name.clone()),
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const MIN: usize = MIN_FUNCTIONS_PER_CODEGEN_UNIT;
+
+    #[test]
+    fn small_modules_are_not_split() {
+        assert_eq!(num_codegen_units(0, 8), 1);
+        assert_eq!(num_codegen_units(MIN * 2 - 1, 8), 1);
+    }
+
+    #[test]
+    fn units_have_a_minimum_number_of_functions() {
+        assert_eq!(num_codegen_units(MIN * 2, 8), 2);
+        assert_eq!(num_codegen_units(MIN * 5 + 1, 8), 5);
+    }
+
+    #[test]
+    fn units_are_bounded_by_the_maximum() {
+        assert_eq!(num_codegen_units(MIN * 100, 8), 8);
+        assert_eq!(num_codegen_units(MIN * 100, 1), 1);
+    }
+}
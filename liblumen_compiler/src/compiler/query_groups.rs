@@ -1,10 +1,10 @@
 use std::collections::HashSet;
 use std::sync::Arc;
-use std::thread::ThreadId;
 
 use liblumen_codegen::codegen::CompiledModule;
 use liblumen_codegen::llvm;
 use liblumen_codegen::mlir;
+use liblumen_codegen::pool::{ContextId, ContextPool};
 use liblumen_core::symbols::FunctionSymbol;
 use liblumen_incremental::ParserDatabase;
 use liblumen_incremental::{InternedInput, QueryResult};
@@ -14,50 +14,44 @@ use crate::compiler::queries;
 
 #[salsa::query_group(CodegenStorage)]
 pub trait CodegenDatabase: CodegenDatabaseBase {
-    #[salsa::invoke(queries::mlir_context)]
-    fn mlir_context(&self, thread_id: ThreadId) -> Arc<mlir::Context>;
-
     #[salsa::invoke(queries::parse_mlir_module)]
     fn parse_mlir_module(
         &self,
-        thread_id: ThreadId,
+        context_id: ContextId,
         input: InternedInput,
     ) -> QueryResult<Arc<mlir::Module>>;
 
     #[salsa::invoke(queries::generate_mlir)]
     fn generate_mlir(
         &self,
-        thread_id: ThreadId,
+        context_id: ContextId,
         input: InternedInput,
     ) -> QueryResult<Arc<mlir::Module>>;
 
     #[salsa::invoke(queries::get_eir_dialect_module)]
     fn get_eir_dialect_module(
         &self,
-        thread_id: ThreadId,
+        context_id: ContextId,
         input: InternedInput,
     ) -> QueryResult<Arc<mlir::Module>>;
 
     #[salsa::invoke(queries::get_llvm_dialect_module)]
     fn get_llvm_dialect_module(
         &self,
-        thread_id: ThreadId,
+        context_id: ContextId,
         input: InternedInput,
     ) -> QueryResult<Arc<mlir::Module>>;
 
-    #[salsa::invoke(queries::llvm_context)]
-    fn llvm_context(&self, thread_id: ThreadId) -> Arc<llvm::Context>;
-
-    #[salsa::invoke(queries::get_target_machine)]
-    fn get_target_machine(&self, thread_id: ThreadId) -> Arc<llvm::TargetMachine>;
-
     #[salsa::invoke(queries::get_llvm_module)]
     fn get_llvm_module(
         &self,
-        thread_id: ThreadId,
+        context_id: ContextId,
         input: InternedInput,
     ) -> QueryResult<Arc<llvm::Module>>;
 
+    #[salsa::invoke(queries::get_llvm_bitcode)]
+    fn get_llvm_bitcode(&self, input: InternedInput) -> QueryResult<Arc<Vec<u8>>>;
+
     #[salsa::invoke(queries::compile)]
     fn compile(&self, input: InternedInput) -> QueryResult<Arc<CompiledModule>>;
 }
@@ -69,6 +63,20 @@ pub trait StringInternerDatabase: salsa::Database {
 }
 
 pub trait CodegenDatabaseBase: ParserDatabase + StringInternerDatabase {
+    /// The pool of MLIR/LLVM contexts shared by all workers
+    fn context_pool(&self) -> &Arc<ContextPool>;
+    /// The MLIR context for the given pool slot
+    fn mlir_context(&self, context_id: ContextId) -> Arc<mlir::Context> {
+        self.context_pool().get(context_id).mlir.clone()
+    }
+    /// The LLVM context for the given pool slot
+    fn llvm_context(&self, context_id: ContextId) -> Arc<llvm::Context> {
+        self.context_pool().get(context_id).llvm.clone()
+    }
+    /// The target machine for the given pool slot
+    fn get_target_machine(&self, context_id: ContextId) -> Arc<llvm::TargetMachine> {
+        self.context_pool().get(context_id).target_machine.clone()
+    }
     fn take_atoms(&mut self) -> HashSet<libeir_intern::Symbol>;
     fn add_atoms<'a, I>(&self, atoms: I)
     where
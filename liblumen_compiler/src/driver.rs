@@ -43,6 +43,9 @@ pub fn run_compiler_with_emitter(
             cwd,
             emitter,
         ),
+        ("run", subcommand_matches) => {
+            commands::run::handle_command(c_opts, z_opts, subcommand_matches.unwrap(), cwd, emitter)
+        }
         (subcommand, _) => unimplemented!("subcommand '{}' is not implemented", subcommand),
     }
 }
@@ -1,18 +1,218 @@
-/// This struct represents the serialized form of an atom table entry
+use core::slice;
+
+use crate::util::phf::{self, Displacement, Hashes};
+
+/// This struct represents the serialized form of the atom table
 ///
 /// Constant atoms found during compilation are serialized into a static
-/// atom table which seeds the runtime atom table during initialization,
-/// in order to connect the values of those constant atoms to the runtime
+/// atom table, which the runtime uses in place as the first level of its
+/// atom table; atoms created dynamically at runtime are stored in a separate
+/// overflow table. In order to connect the values of constant atoms to the
 /// table entries, we serialize both the string value and the id, so that
 /// constant usages can be replaced with a constant term value, and the
 /// atom table will reflect the same data (i.e. the id matches the string)
+///
+/// Lookups by name use a minimal perfect hash generated by the compiler (see
+/// `util::phf`), so no hashing or allocation is required at startup.
+///
+/// NOTE: This is emitted by the compiler in `liblumen_codegen::atoms`, the
+/// layout of these structs must be kept in sync with it
+#[repr(C)]
+pub struct StaticAtomTable {
+    /// The seed used to hash atom strings
+    pub seed: u64,
+    /// The number of atoms in the table
+    pub len: usize,
+    /// One greater than the largest atom id in the table
+    pub id_limit: usize,
+    /// The number of displacements, i.e. hash buckets
+    pub num_displacements: usize,
+    /// The displacements for each hash bucket
+    pub displacements: *const Displacement,
+    /// The id of the atom in each hash slot, has `len` entries
+    pub slots: *const u32,
+    /// The data for each atom, indexed by id, has `id_limit` entries
+    pub atoms: *const AtomData,
+    /// The bytes of all atom strings, laid out contiguously
+    pub strings: *const u8,
+}
+
+/// The serialized form of a single atom in the `StaticAtomTable`
 #[repr(C)]
-pub struct ConstantAtom {
-    // The id of the atom, which will be used as the id in term form
-    pub id: usize,
-    // The string value of the atom.
-    //
-    // We use i8 here, which is equivalent to libc::c_char, but libc
-    // is not universally available in this crate, so we use the former
-    pub value: *const i8,
+#[derive(Debug, Copy, Clone)]
+pub struct AtomData {
+    /// The hash of the atom string, using the seed of the table
+    pub hash: u64,
+    /// The offset of the atom string in the table's string data
+    pub offset: u32,
+    /// The length of the atom string in bytes, or `AtomData::UNUSED`
+    /// if no atom has this id
+    pub len: u32,
+}
+impl AtomData {
+    pub const UNUSED: u32 = u32::max_value();
+}
+
+impl StaticAtomTable {
+    /// Returns the id of the atom with the given name, if it is in this table
+    pub fn get_id(&'static self, name: &[u8]) -> Option<usize> {
+        let hash = phf::hash_bytes(self.seed, name);
+        let slot = phf::index(&Hashes::new(hash), self.displacements(), self.len)?;
+        let id = unsafe { *self.slots.add(slot) } as usize;
+        let data = self.get_data(id)?;
+        if data.hash != hash {
+            return None;
+        }
+        if self.get_bytes(data) != name {
+            return None;
+        }
+        Some(id)
+    }
+
+    /// Returns the string of the atom with the given id, if it is in this table
+    pub fn get_name(&'static self, id: usize) -> Option<&'static [u8]> {
+        self.get_data(id).map(|data| self.get_bytes(data))
+    }
+
+    /// Returns an iterator over the id and string of every atom in this table
+    pub fn iter(&'static self) -> impl Iterator<Item = (usize, &'static [u8])> {
+        (0..self.id_limit).filter_map(move |id| self.get_name(id).map(|name| (id, name)))
+    }
+
+    #[inline]
+    fn displacements(&'static self) -> &'static [Displacement] {
+        if self.num_displacements == 0 {
+            return &[];
+        }
+        unsafe { slice::from_raw_parts(self.displacements, self.num_displacements) }
+    }
+
+    #[inline]
+    fn get_data(&'static self, id: usize) -> Option<&'static AtomData> {
+        if id >= self.id_limit {
+            return None;
+        }
+        let data = unsafe { &*self.atoms.add(id) };
+        if data.len == AtomData::UNUSED {
+            None
+        } else {
+            Some(data)
+        }
+    }
+
+    #[inline]
+    fn get_bytes(&'static self, data: &'static AtomData) -> &'static [u8] {
+        unsafe { slice::from_raw_parts(self.strings.add(data.offset as usize), data.len as usize) }
+    }
+}
+
+// These are safe to implement because the table is static and immutable
+unsafe impl Sync for StaticAtomTable {}
+unsafe impl Send for StaticAtomTable {}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Builds a table, as the compiler does, from atoms given by id, where `None`
+    /// is an id which no atom has
+    fn table(atoms: &[Option<&str>]) -> &'static StaticAtomTable {
+        let names: Vec<(usize, &str)> = atoms
+            .iter()
+            .enumerate()
+            .filter_map(|(id, name)| name.map(|name| (id, name)))
+            .collect();
+        let state = phf::generate(names.len(), |seed, i| {
+            phf::hash_bytes(seed, names[i].1.as_bytes())
+        });
+
+        let mut strings = Vec::new();
+        let mut data = vec![
+            AtomData {
+                hash: 0,
+                offset: 0,
+                len: AtomData::UNUSED,
+            };
+            atoms.len()
+        ];
+        for &(id, name) in &names {
+            data[id] = AtomData {
+                hash: phf::hash_bytes(state.seed, name.as_bytes()),
+                offset: strings.len() as u32,
+                len: name.len() as u32,
+            };
+            strings.extend_from_slice(name.as_bytes());
+        }
+        let slots: Vec<u32> = state.map.iter().map(|&i| names[i].0 as u32).collect();
+
+        Box::leak(Box::new(StaticAtomTable {
+            seed: state.seed,
+            len: names.len(),
+            id_limit: atoms.len(),
+            num_displacements: state.displacements.len(),
+            displacements: Box::leak(state.displacements.into_boxed_slice()).as_ptr(),
+            slots: Box::leak(slots.into_boxed_slice()).as_ptr(),
+            atoms: Box::leak(data.into_boxed_slice()).as_ptr(),
+            strings: Box::leak(strings.into_boxed_slice()).as_ptr(),
+        }))
+    }
+
+    const ATOMS: &[Option<&str>] = &[
+        Some("false"),
+        Some("true"),
+        None,
+        Some("ok"),
+        Some("error"),
+        None,
+        Some("undefined"),
+        Some(""),
+    ];
+
+    #[test]
+    fn atoms_are_found_by_name_and_id() {
+        let table = table(ATOMS);
+
+        for (id, name) in ATOMS.iter().enumerate() {
+            match name {
+                Some(name) => {
+                    assert_eq!(table.get_id(name.as_bytes()), Some(id));
+                    assert_eq!(table.get_name(id), Some(name.as_bytes()));
+                }
+                None => assert_eq!(table.get_name(id), None),
+            }
+        }
+        assert_eq!(table.get_name(ATOMS.len()), None);
+    }
+
+    #[test]
+    fn other_names_are_not_found() {
+        let table = table(ATOMS);
+
+        // Each lands in the slot of some atom in the table, which must not match
+        for name in &["nil", "okay", "o", "True", "undefined "] {
+            assert_eq!(table.get_id(name.as_bytes()), None, "{}", name);
+        }
+    }
+
+    #[test]
+    fn iter_skips_unused_ids() {
+        let table = table(ATOMS);
+
+        let atoms: Vec<(usize, &[u8])> = table.iter().collect();
+        let expected: Vec<(usize, &[u8])> = ATOMS
+            .iter()
+            .enumerate()
+            .filter_map(|(id, name)| name.map(|name| (id, name.as_bytes())))
+            .collect();
+        assert_eq!(atoms, expected);
+    }
+
+    #[test]
+    fn empty_table_finds_nothing() {
+        let table = table(&[]);
+
+        assert_eq!(table.get_id(b"ok"), None);
+        assert_eq!(table.get_name(0), None);
+        assert_eq!(table.iter().count(), 0);
+    }
 }
@@ -0,0 +1,196 @@
+///! This module provides detection of the CPU features available to the
+///! runtime, along with the `multiversion!` macro, which is used to build
+///! functions that have one variant per feature level, selected on first use.
+use core::sync::atomic::{AtomicU8, Ordering};
+
+/// The feature levels for which specialised variants of bulk builtins are built
+///
+/// Levels are ordered, every level implies the features of the levels before it.
+///
+/// NOTE: The compiler selects specialised builtins by suffix, see
+/// `TargetInfo::getBuiltinSuffix` in `liblumen_codegen`, the suffixes
+/// returned by `FeatureLevel::suffix` must be kept in sync with it
+#[repr(u8)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, PartialOrd, Ord)]
+pub enum FeatureLevel {
+    /// No vector extensions are known to be available
+    Generic = 1,
+    /// SSE2, which is the baseline on x86_64
+    Sse2,
+    /// AVX2
+    Avx2,
+    /// AVX-512F and AVX-512BW
+    Avx512,
+}
+impl FeatureLevel {
+    /// Returns the feature level of the current CPU
+    ///
+    /// Detection is only performed once, the result is cached for subsequent calls
+    #[inline]
+    pub fn get() -> Self {
+        match LEVEL.load(Ordering::Relaxed) {
+            UNKNOWN => {
+                let level = detect();
+                LEVEL.store(level as u8, Ordering::Relaxed);
+                level
+            }
+            level => unsafe { core::mem::transmute::<u8, Self>(level) },
+        }
+    }
+
+    /// Returns the symbol suffix used by builtins specialised for this level
+    pub fn suffix(self) -> &'static str {
+        match self {
+            Self::Generic | Self::Sse2 => "",
+            Self::Avx2 => ".avx2",
+            Self::Avx512 => ".avx512",
+        }
+    }
+}
+
+const UNKNOWN: u8 = 0;
+
+static LEVEL: AtomicU8 = AtomicU8::new(UNKNOWN);
+
+#[cfg(target_arch = "x86_64")]
+fn detect() -> FeatureLevel {
+    use core::arch::x86_64::{__cpuid, __cpuid_count, _xgetbv};
+
+    // If the runtime itself was built for a CPU which supports these features,
+    // (i.e. with `-C target-cpu`), then there is no need to ask the CPU
+    if cfg!(all(target_feature = "avx512f", target_feature = "avx512bw")) {
+        return FeatureLevel::Avx512;
+    }
+    if cfg!(target_feature = "avx2") {
+        return FeatureLevel::Avx2;
+    }
+
+    unsafe {
+        if __cpuid(0).eax < 7 {
+            return FeatureLevel::Sse2;
+        }
+        // The OS must have enabled XSAVE, and be saving the AVX state
+        let leaf1 = __cpuid(1);
+        let osxsave = leaf1.ecx & (1 << 27) != 0;
+        let avx = leaf1.ecx & (1 << 28) != 0;
+        if !osxsave || !avx {
+            return FeatureLevel::Sse2;
+        }
+        let xcr0 = _xgetbv(0);
+        // XMM and YMM state
+        if xcr0 & 0x06 != 0x06 {
+            return FeatureLevel::Sse2;
+        }
+
+        let leaf7 = __cpuid_count(7, 0);
+        let avx2 = leaf7.ebx & (1 << 5) != 0;
+        let avx512f = leaf7.ebx & (1 << 16) != 0;
+        let avx512bw = leaf7.ebx & (1 << 30) != 0;
+        // Opmask, ZMM0-15 and ZMM16-31 state
+        let os_avx512 = xcr0 & 0xe0 == 0xe0;
+
+        if avx2 && avx512f && avx512bw && os_avx512 {
+            FeatureLevel::Avx512
+        } else if avx2 {
+            FeatureLevel::Avx2
+        } else {
+            FeatureLevel::Sse2
+        }
+    }
+}
+
+#[cfg(not(target_arch = "x86_64"))]
+#[inline(always)]
+fn detect() -> FeatureLevel {
+    FeatureLevel::Generic
+}
+
+/// Builds a function with one variant per `FeatureLevel`
+///
+/// Each variant is an instantiation of the given kernel, which should be marked
+/// `#[inline(always)]` so that it is compiled with the features of the variant.
+/// Kernels should be written so that LLVM can vectorize them, i.e. fixed-size
+/// chunks with no early exits inside of a chunk.
+///
+/// The variants are exported from the modules `generic`, `avx2` and `avx512`
+/// (the latter two only on x86_64), so that callers which already know the
+/// feature level can call them directly. The function itself dispatches to the
+/// best variant for the current CPU, the variant is selected on first call and
+/// cached in the same way that an ifunc resolver would.
+#[macro_export]
+macro_rules! multiversion {
+    ($(
+        $(#[$attr:meta])*
+        pub fn $name:ident($($arg:ident : $ty:ty),*) -> $ret:ty => $kernel:path;
+    )*) => {
+        /// Variants which use no vector extensions beyond the target baseline
+        pub mod generic {
+            #[allow(unused_imports)]
+            use super::*;
+
+            $(
+                #[inline]
+                pub fn $name($($arg: $ty),*) -> $ret {
+                    $kernel($($arg),*)
+                }
+            )*
+        }
+
+        /// Variants which require AVX2
+        #[cfg(target_arch = "x86_64")]
+        pub mod avx2 {
+            #[allow(unused_imports)]
+            use super::*;
+
+            $(
+                #[target_feature(enable = "avx2")]
+                pub unsafe fn $name($($arg: $ty),*) -> $ret {
+                    $kernel($($arg),*)
+                }
+            )*
+        }
+
+        /// Variants which require AVX-512F and AVX-512BW
+        #[cfg(target_arch = "x86_64")]
+        pub mod avx512 {
+            #[allow(unused_imports)]
+            use super::*;
+
+            $(
+                #[target_feature(enable = "avx2,avx512f,avx512bw")]
+                pub unsafe fn $name($($arg: $ty),*) -> $ret {
+                    $kernel($($arg),*)
+                }
+            )*
+        }
+
+        $(
+            $(#[$attr])*
+            #[inline]
+            pub fn $name($($arg: $ty),*) -> $ret {
+                use core::sync::atomic::{self, AtomicPtr};
+
+                type Variant = unsafe fn($($ty),*) -> $ret;
+
+                static SELECTED: AtomicPtr<()> = AtomicPtr::new(core::ptr::null_mut());
+
+                let mut selected = SELECTED.load(atomic::Ordering::Relaxed);
+                if selected.is_null() {
+                    let variant: Variant = match $crate::cpu::FeatureLevel::get() {
+                        #[cfg(target_arch = "x86_64")]
+                        $crate::cpu::FeatureLevel::Avx512 => avx512::$name,
+                        #[cfg(target_arch = "x86_64")]
+                        $crate::cpu::FeatureLevel::Avx2 => avx2::$name,
+                        _ => generic::$name,
+                    };
+                    selected = variant as *mut ();
+                    SELECTED.store(selected, atomic::Ordering::Relaxed);
+                }
+                unsafe {
+                    let variant = core::mem::transmute::<*mut (), Variant>(selected);
+                    variant($($arg),*)
+                }
+            }
+        )*
+    };
+}
@@ -16,6 +16,8 @@
 #![feature(slice_partition_dedup)]
 // Dynamic dispatch intrinsics
 #![feature(asm)]
+// Multiversioned builtins
+#![feature(avx512_target_feature)]
 
 #[cfg_attr(not(test), macro_use)]
 extern crate alloc as core_alloc;
@@ -26,6 +28,7 @@ extern crate test;
 pub mod alloc;
 pub mod atoms;
 pub mod cmp;
+pub mod cpu;
 pub mod locks;
 pub mod symbols;
 pub mod sys;
@@ -1,7 +1,9 @@
 use core::ffi::c_void;
 use core::mem;
+use core::slice;
 
 use crate::sys::dynamic_call::{self, DynamicCallee};
+use crate::util::phf::{self, Displacement, Hashes};
 
 /// This struct represents the serialized form of a symbol table entry
 ///
@@ -22,7 +24,8 @@ pub struct FunctionSymbol {
     ///
     /// To call the function, it is necessary to transmute this
     /// pointer to one of the correct type. All Erlang functions
-    /// expect terms, and return a term as result.
+    /// expect the process they run in, followed by terms, and
+    /// return a term as result.
     ///
     /// NOTE: The target type must be marked `extern "C"`, in order
     /// to ensure that the correct calling convention is used.
@@ -45,7 +48,8 @@ impl FunctionSymbol {
     ///
     ///   - They use the C calling convention
     ///   - They return a Term/usize value
-    ///   - They accept zero or more Term/usize values
+    ///   - They accept a pointer to the process they run in, followed by
+    ///     zero or more Term/usize values
     ///
     /// Should any of these rules fail to be followed, who knows what kind of
     /// madness will ensue - ideally things explode immediately, but more likely
@@ -59,21 +63,17 @@ impl FunctionSymbol {
     ///
     /// The use of `usize` in the arguments/return value here is due to the lack
     /// of a `Term` definition in this crate - but Term is always convertible to
-    /// `usize`, so it shouldn't be an issue in practice.
+    /// `usize`, so it shouldn't be an issue in practice. Likewise, `process` is
+    /// an opaque pointer to the `Process` the callee runs in, which is passed as
+    /// its implicit first argument.
     #[cfg(all(unix, target_arch = "x86_64"))]
-    pub unsafe fn invoke(&self, args: &[usize]) -> usize {
+    pub unsafe fn invoke(&self, process: *const c_void, args: &[usize]) -> usize {
         let arity = self.arity;
-        let num_args = args.len();
-        debug_assert_eq!(arity as usize, num_args, "mismatched arity!");
-        let args_ptr = args.as_ptr();
+        debug_assert_eq!(arity as usize, args.len(), "mismatched arity!");
 
         let f = mem::transmute::<*const c_void, DynamicCallee>(self.ptr);
 
-        if arity == 0 {
-            return f();
-        }
-
-        dynamic_call::apply(f, args_ptr, num_args)
+        dynamic_call::apply_with_process(f, process, args)
     }
 }
 
@@ -81,3 +81,233 @@ impl FunctionSymbol {
 // It is safe to do so, since the data is static and lives for the life of the program
 unsafe impl Sync for FunctionSymbol {}
 unsafe impl Send for FunctionSymbol {}
+
+/// This struct represents the serialized form of the dispatch table
+///
+/// The compiler emits one of these containing every function defined by
+/// the build, which the runtime uses in place to dispatch dynamic calls:
+///
+/// - Symbols are sorted by (module, function, arity), so the functions of
+/// each module are contiguous, and can be found via `modules`
+/// - Lookups by (module, function, arity) use a minimal perfect hash
+/// generated by the compiler (see `util::phf`), which maps each key to
+/// the index of its symbol
+///
+/// NOTE: This is emitted by the compiler in `liblumen_codegen::symbol_table`,
+/// the layout of these structs must be kept in sync with it
+#[repr(C)]
+pub struct StaticSymbolTable {
+    /// The seed used to hash symbols
+    pub seed: u64,
+    /// The number of symbols in the table
+    pub len: usize,
+    /// The number of displacements, i.e. hash buckets
+    pub num_displacements: usize,
+    /// The number of modules in the table
+    pub num_modules: usize,
+    /// The displacements for each hash bucket
+    pub displacements: *const Displacement,
+    /// The index in `symbols` of the symbol in each hash slot, has `len` entries
+    pub slots: *const u32,
+    /// All symbols, sorted by (module, function, arity), has `len` entries
+    pub symbols: *const FunctionSymbol,
+    /// The range of `symbols` of each module, sorted by module, has `num_modules` entries
+    pub modules: *const ModuleSymbols,
+}
+
+/// The range of symbols belonging to a single module in the `StaticSymbolTable`
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct ModuleSymbols {
+    /// Module name atom
+    pub module: usize,
+    /// The index of the first symbol of this module
+    pub start: u32,
+    /// The number of symbols in this module
+    pub len: u32,
+}
+
+impl StaticSymbolTable {
+    /// Hashes a symbol key with the given seed
+    ///
+    /// This is used both to generate the table and to look up symbols in it
+    #[inline]
+    pub fn hash(seed: u64, module: usize, function: usize, arity: u8) -> u64 {
+        phf::hash_words(seed, &[module as u64, function as u64, arity as u64])
+    }
+
+    /// Returns the symbol for the given function, if it is in this table
+    #[inline]
+    pub fn get(
+        &'static self,
+        module: usize,
+        function: usize,
+        arity: u8,
+    ) -> Option<&'static FunctionSymbol> {
+        self.get_index(module, function, arity)
+            .map(|index| &self.symbols()[index])
+    }
+
+    /// Returns the index in `symbols` of the given function, if it is in this table
+    pub fn get_index(&'static self, module: usize, function: usize, arity: u8) -> Option<usize> {
+        let hash = Self::hash(self.seed, module, function, arity);
+        let slot = phf::index(&Hashes::new(hash), self.displacements(), self.len)?;
+        let index = unsafe { *self.slots.add(slot) } as usize;
+        let symbol = &self.symbols()[index];
+        if symbol.module == module && symbol.function == function && symbol.arity == arity {
+            Some(index)
+        } else {
+            None
+        }
+    }
+
+    /// Returns the symbols of all functions in the given module, sorted by (function, arity)
+    pub fn get_module(&'static self, module: usize) -> Option<&'static [FunctionSymbol]> {
+        let modules = self.modules();
+        let index = modules.binary_search_by_key(&module, |m| m.module).ok()?;
+        let ModuleSymbols { start, len, .. } = modules[index];
+        let start = start as usize;
+        Some(&self.symbols()[start..(start + len as usize)])
+    }
+
+    /// Returns the symbols of all functions in this table
+    #[inline]
+    pub fn symbols(&'static self) -> &'static [FunctionSymbol] {
+        if self.len == 0 {
+            return &[];
+        }
+        unsafe { slice::from_raw_parts(self.symbols, self.len) }
+    }
+
+    #[inline]
+    fn modules(&'static self) -> &'static [ModuleSymbols] {
+        if self.num_modules == 0 {
+            return &[];
+        }
+        unsafe { slice::from_raw_parts(self.modules, self.num_modules) }
+    }
+
+    #[inline]
+    fn displacements(&'static self) -> &'static [Displacement] {
+        if self.num_displacements == 0 {
+            return &[];
+        }
+        unsafe { slice::from_raw_parts(self.displacements, self.num_displacements) }
+    }
+}
+
+// These are safe to implement because the table is static and immutable
+unsafe impl Sync for StaticSymbolTable {}
+unsafe impl Send for StaticSymbolTable {}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use core::ptr;
+
+    /// Builds a table, as the compiler does, from symbols for the given
+    /// (module, function, arity) keys, pointing each symbol at its own index
+    fn table(keys: &[(usize, usize, u8)]) -> &'static StaticSymbolTable {
+        let mut symbols: Vec<FunctionSymbol> = keys
+            .iter()
+            .enumerate()
+            .map(|(i, &(module, function, arity))| FunctionSymbol {
+                module,
+                function,
+                arity,
+                ptr: i as *const c_void,
+            })
+            .collect();
+        symbols.sort_by_key(|s| (s.module, s.function, s.arity));
+
+        let state = phf::generate(symbols.len(), |seed, i| {
+            let s = &symbols[i];
+            StaticSymbolTable::hash(seed, s.module, s.function, s.arity)
+        });
+        let slots: Vec<u32> = state.map.iter().map(|&i| i as u32).collect();
+        let mut modules: Vec<ModuleSymbols> = Vec::new();
+        for (i, symbol) in symbols.iter().enumerate() {
+            match modules.last_mut() {
+                Some(last) if last.module == symbol.module => last.len += 1,
+                _ => modules.push(ModuleSymbols {
+                    module: symbol.module,
+                    start: i as u32,
+                    len: 1,
+                }),
+            }
+        }
+
+        Box::leak(Box::new(StaticSymbolTable {
+            seed: state.seed,
+            len: symbols.len(),
+            num_displacements: state.displacements.len(),
+            num_modules: modules.len(),
+            displacements: Box::leak(state.displacements.into_boxed_slice()).as_ptr(),
+            slots: Box::leak(slots.into_boxed_slice()).as_ptr(),
+            symbols: Box::leak(symbols.into_boxed_slice()).as_ptr(),
+            modules: Box::leak(modules.into_boxed_slice()).as_ptr(),
+        }))
+    }
+
+    fn keys() -> Vec<(usize, usize, u8)> {
+        let mut keys = Vec::new();
+        // Modules are deliberately not in order, nor of the same size
+        for &module in &[30, 10, 20] {
+            for function in 0..module {
+                keys.push((module, 100 + function, (function % 3) as u8));
+            }
+        }
+        keys
+    }
+
+    #[test]
+    fn get_finds_every_symbol() {
+        let keys = keys();
+        let table = table(&keys);
+
+        for (i, &(module, function, arity)) in keys.iter().enumerate() {
+            let symbol = table.get(module, function, arity).unwrap();
+            assert_eq!(symbol.ptr, i as *const c_void);
+            let index = table.get_index(module, function, arity).unwrap();
+            assert!(ptr::eq(&table.symbols()[index], symbol));
+        }
+    }
+
+    #[test]
+    fn get_does_not_find_other_symbols() {
+        let table = table(&keys());
+
+        // The module and function exist, but with another arity
+        assert!(table.get(10, 100, 1).is_none());
+        // The function exists, but in another module
+        assert!(table.get(10, 125, 1).is_none());
+        assert!(table.get(40, 100, 0).is_none());
+    }
+
+    #[test]
+    fn get_module_returns_its_symbols_in_order() {
+        let table = table(&keys());
+
+        for &module in &[10, 20, 30] {
+            let symbols = table.get_module(module).unwrap();
+            assert_eq!(symbols.len(), module);
+            assert!(symbols.iter().all(|s| s.module == module));
+            assert!(symbols
+                .windows(2)
+                .all(|pair| (pair[0].function, pair[0].arity) < (pair[1].function, pair[1].arity)));
+        }
+        assert!(table.get_module(0).is_none());
+        assert!(table.get_module(15).is_none());
+        assert!(table.get_module(40).is_none());
+    }
+
+    #[test]
+    fn empty_table_finds_nothing() {
+        let table = table(&[]);
+
+        assert!(table.symbols().is_empty());
+        assert!(table.get(10, 100, 0).is_none());
+        assert!(table.get_module(10).is_none());
+    }
+}
@@ -23,7 +23,36 @@ pub mod dynamic_call {
     #[cfg(all(unix, target_arch = "x86_64"))]
     pub use super::arch::dynamic_call::*;
 
+    #[cfg(all(unix, target_arch = "x86_64"))]
+    use core::ffi::c_void;
+    #[cfg(all(unix, target_arch = "x86_64"))]
+    use core::mem::MaybeUninit;
+
     pub type DynamicCallee = extern "C" fn() -> usize;
+
+    /// The largest number of arguments an Erlang function takes, besides its process
+    pub const MAX_ARITY: usize = u8::max_value() as usize;
+
+    /// Calls `f` with `process` followed by `args`, as Erlang functions expect, see `apply`
+    ///
+    /// The arguments are gathered in a buffer on the stack, of which only the slots used
+    /// are written, so this does not allocate, and costs the same as `apply` otherwise.
+    #[cfg(all(unix, target_arch = "x86_64"))]
+    pub unsafe fn apply_with_process(
+        f: DynamicCallee,
+        process: *const c_void,
+        args: &[usize],
+    ) -> usize {
+        assert!(args.len() <= MAX_ARITY, "too many arguments");
+
+        let mut argv: [MaybeUninit<usize>; MAX_ARITY + 1] = MaybeUninit::uninit().assume_init();
+        argv[0] = MaybeUninit::new(process as usize);
+        for (slot, arg) in argv[1..].iter_mut().zip(args) {
+            *slot = MaybeUninit::new(*arg);
+        }
+
+        apply(f, argv.as_ptr() as *const usize, args.len() + 1)
+    }
 }
 
 pub mod sysconf {
@@ -114,6 +114,7 @@ pub unsafe fn apply(f: DynamicCallee, argv: *const usize, argc: usize) -> usize
 #[cfg(test)]
 mod tests {
     use super::*;
+    use core::ffi::c_void;
     use core::mem;
 
     #[test]
@@ -131,7 +132,33 @@ mod tests {
         assert_eq!(result, 33);
     }
 
+    #[test]
+    fn apply_with_process_test() {
+        let callee = spiller as *const ();
+        let callee = unsafe { mem::transmute::<*const (), DynamicCallee>(callee) };
+        let process = 0x1000 as *const c_void;
+        // Enough arguments that the last two, with the process, are spilled to the stack
+        let args = &[1, 2, 3, 4, 5, 6, 7];
+        let result = unsafe { crate::sys::dynamic_call::apply_with_process(callee, process, args) };
+
+        assert_eq!(result, 0x1000 + 140);
+    }
+
     extern "C" fn adder(x: usize, y: usize) -> usize {
         x + y
     }
+
+    // Weights each argument by its position, so the sum is only right if they are in order
+    extern "C" fn spiller(
+        process: usize,
+        a: usize,
+        b: usize,
+        c: usize,
+        d: usize,
+        e: usize,
+        f: usize,
+        g: usize,
+    ) -> usize {
+        process + a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g
+    }
 }
@@ -1,6 +1,8 @@
 ///! This module/namespace contains a variety of helpful utility
 ///! functions and types which are used throughout Lumen
+pub mod bytes;
 pub mod cache_padded;
+pub mod phf;
 pub mod pointer;
 pub mod reference;
 
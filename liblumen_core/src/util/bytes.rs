@@ -0,0 +1,314 @@
+///! Bulk operations on byte slices, used by the runtime when comparing,
+///! copying and validating binaries.
+///!
+///! Each operation is multiversioned (see `multiversion!`), with variants for
+///! SSE2, AVX2 and AVX-512 on x86_64, which are selected at runtime by the
+///! features of the CPU. Callers which already know the feature level, such as
+///! builtins specialised by the compiler, can call a variant directly, e.g.
+///! `bytes::avx2::eq`.
+use core::cmp::Ordering;
+use core::str::{self, Utf8Error};
+
+use crate::multiversion;
+
+/// The number of bytes processed per iteration by the vectorized kernels
+///
+/// This is the width of an AVX-512 register, narrower targets just use
+/// multiple registers per chunk
+const CHUNK: usize = 64;
+
+multiversion! {
+    /// Returns true if `lhs` and `rhs` contain the same bytes
+    pub fn eq(lhs: &[u8], rhs: &[u8]) -> bool => eq_kernel;
+
+    /// Compares `lhs` and `rhs` lexicographically, as `<[u8] as Ord>::cmp` does
+    pub fn compare(lhs: &[u8], rhs: &[u8]) -> Ordering => compare_kernel;
+
+    /// Returns the length of a prefix of `bytes` which is known to be ASCII
+    ///
+    /// The returned length may be shorter than the longest ASCII prefix, but
+    /// is always a multiple of the chunk size, or the length of `bytes`
+    pub fn ascii_prefix_len(bytes: &[u8]) -> usize => ascii_prefix_len_kernel;
+
+    /// Copies `src` to `dst` shifted left by `lshift` bits (1 to 7), i.e. each
+    /// output byte takes its high bits from the previous input byte, and its low
+    /// bits from the current one. `first` is used as the byte preceding `src[0]`.
+    ///
+    /// This is the inner loop of bitstring copies where the source and
+    /// destination have different bit offsets.
+    ///
+    /// Returns the last byte of `src`, or `first` if `src` is empty.
+    pub fn shift_copy(dst: &mut [u8], src: &[u8], first: u8, lshift: u32) -> u8 => shift_copy_kernel;
+}
+
+/// Converts `bytes` to a `&str`, as `core::str::from_utf8` does
+///
+/// The leading ASCII portion of the input, which for most binaries is all of it,
+/// is validated with the vectorized `ascii_prefix_len`, and only the remainder
+/// is passed to the standard validation routine.
+#[inline]
+pub fn to_str(bytes: &[u8]) -> Result<&str, Utf8Error> {
+    let ascii_len = ascii_prefix_len(bytes);
+    // An ASCII prefix always ends on a character boundary, so if the rest is valid,
+    // the whole string is valid. Otherwise, validate it all again to get an error
+    // with the correct offset, since `Utf8Error` can't be constructed directly.
+    match str::from_utf8(&bytes[ascii_len..]) {
+        Ok(_) => Ok(unsafe { str::from_utf8_unchecked(bytes) }),
+        Err(_) => str::from_utf8(bytes),
+    }
+}
+
+/// Returns the index of the first chunk in which `lhs` and `rhs` differ, or
+/// the number of whole chunks if they are equal up to that point
+#[inline(always)]
+fn first_mismatched_chunk(lhs: &[u8], rhs: &[u8]) -> usize {
+    let chunks = lhs.chunks_exact(CHUNK).zip(rhs.chunks_exact(CHUNK));
+    let mut index = 0;
+    for (l, r) in chunks {
+        let mut diff = 0u8;
+        for i in 0..CHUNK {
+            diff |= l[i] ^ r[i];
+        }
+        if diff != 0 {
+            break;
+        }
+        index += 1;
+    }
+    index
+}
+
+#[inline(always)]
+fn eq_kernel(lhs: &[u8], rhs: &[u8]) -> bool {
+    if lhs.len() != rhs.len() {
+        return false;
+    }
+    let chunks = lhs.len() / CHUNK;
+    if first_mismatched_chunk(lhs, rhs) != chunks {
+        return false;
+    }
+    let offset = chunks * CHUNK;
+    lhs[offset..] == rhs[offset..]
+}
+
+#[inline(always)]
+fn compare_kernel(lhs: &[u8], rhs: &[u8]) -> Ordering {
+    let offset = first_mismatched_chunk(lhs, rhs) * CHUNK;
+    // Either the chunk at `offset` contains the first difference, or there
+    // are less than a chunk's worth of bytes left in the shorter input
+    lhs[offset..].cmp(&rhs[offset..])
+}
+
+#[inline(always)]
+fn ascii_prefix_len_kernel(bytes: &[u8]) -> usize {
+    let mut len = 0;
+    for chunk in bytes.chunks_exact(CHUNK) {
+        let mut high = 0u8;
+        for i in 0..CHUNK {
+            high |= chunk[i];
+        }
+        if high & 0x80 != 0 {
+            return len;
+        }
+        len += CHUNK;
+    }
+    if bytes[len..].is_ascii() {
+        bytes.len()
+    } else {
+        len
+    }
+}
+
+#[inline(always)]
+fn shift_copy_kernel(dst: &mut [u8], src: &[u8], first: u8, lshift: u32) -> u8 {
+    debug_assert!(lshift > 0 && lshift < 8);
+    let len = src.len();
+    assert!(dst.len() >= len);
+    if len == 0 {
+        return first;
+    }
+    let rshift = 8 - lshift;
+    dst[0] = (first << lshift) | (src[0] >> rshift);
+    // Written in terms of two overlapping windows of the input so that there is
+    // no loop-carried dependency, which lets LLVM vectorize it
+    let (prev, next) = (&src[..len - 1], &src[1..]);
+    let dst = &mut dst[1..len];
+    for i in 0..(len - 1) {
+        dst[i] = (prev[i] << lshift) | (next[i] >> rshift);
+    }
+    src[len - 1]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn variants_agree_with_std() {
+        let mut lhs = [b'a'; 200];
+        let rhs = lhs;
+        assert!(eq(&lhs, &rhs));
+        assert_eq!(compare(&lhs, &rhs), Ordering::Equal);
+        assert_eq!(compare(&lhs[..150], &rhs), Ordering::Less);
+        assert_eq!(ascii_prefix_len(&lhs), lhs.len());
+
+        lhs[130] = b'b';
+        assert!(!eq(&lhs, &rhs));
+        assert_eq!(compare(&lhs, &rhs), Ordering::Greater);
+        assert_eq!(generic::compare(&rhs, &lhs), Ordering::Less);
+
+        lhs[70] = 0xc3;
+        lhs[71] = 0xa9;
+        assert_eq!(ascii_prefix_len(&lhs), CHUNK);
+        assert!(to_str(&lhs).is_ok());
+        lhs[71] = b'x';
+        assert_eq!(
+            to_str(&lhs).unwrap_err().valid_up_to(),
+            str::from_utf8(&lhs).unwrap_err().valid_up_to()
+        );
+
+        let src = [0b1010_0101u8; 100];
+        let mut dst = [0u8; 100];
+        let last = shift_copy(&mut dst, &src, 0b1111_0000, 3);
+        assert_eq!(last, src[99]);
+        assert_eq!(dst[0], 0b1000_0101);
+        assert_eq!(dst[1], 0b0010_1101);
+    }
+
+    /// The variants of each operation, as function pointers
+    struct Variant {
+        name: &'static str,
+        eq: unsafe fn(&[u8], &[u8]) -> bool,
+        compare: unsafe fn(&[u8], &[u8]) -> Ordering,
+        ascii_prefix_len: unsafe fn(&[u8]) -> usize,
+        shift_copy: unsafe fn(&mut [u8], &[u8], u8, u32) -> u8,
+    }
+
+    /// Returns the variants which the CPU running the tests supports
+    ///
+    /// The generic variants are the SSE2 ones on x86_64, as it is the baseline.
+    fn supported_variants() -> Vec<Variant> {
+        let mut variants = vec![Variant {
+            name: "generic",
+            eq: generic::eq,
+            compare: generic::compare,
+            ascii_prefix_len: generic::ascii_prefix_len,
+            shift_copy: generic::shift_copy,
+        }];
+        #[cfg(target_arch = "x86_64")]
+        {
+            if std::is_x86_feature_detected!("avx2") {
+                variants.push(Variant {
+                    name: "avx2",
+                    eq: avx2::eq,
+                    compare: avx2::compare,
+                    ascii_prefix_len: avx2::ascii_prefix_len,
+                    shift_copy: avx2::shift_copy,
+                });
+            }
+            if std::is_x86_feature_detected!("avx512f") && std::is_x86_feature_detected!("avx512bw")
+            {
+                variants.push(Variant {
+                    name: "avx512",
+                    eq: avx512::eq,
+                    compare: avx512::compare,
+                    ascii_prefix_len: avx512::ascii_prefix_len,
+                    shift_copy: avx512::shift_copy,
+                });
+            }
+        }
+        variants
+    }
+
+    /// Lengths either side of each chunk boundary, up to three chunks
+    fn lengths() -> Vec<usize> {
+        let mut lengths = vec![0, 1];
+        for chunks in 1..=3 {
+            let boundary = chunks * CHUNK;
+            lengths.extend_from_slice(&[boundary - 1, boundary, boundary + 1]);
+        }
+        lengths
+    }
+
+    fn bytes(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i % 127) as u8).collect()
+    }
+
+    #[test]
+    fn each_variant_agrees_with_std_around_chunk_boundaries() {
+        for variant in supported_variants() {
+            for len in lengths() {
+                let lhs = bytes(len);
+                let name = variant.name;
+                unsafe {
+                    assert!((variant.eq)(&lhs, &lhs), "{} eq, len {}", name, len);
+                    assert_eq!(
+                        (variant.compare)(&lhs, &lhs),
+                        Ordering::Equal,
+                        "{} compare, len {}",
+                        name,
+                        len
+                    );
+                    assert_eq!(
+                        (variant.ascii_prefix_len)(&lhs),
+                        len,
+                        "{} ascii_prefix_len, len {}",
+                        name,
+                        len
+                    );
+                }
+                if len == 0 {
+                    continue;
+                }
+
+                // A mismatch in the last byte, which is in the tail past the last whole
+                // chunk unless the length is a multiple of the chunk size
+                let mut rhs = lhs.clone();
+                rhs[len - 1] = 0xff;
+                unsafe {
+                    assert!(!(variant.eq)(&lhs, &rhs), "{} eq tail, len {}", name, len);
+                    assert_eq!(
+                        (variant.compare)(&lhs, &rhs),
+                        lhs.cmp(&rhs),
+                        "{} compare tail, len {}",
+                        name,
+                        len
+                    );
+                    assert_eq!(
+                        (variant.compare)(&rhs, &lhs),
+                        rhs.cmp(&lhs),
+                        "{} compare tail, len {}",
+                        name,
+                        len
+                    );
+                    assert_eq!(
+                        (variant.compare)(&lhs[..len - 1], &lhs),
+                        Ordering::Less,
+                        "{} compare prefix, len {}",
+                        name,
+                        len
+                    );
+                    assert_eq!(
+                        (variant.ascii_prefix_len)(&rhs),
+                        (len - 1) / CHUNK * CHUNK,
+                        "{} ascii_prefix_len tail, len {}",
+                        name,
+                        len
+                    );
+                }
+
+                for lshift in 1..8 {
+                    let mut expected = vec![0u8; len];
+                    let mut actual = vec![0u8; len];
+                    let mut previous = 0x5a;
+                    for (i, &byte) in rhs.iter().enumerate() {
+                        expected[i] = (previous << lshift) | (byte >> (8 - lshift));
+                        previous = byte;
+                    }
+                    let last = unsafe { (variant.shift_copy)(&mut actual, &rhs, 0x5a, lshift) };
+                    assert_eq!(last, rhs[len - 1], "{} shift_copy, len {}", name, len);
+                    assert_eq!(actual, expected, "{} shift_copy, len {}", name, len);
+                }
+            }
+        }
+    }
+}
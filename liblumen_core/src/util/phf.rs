@@ -0,0 +1,221 @@
+//! This module implements minimal perfect hashing for tables generated at compile time
+//!
+//! The compiler uses `generate` to build a hash function for a set of keys known
+//! at compile time, e.g. the atoms used by a program, and emits the resulting
+//! table as constant data in the executable. The runtime then uses `index` to look
+//! keys up in that table in place, without needing to build anything at startup.
+//!
+//! The scheme used is "hash, displace, and compress" (CHD), the same as `rust-phf`:
+//! keys are hashed into buckets of roughly `LAMBDA` keys, then each bucket is assigned
+//! a pair of displacements which map all of its keys to free slots in the table.
+use core_alloc::vec::Vec;
+
+/// The average number of keys per bucket
+const LAMBDA: usize = 5;
+
+const FNV_OFFSET_BASIS: u64 = 0xcbf2_9ce4_8422_2325;
+const FNV_PRIME: u64 = 0x0000_0100_0000_01b3;
+
+/// The pair of displacements assigned to a bucket
+///
+/// NOTE: This is emitted as `{ i32, i32 }` by the compiler, so the layout must not change
+#[repr(C)]
+#[derive(Debug, Copy, Clone, Default, PartialEq, Eq)]
+pub struct Displacement {
+    pub d1: u32,
+    pub d2: u32,
+}
+
+/// The values derived from the hash of a key which are used to place it in the table
+#[derive(Debug, Copy, Clone)]
+pub struct Hashes {
+    /// Selects the bucket
+    pub g: u32,
+    /// Scaled by the first displacement
+    pub f1: u32,
+    /// Offset by the second displacement
+    pub f2: u32,
+}
+impl Hashes {
+    /// Splits a 64-bit hash into the values used to place a key
+    #[inline]
+    pub fn new(hash: u64) -> Self {
+        let a = mix(hash);
+        let b = mix(a ^ FNV_OFFSET_BASIS);
+        Self {
+            g: (a >> 32) as u32,
+            f1: a as u32,
+            f2: b as u32,
+        }
+    }
+
+    #[inline]
+    fn displace(&self, disp: Displacement) -> u32 {
+        disp.d2
+            .wrapping_add(self.f1.wrapping_mul(disp.d1))
+            .wrapping_add(self.f2)
+    }
+}
+
+/// Hashes `bytes` using 64-bit FNV-1a, perturbed by `seed`
+///
+/// This is the hash used for all keys in a table, the seed is chosen by `generate`
+#[inline]
+pub fn hash_bytes(seed: u64, bytes: &[u8]) -> u64 {
+    let mut hash = FNV_OFFSET_BASIS ^ mix(seed);
+    for byte in bytes {
+        hash ^= *byte as u64;
+        hash = hash.wrapping_mul(FNV_PRIME);
+    }
+    hash
+}
+
+/// Hashes a sequence of words, see `hash_bytes`
+#[inline]
+pub fn hash_words(seed: u64, words: &[u64]) -> u64 {
+    let mut hash = FNV_OFFSET_BASIS ^ mix(seed);
+    for word in words {
+        hash ^= *word;
+        hash = hash.wrapping_mul(FNV_PRIME);
+    }
+    hash
+}
+
+/// The finalizer from MurmurHash3, FNV alone does not distribute its low bits well
+#[inline]
+fn mix(mut hash: u64) -> u64 {
+    hash ^= hash >> 33;
+    hash = hash.wrapping_mul(0xff51_afd7_ed55_8ccd);
+    hash ^= hash >> 33;
+    hash = hash.wrapping_mul(0xc4ce_b9fe_1a85_ec53);
+    hash ^= hash >> 33;
+    hash
+}
+
+/// Returns the slot of the key with the given hashes, in a table of `len` slots
+///
+/// If the key is not in the table, this returns the slot of some other key, so callers
+/// must compare the key stored in that slot against the one being looked up.
+#[inline]
+pub fn index(hashes: &Hashes, displacements: &[Displacement], len: usize) -> Option<usize> {
+    if len == 0 || displacements.is_empty() {
+        return None;
+    }
+    let disp = displacements[(hashes.g as usize) % displacements.len()];
+    Some((hashes.displace(disp) as usize) % len)
+}
+
+/// The result of `generate`
+#[derive(Debug, Clone)]
+pub struct HashState {
+    /// The seed the keys must be hashed with
+    pub seed: u64,
+    /// The displacements of each bucket
+    pub displacements: Vec<Displacement>,
+    /// Maps each slot in the table to the index of the key placed there
+    pub map: Vec<usize>,
+}
+
+/// Generates a minimal perfect hash function for `len` keys
+///
+/// `hash` is called with a seed and the index of a key, and must return the hash of
+/// that key using the given seed (i.e. `hash_bytes(seed, key)`). Seeds are tried in
+/// order, so the result is deterministic for a given set of keys.
+pub fn generate<F>(len: usize, hash: F) -> HashState
+where
+    F: Fn(u64, usize) -> u64,
+{
+    (0u64..)
+        .find_map(|seed| try_generate(seed, len, &hash))
+        .expect("failed to generate perfect hash function")
+}
+
+struct Bucket {
+    idx: usize,
+    keys: Vec<usize>,
+}
+
+fn try_generate<F>(seed: u64, len: usize, hash: &F) -> Option<HashState>
+where
+    F: Fn(u64, usize) -> u64,
+{
+    if len == 0 {
+        return Some(HashState {
+            seed,
+            displacements: Vec::new(),
+            map: Vec::new(),
+        });
+    }
+
+    let hashes: Vec<Hashes> = (0..len).map(|i| Hashes::new(hash(seed, i))).collect();
+
+    let num_buckets = (len + LAMBDA - 1) / LAMBDA;
+    let mut buckets: Vec<Bucket> = (0..num_buckets)
+        .map(|idx| Bucket {
+            idx,
+            keys: Vec::new(),
+        })
+        .collect();
+    for (i, hashes) in hashes.iter().enumerate() {
+        buckets[(hashes.g as usize) % num_buckets].keys.push(i);
+    }
+    // Place the largest buckets first, while the table is mostly empty
+    buckets.sort_by(|a, b| b.keys.len().cmp(&a.keys.len()));
+
+    let mut map: Vec<Option<usize>> = vec![None; len];
+    let mut displacements = vec![Displacement::default(); num_buckets];
+    // Marks the slots claimed by the displacement currently being tried, so that
+    // the keys of a bucket do not collide with each other
+    let mut try_map = vec![0u64; len];
+    let mut generation = 0u64;
+    let mut values_to_add = Vec::new();
+
+    'buckets: for bucket in buckets.iter() {
+        for d1 in 0..(len as u32) {
+            'disps: for d2 in 0..(len as u32) {
+                let disp = Displacement { d1, d2 };
+                values_to_add.clear();
+                generation += 1;
+                for &key in bucket.keys.iter() {
+                    let idx = (hashes[key].displace(disp) as usize) % len;
+                    if map[idx].is_some() || try_map[idx] == generation {
+                        continue 'disps;
+                    }
+                    try_map[idx] = generation;
+                    values_to_add.push((idx, key));
+                }
+                displacements[bucket.idx] = disp;
+                for &(idx, key) in values_to_add.iter() {
+                    map[idx] = Some(key);
+                }
+                continue 'buckets;
+            }
+        }
+        // No displacement works for this bucket, try another seed
+        return None;
+    }
+
+    Some(HashState {
+        seed,
+        displacements,
+        map: map.into_iter().map(|key| key.unwrap()).collect(),
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn generates_minimal_perfect_hash() {
+        let keys: Vec<String> = (0..1000).map(|i| format!("key{}", i)).collect();
+        let state = generate(keys.len(), |seed, i| hash_bytes(seed, keys[i].as_bytes()));
+
+        assert_eq!(state.map.len(), keys.len());
+        for (i, key) in keys.iter().enumerate() {
+            let hashes = Hashes::new(hash_bytes(state.seed, key.as_bytes()));
+            let idx = index(&hashes, &state.displacements, keys.len()).unwrap();
+            assert_eq!(state.map[idx], i);
+        }
+    }
+}
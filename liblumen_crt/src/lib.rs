@@ -36,12 +36,12 @@ pub fn main_internal() -> i32 {
     use crate::symbols::*;
 
     // Initialize atom table
-    if unsafe { InitializeLumenAtomTable(ATOM_TABLE, NUM_ATOMS) } == false {
+    if unsafe { InitializeLumenAtomTable(&ATOM_TABLE) } == false {
         return 102;
     }
 
     // Initialize the dispatch table
-    if unsafe { InitializeLumenDispatchTable(SYMBOL_TABLE, NUM_SYMBOLS) } == false {
+    if unsafe { InitializeLumenDispatchTable(&SYMBOL_TABLE) } == false {
         return 103;
     }
 
@@ -20,6 +20,7 @@ use liblumen_alloc::erts::process::{Process, ProcessFlags};
 use liblumen_alloc::erts::term::prelude::*;
 
 use crate::module::{ErlangFunction, NativeFunctionKind, ResolvedFunction};
+use crate::tier::Tiering;
 use crate::vm::VMState;
 
 mod r#match;
@@ -217,8 +218,11 @@ impl CallExecutor {
                 self.run_native(vm, proc, native, args);
             }
             Some(ResolvedFunction::Erlang(fun)) => {
+                if let Some(tiering) = modules.tiering() {
+                    tiering.record_call(fun);
+                }
                 let entry = fun.fun.block_entry();
-                self.run_erlang(vm, proc, fun, entry, args);
+                self.run_erlang(vm, proc, modules.tiering(), fun, entry, args);
             }
         }
     }
@@ -246,7 +250,7 @@ impl CallExecutor {
                     self.binds.insert(v, *t);
                 }
 
-                self.run_erlang(vm, proc, fun, block, args);
+                self.run_erlang(vm, proc, modules.tiering(), fun, block, args);
             }
         }
     }
@@ -303,6 +307,7 @@ impl CallExecutor {
         &mut self,
         vm: &VMState,
         proc: &Arc<Process>,
+        tiering: Option<&Tiering>,
         fun: &ErlangFunction,
         mut block: Block,
         args: &mut [Term],
@@ -330,6 +335,13 @@ impl CallExecutor {
                 exec.run_erlang_op(vm, proc, fun, block)
             }) {
                 OpResult::Block(b) => {
+                    // Blocks are numbered in order of creation, which follows
+                    // the source, so a jump backwards is taken to be a loop
+                    if b.index() <= block.index() {
+                        if let Some(tiering) = tiering {
+                            tiering.record_back_edge(fun);
+                        }
+                    }
                     block = b;
                     continue;
                 }
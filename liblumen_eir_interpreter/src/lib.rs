@@ -3,9 +3,10 @@
 pub mod code;
 mod exec;
 mod module;
-pub use module::NativeModule;
+pub use module::{NativeFunctionKind, NativeModule};
 pub mod call_result;
 mod native;
+pub mod tier;
 mod vm;
 
 #[cfg(test)]
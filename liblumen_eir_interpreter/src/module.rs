@@ -8,6 +8,8 @@ use liblumen_alloc::erts::process::code::Result;
 use liblumen_alloc::erts::process::Process;
 use liblumen_alloc::erts::term::prelude::*;
 
+use crate::tier::{Counters, TierCompiler, TierConfig, Tiering};
+
 macro_rules! trace {
     ($($t:tt)*) => (lumen_runtime::system::io::puts(&format_args!($($t)*).to_string()))
 }
@@ -20,17 +22,44 @@ pub enum ResolvedFunction<'a> {
     Erlang(&'a ErlangFunction),
 }
 
+impl<'a> ResolvedFunction<'a> {
+    /// Resolves to `fun`, or to its compiled version if there is one
+    ///
+    /// Closures are not resolved through this, as they are created from, and
+    /// so still refer to, the blocks of the interpreted function.
+    fn erlang(fun: &'a ErlangFunction) -> Self {
+        match fun.counters.compiled() {
+            Some(native) => ResolvedFunction::Native(native),
+            None => ResolvedFunction::Erlang(fun),
+        }
+    }
+}
+
 pub struct ModuleRegistry {
     map: HashMap<Atom, ModuleType>,
+    tiering: Option<Tiering>,
 }
 
 impl ModuleRegistry {
     pub fn new() -> Self {
         ModuleRegistry {
             map: HashMap::new(),
+            tiering: None,
         }
     }
 
+    /// Enables tiered execution, see the `tier` module
+    ///
+    /// Functions called after this point are counted, and compiled with
+    /// `compiler` in the background once they become hot.
+    pub fn enable_tiering(&mut self, config: TierConfig, compiler: Arc<dyn TierCompiler>) {
+        self.tiering = Some(Tiering::new(config, compiler));
+    }
+
+    pub fn tiering(&self) -> Option<&Tiering> {
+        self.tiering.as_ref()
+    }
+
     pub fn register_erlang_module(&mut self, module: Module) {
         let erl_module = ErlangModule::from_eir(module);
         match self.map.remove(&erl_module.name) {
@@ -54,6 +83,8 @@ impl ModuleRegistry {
         };
     }
 
+    /// Resolves a call, to the compiled version of an Erlang function if
+    /// tiered execution has compiled it, see the `tier` module
     pub fn lookup_function(
         &self,
         module: Atom,
@@ -66,8 +97,7 @@ impl ModuleRegistry {
             Some(ModuleType::Erlang(erl)) => erl
                 .name_map
                 .get(&(function, arity))
-                .map(|i| &erl.funs[i])
-                .map(ResolvedFunction::Erlang),
+                .map(|i| ResolvedFunction::erlang(&erl.funs[i])),
             Some(ModuleType::Native(nat)) => nat
                 .functions
                 .get(&(function, arity))
@@ -79,8 +109,7 @@ impl ModuleRegistry {
                 } else {
                     erl.name_map
                         .get(&(function, arity))
-                        .map(|i| &erl.funs[i])
-                        .map(ResolvedFunction::Erlang)
+                        .map(|i| ResolvedFunction::erlang(&erl.funs[i]))
                 }
             }
         }
@@ -149,6 +178,8 @@ pub struct ErlangFunction {
     pub fun: Function,
     pub index: FunctionIndex,
     pub live: LiveValues,
+    /// Execution counters, used for tiered execution
+    pub counters: Arc<Counters>,
 }
 
 pub struct ErlangModule {
@@ -169,6 +200,7 @@ impl ErlangModule {
                     live: fun.live_values(),
                     index: fun_def.index(),
                     fun: fun.clone(),
+                    counters: Arc::new(Counters::new()),
                 };
                 (fun_def.index(), nfun)
             })
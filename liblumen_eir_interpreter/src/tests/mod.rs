@@ -292,3 +292,96 @@ run(N) -> this_proc(N, 0).
     println!("{:?}", res.result);
     //assert!(res.result == Ok(100));
 }
+
+#[test]
+fn tiered_compilation() {
+    use std::sync::Arc;
+    use std::thread;
+    use std::time::Duration;
+
+    use libeir_ir::Function;
+
+    use crate::module::{ModuleRegistry, ResolvedFunction};
+    use crate::tier::{TierCompiler, TierConfig};
+    use crate::NativeFunctionKind;
+
+    /// "Compiles" `tier_test:id/1` to the identity function, and refuses
+    /// everything else, which leaves it interpreted
+    struct IdentityCompiler;
+    impl TierCompiler for IdentityCompiler {
+        fn compile(&self, fun: &Function) -> anyhow::Result<NativeFunctionKind> {
+            let ident = fun.ident();
+            let module = Atom::try_from_str(ident.module.as_str()).unwrap();
+            let function = Atom::try_from_str(ident.name.as_str()).unwrap();
+            if module != Atom::try_from_str("tier_test").unwrap()
+                || function != Atom::try_from_str("id").unwrap()
+            {
+                anyhow::bail!("not compiled by this test");
+            }
+            Ok(NativeFunctionKind::Simple(|_process, args| Ok(args[0])))
+        }
+    }
+
+    let module = Atom::try_from_str("tier_test").unwrap();
+    let id = Atom::try_from_str("id").unwrap();
+    let run = Atom::try_from_str("run").unwrap();
+
+    let eir_mod = compile(
+        "
+-module(tier_test).
+
+id(X) -> X.
+
+run(0) -> done;
+run(N) -> id(N), run(N - 1).
+",
+    );
+
+    // Tiering is enabled on a registry of its own, rather than on the shared
+    // `VM`, so that the other tests keep running fully interpreted
+    let mut modules = ModuleRegistry::new();
+    modules.register_erlang_module(eir_mod);
+    let config = TierConfig {
+        call_threshold: 10,
+        back_edge_threshold: u32::max_value(),
+        num_workers: 1,
+    };
+    modules.enable_tiering(config, Arc::new(IdentityCompiler));
+
+    // Count calls as the interpreter does when it resolves a call
+    let tiering = modules.tiering().unwrap();
+    for _ in 0..10 {
+        for &function in &[id, run] {
+            match modules.lookup_function(module, function, 1) {
+                Some(ResolvedFunction::Erlang(fun)) => tiering.record_call(fun),
+                _ => panic!("expected an interpreted function"),
+            }
+        }
+    }
+
+    // Compilation happens in the background, so wait for `id/1` to be
+    // published, holding the registry as a running interpreter would
+    let mut compiled = false;
+    for _ in 0..100 {
+        if let Some(ResolvedFunction::Native(_)) = modules.lookup_function(module, id, 1) {
+            compiled = true;
+            break;
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    assert!(compiled);
+
+    // `run/1` was just as hot, but the compiler refused it
+    match modules.lookup_function(module, run, 1) {
+        Some(ResolvedFunction::Erlang(fun)) => {
+            for _ in 0..100 {
+                if fun.counters.is_failed() {
+                    break;
+                }
+                thread::sleep(Duration::from_millis(10));
+            }
+            assert!(fun.counters.is_failed());
+        }
+        _ => panic!("expected `run/1` to stay interpreted"),
+    }
+}
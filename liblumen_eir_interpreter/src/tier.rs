@@ -0,0 +1,239 @@
+//! Tiered execution
+//!
+//! When tiering is enabled, every function starts out interpreted, with
+//! counters for the number of times it has been called, and the number of
+//! loop back-edges taken within it. Once either counter crosses its
+//! threshold, the function is queued for compilation on a pool of background
+//! threads, while the interpreter carries on executing it. When compilation
+//! completes, the compiled function is published in the function's counters,
+//! which `ModuleRegistry::lookup_function` checks, so subsequent calls go
+//! straight to native code. Publishing does not take the registry lock, which
+//! interpreters hold for as long as they run a function.
+//!
+//! This module only provides the mechanics: counting, queueing, and
+//! publishing. The compilation itself is performed by a `TierCompiler`, which
+//! is provided by the embedder, since this crate does not depend on the code
+//! generator. There is no such compiler for the code generator yet, and one
+//! cannot be written against this interface as it stands: the code it
+//! generates runs against the runtimes/core builtins and process layout
+//! rather than lumen_runtime's, and a `NativeFunctionKind` is a plain `fn`
+//! pointer, which cannot refer to code emitted at runtime. Compiled programs
+//! also do not go through the interpreter's `ModuleRegistry`, so there is no
+//! dispatch table of theirs to patch here. Until those are addressed, tiering
+//! is only driven by tests.
+use std::ptr;
+use std::sync::atomic::{AtomicPtr, AtomicU32, AtomicU8, Ordering};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Arc, Mutex};
+use std::thread;
+
+use libeir_ir::Function;
+
+use crate::module::{ErlangFunction, NativeFunctionKind};
+
+//macro_rules! trace {
+//    ($($t:tt)*) => (lumen_runtime::system::io::puts(&format_args!($($t)*).to_string()))
+//}
+macro_rules! trace {
+    ($($t:tt)*) => {
+        if false {
+            let _ = format_args!($($t)*);
+        }
+    };
+}
+
+/// Compiles hot functions to native code
+pub trait TierCompiler: Send + Sync {
+    /// Compiles `fun`, returning a native function which the interpreter can
+    /// call in its place
+    ///
+    /// This is called on a background thread, and may take as long as it needs.
+    fn compile(&self, fun: &Function) -> anyhow::Result<NativeFunctionKind>;
+}
+
+#[derive(Debug, Clone)]
+pub struct TierConfig {
+    /// The number of calls after which a function is compiled
+    pub call_threshold: u32,
+    /// The number of loop back-edges after which a function is compiled
+    pub back_edge_threshold: u32,
+    /// The number of background compilation threads
+    pub num_workers: usize,
+}
+impl Default for TierConfig {
+    fn default() -> Self {
+        Self {
+            call_threshold: 1_000,
+            back_edge_threshold: 10_000,
+            num_workers: 1,
+        }
+    }
+}
+
+const INTERPRETED: u8 = 0;
+const QUEUED: u8 = 1;
+const COMPILED: u8 = 2;
+const FAILED: u8 = 3;
+
+/// The execution counters of a single function, and its compiled code once
+/// there is some
+///
+/// Counting is relaxed, the thresholds only need to be crossed approximately.
+pub struct Counters {
+    calls: AtomicU32,
+    back_edges: AtomicU32,
+    state: AtomicU8,
+    compiled: AtomicPtr<NativeFunctionKind>,
+}
+impl Counters {
+    pub fn new() -> Self {
+        Self {
+            calls: AtomicU32::new(0),
+            back_edges: AtomicU32::new(0),
+            state: AtomicU8::new(INTERPRETED),
+            compiled: AtomicPtr::new(ptr::null_mut()),
+        }
+    }
+
+    /// Returns the compiled function, if it has been compiled
+    #[inline]
+    pub fn compiled(&self) -> Option<NativeFunctionKind> {
+        let compiled = self.compiled.load(Ordering::Acquire);
+        if compiled.is_null() {
+            None
+        } else {
+            // Only ever set once, and freed with `self`
+            Some(unsafe { *compiled })
+        }
+    }
+
+    /// Publishes the compiled function, which calls resolve to from then on
+    fn set_compiled(&self, native: NativeFunctionKind) {
+        let compiled = Box::into_raw(Box::new(native));
+        self.compiled.store(compiled, Ordering::Release);
+        self.state.store(COMPILED, Ordering::Release);
+    }
+
+    /// Returns true if the function has been compiled and patched in
+    pub fn is_compiled(&self) -> bool {
+        self.state.load(Ordering::Acquire) == COMPILED
+    }
+
+    /// Returns true if compilation of the function was attempted, and failed
+    pub fn is_failed(&self) -> bool {
+        self.state.load(Ordering::Acquire) == FAILED
+    }
+
+    /// Records a call, returning true if the function should now be queued
+    #[inline]
+    fn record_call(&self, threshold: u32) -> bool {
+        self.calls.fetch_add(1, Ordering::Relaxed) + 1 == threshold
+    }
+
+    /// Records a back-edge, returning true if the function should now be queued
+    #[inline]
+    fn record_back_edge(&self, threshold: u32) -> bool {
+        self.back_edges.fetch_add(1, Ordering::Relaxed) + 1 == threshold
+    }
+
+    /// Moves the function to the queued state, returning false if it had
+    /// already left the interpreted state, e.g. via the other counter
+    fn try_queue(&self) -> bool {
+        self.state
+            .compare_exchange(INTERPRETED, QUEUED, Ordering::AcqRel, Ordering::Relaxed)
+            .is_ok()
+    }
+}
+impl Drop for Counters {
+    fn drop(&mut self) {
+        let compiled = *self.compiled.get_mut();
+        if !compiled.is_null() {
+            drop(unsafe { Box::from_raw(compiled) });
+        }
+    }
+}
+
+struct Job {
+    fun: Function,
+    counters: Arc<Counters>,
+}
+
+/// The state of tiered execution for a `ModuleRegistry`
+pub struct Tiering {
+    config: TierConfig,
+    queue: Mutex<Sender<Job>>,
+}
+impl Tiering {
+    /// Starts the background compilation threads
+    pub fn new(config: TierConfig, compiler: Arc<dyn TierCompiler>) -> Self {
+        let (tx, rx) = channel();
+        let rx = Arc::new(Mutex::new(rx));
+        for i in 0..config.num_workers.max(1) {
+            let rx = rx.clone();
+            let compiler = compiler.clone();
+            thread::Builder::new()
+                .name(format!("tier-compiler-{}", i))
+                .spawn(move || compile_worker(rx, compiler))
+                .expect("unable to spawn tier compiler thread");
+        }
+        Self {
+            config,
+            queue: Mutex::new(tx),
+        }
+    }
+
+    /// Records a call to `fun`, queueing it for compilation if it is now hot
+    #[inline]
+    pub(crate) fn record_call(&self, fun: &ErlangFunction) {
+        if fun.counters.record_call(self.config.call_threshold) {
+            self.enqueue(fun);
+        }
+    }
+
+    /// Records a loop back-edge in `fun`, queueing it for compilation if it is now hot
+    #[inline]
+    pub(crate) fn record_back_edge(&self, fun: &ErlangFunction) {
+        if fun
+            .counters
+            .record_back_edge(self.config.back_edge_threshold)
+        {
+            self.enqueue(fun);
+        }
+    }
+
+    #[cold]
+    fn enqueue(&self, fun: &ErlangFunction) {
+        if !fun.counters.try_queue() {
+            return;
+        }
+        trace!("TIER QUEUE {}", fun.fun.ident());
+        let job = Job {
+            fun: fun.fun.clone(),
+            counters: fun.counters.clone(),
+        };
+        // If the workers have gone away, the function just stays interpreted
+        let _ = self.queue.lock().unwrap().send(job);
+    }
+}
+
+fn compile_worker(rx: Arc<Mutex<Receiver<Job>>>, compiler: Arc<dyn TierCompiler>) {
+    loop {
+        let job = match rx.lock().unwrap().recv() {
+            Ok(job) => job,
+            Err(_) => break,
+        };
+        match compiler.compile(&job.fun) {
+            Ok(native) => {
+                // Only the worker which queued the function sets this, as it
+                // is queued once
+                job.counters.set_compiled(native);
+                trace!("TIER COMPILED {}", job.fun.ident());
+            }
+            Err(err) => {
+                // Failed functions are not retried, they stay interpreted
+                job.counters.state.store(FAILED, Ordering::Release);
+                trace!("TIER FAILED {}: {}", job.fun.ident(), err);
+            }
+        }
+    }
+}
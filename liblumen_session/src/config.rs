@@ -7,6 +7,7 @@ mod options;
 mod output;
 mod project;
 mod sanitizer;
+mod stats;
 
 pub use self::debug::DebugInfo;
 pub use self::input::{Input, InputType};
@@ -18,3 +19,4 @@ pub use self::options::{
 pub use self::output::{calculate_outputs, Emit, OutputType, OutputTypeError, OutputTypes};
 pub use self::project::ProjectType;
 pub use self::sanitizer::Sanitizer;
+pub use self::stats::StatsFormat;
@@ -174,4 +174,12 @@ impl Passes {
             Passes::All => false,
         }
     }
+
+    /// Returns true if the pass with the given name is selected
+    pub fn contains(&self, pass: &str) -> bool {
+        match *self {
+            Passes::Some(ref v) => v.iter().any(|p| p == pass),
+            Passes::All => true,
+        }
+    }
 }
@@ -92,6 +92,12 @@ pub struct CodegenOptions {
      **     _
      **/
     pub opt_level: Option<OptLevel>,
+    #[option(value_name("N"), takes_value(true))]
+    /// Divide each module into N units for parallel code generation (default: automatic)
+    pub codegen_units: Option<u64>,
+    #[option(value_name("DIR"), takes_value(true))]
+    /// Cache compiled objects in DIR, reusing them for unchanged modules (default: disabled)
+    pub object_cache: Option<PathBuf>,
     #[option(hidden(true))]
     /// Run `dsymutil` and delete intermediate object files
     pub run_dsymutil: Option<bool>,
@@ -11,7 +11,7 @@ pub struct DebuggingOptions {
     /// Measure time of each lumen pass
     pub time_passes: bool,
     #[option]
-    /// Measure time of each LLVM pass
+    /// Measure time of each MLIR pass
     pub time_mlir_passes: bool,
     #[option]
     /// Measure time of each LLVM pass
@@ -50,6 +50,13 @@ pub struct DebuggingOptions {
     /// Print some performance-related statistics
     pub perf_stats: bool,
     #[option]
+    /// Print compiler statistics when finished, i.e. pass timings, rewrite
+    /// counts, runtime calls introduced by lowering, and IR sizes
+    pub print_stats: bool,
+    #[option(takes_value(true), possible_values("text", "json"))]
+    /// The format used when reporting statistics (default: text)
+    pub stats_format: Option<StatsFormat>,
+    #[option]
     /// Pass `-install_name @rpath/...` to the macOS linker
     pub osx_rpath_install_name: bool,
     #[option(
@@ -81,8 +88,14 @@ pub struct DebuggingOptions {
     /// Tell the linker to strip debuginfo when building without debuginfo enabled
     pub strip_debuginfo_if_disabled: Option<bool>,
     #[option]
-    /// Don't run LLVM in parallel (while keeping codegen-units and ThinLTO)
+    /// Don't run LLVM in parallel (emits each module as a single codegen unit; keeps ThinLTO)
     pub no_parallel_llvm: bool,
+    #[option]
+    /// Don't run MLIR function pass pipelines in parallel
+    pub no_parallel_mlir: bool,
+    #[option]
+    /// Always recompile modules, bypassing the object cache
+    pub no_object_cache: bool,
     #[option(
         takes_value(true),
         possible_values("disabled", "trampolines", "aliases")
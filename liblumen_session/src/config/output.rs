@@ -77,6 +77,7 @@ pub enum OutputType {
     Assembly,
     Object,
     Exe,
+    CodegenReport,
 }
 impl FromStr for OutputType {
     type Err = ();
@@ -92,6 +93,7 @@ impl FromStr for OutputType {
             "asm" => Ok(OutputType::Assembly),
             "obj" => Ok(OutputType::Object),
             "link" => Ok(OutputType::Exe),
+            "codegen-report" => Ok(OutputType::CodegenReport),
             _ => Err(()),
         }
     }
@@ -120,6 +122,7 @@ impl OutputType {
             &OutputType::Assembly => "asm",
             &OutputType::Object => "obj",
             &OutputType::Exe => "link",
+            &OutputType::CodegenReport => "codegen-report",
         }
     }
 
@@ -135,6 +138,7 @@ impl OutputType {
             OutputType::Assembly,
             OutputType::Object,
             OutputType::Exe,
+            OutputType::CodegenReport,
         ]
     }
 
@@ -155,6 +159,7 @@ Supported output types:
 - asm:       Assembly (*)
 - obj:       Object File (*)
 - link:      Executable (*)
+- codegen-report: Runtime calls emitted per function (JSON)
 
 (*) Indicates that globs cannot be applied to this output type"
     }
@@ -171,6 +176,7 @@ Supported output types:
             OutputType::Assembly => "s",
             OutputType::Object => "o",
             OutputType::Exe => "",
+            OutputType::CodegenReport => "codegen.json",
         }
     }
 }
@@ -0,0 +1,69 @@
+use std::fmt;
+use std::str::FromStr;
+
+use clap::ArgMatches;
+
+use thiserror::Error;
+
+use crate::config::options::{invalid_value, required_option_missing};
+use crate::config::options::{OptionInfo, ParseOption};
+
+/// The format in which compiler statistics are reported
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum StatsFormat {
+    Text,
+    Json,
+}
+impl Default for StatsFormat {
+    fn default() -> Self {
+        StatsFormat::Text
+    }
+}
+impl fmt::Display for StatsFormat {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match *self {
+            StatsFormat::Text => "text".fmt(f),
+            StatsFormat::Json => "json".fmt(f),
+        }
+    }
+}
+impl FromStr for StatsFormat {
+    type Err = InvalidStatsFormatError;
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s {
+            "text" => Ok(StatsFormat::Text),
+            "json" => Ok(StatsFormat::Json),
+            _ => Err(InvalidStatsFormatError),
+        }
+    }
+}
+impl ParseOption for StatsFormat {
+    fn parse_option<'a>(info: &OptionInfo, matches: &ArgMatches<'a>) -> clap::Result<Self> {
+        match matches.value_of(info.name) {
+            None => Err(required_option_missing(info)),
+            Some(s) => Self::from_str(s).map_err(|e| invalid_value(info, &e.to_string())),
+        }
+    }
+}
+
+#[derive(Error, Debug, Clone, Copy, PartialEq)]
+#[error("invalid statistics format, expected 'text' or 'json'")]
+pub struct InvalidStatsFormatError;
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn formats_round_trip_through_their_names() {
+        for format in &[StatsFormat::Text, StatsFormat::Json] {
+            assert_eq!(format.to_string().parse::<StatsFormat>(), Ok(*format));
+        }
+    }
+
+    #[test]
+    fn unknown_formats_are_rejected() {
+        assert_eq!("yaml".parse::<StatsFormat>(), Err(InvalidStatsFormatError));
+        assert_eq!("JSON".parse::<StatsFormat>(), Err(InvalidStatsFormatError));
+    }
+}
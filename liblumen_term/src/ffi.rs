@@ -218,6 +218,28 @@ pub extern "C" fn header_mask(encoding: *const EncodingInfo) -> MaskInfo {
     }
 }
 
+#[export_name = "lumen_min_fixnum"]
+pub extern "C" fn min_fixnum(encoding: *const EncodingInfo) -> i64 {
+    let encoding = unsafe { &*encoding };
+    match encoding.pointer_size {
+        32 => Encoding32::MIN_SMALLINT_VALUE as i64,
+        64 if encoding.supports_nanboxing => Encoding64Nanboxed::MIN_SMALLINT_VALUE,
+        64 => Encoding64::MIN_SMALLINT_VALUE,
+        _ => unreachable!(),
+    }
+}
+
+#[export_name = "lumen_max_fixnum"]
+pub extern "C" fn max_fixnum(encoding: *const EncodingInfo) -> i64 {
+    let encoding = unsafe { &*encoding };
+    match encoding.pointer_size {
+        32 => Encoding32::MAX_SMALLINT_VALUE as i64,
+        64 if encoding.supports_nanboxing => Encoding64Nanboxed::MAX_SMALLINT_VALUE,
+        64 => Encoding64::MAX_SMALLINT_VALUE,
+        _ => unreachable!(),
+    }
+}
+
 #[inline]
 fn do_is_type<T>(ty: u32, value: usize) -> bool
 where
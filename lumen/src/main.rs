@@ -68,6 +68,7 @@ pub fn main() -> anyhow::Result<()> {
 fn handle_help(err: &HelpRequested) -> ! {
     match err.primary() {
         "compile" => argparser::print_compile_help(),
+        "run" => argparser::print_run_help(),
         "print" => argparser::print_print_help(),
         _ => unimplemented!(),
     }
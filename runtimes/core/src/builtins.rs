@@ -1,14 +1,54 @@
 use std::panic;
+use std::ptr;
+use std::slice;
 
+use anyhow::anyhow;
+
+use liblumen_core::util::bytes;
+
+use liblumen_alloc::erts::apply::{self, CallTarget};
+use liblumen_alloc::erts::exception::{self, Exception, RuntimeException};
+use liblumen_alloc::erts::process::Process;
 use liblumen_alloc::erts::term::prelude::*;
+use liblumen_alloc::erts::Arity;
 
 /// Strict equality
 #[export_name = "__lumen_builtin_cmpeq"]
 pub extern "C" fn builtin_cmpeq(lhs: Term, rhs: Term) -> bool {
+    cmpeq(lhs, rhs, bytes::eq)
+}
+
+/// Strict equality, specialised for CPUs with AVX2
+///
+/// The compiler calls this rather than `__lumen_builtin_cmpeq` when it knows that
+/// the target CPU supports AVX2, so binaries are compared without runtime dispatch
+#[cfg(target_arch = "x86_64")]
+#[export_name = "__lumen_builtin_cmpeq.avx2"]
+pub extern "C" fn builtin_cmpeq_avx2(lhs: Term, rhs: Term) -> bool {
+    cmpeq(lhs, rhs, |l, r| unsafe { bytes::avx2::eq(l, r) })
+}
+
+/// Strict equality, specialised for CPUs with AVX-512F and AVX-512BW
+#[cfg(target_arch = "x86_64")]
+#[export_name = "__lumen_builtin_cmpeq.avx512"]
+pub extern "C" fn builtin_cmpeq_avx512(lhs: Term, rhs: Term) -> bool {
+    cmpeq(lhs, rhs, |l, r| unsafe { bytes::avx512::eq(l, r) })
+}
+
+#[inline(always)]
+fn cmpeq<F>(lhs: Term, rhs: Term, bytes_eq: F) -> bool
+where
+    F: Fn(&[u8], &[u8]) -> bool + panic::RefUnwindSafe,
+{
     let result = panic::catch_unwind(|| {
         if let Ok(left) = lhs.decode() {
             if let Ok(right) = rhs.decode() {
-                left.exact_eq(&right)
+                // Comparing binaries is the only part of this that does bulk work,
+                // so that is what is done with the given implementation
+                match (aligned_bytes(&left), aligned_bytes(&right)) {
+                    (Some(l), Some(r)) => bytes_eq(l, r),
+                    _ => left.exact_eq(&right),
+                }
             } else {
                 //Atom::str_to_term("false")
                 false
@@ -31,9 +71,208 @@ pub extern "C" fn builtin_cmpeq(lhs: Term, rhs: Term) -> bool {
     }
 }
 
+#[inline(always)]
+fn aligned_bytes(term: &TypedTerm) -> Option<&[u8]> {
+    match term {
+        TypedTerm::HeapBinary(bin) => Some(bin.as_bytes()),
+        TypedTerm::ProcBin(bin) => Some(bin.as_bytes()),
+        TypedTerm::BinaryLiteral(bin) => Some(bin.as_bytes()),
+        _ => None,
+    }
+}
+
 /// Capture the current stack trace
 #[export_name = "__lumen_builtin_trace_capture"]
 pub extern "C" fn builtin_trace_capture() -> Term {
     // TODO:
     Term::NIL
 }
+
+/// Resolves the target of a dynamic call, i.e. `Mod:Fun(Args)` or `apply/3`
+///
+/// Compiled code caches the result at the call site, and only calls this when the
+/// cached target does not match the callee. Returns null, after raising `undef` in
+/// `process`, if the callee is undefined, or `badarg` if it is not named by atoms.
+#[export_name = "__lumen_builtin_apply_resolve"]
+pub extern "C" fn builtin_apply_resolve(
+    process: &Process,
+    module: Term,
+    function: Term,
+    arity: usize,
+) -> *const CallTarget {
+    if !(module.is_atom() && function.is_atom()) {
+        process.exception(exception::badarg(
+            None,
+            anyhow!("{}:{} is not a function name", module, function).into(),
+        ));
+        return ptr::null();
+    }
+
+    let target = if arity <= (Arity::max_value() as usize) {
+        apply::resolve_call_target(module, function, arity as Arity)
+    } else {
+        None
+    };
+    match target {
+        Some(target) => target,
+        None => {
+            process.exception(undef(process, module, function, arity));
+            ptr::null()
+        }
+    }
+}
+
+/// Raises `badfun` in `process`, for a call through `fun` which is not a fun
+///
+/// Returns NONE, which compiled code returns in turn to unwind to the scheduler
+#[export_name = "__lumen_builtin_raise_badfun"]
+pub extern "C" fn builtin_raise_badfun(process: &Process, fun: Term) -> Term {
+    let source = anyhow!("{} is not a function", fun).into();
+    raise(process, exception::badfun(process, fun, source))
+}
+
+/// Raises `badarity` in `process`, for a call of `fun` with the `argc` arguments
+/// at `argv`, which is not the arity of `fun`
+///
+/// Returns NONE, which compiled code returns in turn to unwind to the scheduler
+#[export_name = "__lumen_builtin_raise_badarity"]
+pub extern "C" fn builtin_raise_badarity(
+    process: &Process,
+    fun: Term,
+    argv: *const Term,
+    argc: usize,
+) -> Term {
+    let args = unsafe { slice::from_raw_parts(argv, argc) };
+    let source = anyhow!("{} called with {} arguments", fun, argc).into();
+    let exception = match process.list_from_slice(args) {
+        Ok(args) => exception::badarity(process, fun, args, source),
+        Err(err) => err.into(),
+    };
+    raise(process, exception)
+}
+
+fn raise(process: &Process, exception: Exception) -> Term {
+    match exception {
+        Exception::Runtime(err) => {
+            process.exception(err);
+            Term::NONE
+        }
+        // Generated code cannot recover from this, as there is no way to collect
+        // the heap and retry
+        Exception::System(err) => panic!("{}", err),
+    }
+}
+
+fn undef(process: &Process, module: Term, function: Term, arity: usize) -> RuntimeException {
+    let source = anyhow!("{}:{}/{} is not defined", module, function, arity).into();
+    // As in BEAM, the stacktrace starts with the undefined function, if there is room
+    let stacktrace = process
+        .integer(arity)
+        .and_then(|arity| process.tuple_from_slice(&[module, function, arity, Term::NIL]))
+        .and_then(|top| process.cons(top, Term::NIL))
+        .ok();
+
+    exception::error(Atom::str_to_term("undef"), None, stacktrace, source)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::convert::TryInto;
+    use std::sync::Arc;
+
+    use liblumen_alloc::erts::process::{self, Priority, Status};
+    use liblumen_alloc::erts::ModuleFunctionArity;
+
+    fn process() -> Process {
+        let (heap, heap_size) = process::alloc::default_heap().unwrap();
+        Process::new(
+            Priority::Normal,
+            None,
+            Arc::new(ModuleFunctionArity {
+                module: Atom::from_str("builtins_test"),
+                function: Atom::from_str("process"),
+                arity: 0,
+            }),
+            heap,
+            heap_size,
+        )
+    }
+
+    /// Returns the reason and stacktrace of the error raised in `process`
+    fn raised(process: &Process) -> (Term, Option<Term>) {
+        match *process.status.read() {
+            Status::Exiting(RuntimeException::Error(ref err)) => (err.reason(), err.stacktrace()),
+            _ => panic!("expected an error to be raised"),
+        }
+    }
+
+    fn elements(tuple: Term) -> Vec<Term> {
+        let tuple: Boxed<Tuple> = tuple.try_into().unwrap();
+        tuple.elements().to_vec()
+    }
+
+    #[test]
+    fn apply_resolve_raises_badarg_for_names_which_are_not_atoms() {
+        let process = process();
+        let module = process.integer(1).unwrap();
+        let function = Atom::str_to_term("start");
+
+        assert!(builtin_apply_resolve(&process, module, function, 0).is_null());
+        let (reason, _) = raised(&process);
+        assert_eq!(reason, Atom::str_to_term("badarg"));
+    }
+
+    #[test]
+    fn apply_resolve_raises_undef_headed_by_the_callee() {
+        let process = process();
+        let module = Atom::str_to_term("builtins_test");
+        let function = Atom::str_to_term("start");
+        // No function can have this arity, so the dispatch table is not consulted
+        let arity = (Arity::max_value() as usize) + 1;
+
+        assert!(builtin_apply_resolve(&process, module, function, arity).is_null());
+        let (reason, stacktrace) = raised(&process);
+        assert_eq!(reason, Atom::str_to_term("undef"));
+
+        let stacktrace: Boxed<Cons> = stacktrace.unwrap().try_into().unwrap();
+        assert_eq!(stacktrace.tail, Term::NIL);
+        let top = elements(stacktrace.head);
+        assert_eq!(top.len(), 4);
+        assert_eq!(top[0], module);
+        assert_eq!(top[1], function);
+        assert_eq!(top[2], process.integer(arity).unwrap());
+        assert_eq!(top[3], Term::NIL);
+    }
+
+    #[test]
+    fn raise_badfun_raises_with_the_callee() {
+        let process = process();
+        let fun = Atom::str_to_term("not_a_fun");
+
+        assert!(builtin_raise_badfun(&process, fun).is_none());
+        let (reason, _) = raised(&process);
+        let reason = elements(reason);
+        assert_eq!(reason, vec![Atom::str_to_term("badfun"), fun]);
+    }
+
+    #[test]
+    fn raise_badarity_raises_with_the_callee_and_arguments() {
+        let process = process();
+        let fun = Atom::str_to_term("not_a_fun");
+        let args = [process.integer(1).unwrap(), process.integer(2).unwrap()];
+
+        assert!(builtin_raise_badarity(&process, fun, args.as_ptr(), args.len()).is_none());
+        let (reason, _) = raised(&process);
+        let reason = elements(reason);
+        assert_eq!(reason.len(), 2);
+        assert_eq!(reason[0], Atom::str_to_term("badarity"));
+
+        let fun_args = elements(reason[1]);
+        assert_eq!(fun_args[0], fun);
+        let list: Boxed<Cons> = fun_args[1].try_into().unwrap();
+        let raised_args: Vec<Term> = list.into_iter().map(|arg| arg.unwrap()).collect();
+        assert_eq!(raised_args, args.to_vec());
+    }
+}
@@ -100,7 +100,9 @@ impl Hierarchy {
     const LATER_TOTAL_MILLISECONDS: Milliseconds =
         Self::LATER_MILLISECONDS_PER_SLOT * (Wheel::LENGTH as Milliseconds);
 
-    fn cancel(&mut self, timer_reference_number: ReferenceNumber) -> Option<Milliseconds> {
+    /// Cancels the timer numbered `timer_reference_number`, returning the milliseconds it
+    /// had left, or `None` if it has already timed out
+    pub fn cancel(&mut self, timer_reference_number: ReferenceNumber) -> Option<Milliseconds> {
         self.timer_by_reference_number
             .remove(&timer_reference_number)
             .and_then(|weak_timer| weak_timer.upgrade())
@@ -166,16 +168,59 @@ impl Hierarchy {
                 process_tuple.clone_to_fragment()?
             }
         };
+        self.insert(
+            reference_number,
+            monotonic_time_milliseconds,
+            Action::Send {
+                destination,
+                message_heap: HeapFragment {
+                    heap_fragment,
+                    term: heap_fragment_message,
+                },
+            },
+        );
+
+        Ok(process_reference)
+    }
+    */
+
+    /// Starts a timer which calls `wake` with `process` at `monotonic_time_milliseconds`,
+    /// if the process is still alive, e.g. to make it runnable again when the timeout of
+    /// its receive expires
+    ///
+    /// The timer can be cancelled with `cancel` using `reference_number`, which must be
+    /// unique to the scheduler this hierarchy belongs to.
+    pub fn start_wake(
+        &mut self,
+        monotonic_time_milliseconds: Milliseconds,
+        reference_number: ReferenceNumber,
+        process: Weak<Process>,
+        wake: fn(Arc<Process>),
+    ) {
+        self.insert(
+            reference_number,
+            monotonic_time_milliseconds,
+            Action::Wake { process, wake },
+        );
+    }
+
+    /// Returns true if no timer is waiting to time out
+    pub fn is_empty(&self) -> bool {
+        self.timer_by_reference_number.is_empty()
+    }
+
+    fn insert(
+        &mut self,
+        reference_number: ReferenceNumber,
+        monotonic_time_milliseconds: Milliseconds,
+        action: Action,
+    ) {
         let position = self.position(monotonic_time_milliseconds);
 
         let timer = Timer {
             reference_number,
             monotonic_time_milliseconds,
-            destination,
-            message_heap: Mutex::new(message::HeapFragment {
-                heap_fragment,
-                term: heap_fragment_message,
-            }),
+            action: Mutex::new(action),
             position: Mutex::new(position),
         };
 
@@ -192,10 +237,7 @@ impl Hierarchy {
 
         self.timer_by_reference_number
             .insert(reference_number, cancellable);
-
-        Ok(process_reference)
     }
-    */
 
     pub fn timeout(&mut self) {
         self.timeout_at_once();
@@ -372,11 +414,25 @@ struct Timer {
     // could GC the unboxed `LocalReference` `Term`.
     reference_number: ReferenceNumber,
     monotonic_time_milliseconds: Milliseconds,
-    destination: Destination,
-    message_heap: Mutex<HeapFragment>,
+    action: Mutex<Action>,
     position: Mutex<Position>,
 }
 
+/// What a `Timer` does when it times out
+#[cfg_attr(debug_assertions, derive(Debug))]
+enum Action {
+    /// Sends `message_heap` to `destination`
+    Send {
+        destination: Destination,
+        message_heap: HeapFragment,
+    },
+    /// Calls `wake` with `process`, if it is still alive
+    Wake {
+        process: Weak<Process>,
+        wake: fn(Arc<Process>),
+    },
+}
+
 impl Timer {
     fn milliseconds_remaining(&self) -> Milliseconds {
         // The timer may be read when it is past its timeout, but it has not been timed-out
@@ -392,18 +448,32 @@ impl Timer {
     }
 
     fn timeout(self) {
-        let option_destination_arc_process = match &self.destination {
-            Destination::Name(ref name) => registry::atom_to_process(name),
-            Destination::Process(destination_process_weak) => destination_process_weak.upgrade(),
-        };
+        match self.action.into_inner() {
+            Action::Send {
+                destination,
+                message_heap,
+            } => {
+                let option_destination_arc_process = match &destination {
+                    Destination::Name(ref name) => registry::atom_to_process(name),
+                    Destination::Process(destination_process_weak) => {
+                        destination_process_weak.upgrade()
+                    }
+                };
 
-        if let Some(destination_arc_process) = option_destination_arc_process {
-            let HeapFragment {
-                heap_fragment,
-                term,
-            } = self.message_heap.into_inner();
+                if let Some(destination_arc_process) = option_destination_arc_process {
+                    let HeapFragment {
+                        heap_fragment,
+                        term,
+                    } = message_heap;
 
-            destination_arc_process.send_heap_message(heap_fragment, term);
+                    destination_arc_process.send_heap_message(heap_fragment, term);
+                }
+            }
+            Action::Wake { process, wake } => {
+                if let Some(arc_process) = process.upgrade() {
+                    wake(arc_process);
+                }
+            }
         }
     }
 }
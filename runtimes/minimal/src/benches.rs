@@ -0,0 +1,393 @@
+//! Microbenchmarks for the runtime functions called by generated code
+//!
+//! The builtins are called through the same signatures that the EIR to LLVM lowering
+//! declares them with, so these measure what a call from compiled code costs. They give
+//! a baseline against which inline lowerings of the same operations can be compared.
+//!
+//! Run with `cargo bench -p lumen_rt_minimal`. In addition to the time per iteration,
+//! each benchmark prints the number of allocations it made per iteration. Only
+//! allocations made through the global allocator are counted, allocations on process
+//! heaps are bump allocations, and are not.
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::ffi::c_void;
+use std::mem;
+use std::sync::{Arc, Once};
+
+use test::{black_box, Bencher};
+
+use liblumen_core::symbols::{FunctionSymbol, ModuleSymbols, StaticSymbolTable};
+use liblumen_core::util::phf;
+
+use liblumen_alloc::erts::apply::InitializeLumenDispatchTable;
+use liblumen_alloc::erts::process::{self, Priority, Process, ProcessFlags};
+use liblumen_alloc::erts::term::prelude::*;
+use liblumen_alloc::erts::ModuleFunctionArity;
+
+use liblumen_term::TermKind;
+
+use lumen_rt_core as rt_core;
+
+use crate::scheduler::Scheduler;
+
+// These are the signatures used by `ConvertEIRToLLVM.cpp`
+extern "C" {
+    #[link_name = "__lumen_builtin_cmpeq"]
+    fn builtin_cmpeq(lhs: Term, rhs: Term) -> bool;
+
+    #[link_name = "__lumen_builtin_is_type"]
+    fn builtin_is_type(ty: u32, value: Term) -> bool;
+
+    #[link_name = "__lumen_builtin_math.add"]
+    fn builtin_math_add(process: &Process, lhs: Term, rhs: Term) -> Term;
+
+    #[link_name = "__lumen_builtin_malloc"]
+    fn builtin_malloc(process: &Process, bytes: usize) -> *mut u8;
+
+    // The result of a yield is not used by generated code
+    #[link_name = "__lumen_builtin_yield"]
+    fn builtin_yield() -> bool;
+}
+
+/// Counts the allocations made by the current thread
+struct CountingAlloc;
+
+#[thread_local]
+static mut ALLOCATIONS: usize = 0;
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS += 1;
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS += 1;
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS += 1;
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static ALLOCATOR: CountingAlloc = CountingAlloc;
+
+fn allocations() -> usize {
+    unsafe { ALLOCATIONS }
+}
+
+/// Benchmarks `f`, then reports the number of allocations it made per iteration
+fn bench_allocs<T, F>(name: &str, b: &mut Bencher, mut f: F)
+where
+    F: FnMut() -> T,
+{
+    let mut iterations = 0usize;
+    let before = allocations();
+    b.iter(|| {
+        iterations += 1;
+        f()
+    });
+    let allocs = allocations() - before;
+    if iterations > 0 {
+        eprintln!(
+            "{}: {:.2} allocs/op",
+            name,
+            allocs as f64 / iterations as f64
+        );
+    }
+}
+
+const MODULE: &'static str = "lumen_rt_bench";
+
+thread_local! {
+    static YIELDING: Cell<bool> = Cell::new(false);
+}
+
+/// The entry of processes which exit immediately
+extern "C" fn noop(_process: &Process) -> Term {
+    Term::NIL
+}
+
+/// The entry of processes which yield until `YIELDING` is cleared
+extern "C" fn yield_loop(_process: &Process) -> Term {
+    while YIELDING.with(|yielding| yielding.get()) {
+        unsafe {
+            builtin_yield();
+        }
+    }
+    Term::NIL
+}
+
+/// Initializes the dispatch table with the entries of benchmark processes, as the
+/// scheduler can only spawn processes whose entry is in the table
+fn init_dispatch_table() {
+    static INIT: Once = Once::new();
+
+    INIT.call_once(|| {
+        let module = Atom::from_str(MODULE).id();
+        let entries: [(&str, *const c_void); 2] = [
+            ("noop", noop as *const c_void),
+            ("yield_loop", yield_loop as *const c_void),
+        ];
+        let mut symbols: Vec<FunctionSymbol> = entries
+            .iter()
+            .map(|&(function, ptr)| FunctionSymbol {
+                module,
+                function: Atom::from_str(function).id(),
+                arity: 0,
+                ptr,
+            })
+            .collect();
+        symbols.sort_by_key(|s| (s.module, s.function, s.arity));
+
+        let state = phf::generate(symbols.len(), |seed, i| {
+            let s = &symbols[i];
+            StaticSymbolTable::hash(seed, s.module, s.function, s.arity)
+        });
+        let slots: Vec<u32> = state.map.iter().map(|&i| i as u32).collect();
+        let modules = vec![ModuleSymbols {
+            module,
+            start: 0,
+            len: symbols.len() as u32,
+        }];
+
+        // The table must live for the rest of the program
+        let table = Box::leak(Box::new(StaticSymbolTable {
+            seed: state.seed,
+            len: symbols.len(),
+            num_displacements: state.displacements.len(),
+            num_modules: modules.len(),
+            displacements: Box::leak(state.displacements.into_boxed_slice()).as_ptr(),
+            slots: Box::leak(slots.into_boxed_slice()).as_ptr(),
+            symbols: Box::leak(symbols.into_boxed_slice()).as_ptr(),
+            modules: Box::leak(modules.into_boxed_slice()).as_ptr(),
+        }));
+        assert!(unsafe { InitializeLumenDispatchTable(table) });
+    });
+}
+
+fn mfa(function: &str) -> Arc<ModuleFunctionArity> {
+    Arc::new(ModuleFunctionArity {
+        module: Atom::from_str(MODULE),
+        function: Atom::from_str(function),
+        arity: 0,
+    })
+}
+
+/// Creates a process with a heap of at least `min_size` words, which is not scheduled
+fn heap_process(min_size: usize) -> Arc<Process> {
+    let heap_size = process::alloc::next_heap_size(min_size);
+    let heap = process::alloc::heap(heap_size).unwrap();
+    Arc::new(Process::new(
+        Priority::Normal,
+        None,
+        mfa("noop"),
+        heap,
+        heap_size,
+    ))
+}
+
+/// Creates a process which can be spawned, entering `function` when first scheduled
+fn spawnable_process(function: &str) -> Arc<Process> {
+    let (heap, heap_size) = process::alloc::default_heap().unwrap();
+    Arc::new(
+        Process::new_with_stack(Priority::Normal, None, mfa(function), heap, heap_size).unwrap(),
+    )
+}
+
+/// Collects the young heap of `process`, falling back to a full sweep if needed
+fn collect(process: &Process, roots: &mut [Term]) {
+    if process.garbage_collect(0, roots).is_err() {
+        process.set_flags(ProcessFlags::NeedFullSweep);
+        process
+            .garbage_collect(0, roots)
+            .expect("full sweep failed");
+    }
+}
+
+#[bench]
+fn cmpeq_small_integer(b: &mut Bencher) {
+    let process = heap_process(0);
+    let lhs = process.integer(42).unwrap();
+    let rhs = process.integer(42).unwrap();
+    bench_allocs("cmpeq_small_integer", b, || unsafe {
+        builtin_cmpeq(black_box(lhs), black_box(rhs))
+    });
+}
+
+#[bench]
+fn cmpeq_atom(b: &mut Bencher) {
+    let lhs = Atom::from_str("ok").encode().unwrap();
+    let rhs = Atom::from_str("error").encode().unwrap();
+    bench_allocs("cmpeq_atom", b, || unsafe {
+        builtin_cmpeq(black_box(lhs), black_box(rhs))
+    });
+}
+
+#[bench]
+fn cmpeq_binary_64(b: &mut Bencher) {
+    let process = heap_process(0);
+    let bytes = [0xa5u8; 64];
+    let lhs = process.binary_from_bytes(&bytes).unwrap();
+    let rhs = process.binary_from_bytes(&bytes).unwrap();
+    bench_allocs("cmpeq_binary_64", b, || unsafe {
+        builtin_cmpeq(black_box(lhs), black_box(rhs))
+    });
+}
+
+#[bench]
+fn cmpeq_tuple(b: &mut Bencher) {
+    let process = heap_process(0);
+    let elements = [
+        Atom::from_str("ok").encode().unwrap(),
+        process.integer(1).unwrap(),
+        process.integer(2).unwrap(),
+    ];
+    let lhs = process.tuple_from_slice(&elements).unwrap();
+    let rhs = process.tuple_from_slice(&elements).unwrap();
+    bench_allocs("cmpeq_tuple", b, || unsafe {
+        builtin_cmpeq(black_box(lhs), black_box(rhs))
+    });
+}
+
+#[bench]
+fn is_type_fixnum(b: &mut Bencher) {
+    let process = heap_process(0);
+    let value = process.integer(42).unwrap();
+    let kind = TermKind::Fixnum as u32;
+    bench_allocs("is_type_fixnum", b, || unsafe {
+        builtin_is_type(black_box(kind), black_box(value))
+    });
+}
+
+#[bench]
+fn is_type_list(b: &mut Bencher) {
+    let process = heap_process(0);
+    let value = process
+        .cons(process.integer(1).unwrap(), Term::NIL)
+        .unwrap();
+    let kind = TermKind::List as u32;
+    bench_allocs("is_type_list", b, || unsafe {
+        builtin_is_type(black_box(kind), black_box(value))
+    });
+}
+
+/// Adds two fixnums whose sum is a bigint, which is the slow path of an inline add,
+/// collecting the heap as it fills with the sums
+#[bench]
+fn math_add_bigint_promotion(b: &mut Bencher) {
+    let process = heap_process(0);
+    let lhs = process.integer(SmallInteger::MAX_VALUE).unwrap();
+    let rhs = process.integer(1).unwrap();
+    bench_allocs("math_add_bigint_promotion", b, || unsafe {
+        if process.should_collect() {
+            collect(&process, &mut []);
+        }
+        builtin_math_add(&process, black_box(lhs), black_box(rhs))
+    });
+}
+
+/// Allocates a cons cell on the current process heap, collecting it when full,
+/// so the cost of collection is amortized over the allocations
+#[bench]
+fn malloc_cons(b: &mut Bencher) {
+    let scheduler = <Scheduler as rt_core::Scheduler>::current();
+    let process = heap_process(0);
+    let previous = scheduler.replace_current(process.clone());
+    let bytes = 2 * mem::size_of::<Term>();
+    bench_allocs("malloc_cons", b, || unsafe {
+        let ptr = builtin_malloc(&process, black_box(bytes));
+        if ptr.is_null() {
+            collect(&process, &mut []);
+        }
+        ptr
+    });
+    scheduler.replace_current(previous);
+}
+
+/// Switches from the scheduler to a process which immediately yields back
+#[bench]
+fn yield_round_trip(b: &mut Bencher) {
+    init_dispatch_table();
+    let scheduler = <Scheduler as rt_core::Scheduler>::current();
+    YIELDING.with(|yielding| yielding.set(true));
+    scheduler.spawn_shared(spawnable_process("yield_loop"));
+    bench_allocs("yield_round_trip", b, || scheduler.run_once());
+    // Let the process exit
+    YIELDING.with(|yielding| yielding.set(false));
+    while scheduler.run_once() {}
+}
+
+/// Spawns a process, and runs it until it exits
+#[bench]
+fn spawn_exit(b: &mut Bencher) {
+    init_dispatch_table();
+    let scheduler = <Scheduler as rt_core::Scheduler>::current();
+    bench_allocs("spawn_exit", b, || {
+        scheduler.spawn_shared(spawnable_process("noop"));
+        while scheduler.run_once() {}
+    });
+}
+
+#[bench]
+fn send_receive_immediate(b: &mut Bencher) {
+    let receiver = heap_process(0);
+    let message = receiver.integer(42).unwrap();
+    bench_allocs("send_receive_immediate", b, || {
+        receiver.send_from_other(black_box(message)).unwrap();
+        let mailbox = receiver.mailbox.lock();
+        let received = mailbox.borrow_mut().receive(&receiver).unwrap().unwrap();
+        received
+    });
+}
+
+/// Sends a tuple, which is copied to the receiver's heap, collecting the receiver's
+/// heap as it fills, as the receiving process would
+#[bench]
+fn send_receive_tuple(b: &mut Bencher) {
+    let sender = heap_process(0);
+    let receiver = heap_process(0);
+    let elements = [
+        Atom::from_str("ok").encode().unwrap(),
+        sender.integer(1).unwrap(),
+        sender.binary_from_str("hello").unwrap(),
+    ];
+    let message = sender.tuple_from_slice(&elements).unwrap();
+    bench_allocs("send_receive_tuple", b, || {
+        if receiver.should_collect() {
+            collect(&receiver, &mut []);
+        }
+        receiver.send_from_other(black_box(message)).unwrap();
+        let mailbox = receiver.mailbox.lock();
+        let received = mailbox.borrow_mut().receive(&receiver).unwrap().unwrap();
+        received
+    });
+}
+
+/// Collects a heap with 100 live tuples, and as many dead ones
+#[bench]
+fn gc_young(b: &mut Bencher) {
+    let process = heap_process(4096);
+    let live: Vec<Term> = (0..100)
+        .map(|i| {
+            let elements = [process.integer(i).unwrap(), Term::NIL];
+            process.tuple_from_slice(&elements).unwrap()
+        })
+        .collect();
+    let mut roots = [process.list_from_slice(&live).unwrap()];
+    drop(live);
+    bench_allocs("gc_young", b, || {
+        for i in 0..100 {
+            let elements = [process.integer(i).unwrap(), Term::NIL];
+            black_box(process.tuple_from_slice(&elements).unwrap());
+        }
+        collect(&process, &mut roots);
+    });
+}
@@ -0,0 +1,410 @@
+//! Arithmetic and bitwise builtins called by generated code
+//!
+//! The EIR arithmetic ops are lowered to inline code when both operands are fixnums
+//! and the result is a fixnum; these are only called on the slow path, i.e. when an
+//! operand is a bigint or float, the result does not fit in a fixnum, or the operation
+//! raises. They implement the full semantics of the corresponding `erlang` operators.
+//!
+//! Like other calls in generated code, these take the process they run on first, and
+//! return NONE when they raise, after the exception has been stored on the process.
+mod bifs;
+mod receive;
+
+use std::mem;
+
+use anyhow::anyhow;
+use num_bigint::BigInt;
+use num_traits::{ToPrimitive, Zero};
+
+use liblumen_alloc::erts::exception::{self, badarith, Exception};
+use liblumen_alloc::erts::process::Process;
+use liblumen_alloc::erts::term::prelude::*;
+
+/// `+/2`
+#[export_name = "__lumen_builtin_math.add"]
+pub extern "C" fn builtin_add(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => match l.checked_add(r) {
+            Some(result) => Ok(process.integer(result)?),
+            None => Ok(process.integer(BigInt::from(l) + BigInt::from(r))?),
+        },
+        Operands::BigInts(l, r) => Ok(process.integer(l + r)?),
+        Operands::Floats(l, r) => float(process, l + r),
+    })
+}
+
+/// `-/2`
+#[export_name = "__lumen_builtin_math.sub"]
+pub extern "C" fn builtin_sub(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => match l.checked_sub(r) {
+            Some(result) => Ok(process.integer(result)?),
+            None => Ok(process.integer(BigInt::from(l) - BigInt::from(r))?),
+        },
+        Operands::BigInts(l, r) => Ok(process.integer(l - r)?),
+        Operands::Floats(l, r) => float(process, l - r),
+    })
+}
+
+/// `*/2`
+#[export_name = "__lumen_builtin_math.mul"]
+pub extern "C" fn builtin_mul(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => match l.checked_mul(r) {
+            Some(result) => Ok(process.integer(result)?),
+            None => Ok(process.integer(BigInt::from(l) * BigInt::from(r))?),
+        },
+        Operands::BigInts(l, r) => Ok(process.integer(l * r)?),
+        Operands::Floats(l, r) => float(process, l * r),
+    })
+}
+
+/// `div/2`, which truncates towards zero
+#[export_name = "__lumen_builtin_math.div"]
+pub extern "C" fn builtin_div(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(_, 0) => Err(division_by_zero()),
+        Operands::Smalls(l, r) => match l.checked_div(r) {
+            Some(result) => Ok(process.integer(result)?),
+            None => Ok(process.integer(BigInt::from(l) / BigInt::from(r))?),
+        },
+        Operands::BigInts(_, r) if r.is_zero() => Err(division_by_zero()),
+        Operands::BigInts(l, r) => Ok(process.integer(l / r)?),
+        Operands::Floats(..) => Err(not_integers(lhs, rhs)),
+    })
+}
+
+/// `rem/2`, the sign of which is that of the dividend
+#[export_name = "__lumen_builtin_math.rem"]
+pub extern "C" fn builtin_rem(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(_, 0) => Err(division_by_zero()),
+        // `checked_rem` only fails for `MIN rem -1`, which is zero
+        Operands::Smalls(l, r) => Ok(process.integer(l.checked_rem(r).unwrap_or(0))?),
+        Operands::BigInts(_, r) if r.is_zero() => Err(division_by_zero()),
+        Operands::BigInts(l, r) => Ok(process.integer(l % r)?),
+        Operands::Floats(..) => Err(not_integers(lhs, rhs)),
+    })
+}
+
+/// `-/1`
+#[export_name = "__lumen_builtin_math.neg"]
+pub extern "C" fn builtin_neg(process: &Process, value: Term) -> Term {
+    with_process(process, |process| match decode_number(value)? {
+        Number::Small(i) => match i.checked_neg() {
+            Some(result) => Ok(process.integer(result)?),
+            None => Ok(process.integer(-BigInt::from(i))?),
+        },
+        Number::Big(i) => Ok(process.integer(-i)?),
+        Number::Float(f) => float(process, -f),
+    })
+}
+
+/// `band/2`
+#[export_name = "__lumen_builtin_math.band"]
+pub extern "C" fn builtin_band(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => Ok(process.integer(l & r)?),
+        Operands::BigInts(l, r) => Ok(process.integer(l & r)?),
+        Operands::Floats(..) => Err(not_integers(lhs, rhs)),
+    })
+}
+
+/// `bor/2`
+#[export_name = "__lumen_builtin_math.bor"]
+pub extern "C" fn builtin_bor(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => Ok(process.integer(l | r)?),
+        Operands::BigInts(l, r) => Ok(process.integer(l | r)?),
+        Operands::Floats(..) => Err(not_integers(lhs, rhs)),
+    })
+}
+
+/// `bxor/2`
+#[export_name = "__lumen_builtin_math.bxor"]
+pub extern "C" fn builtin_bxor(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => Ok(process.integer(l ^ r)?),
+        Operands::BigInts(l, r) => Ok(process.integer(l ^ r)?),
+        Operands::Floats(..) => Err(not_integers(lhs, rhs)),
+    })
+}
+
+/// `bnot/1`
+#[export_name = "__lumen_builtin_math.bnot"]
+pub extern "C" fn builtin_bnot(process: &Process, value: Term) -> Term {
+    with_process(process, |process| match decode_number(value)? {
+        Number::Small(i) => Ok(process.integer(!i)?),
+        // Two's complement, i.e. `-i - 1`
+        Number::Big(i) => Ok(process.integer(-i - 1)?),
+        Number::Float(_) => Err(badarith(anyhow!("{} is not an integer", value).into()).into()),
+    })
+}
+
+/// `bsl/2`, which shifts right if the shift is negative
+#[export_name = "__lumen_builtin_math.bsl"]
+pub extern "C" fn builtin_bsl(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| bit_shift(process, lhs, rhs, false))
+}
+
+/// `bsr/2`, which shifts left if the shift is negative
+#[export_name = "__lumen_builtin_math.bsr"]
+pub extern "C" fn builtin_bsr(process: &Process, lhs: Term, rhs: Term) -> Term {
+    with_process(process, |process| bit_shift(process, lhs, rhs, true))
+}
+
+/// Calls `f` with the process, storing the exception it raises, if any, on the process,
+/// in which case NONE is returned
+#[inline]
+fn with_process<F>(process: &Process, f: F) -> Term
+where
+    F: FnOnce(&Process) -> exception::Result<Term>,
+{
+    match f(process) {
+        Ok(result) => result,
+        Err(Exception::Runtime(err)) => {
+            process.exception(err);
+            Term::NONE
+        }
+        // Generated code cannot recover from this, as there is no way to collect
+        // the heap and retry
+        Err(Exception::System(err)) => panic!("{}", err),
+    }
+}
+
+enum Number {
+    Small(isize),
+    Big(BigInt),
+    Float(f64),
+}
+
+enum Operands {
+    Smalls(isize, isize),
+    BigInts(BigInt, BigInt),
+    Floats(f64, f64),
+}
+
+fn decode_number(value: Term) -> exception::Result<Number> {
+    match value.decode()? {
+        TypedTerm::SmallInteger(i) => Ok(Number::Small(i.into())),
+        TypedTerm::BigInteger(i) => {
+            let i: &BigInt = i.as_ref().into();
+            Ok(Number::Big(i.clone()))
+        }
+        TypedTerm::Float(f) => Ok(Number::Float(f.into())),
+        _ => Err(badarith(anyhow!("{} is not a number", value).into()).into()),
+    }
+}
+
+/// Decodes both operands, promoting one of them if their types differ
+fn decode_operands(lhs: Term, rhs: Term) -> exception::Result<Operands> {
+    let operands = match (decode_number(lhs), decode_number(rhs)) {
+        (Ok(l), Ok(r)) => (l, r),
+        _ => {
+            return Err(badarith(anyhow!("{} and {} aren't both numbers", lhs, rhs).into()).into())
+        }
+    };
+    let operands = match operands {
+        (Number::Small(l), Number::Small(r)) => Operands::Smalls(l, r),
+        (Number::Small(l), Number::Big(r)) => Operands::BigInts(l.into(), r),
+        (Number::Big(l), Number::Small(r)) => Operands::BigInts(l, r.into()),
+        (Number::Big(l), Number::Big(r)) => Operands::BigInts(l, r),
+        (Number::Float(l), Number::Float(r)) => Operands::Floats(l, r),
+        (Number::Float(l), r) => Operands::Floats(l, to_f64(r)),
+        (l, Number::Float(r)) => Operands::Floats(to_f64(l), r),
+    };
+    Ok(operands)
+}
+
+fn to_f64(number: Number) -> f64 {
+    match number {
+        Number::Small(i) => i as f64,
+        // Too large to be represented, which makes the result of the operation raise
+        Number::Big(i) => i.to_f64().unwrap_or(f64::NAN),
+        Number::Float(f) => f,
+    }
+}
+
+/// Shifts `lhs` left by `rhs` bits, or right if `rhs` is negative, or if `right` is set
+///
+/// Raises `system_limit` if the result would be larger than the largest integer.
+fn bit_shift(process: &Process, lhs: Term, rhs: Term, right: bool) -> exception::Result<Term> {
+    const MAX_SHIFT: isize = (mem::size_of::<isize>() * 8 - 1) as isize;
+    // As in BEAM, which limits integers to `(1 << 19) - 1` 64-bit words
+    const MAX_BITS: u64 = ((1 << 19) - 1) * 64;
+
+    let (value, shift) = match decode_operands(lhs, rhs)? {
+        Operands::Smalls(l, r) => (Number::Small(l), r),
+        // A shift too large for an `isize` either shifts out all of the bits, or makes
+        // an integer far larger than the limit
+        Operands::BigInts(l, r) => match r.to_isize() {
+            Some(r) => (Number::Big(l), r),
+            None if r > BigInt::zero() => (Number::Big(l), isize::max_value()),
+            None => (Number::Big(l), isize::min_value()),
+        },
+        Operands::Floats(..) => return Err(not_integers(lhs, rhs)),
+    };
+    // Negating the smallest shift saturates, as that shifts out all of the bits anyway
+    let shift = if right {
+        shift.checked_neg().unwrap_or(isize::max_value())
+    } else {
+        shift
+    };
+
+    // Zero stays zero however far it is shifted
+    if let Number::Small(0) = value {
+        return Ok(process.integer(0)?);
+    }
+    if let Number::Big(i) = &value {
+        if i.is_zero() {
+            return Ok(process.integer(0)?);
+        }
+    }
+    if shift > 0 {
+        let bits = match &value {
+            Number::Small(i) => {
+                let magnitude = if *i < 0 { !*i } else { *i };
+                (mem::size_of::<isize>() * 8) as u64 - magnitude.leading_zeros() as u64
+            }
+            Number::Big(i) => i.bits() as u64,
+            Number::Float(_) => unreachable!(),
+        };
+        if bits.saturating_add(shift as u64) > MAX_BITS {
+            return Err(system_limit(lhs, rhs));
+        }
+    }
+
+    match value {
+        // Shifting right, which can't overflow
+        Number::Small(i) if shift <= 0 => {
+            let shift = shift.checked_neg().unwrap_or(MAX_SHIFT).min(MAX_SHIFT);
+            Ok(process.integer(i >> shift)?)
+        }
+        // Shifting left without overflowing
+        Number::Small(i) if shift <= MAX_SHIFT && (i << shift) >> shift == i => {
+            Ok(process.integer(i << shift)?)
+        }
+        Number::Small(i) => Ok(process.integer(BigInt::from(i) << shift as usize)?),
+        Number::Big(i) if shift >= 0 => Ok(process.integer(i << shift as usize)?),
+        Number::Big(i) => {
+            let shift = shift.checked_neg().unwrap_or(isize::max_value());
+            Ok(process.integer(i >> shift as usize)?)
+        }
+        Number::Float(_) => unreachable!(),
+    }
+}
+
+/// Allocates the result of a float operation, which raises if it is not finite
+fn float(process: &Process, f: f64) -> exception::Result<Term> {
+    if f.is_finite() {
+        Ok(process.float(f)?)
+    } else {
+        Err(badarith(anyhow!("float operation resulted in {}", f).into()).into())
+    }
+}
+
+fn division_by_zero() -> Exception {
+    badarith(anyhow!("division by zero").into()).into()
+}
+
+fn system_limit(lhs: Term, rhs: Term) -> Exception {
+    let source = anyhow!("shifting {} by {} exceeds the integer size limit", lhs, rhs).into();
+    exception::error(Atom::str_to_term("system_limit"), None, None, source).into()
+}
+
+fn not_integers(lhs: Term, rhs: Term) -> Exception {
+    badarith(anyhow!("{} and {} aren't both integers", lhs, rhs).into()).into()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::Arc;
+
+    use liblumen_alloc::erts::exception::RuntimeException;
+    use liblumen_alloc::erts::process::{self, Priority};
+    use liblumen_alloc::erts::ModuleFunctionArity;
+
+    fn process() -> Process {
+        let (heap, heap_size) = process::alloc::default_heap().unwrap();
+        Process::new(
+            Priority::Normal,
+            None,
+            Arc::new(ModuleFunctionArity {
+                module: Atom::from_str("builtins_test"),
+                function: Atom::from_str("process"),
+                arity: 0,
+            }),
+            heap,
+            heap_size,
+        )
+    }
+
+    fn assert_raises(result: exception::Result<Term>, reason: &str) {
+        match result {
+            Err(Exception::Runtime(RuntimeException::Error(err))) => {
+                assert_eq!(err.reason(), Atom::str_to_term(reason))
+            }
+            Err(err) => panic!("expected {}, raised {:?}", reason, err),
+            Ok(term) => panic!("expected {}, returned {}", reason, term),
+        }
+    }
+
+    #[test]
+    fn bit_shift_promotes_to_bigint() {
+        let process = process();
+        let one = process.integer(1).unwrap();
+        let shift = process.integer(100).unwrap();
+
+        let result = bit_shift(&process, one, shift, false).unwrap();
+        match result.decode().unwrap() {
+            TypedTerm::BigInteger(i) => {
+                let i: &BigInt = i.as_ref().into();
+                assert_eq!(i, &(BigInt::from(1) << 100));
+            }
+            _ => panic!("{} is not a bigint", result),
+        }
+        let back = bit_shift(&process, result, shift, true).unwrap();
+        assert_eq!(back, one);
+    }
+
+    #[test]
+    fn bit_shift_past_the_integer_limit_raises_system_limit() {
+        let process = process();
+        let one = process.integer(1).unwrap();
+        let minus_one = process.integer(-1).unwrap();
+        let huge = process.integer(1isize << 40).unwrap();
+        let too_large = process.integer(BigInt::from(1) << 100).unwrap();
+
+        assert_raises(bit_shift(&process, one, huge, false), "system_limit");
+        assert_raises(bit_shift(&process, minus_one, huge, false), "system_limit");
+        assert_raises(bit_shift(&process, one, too_large, false), "system_limit");
+        assert_raises(bit_shift(&process, too_large, huge, false), "system_limit");
+        // A negative right shift is a left shift
+        let minus_huge = process.integer(-(1isize << 40)).unwrap();
+        assert_raises(bit_shift(&process, one, minus_huge, true), "system_limit");
+    }
+
+    #[test]
+    fn bit_shift_without_growing_past_the_limit_does_not_raise() {
+        let process = process();
+        let zero = process.integer(0).unwrap();
+        let one = process.integer(1).unwrap();
+        let minus_one = process.integer(-1).unwrap();
+        let huge = process.integer(1isize << 40).unwrap();
+        let too_large = process.integer(BigInt::from(1) << 100).unwrap();
+
+        assert_eq!(bit_shift(&process, zero, huge, false).unwrap(), zero);
+        assert_eq!(bit_shift(&process, zero, too_large, false).unwrap(), zero);
+        assert_eq!(bit_shift(&process, one, huge, true).unwrap(), zero);
+        assert_eq!(
+            bit_shift(&process, minus_one, too_large, true).unwrap(),
+            minus_one
+        );
+        assert_eq!(
+            bit_shift(&process, too_large, too_large, true).unwrap(),
+            zero
+        );
+    }
+}
@@ -0,0 +1,287 @@
+//! BIFs which calls to are translated to dedicated EIR ops, see the intrinsic registry in
+//! `ModuleBuilder.cpp`
+//!
+//! Those ops which are lowered to inline code only call these on the slow path, e.g. when
+//! given a literal, or an argument of the wrong type, in which case they raise `badarg`.
+use std::convert::TryInto;
+
+use anyhow::anyhow;
+
+use liblumen_alloc::erts::exception::{self, badarg, badmap};
+use liblumen_alloc::erts::process::Process;
+use liblumen_alloc::erts::term::index::OneBasedIndex;
+use liblumen_alloc::erts::term::prelude::*;
+
+use crate::distribution::nodes::node;
+use crate::process::SchedulerDependentAlloc;
+
+use super::with_process;
+
+/// `tuple_size/1`
+#[export_name = "__lumen_builtin_tuple.size"]
+pub extern "C" fn builtin_tuple_size(process: &Process, tuple: Term) -> Term {
+    with_process(process, |process| tuple_size(process, tuple))
+}
+
+/// `element/2`
+#[export_name = "__lumen_builtin_tuple.element"]
+pub extern "C" fn builtin_element(process: &Process, index: Term, tuple: Term) -> Term {
+    with_process(process, |_| element(index, tuple))
+}
+
+/// `setelement/3`
+#[export_name = "__lumen_builtin_tuple.setelement"]
+pub extern "C" fn builtin_setelement(
+    process: &Process,
+    index: Term,
+    tuple: Term,
+    value: Term,
+) -> Term {
+    with_process(process, |process| setelement(process, index, tuple, value))
+}
+
+/// `hd/1`
+#[export_name = "__lumen_builtin_list.hd"]
+pub extern "C" fn builtin_hd(process: &Process, list: Term) -> Term {
+    with_process(process, |_| Ok(decode_cons(list)?.head))
+}
+
+/// `tl/1`
+#[export_name = "__lumen_builtin_list.tl"]
+pub extern "C" fn builtin_tl(process: &Process, list: Term) -> Term {
+    with_process(process, |_| Ok(decode_cons(list)?.tail))
+}
+
+/// `byte_size/1`, which rounds up the size of bitstrings
+#[export_name = "__lumen_builtin_binary.byte_size"]
+pub extern "C" fn builtin_byte_size(process: &Process, bitstring: Term) -> Term {
+    with_process(process, |process| byte_size(process, bitstring))
+}
+
+/// `map_size/1`, which raises `{badmap, Map}` rather than `badarg`
+#[export_name = "__lumen_builtin_map.size"]
+pub extern "C" fn builtin_map_size(process: &Process, map: Term) -> Term {
+    with_process(process, |process| map_size(process, map))
+}
+
+/// `self/0`
+#[export_name = "__lumen_builtin_self"]
+pub extern "C" fn builtin_self(process: &Process) -> Term {
+    process.pid_term()
+}
+
+/// `node/0`
+#[export_name = "__lumen_builtin_node"]
+pub extern "C" fn builtin_node() -> Term {
+    node::term()
+}
+
+/// `make_ref/0`
+#[export_name = "__lumen_builtin_make_ref"]
+pub extern "C" fn builtin_make_ref(process: &Process) -> Term {
+    with_process(process, |process| Ok(process.next_reference()?))
+}
+
+fn tuple_size(process: &Process, tuple: Term) -> exception::Result<Term> {
+    let tuple = decode_tuple(tuple)?;
+    Ok(process.integer(tuple.len())?)
+}
+
+fn element(index: Term, tuple: Term) -> exception::Result<Term> {
+    let elements = decode_tuple(tuple)?;
+    let index = decode_index(index, elements.len())?;
+    Ok(elements.elements()[index])
+}
+
+fn setelement(process: &Process, index: Term, tuple: Term, value: Term) -> exception::Result<Term> {
+    let elements = decode_tuple(tuple)?;
+    let index = decode_index(index, elements.len())?;
+    let elements = elements.elements();
+    Ok(process.tuple_from_slices(&[&elements[..index], &[value], &elements[(index + 1)..]])?)
+}
+
+fn byte_size(process: &Process, bitstring: Term) -> exception::Result<Term> {
+    let byte_len = match bitstring.decode()? {
+        TypedTerm::HeapBinary(bin) => bin.total_byte_len(),
+        TypedTerm::ProcBin(bin) => bin.total_byte_len(),
+        TypedTerm::BinaryLiteral(bin) => bin.total_byte_len(),
+        TypedTerm::SubBinary(bin) => bin.total_byte_len(),
+        _ => return Err(not_a(bitstring, "bitstring")),
+    };
+    Ok(process.integer(byte_len)?)
+}
+
+fn map_size(process: &Process, map: Term) -> exception::Result<Term> {
+    match map.decode()? {
+        TypedTerm::Map(boxed) => Ok(process.integer(boxed.len())?),
+        _ => Err(badmap(process, map, anyhow!("{} is not a map", map).into())),
+    }
+}
+
+fn decode_tuple(tuple: Term) -> exception::Result<Boxed<Tuple>> {
+    match tuple.decode()? {
+        TypedTerm::Tuple(boxed) => Ok(boxed),
+        _ => Err(not_a(tuple, "tuple")),
+    }
+}
+
+fn decode_cons(list: Term) -> exception::Result<Boxed<Cons>> {
+    match list.decode()? {
+        TypedTerm::List(boxed) => Ok(boxed),
+        _ => Err(not_a(list, "non-empty list")),
+    }
+}
+
+/// Decodes a one-based index, returning it as a zero-based index into `len` elements
+fn decode_index(index: Term, len: usize) -> exception::Result<usize> {
+    let one_based: Result<OneBasedIndex, _> = index.try_into();
+    if let Ok(one_based) = one_based {
+        let i: usize = one_based.into();
+        if i < len {
+            return Ok(i);
+        }
+    }
+    Err(badarg(
+        None,
+        anyhow!("index ({}) is not in 1..={}", index, len).into(),
+    )
+    .into())
+}
+
+fn not_a(term: Term, kind: &str) -> exception::Exception {
+    badarg(None, anyhow!("{} is not a {}", term, kind).into()).into()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::Arc;
+
+    use liblumen_alloc::erts::exception::{Exception, RuntimeException};
+    use liblumen_alloc::erts::process::{self, Priority};
+    use liblumen_alloc::erts::ModuleFunctionArity;
+
+    fn process() -> Process {
+        let (heap, heap_size) = process::alloc::default_heap().unwrap();
+        Process::new(
+            Priority::Normal,
+            None,
+            Arc::new(ModuleFunctionArity {
+                module: Atom::from_str("bifs_test"),
+                function: Atom::from_str("process"),
+                arity: 0,
+            }),
+            heap,
+            heap_size,
+        )
+    }
+
+    fn atom(name: &str) -> Term {
+        Atom::str_to_term(name)
+    }
+
+    fn elements(tuple: Term) -> Vec<Term> {
+        decode_tuple(tuple).unwrap().elements().to_vec()
+    }
+
+    fn reason(result: exception::Result<Term>) -> Term {
+        match result {
+            Err(Exception::Runtime(RuntimeException::Error(err))) => err.reason(),
+            Err(err) => panic!("expected an error, raised {:?}", err),
+            Ok(term) => panic!("expected an error, returned {}", term),
+        }
+    }
+
+    #[test]
+    fn tuple_size_counts_elements() {
+        let process = process();
+        let tuple = process
+            .tuple_from_slice(&[atom("a"), atom("b"), atom("c")])
+            .unwrap();
+
+        assert_eq!(
+            tuple_size(&process, tuple).unwrap(),
+            process.integer(3).unwrap()
+        );
+        assert_eq!(reason(tuple_size(&process, atom("a"))), atom("badarg"));
+    }
+
+    #[test]
+    fn element_indices_are_one_based() {
+        let process = process();
+        let tuple = process
+            .tuple_from_slice(&[atom("a"), atom("b"), atom("c")])
+            .unwrap();
+        let index = |i: isize| process.integer(i).unwrap();
+
+        assert_eq!(element(index(1), tuple).unwrap(), atom("a"));
+        assert_eq!(element(index(3), tuple).unwrap(), atom("c"));
+        assert_eq!(reason(element(index(0), tuple)), atom("badarg"));
+        assert_eq!(reason(element(index(4), tuple)), atom("badarg"));
+        assert_eq!(reason(element(atom("a"), tuple)), atom("badarg"));
+        assert_eq!(reason(element(index(1), atom("a"))), atom("badarg"));
+    }
+
+    #[test]
+    fn setelement_copies_the_tuple() {
+        let process = process();
+        let tuple = process
+            .tuple_from_slice(&[atom("a"), atom("b"), atom("c")])
+            .unwrap();
+        let index = |i: isize| process.integer(i).unwrap();
+
+        let updated = setelement(&process, index(2), tuple, atom("x")).unwrap();
+        assert_eq!(elements(updated), vec![atom("a"), atom("x"), atom("c")]);
+        assert_eq!(elements(tuple), vec![atom("a"), atom("b"), atom("c")]);
+        let updated = setelement(&process, index(3), tuple, atom("x")).unwrap();
+        assert_eq!(elements(updated), vec![atom("a"), atom("b"), atom("x")]);
+
+        assert_eq!(
+            reason(setelement(&process, index(4), tuple, atom("x"))),
+            atom("badarg")
+        );
+    }
+
+    #[test]
+    fn only_non_empty_lists_have_a_head_and_tail() {
+        let process = process();
+        let list = process.cons(atom("a"), Term::NIL).unwrap();
+
+        let cons = decode_cons(list).unwrap();
+        assert_eq!(cons.head, atom("a"));
+        assert_eq!(cons.tail, Term::NIL);
+        assert_eq!(reason(decode_cons(Term::NIL).map(|_| list)), atom("badarg"));
+    }
+
+    #[test]
+    fn byte_size_rounds_up_bitstrings() {
+        let process = process();
+        let binary = process.binary_from_bytes(&[1, 2, 3]).unwrap();
+        // One byte and three bits
+        let bitstring = process.subbinary_from_original(binary, 0, 0, 1, 3).unwrap();
+
+        assert_eq!(
+            byte_size(&process, binary).unwrap(),
+            process.integer(3).unwrap()
+        );
+        assert_eq!(
+            byte_size(&process, bitstring).unwrap(),
+            process.integer(2).unwrap()
+        );
+        assert_eq!(reason(byte_size(&process, atom("a"))), atom("badarg"));
+    }
+
+    #[test]
+    fn map_size_raises_badmap() {
+        let process = process();
+        let map = process.map_from_slice(&[(atom("k"), atom("v"))]).unwrap();
+
+        assert_eq!(
+            map_size(&process, map).unwrap(),
+            process.integer(1).unwrap()
+        );
+        let reason = reason(map_size(&process, atom("a")));
+        assert_eq!(elements(reason), vec![atom("badmap"), atom("a")]);
+    }
+}
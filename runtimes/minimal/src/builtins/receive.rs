@@ -0,0 +1,196 @@
+//! Receive builtins called by generated code
+//!
+//! A selective receive is compiled to a loop which matches each message inline, see the
+//! receive ops in `EIROps.td`; these only move the cursor of the mailbox of the process,
+//! so each costs the same however many messages are waiting.
+//!
+//! A receive with a finite timeout starts a timer the first time it waits, which makes
+//! the process runnable again when the timeout expires, and is cancelled if a message is
+//! accepted first.
+use anyhow::anyhow;
+
+use liblumen_alloc::erts::exception::{self, RuntimeException};
+use liblumen_alloc::erts::process::{Process, ReceiveTimer};
+use liblumen_alloc::erts::term::prelude::*;
+
+use lumen_rt_core::time::monotonic;
+use lumen_rt_core::Scheduler as SchedulerTrait;
+
+use crate::scheduler::{process_yield, Scheduler};
+
+/// Starts a receive which times out after `timeout` milliseconds, or never if it is
+/// `infinity`, returning NONE if it is neither, after raising `timeout_value`
+#[export_name = "__lumen_builtin_receive_start"]
+pub extern "C" fn builtin_receive_start(process: &Process, timeout: Term) -> Term {
+    match decode_deadline(timeout) {
+        Ok(deadline) => {
+            process
+                .mailbox
+                .lock()
+                .borrow_mut()
+                .recv_start_with_deadline(deadline);
+
+            Term::NIL
+        }
+        Err(exception) => {
+            process.exception(exception);
+
+            Term::NONE
+        }
+    }
+}
+
+/// Returns the message at the cursor, advancing past it, or NONE if every message has
+/// been seen
+#[export_name = "__lumen_builtin_receive_peek"]
+pub extern "C" fn builtin_receive_peek(process: &Process) -> Term {
+    let mailbox_guard = process.mailbox.lock();
+    let mut mailbox = mailbox_guard.borrow_mut();
+
+    match mailbox.recv_peek() {
+        Some(message) => {
+            mailbox.recv_increment();
+
+            message
+        }
+        None => Term::NONE,
+    }
+}
+
+/// Suspends the process until a message arrives after those already seen, returning
+/// `true` if the timeout of the current receive expires first
+#[export_name = "__lumen_builtin_receive_wait"]
+pub extern "C" fn builtin_receive_wait(process: &Process) -> bool {
+    loop {
+        // The process may have been stolen by another scheduler while it was suspended
+        let scheduler = Scheduler::current();
+
+        // mailbox lock scope, which is held while the process starts waiting, so that a
+        // message pushed after the check finds it waiting and makes it runnable
+        let start_timer = {
+            let mailbox_guard = process.mailbox.lock();
+            let mut mailbox = mailbox_guard.borrow_mut();
+
+            if mailbox.recv_pending() {
+                return false;
+            }
+
+            match mailbox.recv_deadline() {
+                None => {
+                    process.wait();
+
+                    None
+                }
+                Some(deadline) if deadline <= monotonic::time_in_milliseconds() => {
+                    mailbox.recv_end();
+                    let timer = mailbox.recv_take_timer();
+                    drop(mailbox);
+                    drop(mailbox_guard);
+
+                    cancel_timer(timer);
+
+                    return true;
+                }
+                Some(deadline) => {
+                    process.wait();
+
+                    if mailbox.recv_has_timer() {
+                        None
+                    } else {
+                        let reference = scheduler.next_reference_number();
+                        mailbox.recv_set_timer(ReceiveTimer {
+                            scheduler_id: scheduler.id(),
+                            reference,
+                        });
+
+                        Some((deadline, reference))
+                    }
+                }
+            }
+        };
+
+        // The timer only fires once this scheduler switches processes, so it cannot wake
+        // the process before it has yielded
+        if let Some((deadline, reference)) = start_timer {
+            scheduler.start_wake_timer(deadline, reference);
+        }
+
+        unsafe {
+            process_yield();
+        }
+    }
+}
+
+/// Removes the message last peeked, which the receive accepted
+#[export_name = "__lumen_builtin_receive_done"]
+pub extern "C" fn builtin_receive_done(process: &Process) {
+    let timer = {
+        let mailbox_guard = process.mailbox.lock();
+        let mut mailbox = mailbox_guard.borrow_mut();
+
+        mailbox.recv_remove();
+
+        mailbox.recv_take_timer()
+    };
+
+    cancel_timer(timer);
+}
+
+/// Saves the end of the mailbox for `reference`, which has just been made
+#[export_name = "__lumen_builtin_receive_mark"]
+pub extern "C" fn builtin_receive_mark(process: &Process, reference: Term) {
+    if let Some(number) = reference_number(reference) {
+        process.mailbox.lock().borrow_mut().recv_mark(number);
+    }
+}
+
+/// Moves the cursor of the receive just started to the end of the mailbox saved for
+/// `reference`, if it is the last reference marked
+#[export_name = "__lumen_builtin_receive_set"]
+pub extern "C" fn builtin_receive_set(process: &Process, reference: Term) {
+    if let Some(number) = reference_number(reference) {
+        process.mailbox.lock().borrow_mut().recv_set(number);
+    }
+}
+
+/// Decodes a timeout, returning when it expires, in monotonic milliseconds, if it does
+fn decode_deadline(timeout: Term) -> Result<Option<u64>, RuntimeException> {
+    match timeout.decode() {
+        Ok(TypedTerm::Atom(atom)) if atom.name() == "infinity" => Ok(None),
+        Ok(TypedTerm::SmallInteger(small)) => {
+            let milliseconds: isize = small.into();
+            if 0 <= milliseconds {
+                Ok(Some(
+                    monotonic::time_in_milliseconds() + (milliseconds as u64),
+                ))
+            } else {
+                Err(timeout_value(timeout))
+            }
+        }
+        _ => Err(timeout_value(timeout)),
+    }
+}
+
+fn timeout_value(timeout: Term) -> RuntimeException {
+    exception::error(
+        Atom::str_to_term("timeout_value"),
+        None,
+        None,
+        anyhow!("{} is not a valid timeout", timeout).into(),
+    )
+}
+
+/// Cancels the timer of a receive which has ended, outside of the mailbox lock, as the
+/// timer may fire, and send a message, on another scheduler meanwhile
+fn cancel_timer(timer: Option<ReceiveTimer>) {
+    if let Some(timer) = timer {
+        Scheduler::cancel_wake_timer(timer);
+    }
+}
+
+fn reference_number(reference: Term) -> Option<ReferenceNumber> {
+    match reference.decode() {
+        Ok(TypedTerm::Reference(reference)) => Some(reference.number()),
+        _ => None,
+    }
+}
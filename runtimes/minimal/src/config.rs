@@ -51,6 +51,7 @@ pub struct Config {
     pub debug: bool,
     pub name: Option<String>,
     pub cookie: Option<String>,
+    pub schedulers: Option<usize>,
     pub command: Command,
     pub extra: Vec<String>,
 }
@@ -92,6 +93,12 @@ impl Config {
                      .help("The secret cookie to use in distributed mode")
                      .takes_value(true)
                      .env("COOKIE"))
+            .arg(Arg::with_name("schedulers")
+                     .long("schedulers")
+                     .help("The number of scheduler threads to run\n\
+                            Defaults to the number of logical CPUs available")
+                     .takes_value(true)
+                     .validator(is_valid_scheduler_count))
             .arg(Arg::with_name("extra")
                      .last(true)
                      .multiple(true)
@@ -132,6 +139,7 @@ impl Config {
             debug: matches.is_present("debug"),
             name: matches.value_of("name").map(|v| v.to_string()),
             cookie: matches.value_of("cookie").map(|v| v.to_string()),
+            schedulers: matches.value_of("schedulers").map(|v| v.parse().unwrap()),
             command,
             extra: extra.iter().map(|v| v.to_string()).collect(),
         })
@@ -143,6 +151,16 @@ fn is_valid_node_name(_f: String) -> Result<(), String> {
     Ok(())
 }
 
+fn is_valid_scheduler_count(count: String) -> Result<(), String> {
+    match count.parse::<usize>() {
+        Ok(n) if n > 0 => Ok(()),
+        _ => Err(format!(
+            "expected a positive number of schedulers, got '{}'",
+            count
+        )),
+    }
+}
+
 fn with_file<T>(v: Option<&OsStr>, default: T, fun: fn(String) -> T) -> ConfigResult<T> {
     match v {
         None => Ok(default),
@@ -6,8 +6,6 @@ use once_cell::sync::OnceCell;
 use liblumen_alloc::erts::process::{Process, ProcessFlags};
 use liblumen_alloc::erts::term::prelude::*;
 
-use crate::scheduler::Scheduler;
-
 static ARGV: OnceCell<Vec<String>> = OnceCell::new();
 static ARGV_TERM: OnceCell<Vec<BinaryLiteral>> = OnceCell::new();
 
@@ -98,11 +96,7 @@ pub fn get_argv_literals<'a>() -> Option<&'a [BinaryLiteral]> {
 }
 
 #[export_name = "init:get_plain_arguments/0"]
-pub extern "C" fn get_plain_arguments() -> Term {
-    get_plain_arguments_with_process(&Scheduler::current_process())
-}
-
-fn get_plain_arguments_with_process(process: &Process) -> Term {
+pub extern "C" fn get_plain_arguments(process: &Process) -> Term {
     let argv = get_argv_literals();
     if argv.is_none() {
         return Term::NIL;
@@ -3,12 +3,19 @@
 #![feature(termination_trait_lib)]
 #![feature(thread_local)]
 #![feature(alloc_layout_extra)]
+#![feature(test)]
 
 #[cfg(not(unix))]
 compile_error!("lumen_rt_minimal is only supported on unix targets!");
 
+#[cfg(test)]
+extern crate test;
+
 #[macro_use]
 mod macros;
+#[cfg(test)]
+mod benches;
+mod builtins;
 mod config;
 mod distribution;
 pub mod env;
@@ -17,6 +24,8 @@ mod process;
 mod scheduler;
 mod sys;
 
+use std::thread;
+
 use bus::Bus;
 use log::Level;
 
@@ -36,7 +45,7 @@ fn main() -> impl ::std::process::Termination + 'static {
 fn main_internal(name: &str, version: &str, argv: Vec<String>) -> Result<(), ()> {
     self::env::init_argv_from_slice(std::env::args_os()).unwrap();
     // Load system configuration
-    let _config = match Config::from_argv(name.to_string(), version.to_string(), argv) {
+    let config = match Config::from_argv(name.to_string(), version.to_string(), argv) {
         Ok(config) => config,
         Err(err) => {
             panic!("Config error: {}", err);
@@ -54,8 +63,23 @@ fn main_internal(name: &str, version: &str, argv: Vec<String>) -> Result<(), ()>
     let level_filter = Level::Info.to_level_filter();
     logging::init(level_filter).expect("Unexpected failure initializing logger");
 
+    // Run one scheduler per core, this thread being the first
+    let num_schedulers = config.schedulers.unwrap_or_else(sys::cpus::num_logical);
+    scheduler::set_num_schedulers(num_schedulers);
+
     let scheduler = <Scheduler as rt_core::Scheduler>::current();
     scheduler.init().unwrap();
+
+    // The other schedulers start out idle, and steal from this one as init spawns processes
+    let workers: Vec<_> = (1..num_schedulers)
+        .map(|i| {
+            thread::Builder::new()
+                .name(format!("scheduler-{}", i))
+                .spawn(scheduler::run)
+                .expect("unable to spawn scheduler thread")
+        })
+        .collect();
+
     loop {
         // Run the scheduler for a cycle
         let scheduled = scheduler.run_once();
@@ -64,6 +88,7 @@ fn main_internal(name: &str, version: &str, argv: Vec<String>) -> Result<(), ()>
             match sig {
                 // For now, SIGINT initiates a controlled shutdown
                 Signal::INT => {
+                    scheduler::halt();
                     // If an error occurs, report it before shutdown
                     if let Err(err) = scheduler.shutdown() {
                         eprintln!("System error: {}", err);
@@ -89,8 +114,14 @@ fn main_internal(name: &str, version: &str, argv: Vec<String>) -> Result<(), ()>
         if scheduled {
             continue;
         }
+        // Otherwise, sleep until there is work again, or every scheduler is idle
+        if !scheduler.park() {
+            break;
+        }
+    }
 
-        break;
+    for worker in workers {
+        let _ = worker.join();
     }
 
     match scheduler.shutdown() {
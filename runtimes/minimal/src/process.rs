@@ -9,7 +9,7 @@ use liblumen_core::locks::RwLockWriteGuard;
 
 use liblumen_alloc::erts::exception::{self, AllocResult, ArcError, RuntimeException};
 use liblumen_alloc::erts::process::alloc::{Heap, TermAlloc};
-use liblumen_alloc::erts::process::{Process, ProcessHeap};
+use liblumen_alloc::erts::process::{Process, ProcessHeap, Status};
 use liblumen_alloc::erts::term::prelude::*;
 use liblumen_alloc::{atom, CloneToProcess, HeapFragment, Monitor};
 
@@ -89,6 +89,31 @@ pub fn propagate_exit(process: &Process, exception: &RuntimeException) {
     propagate_exit_to_links(process, exception);
 }
 
+/// Makes `process` runnable again if it is waiting, as it has to be once a message has
+/// been sent to it, or it has been made to exit
+///
+/// The status is changed before the process is looked for in the waiting set, so that a
+/// scheduler which is about to put it there sees the change, see `Queues::requeue`.
+pub fn stop_waiting(process: &Process) {
+    // status.write() scope
+    {
+        let mut writable_status = process.status.write();
+
+        match *writable_status {
+            Status::Waiting => *writable_status = Status::Runnable,
+            Status::Exiting(_) => (),
+            _ => return,
+        }
+    }
+
+    if let Some(scheduler) = process
+        .scheduler_id()
+        .and_then(|scheduler_id| Scheduler::from_id(&scheduler_id))
+    {
+        scheduler.stop_waiting(process);
+    }
+}
+
 pub fn propagate_exit_to_links(process: &Process, exception: &RuntimeException) {
     if !is_expected_exception(exception) {
         let tag = atom!("EXIT");
@@ -148,6 +173,8 @@ pub fn propagate_exit_to_links(process: &Process, exception: &RuntimeException)
                         }
                     }
                 }
+
+                stop_waiting(&linked_pid_arc_process);
             }
         }
     }
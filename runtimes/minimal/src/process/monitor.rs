@@ -69,6 +69,8 @@ pub fn propagate_exit(process: &Process, exception: &RuntimeException) {
                     );
                 }
             }
+
+            super::stop_waiting(&monitoring_pid_arc_process);
         }
     }
 }
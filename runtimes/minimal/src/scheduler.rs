@@ -1,4 +1,5 @@
 #![allow(unused)]
+mod parking;
 mod run_queue;
 
 use std::alloc::Layout;
@@ -9,6 +10,7 @@ use std::ops::Deref;
 use std::ptr;
 use std::sync::atomic::{AtomicU64, Ordering};
 use std::sync::{Arc, Weak};
+use std::thread::{self, Thread};
 
 use hashbrown::HashMap;
 
@@ -22,14 +24,23 @@ use liblumen_core::locks::{Mutex, RwLock};
 use liblumen_alloc::atom;
 use liblumen_alloc::erts::apply;
 use liblumen_alloc::erts::process;
-use liblumen_alloc::erts::process::{CalleeSavedRegisters, Priority, Process, Status};
+use liblumen_alloc::erts::process::{
+    CalleeSavedRegisters, Priority, Process, ReceiveTimer, Status,
+};
 use liblumen_alloc::erts::scheduler::id;
 use liblumen_alloc::erts::term::prelude::{Atom, ReferenceNumber, Term};
 use liblumen_alloc::erts::ModuleFunctionArity;
 
 use lumen_rt_core as rt_core;
+use lumen_rt_core::time::Milliseconds;
 use lumen_rt_core::timer::Hierarchy;
 
+pub use self::parking::{halt, is_halted, set_num_schedulers};
+
+const NO_STEAL_REQUEST: u64 = u64::max_value();
+
+// Each scheduler thread counts the reductions of the process it is running
+#[thread_local]
 static CURRENT_REDUCTION_COUNT: AtomicU64 = AtomicU64::new(0);
 
 /*
@@ -80,6 +91,27 @@ pub unsafe extern "C" fn process_return_continuation() {
     );
 }
 
+/// The first code a newly spawned process runs, returned into by `swap_stack`
+///
+/// Erlang functions take the process they run in as an implicit first argument, so
+/// this calls the init function, left in `r13` by `spawn_internal`, with the process
+/// left in `r12`. As it jumps rather than calls, the init function returns into
+/// `process_return_continuation`, which is beneath it on the stack.
+#[naked]
+#[inline(never)]
+#[cfg(all(unix, target_arch = "x86_64"))]
+unsafe extern "C" fn process_entry() {
+    asm!("
+        movq %r12, %rdi
+        jmpq *%r13
+        "
+    :
+    :
+    :
+    : "volatile"
+    );
+}
+
 #[inline(never)]
 fn process_return() {
     let s = <Scheduler as rt_core::Scheduler>::current();
@@ -87,10 +119,9 @@ fn process_return() {
 }
 
 #[export_name = "__lumen_builtin_malloc"]
-pub unsafe extern "C" fn builtin_malloc(bytes: usize) -> *mut u8 {
+pub unsafe extern "C" fn builtin_malloc(process: &Process, bytes: usize) -> *mut u8 {
     if let Ok(layout) = Layout::from_size_align(bytes, mem::align_of::<Term>()) {
-        let s = <Scheduler as rt_core::Scheduler>::current();
-        let result = s.current.alloc_nofrag_layout(layout);
+        let result = process.alloc_nofrag_layout(layout);
         if let Ok(nn) = result {
             return nn.as_ptr() as *mut u8;
         }
@@ -125,6 +156,10 @@ impl ScheduledProcess {
     fn replace(&self, process: Arc<Process>) -> Arc<Process> {
         self.process.replace(process)
     }
+
+    fn to_arc(&self) -> Arc<Process> {
+        unsafe { (*self.process.as_ptr()).clone() }
+    }
 }
 impl Deref for ScheduledProcess {
     type Target = Process;
@@ -148,13 +183,19 @@ pub struct Scheduler {
     hierarchy: RwLock<Hierarchy>,
     // References are always 64-bits even on 32-bit platforms
     reference_count: AtomicU64,
-    run_queues: RwLock<run_queue::Queues>,
+    run_queues: run_queue::Queues,
     // Non-monotonic unique integers are scoped to the scheduler ID and then use this per-scheduler
     // `u64`.
     unique_integer: AtomicU64,
     root: Arc<Process>,
     init: Cell<Arc<Process>>,
     current: ScheduledProcess,
+    // The thread this scheduler runs on, used to wake it when it is parked
+    thread: Thread,
+    // Rotates the first victim tried when stealing, so idle schedulers spread out
+    steal_cursor: AtomicU64,
+    // The ID of a scheduler which has asked this one for processes, or `NO_STEAL_REQUEST`
+    steal_request: AtomicU64,
 }
 // This guarantee holds as long as `init` and `current` are only
 // ever accessed by the scheduler when scheduling
@@ -224,6 +265,9 @@ impl Scheduler {
             hierarchy: Default::default(),
             reference_count: AtomicU64::new(0),
             unique_integer: AtomicU64::new(0),
+            thread: thread::current(),
+            steal_cursor: AtomicU64::new(Into::<u32>::into(id) as u64),
+            steal_request: AtomicU64::new(NO_STEAL_REQUEST),
         })
     }
 
@@ -285,19 +329,168 @@ impl Scheduler {
 
     /// Returns the length of the current scheduler's run queue
     pub fn run_queues_len(&self) -> usize {
-        self.run_queues.read().len()
+        self.run_queues.len()
     }
 
     /// Returns the length of a specific run queue in the current scheduler
     #[cfg(test)]
     pub fn run_queue_len(&self, priority: Priority) -> usize {
-        self.run_queues.read().run_queue_len(priority)
+        self.run_queues.run_queue_len(priority)
     }
 
     /// Returns true if the given process is in the current scheduler's run queue
     #[cfg(test)]
     pub fn is_run_queued(&self, value: &Arc<Process>) -> bool {
-        self.run_queues.read().contains(value)
+        self.run_queues.contains(value)
+    }
+
+    /// Spawns a process on this scheduler, as `spawn` does, but through a shared reference
+    #[cfg(test)]
+    pub(crate) fn spawn_shared(&self, process: Arc<Process>) {
+        Self::spawn_internal(process, self.id, &self.run_queues);
+    }
+
+    /// Makes `process` the current process without switching to its stack, returning
+    /// the previous one, so builtins which act on the current process can be called
+    /// directly; the previous process must be restored before scheduling again
+    #[cfg(test)]
+    pub(crate) fn replace_current(&self, process: Arc<Process>) -> Arc<Process> {
+        self.current.replace(process)
+    }
+
+    /// Makes a waiting process runnable again, e.g. when it has been sent a message,
+    /// waking this scheduler if it is parked
+    ///
+    /// If the process was donated to another scheduler in the meantime, it is woken there.
+    pub fn stop_waiting(&self, process: &Process) {
+        if self.run_queues.stop_waiting(process) {
+            self.thread.unpark();
+            return;
+        }
+
+        // Waiting processes are never donated, so if it wasn't waiting here, and has
+        // moved since its scheduler was looked up, it may be waiting where it moved to
+        match process.scheduler_id() {
+            Some(id) if id != self.id => {
+                if let Some(scheduler) = Self::from_id(&id) {
+                    scheduler.stop_waiting(process);
+                }
+            }
+            _ => (),
+        }
+    }
+
+    /// Starts a timer, numbered `reference_number`, which makes the current process
+    /// runnable again at `deadline`, in monotonic milliseconds, if it is still waiting
+    ///
+    /// The timer fires when this scheduler next switches processes, or wakes from parking.
+    pub fn start_wake_timer(&self, deadline: Milliseconds, reference_number: ReferenceNumber) {
+        let process = Arc::downgrade(&self.current.to_arc());
+
+        self.hierarchy
+            .write()
+            .start_wake(deadline, reference_number, process, |arc_process| {
+                crate::process::stop_waiting(&arc_process)
+            });
+    }
+
+    /// Cancels a timer started by `start_wake_timer` on whichever scheduler started it, as
+    /// the process may have been stolen since
+    pub fn cancel_wake_timer(timer: ReceiveTimer) {
+        if let Some(scheduler) = Self::from_id(&timer.scheduler_id) {
+            scheduler.hierarchy.write().cancel(timer.reference);
+        }
+    }
+
+    /// Asks another scheduler for some of its runnable processes, returning `true` if
+    /// a request was made
+    ///
+    /// Victims are tried in turn, starting from a different one on each attempt, and the
+    /// first with runnable processes, and no other pending request, is asked. It donates
+    /// half of its runnable processes the next time it switches processes, pushing them
+    /// onto this scheduler's inbound queues and waking it, so that only the owner of a
+    /// run queue ever takes processes out of it.
+    pub fn steal(&self) -> bool {
+        let victims: Vec<Arc<Scheduler>> = Self::all()
+            .into_iter()
+            .filter(|s| s.id != self.id)
+            .collect();
+        self.request_steal(&victims)
+    }
+
+    fn request_steal(&self, victims: &[Arc<Scheduler>]) -> bool {
+        if victims.is_empty() {
+            return false;
+        }
+
+        let thief = Into::<u32>::into(self.id) as u64;
+        let start = self.steal_cursor.fetch_add(1, Ordering::Relaxed) as usize;
+        for i in 0..victims.len() {
+            let victim = &victims[(start + i) % victims.len()];
+            if victim.run_queues.runnable_len() == 0 {
+                continue;
+            }
+            if victim
+                .steal_request
+                .compare_exchange(NO_STEAL_REQUEST, thief, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+            {
+                return true;
+            }
+        }
+
+        false
+    }
+
+    /// Serves a pending steal request, if there is one
+    #[inline]
+    fn donate(&self) {
+        if self.steal_request.load(Ordering::Relaxed) == NO_STEAL_REQUEST {
+            return;
+        }
+        let thief = self.steal_request.swap(NO_STEAL_REQUEST, Ordering::AcqRel);
+        let thief = match Self::from_id(&id::ID::from(thief as u32)) {
+            Some(thief) => thief,
+            None => return,
+        };
+
+        let donated = self.run_queues.donate();
+        if donated.is_empty() {
+            return;
+        }
+        info!(
+            "donating {} processes to scheduler {}",
+            donated.len(),
+            thief.id
+        );
+        for process in donated {
+            process.schedule_with(thief.id);
+            thief.run_queues.push(process);
+        }
+        thief.thread.unpark();
+    }
+
+    /// Parks this scheduler's thread until there may be work for it again
+    ///
+    /// Returns `false` if the system has halted, and the scheduler loop should exit
+    ///
+    /// A scheduler with pending timers still has work, as they may make a waiting process
+    /// runnable again.
+    pub fn park(&self) -> bool {
+        parking::park(|| {
+            Self::all()
+                .iter()
+                .any(|s| 0 < s.run_queues.runnable_len() || !s.hierarchy.read().is_empty())
+        })
+    }
+
+    /// Returns all of the currently registered schedulers
+    fn all() -> Vec<Arc<Self>> {
+        SCHEDULERS
+            .lock()
+            .values()
+            .filter_map(|s| s.upgrade())
+            .collect()
     }
 
     pub fn current_process() -> Arc<Process> {
@@ -388,12 +581,10 @@ impl Scheduler {
     fn process_yield(&self, is_root: bool) -> bool {
         info!("entering core scheduler loop");
         self.hierarchy.write().timeout();
+        self.donate();
 
         loop {
-            let next = {
-                let mut rq = self.run_queues.write();
-                rq.dequeue()
-            };
+            let next = self.run_queues.dequeue();
 
             match next {
                 Run::Now(process) => {
@@ -424,13 +615,12 @@ impl Scheduler {
                 }
                 Run::None if is_root => {
                     info!("no processes remaining to schedule, exiting loop");
-                    // If no processes are available, then the scheduler should steal,
-                    // but if it can't/doesn't, then it must terminate, as there is
-                    // nothing we can swap to. When we break here, we're returning
-                    // to the core scheduler loop, which _must_ terminate, if it does
-                    // not, we'll just end up right back here again.
-                    //
-                    // TODO: stealing
+                    // If no processes are available, then the scheduler asks another
+                    // scheduler for some, which arrive once that scheduler next switches
+                    // processes. Until then there is nothing we can swap to. When we break
+                    // here, we're returning to the core scheduler loop, which parks until
+                    // there is work again, or the system halts
+                    self.steal();
                     break false;
                 }
                 Run::None => unreachable!(),
@@ -482,7 +672,10 @@ impl Scheduler {
         // Then try to schedule it for the future
         // If the process is exiting, then handle the exit, otherwise
         // proceed to the stack swap
-        if let Some(exiting) = self.run_queues.write().requeue(prev) {
+        //
+        // The root process is pinned, so that it is never donated to another scheduler
+        let pinned = prev.pid() == self.root.pid();
+        if let Some(exiting) = self.run_queues.requeue(prev, pinned) {
             if let Status::Exiting(ref ex) = *exiting.status.read() {
                 crate::process::log_exit(&exiting, ex);
                 crate::process::propagate_exit(&exiting, ex);
@@ -521,8 +714,8 @@ impl Scheduler {
 
         process.schedule_with(self.id);
 
-        let mut rq = self.run_queues.write();
-        rq.enqueue(process);
+        self.run_queues.push(process);
+        self.thread.unpark();
     }
 
     /// Spawns a new process using the given init function as its entry
@@ -538,7 +731,7 @@ impl Scheduler {
     fn spawn_root(
         process: Arc<Process>,
         id: id::ID,
-        _run_queues: &RwLock<run_queue::Queues>,
+        _run_queues: &run_queue::Queues,
     ) -> anyhow::Result<()> {
         process.schedule_with(id);
 
@@ -547,7 +740,7 @@ impl Scheduler {
         Ok(())
     }
 
-    fn spawn_internal(process: Arc<Process>, id: id::ID, run_queues: &RwLock<run_queue::Queues>) {
+    fn spawn_internal(process: Arc<Process>, id: id::ID, run_queues: &run_queue::Queues) {
         process.schedule_with(id);
 
         let mfa = &process.initial_module_function_arity;
@@ -566,9 +759,11 @@ impl Scheduler {
             ptr::write(sp.0, value);
         }
 
-        // Write the return function and init function to the end of the stack,
+        // Write the return function and entry function to the end of the stack,
         // when execution resumes, the pointer before the stack pointer will be
-        // used as the return address - the first time that will be the init function.
+        // used as the return address - the first time that will be `process_entry`,
+        // which calls the init function with the process in the registers restored
+        // by `swap_stack`.
         //
         // When execution returns from the init function, then it will return via
         // `process_return`, which will return to the scheduler and indicate that
@@ -579,7 +774,12 @@ impl Scheduler {
             // Function that will be called when returning from init_fn
             push(&mut sp, process_return_continuation as u64);
             // Function that the newly spawned process should call first
-            push(&mut sp, init_fn as u64);
+            push(&mut sp, process_entry as u64);
+            // Arguments of `process_entry`, the process and its init function
+            let r12 = &process.registers.r12 as *const u64 as *mut _;
+            ptr::write(r12, &*process as *const Process as u64);
+            let r13 = &process.registers.r13 as *const u64 as *mut _;
+            ptr::write(r13, init_fn as u64);
             // Update process stack pointer
             let s_top = &process.stack.top as *const _ as *mut _;
             ptr::write(s_top, sp.0 as *const u8);
@@ -592,8 +792,34 @@ impl Scheduler {
 
         *process.status.write() = Status::Runnable;
 
-        let mut rq = run_queues.write();
-        rq.enqueue(process);
+        // Processes are only ever spawned from the thread of the scheduler they are spawned on
+        run_queues.enqueue(process);
+
+        // Give an idle scheduler the chance to steal the new process
+        parking::notify_one();
+    }
+}
+
+/// Runs the scheduler loop for an additional scheduler thread
+///
+/// Additional schedulers start out with no processes, they get work by stealing it
+/// from the other schedulers, and exit when the system halts.
+pub fn run() {
+    let scheduler = <Scheduler as rt_core::Scheduler>::current();
+    loop {
+        if is_halted() {
+            break;
+        }
+        if scheduler.run_once() {
+            continue;
+        }
+        if !scheduler.park() {
+            break;
+        }
+    }
+
+    if let Err(err) = scheduler.shutdown() {
+        eprintln!("System error: {}", err);
     }
 }
 
@@ -646,3 +872,161 @@ unsafe fn swap_stack(prev: *mut CalleeSavedRegisters, new: *const CalleeSavedReg
 
 #[cfg(not(all(unix, target_arch = "x86_64")))]
 compile_error!("lumen_rt_minimal does not currently support this architecture!");
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::mpsc;
+
+    /// Creates a process which is only ever queued, never run
+    fn process(priority: Priority) -> Arc<Process> {
+        Arc::new(Process::new(
+            priority,
+            None,
+            Arc::new(ModuleFunctionArity {
+                module: Atom::from_str("scheduler_test"),
+                function: Atom::from_str("process"),
+                arity: 0,
+            }),
+            ptr::null_mut(),
+            0,
+        ))
+    }
+
+    /// Runs a scheduler on another thread, which waits until it is handed `expected`
+    /// processes, then returns how many it has queued once their inbound queues are
+    /// drained into its own
+    fn spawn_thief(expected: usize) -> (Arc<Scheduler>, thread::JoinHandle<usize>) {
+        let (tx, rx) = mpsc::channel();
+        let handle = thread::spawn(move || {
+            let thief = <Scheduler as rt_core::Scheduler>::current();
+            tx.send(thief.clone()).unwrap();
+            while thief.run_queues.runnable_len() < expected {
+                thread::park();
+            }
+            thief.run_queue_len(Priority::Normal)
+        });
+        (rx.recv().unwrap(), handle)
+    }
+
+    #[test]
+    fn steal_request_is_served_by_donating_half_to_the_thief() {
+        let victim = <Scheduler as rt_core::Scheduler>::current();
+        let processes: Vec<_> = (0..4).map(|_| process(Priority::Normal)).collect();
+        for process in &processes {
+            victim.spawn_queued(process.clone());
+        }
+
+        let (thief, handle) = spawn_thief(2);
+        assert!(thief.request_steal(&[victim.clone()]));
+        victim.donate();
+
+        assert_eq!(handle.join().unwrap(), 2);
+        assert_eq!(victim.run_queues.runnable_len(), 2);
+        assert_eq!(
+            victim.steal_request.load(Ordering::Relaxed),
+            NO_STEAL_REQUEST
+        );
+        // The processes furthest from running are given away
+        for process in &processes[..2] {
+            assert_eq!(process.scheduler_id(), Some(victim.id));
+            assert!(victim.is_run_queued(process));
+        }
+        for process in &processes[2..] {
+            assert_eq!(process.scheduler_id(), Some(thief.id));
+        }
+    }
+
+    #[test]
+    fn root_process_is_never_donated() {
+        let victim = <Scheduler as rt_core::Scheduler>::current();
+        let other = process(Priority::Normal);
+        victim.spawn_queued(other.clone());
+        // As when the root process switches to another process
+        *victim.root.status.write() = Status::Runnable;
+        assert!(victim
+            .run_queues
+            .requeue(victim.root.clone(), /* pinned= */ true)
+            .is_none());
+        // The pinned root process is not counted as stealable
+        assert_eq!(victim.run_queues.runnable_len(), 1);
+
+        let (thief, handle) = spawn_thief(1);
+        assert!(thief.request_steal(&[victim.clone()]));
+        victim.donate();
+
+        assert_eq!(handle.join().unwrap(), 1);
+        assert_eq!(other.scheduler_id(), Some(thief.id));
+        assert_eq!(victim.root.scheduler_id(), Some(victim.id));
+        assert!(victim.is_run_queued(&victim.root));
+    }
+
+    #[test]
+    fn processes_made_runnable_by_other_threads_are_drained_on_dequeue() {
+        let scheduler = <Scheduler as rt_core::Scheduler>::current();
+        let waiter = process(Priority::High);
+        scheduler.spawn_queued(waiter.clone());
+        match scheduler.run_queues.dequeue() {
+            Run::Now(dequeued) => assert!(Arc::ptr_eq(&dequeued, &waiter)),
+            _ => panic!("process was not dequeued"),
+        }
+        *waiter.status.write() = Status::Waiting;
+        assert!(scheduler
+            .run_queues
+            .requeue(waiter.clone(), false)
+            .is_none());
+        assert_eq!(scheduler.run_queues.runnable_len(), 0);
+
+        // As when another process sends it a message
+        let sender = {
+            let scheduler = scheduler.clone();
+            let waiter = waiter.clone();
+            thread::spawn(move || {
+                *waiter.status.write() = Status::Runnable;
+                scheduler.stop_waiting(&waiter);
+            })
+        };
+        sender.join().unwrap();
+
+        assert_eq!(scheduler.run_queues.runnable_len(), 1);
+        match scheduler.run_queues.dequeue() {
+            Run::Now(dequeued) => assert!(Arc::ptr_eq(&dequeued, &waiter)),
+            _ => panic!("woken process was not dequeued"),
+        }
+    }
+
+    #[test]
+    fn steal_skips_victims_without_work_or_with_a_pending_request() {
+        // Registered, as schedulers unregister themselves on drop, but not bound to this
+        // thread, as none of them are run
+        let thief = Scheduler::registered();
+        let idle = Scheduler::registered();
+        let requested = Scheduler::registered();
+        let busy = Scheduler::registered();
+        for victim in &[&requested, &busy] {
+            victim.spawn_queued(process(Priority::Normal));
+        }
+        requested.steal_request.store(0, Ordering::Relaxed);
+
+        let victims = [idle.clone(), requested.clone(), busy.clone()];
+        assert!(thief.request_steal(&victims));
+
+        let thief_id = Into::<u32>::into(thief.id) as u64;
+        assert_eq!(idle.steal_request.load(Ordering::Relaxed), NO_STEAL_REQUEST);
+        assert_eq!(requested.steal_request.load(Ordering::Relaxed), 0);
+        assert_eq!(busy.steal_request.load(Ordering::Relaxed), thief_id);
+
+        // There is no one left to ask
+        assert!(!thief.request_steal(&victims));
+    }
+
+    impl Scheduler {
+        /// Queues `process` as runnable on this scheduler, as `spawn` does, without giving
+        /// it a stack to run on
+        fn spawn_queued(&self, process: Arc<Process>) {
+            process.schedule_with(self.id);
+            self.run_queues.enqueue(process);
+        }
+    }
+}
@@ -0,0 +1,227 @@
+//! Parking of idle schedulers
+//!
+//! A scheduler with nothing to run, and nothing to steal from the other schedulers,
+//! parks its thread until it is woken, either because a process was made runnable
+//! on it, or because another scheduler spawned work it could steal. Parking is
+//! bounded by a timeout, so that timers keep firing on idle schedulers.
+//!
+//! When the last running scheduler parks, and no scheduler has a runnable process,
+//! nothing can make a process runnable again, so the system halts, which is the
+//! multi-scheduler equivalent of a lone scheduler running out of processes.
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::thread::{self, Thread};
+use std::time::Duration;
+
+use lazy_static::lazy_static;
+
+use liblumen_core::locks::Mutex;
+
+/// How long an idle scheduler sleeps before checking its timers and stealing again
+const PARK_TIMEOUT: Duration = Duration::from_millis(10);
+
+lazy_static! {
+    static ref PARKING: Parking = Parking::new(1);
+}
+
+/// Sets the number of scheduler threads, which must be done before any of them start
+pub fn set_num_schedulers(num: usize) {
+    PARKING.set_num_schedulers(num);
+}
+
+/// Returns true if the system has halted, and schedulers should exit their loops
+#[inline]
+pub fn is_halted() -> bool {
+    PARKING.is_halted()
+}
+
+/// Halts the system, waking all parked schedulers so they can exit
+pub fn halt() {
+    PARKING.halt();
+}
+
+/// Wakes one parked scheduler, if there are any, so that it can steal work
+#[inline]
+pub fn notify_one() {
+    PARKING.notify_one();
+}
+
+/// Parks the current scheduler thread until it is woken, or the timeout elapses
+///
+/// If this is the last scheduler to park, `has_work` is called to check whether any
+/// scheduler still has a runnable process, and if none do, the system is halted.
+///
+/// Returns false if the system has halted.
+pub fn park<F>(has_work: F) -> bool
+where
+    F: FnOnce() -> bool,
+{
+    PARKING.park(has_work, PARK_TIMEOUT)
+}
+
+/// The parking state shared by a set of schedulers
+struct Parking {
+    num_schedulers: AtomicUsize,
+    num_parked: AtomicUsize,
+    // Counts every return from parking, so that a scheduler which is deciding whether
+    // to halt can tell that another scheduler became active while it was deciding
+    wakes: AtomicUsize,
+    halted: AtomicBool,
+    parked: Mutex<Vec<Thread>>,
+}
+impl Parking {
+    fn new(num_schedulers: usize) -> Self {
+        Self {
+            num_schedulers: AtomicUsize::new(num_schedulers.max(1)),
+            num_parked: AtomicUsize::new(0),
+            wakes: AtomicUsize::new(0),
+            halted: AtomicBool::new(false),
+            parked: Mutex::new(Vec::new()),
+        }
+    }
+
+    fn set_num_schedulers(&self, num: usize) {
+        self.num_schedulers.store(num.max(1), Ordering::SeqCst);
+    }
+
+    #[inline]
+    fn is_halted(&self) -> bool {
+        self.halted.load(Ordering::Acquire)
+    }
+
+    fn halt(&self) {
+        self.halted.store(true, Ordering::Release);
+        for thread in self.parked.lock().drain(..) {
+            thread.unpark();
+        }
+    }
+
+    #[inline]
+    fn notify_one(&self) {
+        if self.num_parked.load(Ordering::Acquire) == 0 {
+            return;
+        }
+        if let Some(thread) = self.parked.lock().pop() {
+            thread.unpark();
+        }
+    }
+
+    fn park<F>(&self, has_work: F, timeout: Duration) -> bool
+    where
+        F: FnOnce() -> bool,
+    {
+        if self.is_halted() {
+            return false;
+        }
+
+        let current = thread::current();
+        self.parked.lock().push(current.clone());
+
+        let wakes = self.wakes.load(Ordering::SeqCst);
+        let parked = self.num_parked.fetch_add(1, Ordering::SeqCst) + 1;
+        if parked == self.num_schedulers.load(Ordering::SeqCst) && self.is_idle(has_work, wakes) {
+            self.halt();
+        } else {
+            thread::park_timeout(timeout);
+        }
+        // A scheduler counts as active from here on, before it fires any of the timers
+        // it woke up for, which may make a process runnable
+        self.wakes.fetch_add(1, Ordering::SeqCst);
+        self.num_parked.fetch_sub(1, Ordering::SeqCst);
+
+        // We may have woken due to the timeout, in which case we are still registered
+        let mut parked = self.parked.lock();
+        if let Some(index) = parked.iter().position(|t| t.id() == current.id()) {
+            parked.swap_remove(index);
+        }
+        drop(parked);
+
+        !self.is_halted()
+    }
+
+    /// Returns true if no scheduler has work, and none woke up while that was checked,
+    /// as one which did may have fired a timer, or stolen a process, that `has_work`
+    /// missed
+    fn is_idle<F>(&self, has_work: F, wakes: usize) -> bool
+    where
+        F: FnOnce() -> bool,
+    {
+        !has_work()
+            && self.wakes.load(Ordering::SeqCst) == wakes
+            && self.num_parked.load(Ordering::SeqCst) == self.num_schedulers.load(Ordering::SeqCst)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::Arc;
+
+    const TIMEOUT: Duration = Duration::from_millis(1);
+
+    #[test]
+    fn last_scheduler_to_park_without_work_halts() {
+        let parking = Parking::new(1);
+
+        assert!(parking.park(|| true, TIMEOUT));
+        assert!(!parking.is_halted());
+
+        assert!(!parking.park(|| false, TIMEOUT));
+        assert!(parking.is_halted());
+        assert!(!parking.park(|| false, TIMEOUT));
+    }
+
+    #[test]
+    fn scheduler_parking_while_another_runs_does_not_halt() {
+        let parking = Parking::new(2);
+
+        assert!(parking.park(|| false, TIMEOUT));
+        assert!(!parking.is_halted());
+    }
+
+    #[test]
+    fn halt_wakes_parked_schedulers() {
+        let parking = Arc::new(Parking::new(2));
+
+        let other = {
+            let parking = parking.clone();
+            thread::spawn(move || while parking.park(|| true, Duration::from_secs(60)) {})
+        };
+        while parking.num_parked.load(Ordering::SeqCst) == 0 {
+            thread::yield_now();
+        }
+
+        parking.halt();
+        other.join().unwrap();
+        assert!(parking.is_halted());
+    }
+
+    #[test]
+    fn scheduler_waking_while_last_parks_prevents_halt() {
+        let parking = Arc::new(Parking::new(2));
+
+        let other = {
+            let parking = parking.clone();
+            thread::spawn(move || parking.park(|| true, Duration::from_secs(60)))
+        };
+        while parking.num_parked.load(Ordering::SeqCst) == 0 {
+            thread::yield_now();
+        }
+
+        // The other scheduler wakes, e.g. from its timeout, and may fire a timer, after
+        // this one has counted it as parked, so its view of the work is out of date
+        let halted = !parking.park(
+            || {
+                other.thread().unpark();
+                while parking.num_parked.load(Ordering::SeqCst) == 2 {
+                    thread::yield_now();
+                }
+                false
+            },
+            TIMEOUT,
+        );
+        assert!(!halted);
+        assert!(other.join().unwrap());
+        assert!(!parking.is_halted());
+    }
+}
@@ -1,73 +1,139 @@
 #![allow(unused)]
 use std::borrow::Borrow;
+use std::cell::UnsafeCell;
 use std::collections::vec_deque::VecDeque;
 use std::collections::HashSet;
 use std::fmt::{self, Debug};
 use std::hash::Hash;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use std::sync::Arc;
 
+use crossbeam_queue::SegQueue;
+
+use liblumen_core::locks::Mutex;
+
 use liblumen_alloc::erts::process::{Priority, Process, Status};
 
 use crate::scheduler::Run;
 
-#[derive(Debug, Default)]
+/// The run queues of a single scheduler
+///
+/// Runnable processes live in queues which only the owning scheduler thread touches, so
+/// switching processes takes no locks, and contends on no atomics. Other threads hand
+/// processes to the scheduler through lock-free inbound queues, one per priority, which
+/// the owner drains into its local queues whenever it dequeues; e.g. when a process is
+/// woken by a message send, or donated by another scheduler.
+///
+/// Only blocking and waking a process takes the lock on the waiting set.
+#[derive(Default)]
 pub struct Queues {
-    waiting: Waiting,
-    normal_low: Delayed,
-    high: Immediate,
-    max: Immediate,
+    local: UnsafeCell<Local>,
+    inbound: Inbound,
+    waiting: Mutex<Waiting>,
+    // The number of unpinned processes ready to run, in the local and inbound queues,
+    // which other schedulers read when looking for work to steal
+    runnable: AtomicUsize,
 }
+// Methods documented as owner-only must only ever be called from the scheduler thread
+// which owns these queues, all of the others are thread-safe
+unsafe impl Sync for Queues {}
 impl Queues {
     #[cfg(test)]
     pub fn contains(&self, value: &Arc<Process>) -> bool {
-        self.waiting.contains(value)
-            || self.normal_low.contains(value)
-            || self.high.contains(value)
-            || self.max.contains(value)
+        let local = unsafe { self.local() };
+        self.inbound.drain_into(local);
+        local.normal_low.contains(value)
+            || local.high.contains(value)
+            || local.max.contains(value)
+            || self.waiting.lock().contains(value)
     }
 
     #[cfg(test)]
     pub fn run_queue_len(&self, priority: Priority) -> usize {
+        let local = unsafe { self.local() };
+        self.inbound.drain_into(local);
         match priority {
-            Priority::Low | Priority::Normal => self.normal_low.len(),
-            Priority::High => self.high.len(),
-            Priority::Max => self.max.len(),
+            Priority::Low | Priority::Normal => local.normal_low.len(),
+            Priority::High => local.high.len(),
+            Priority::Max => local.max.len(),
         }
     }
 
-    pub fn dequeue(&mut self) -> Run {
-        if 0 < self.max.len() {
-            self.max.dequeue()
-        } else if 0 < self.high.len() {
-            self.high.dequeue()
-        } else if 0 < self.normal_low.len() {
-            self.normal_low.dequeue()
+    /// Owner-only
+    pub fn dequeue(&self) -> Run {
+        let local = unsafe { self.local() };
+        self.inbound.drain_into(local);
+
+        if 0 < local.max.len() {
+            self.dequeued(local.max.dequeue())
+        } else if 0 < local.high.len() {
+            self.dequeued(local.high.dequeue())
+        } else if 0 < local.normal_low.len() {
+            match local.normal_low.dequeue() {
+                (run, false) => self.dequeued(run),
+                (run, true) => run,
+            }
         } else {
             Run::None
         }
     }
 
-    pub fn enqueue(&mut self, arc_process: Arc<Process>) {
-        match arc_process.priority {
-            Priority::Low | Priority::Normal => self.normal_low.enqueue(arc_process),
-            Priority::High => self.high.enqueue(arc_process),
-            Priority::Max => self.max.enqueue(arc_process),
-        }
+    /// Owner-only, other threads must use `push`
+    pub fn enqueue(&self, arc_process: Arc<Process>) {
+        self.runnable.fetch_add(1, Ordering::Relaxed);
+        unsafe { self.local() }.enqueue(arc_process);
+    }
+
+    /// Enqueues a process from any thread, it becomes visible to the owner on its
+    /// next dequeue
+    pub fn push(&self, arc_process: Arc<Process>) {
+        self.runnable.fetch_add(1, Ordering::Relaxed);
+        self.inbound.push(arc_process);
     }
 
     pub fn len(&self) -> usize {
-        self.waiting.len() + self.normal_low.len() + self.high.len() + self.max.len()
+        self.waiting.lock().len() + self.runnable_len()
+    }
+
+    /// Returns the number of processes which are ready to run, excluding the pinned
+    /// root process; this may be called from any thread
+    pub fn runnable_len(&self) -> usize {
+        self.runnable.load(Ordering::Relaxed)
     }
 
     /// Returns the process is not pushed back because it is exiting
+    ///
+    /// A pinned process is never donated to another scheduler, which is how the root
+    /// process stays on the thread whose stack it runs on.
+    ///
+    /// Owner-only
     #[must_use]
-    pub fn requeue(&mut self, arc_process: Arc<Process>) -> Option<Arc<Process>> {
+    pub fn requeue(&self, arc_process: Arc<Process>, pinned: bool) -> Option<Arc<Process>> {
         let next = Next::from_status(&arc_process.status.read());
 
         // has to be separate so that `arc_process` can be moved
         match next {
             Next::Wait => {
-                self.waiting.insert(arc_process);
+                // A sender makes the process runnable before looking for it in the waiting
+                // set, so the status is read again under the lock on the set, otherwise a
+                // message sent since the first read could leave the process waiting for good
+                let mut waiting = self.waiting.lock();
+                match Next::from_status(&arc_process.status.read()) {
+                    Next::Wait => {
+                        waiting.insert(arc_process);
+                        None
+                    }
+                    Next::PushBack => {
+                        drop(waiting);
+                        self.requeue(arc_process, pinned)
+                    }
+                    Next::Exit => Some(arc_process),
+                }
+            }
+            Next::PushBack if pinned => {
+                unsafe { self.local() }
+                    .normal_low
+                    .enqueue_pinned(arc_process);
                 None
             }
             Next::PushBack => {
@@ -78,21 +144,127 @@ impl Queues {
         }
     }
 
-    pub fn stop_waiting(&mut self, process: &Process) {
-        match self.waiting.get(process) {
-            Some(arc_process) => {
-                let arc_process = Arc::clone(arc_process);
-                self.waiting.remove(&arc_process);
-
-                self.enqueue(arc_process);
+    /// Returns false if the process was not waiting here
+    pub fn stop_waiting(&self, process: &Process) -> bool {
+        let arc_process = {
+            let mut waiting = self.waiting.lock();
+            match waiting.get(process) {
+                Some(arc_process) => {
+                    let arc_process = Arc::clone(arc_process);
+                    waiting.remove(&arc_process);
+                    arc_process
+                }
+                None => return false,
             }
-            None => (),
+        };
+
+        self.push(arc_process);
+        true
+    }
+
+    /// Gives away up to half of the runnable processes of the highest priority which has
+    /// any, so that another scheduler can run them
+    ///
+    /// Processes are taken from the back of the queue, as they are the furthest from being
+    /// run here. Pinned processes are never given away.
+    ///
+    /// Owner-only
+    pub fn donate(&self) -> Vec<Arc<Process>> {
+        let local = unsafe { self.local() };
+        self.inbound.drain_into(local);
+
+        let mut donated = Vec::new();
+        local.max.donate_into(&mut donated);
+        if donated.is_empty() {
+            local.high.donate_into(&mut donated);
+        }
+        if donated.is_empty() {
+            local.normal_low.donate_into(&mut donated);
         }
+        self.runnable.fetch_sub(donated.len(), Ordering::Relaxed);
+
+        donated
+    }
+
+    fn dequeued(&self, run: Run) -> Run {
+        if let Run::Now(_) = run {
+            self.runnable.fetch_sub(1, Ordering::Relaxed);
+        }
+        run
+    }
+
+    #[allow(clippy::mut_from_ref)]
+    #[inline]
+    unsafe fn local(&self) -> &mut Local {
+        &mut *self.local.get()
+    }
+}
+impl Debug for Queues {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("Queues")
+            .field("runnable", &self.runnable_len())
+            .field("waiting", &*self.waiting.lock())
+            .finish()
     }
 }
 
 // Private
 
+#[derive(Debug, Default)]
+struct Local {
+    normal_low: Delayed,
+    high: Immediate,
+    max: Immediate,
+}
+impl Local {
+    fn enqueue(&mut self, arc_process: Arc<Process>) {
+        match arc_process.priority {
+            Priority::Low | Priority::Normal => self.normal_low.enqueue(arc_process),
+            Priority::High => self.high.enqueue(arc_process),
+            Priority::Max => self.max.enqueue(arc_process),
+        }
+    }
+}
+
+/// Lock-free queues, one per priority, through which other threads hand processes to the
+/// owning scheduler
+///
+/// Many threads push, but only the owner pops, so these are only ever contended by
+/// producers.
+#[derive(Default)]
+struct Inbound {
+    normal_low: SegQueue<Arc<Process>>,
+    high: SegQueue<Arc<Process>>,
+    max: SegQueue<Arc<Process>>,
+}
+impl Inbound {
+    fn push(&self, arc_process: Arc<Process>) {
+        match arc_process.priority {
+            Priority::Low | Priority::Normal => self.normal_low.push(arc_process),
+            Priority::High => self.high.push(arc_process),
+            Priority::Max => self.max.push(arc_process),
+        }
+    }
+
+    #[inline]
+    fn drain_into(&self, local: &mut Local) {
+        Self::drain(&self.max, |p| local.max.enqueue(p));
+        Self::drain(&self.high, |p| local.high.enqueue(p));
+        Self::drain(&self.normal_low, |p| local.normal_low.enqueue(p));
+    }
+
+    #[inline]
+    fn drain<F: FnMut(Arc<Process>)>(queue: &SegQueue<Arc<Process>>, mut enqueue: F) {
+        // Checking for emptiness first keeps the common case to a single load
+        if queue.is_empty() {
+            return;
+        }
+        while let Ok(arc_process) = queue.pop() {
+            enqueue(arc_process);
+        }
+    }
+}
+
 enum Next {
     Wait,
     PushBack,
@@ -179,6 +351,11 @@ impl Immediate {
     pub fn enqueue(&mut self, process: Arc<Process>) {
         self.0.push_back(process);
     }
+
+    fn donate_into(&mut self, donated: &mut Vec<Arc<Process>>) {
+        let keep = self.0.len() / 2;
+        donated.extend(self.0.drain(keep..));
+    }
 }
 
 /// A run queue where the `Arc<Process` is run only when its delay is `0`.  This allows
@@ -199,26 +376,49 @@ impl Delayed {
         self.0.len()
     }
 
-    pub fn dequeue(&mut self) -> Run {
+    /// Returns whether the process is pinned along with it
+    pub fn dequeue(&mut self) -> (Run, bool) {
         match self.0.pop_front() {
             Some(mut delayed_process) => {
                 if delayed_process.delay == 0 {
-                    Run::Now(delayed_process.arc_process)
+                    (
+                        Run::Now(delayed_process.arc_process),
+                        delayed_process.pinned,
+                    )
                 } else {
                     delayed_process.delay -= 1;
                     self.0.push_back(delayed_process);
 
-                    Run::Delayed
+                    (Run::Delayed, false)
                 }
             }
-            None => Run::None,
+            None => (Run::None, false),
         }
     }
 
     pub fn enqueue(&mut self, arc_process: Arc<Process>) {
-        let delayed_process = DelayedProcess::new(arc_process);
+        let delayed_process = DelayedProcess::new(arc_process, false);
+        self.0.push_back(delayed_process);
+    }
+
+    fn enqueue_pinned(&mut self, arc_process: Arc<Process>) {
+        let delayed_process = DelayedProcess::new(arc_process, true);
         self.0.push_back(delayed_process);
     }
+
+    /// Donated processes lose their remaining delay, it starts over when they are
+    /// enqueued on the receiving scheduler
+    fn donate_into(&mut self, donated: &mut Vec<Arc<Process>>) {
+        let mut remaining = (self.0.len() + 1) / 2;
+        let mut index = self.0.len();
+        while 0 < remaining && 0 < index {
+            index -= 1;
+            if !self.0[index].pinned {
+                donated.push(self.0.remove(index).unwrap().arc_process);
+                remaining -= 1;
+            }
+        }
+    }
 }
 
 type Delay = u8;
@@ -226,13 +426,15 @@ type Delay = u8;
 #[derive(Debug)]
 struct DelayedProcess {
     delay: Delay,
+    pinned: bool,
     arc_process: Arc<Process>,
 }
 
 impl DelayedProcess {
-    fn new(arc_process: Arc<Process>) -> DelayedProcess {
+    fn new(arc_process: Arc<Process>, pinned: bool) -> DelayedProcess {
         DelayedProcess {
             delay: Self::priority_to_delay(arc_process.priority),
+            pinned,
             arc_process,
         }
     }
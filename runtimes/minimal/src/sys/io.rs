@@ -2,6 +2,7 @@ use std::ffi::CStr;
 
 use libc;
 
+use liblumen_alloc::erts::process::Process;
 use liblumen_alloc::erts::term::prelude::*;
 
 #[export_name = "__lumen_builtin_printf"]
@@ -23,7 +24,7 @@ pub extern "C" fn printf_1(term: Term) -> Term {
 }
 
 #[export_name = "io:put_chars/1"]
-pub extern "C" fn put_chars_1(s: *const libc::c_char) -> Option<Term> {
+pub extern "C" fn put_chars_1(_process: &Process, s: *const libc::c_char) -> Option<Term> {
     let sref = unsafe { CStr::from_ptr(s).to_string_lossy() };
     println!("{}", &sref);
     Some(ok!())
@@ -31,6 +32,7 @@ pub extern "C" fn put_chars_1(s: *const libc::c_char) -> Option<Term> {
 
 #[export_name = "io:format/2"]
 pub extern "C" fn format_2(
+    _process: &Process,
     _s: *const libc::c_char,
     _argv: *const Term,
     _argc: libc::c_uint,
@@ -39,7 +41,7 @@ pub extern "C" fn format_2(
 }
 
 #[export_name = "io:nl/0"]
-pub extern "C" fn nl_0() -> Option<Term> {
+pub extern "C" fn nl_0(_process: &Process) -> Option<Term> {
     println!();
     Some(ok!())
 }